@@ -0,0 +1,212 @@
+/**
+ * @brief   Messaging micro benchmark
+ * @file    messagingBenchmark.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ *
+ * Measures how many messages per second one activity can send to another one.
+ * The legacy send path (open/send/close the receiver's message queue for every message)
+ * is compared with sendMessage2(), which uses the cached queue handles of the activity registry,
+ * and with sendMessage2() to a receiver using the in-process mailbox transport.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#include <defines.h>
+#include <log.h>
+#include <activity.h>
+
+#define DEFAULT_NUMBER_OF_MESSAGES 100000
+
+/**
+ * A small message, comparable to a machine state changed notification.
+ */
+typedef struct {
+	Byte type;
+	int state;
+} BenchmarkMessage;
+
+static void setUpReceiver(void *activity);
+static void runReceiver(void *activity);
+static void setUpSender(void *activity);
+static void runSender(void *activity);
+static void tearDown(void *activity);
+
+/**
+ * Represents the send path measured by a benchmark round.
+ */
+typedef enum {
+	sendPath_uncached,
+	sendPath_cached,
+	sendPath_mailbox
+} SendPath;
+
+static ActivityDescriptor receiverDescriptor = {
+	.name = "benchmarkReceiver",
+	.setUp = setUpReceiver,
+	.run = runReceiver,
+	.tearDown = tearDown,
+	.transport = activityTransport_messageQueue
+};
+
+static ActivityDescriptor mailboxReceiverDescriptor = {
+	.name = "benchmarkMailboxReceiver",
+	.setUp = setUpReceiver,
+	.run = runReceiver,
+	.tearDown = tearDown
+};
+
+static ActivityDescriptor senderDescriptor = {
+	.name = "benchmarkSender",
+	.setUp = setUpSender,
+	.run = runSender,
+	.tearDown = tearDown
+};
+
+static unsigned long numberOfMessages = DEFAULT_NUMBER_OF_MESSAGES;
+static volatile unsigned long numberOfReceivedMessages = 0;
+static sem_t roundFinished;
+static sem_t benchmarkFinished;
+
+static double getTime() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Sends a message the way sendMessage2() did before the activity registry was introduced.
+ */
+static int sendMessageUncached(Activity *sender, ActivityDescriptor receiverDescriptor, unsigned long length, void *buffer) {
+	size_t idLength = strlen(receiverDescriptor.name) + 2;
+	char *id = (char *) malloc(idLength);
+	memset(id, 0, idLength);
+	id[0] = '/';
+	strcat(id, receiverDescriptor.name);
+
+	mqd_t receiverQueue = mq_open(id, O_WRONLY);
+	free(id);
+	if (receiverQueue < 0) {
+		return -EFAULT;
+	}
+
+	MessageHeader header = {
+		.version = MESSAGE_HEADER_VERSION,
+		.type = *(Byte *)buffer,
+		.senderId = sender->descriptor->id,
+		.length = length,
+		.priority = messagePriority_medium
+	};
+	unsigned long sendLength = sizeof(header) + length;
+	char *sendBuffer = malloc(sendLength);
+	memcpy(sendBuffer, &header, sizeof(header));
+	memcpy(sendBuffer + sizeof(header), buffer, length);
+
+	int result = mq_send(receiverQueue, sendBuffer, sendLength, messagePriority_medium) < 0 ? -EFAULT : 0;
+
+	free(sendBuffer);
+	mq_close(receiverQueue);
+
+	return result;
+}
+
+static void setUpReceiver(void *activity) {
+}
+
+static void runReceiver(void *activity) {
+	while (isActivityRunning(activity)) {
+		BenchmarkMessage message;
+		if (receiveMessage2(activity, NULL, &message, sizeof(message)) > 0) {
+			if (++numberOfReceivedMessages == numberOfMessages) {
+				numberOfReceivedMessages = 0;
+
+				sem_post(&roundFinished);
+			}
+		}
+	}
+}
+
+static void setUpSender(void *activity) {
+}
+
+static double runRound(Activity *sender, SendPath sendPath) {
+	BenchmarkMessage message = {
+		.type = 1,
+		.state = machineState_idle
+	};
+
+	double startTime = getTime();
+	for (unsigned long i = 0; i < numberOfMessages; i++) {
+		switch (sendPath) {
+		case sendPath_uncached:
+			sendMessageUncached(sender, receiverDescriptor, sizeof(message), &message);
+			break;
+		case sendPath_cached:
+			sendMessage2(sender, receiverDescriptor, sizeof(message), &message, messagePriority_medium);
+			break;
+		case sendPath_mailbox:
+			sendMessage2(sender, mailboxReceiverDescriptor, sizeof(message), &message, messagePriority_medium);
+			break;
+		}
+	}
+	sem_wait(&roundFinished);
+
+	return numberOfMessages / (getTime() - startTime);
+}
+
+static void runSender(void *activity) {
+	Activity *sender = (Activity *)activity;
+
+	// Warm up (e.g. open and cache the receiver's queue)
+	runRound(sender, sendPath_cached);
+	runRound(sender, sendPath_mailbox);
+
+	double uncachedRate = runRound(sender, sendPath_uncached);
+	double cachedRate = runRound(sender, sendPath_cached);
+	double mailboxRate = runRound(sender, sendPath_mailbox);
+
+	printf("Messages per round:               %lu\n", numberOfMessages);
+	printf("Uncached (open/send/close):       %.0f messages/s\n", uncachedRate);
+	printf("Cached (activity registry):       %.0f messages/s\n", cachedRate);
+	printf("Speed-up:                         %.2f\n", cachedRate / uncachedRate);
+	printf("Mailbox (in-process transport):   %.0f messages/s\n", mailboxRate);
+	printf("Speed-up:                         %.2f\n", mailboxRate / uncachedRate);
+
+	sem_post(&benchmarkFinished);
+}
+
+static void tearDown(void *activity) {
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		numberOfMessages = strtoul(argv[1], NULL, 10);
+	}
+
+	sem_init(&roundFinished, 0, 0);
+	sem_init(&benchmarkFinished, 0, 0);
+
+	// Intern the receiver once, like the descriptor getters of the subsystems do
+	internActivityDescriptor(&receiverDescriptor);
+
+	internActivityDescriptor(&mailboxReceiverDescriptor);
+
+	Activity *receiver = createActivity(receiverDescriptor, messageQueue_blocking);
+	Activity *mailboxReceiver = createActivity(mailboxReceiverDescriptor, messageQueue_blocking);
+	Activity *sender = createActivity(senderDescriptor, messageQueue_blocking);
+
+	sem_wait(&benchmarkFinished);
+
+	destroyActivity(sender);
+	destroyActivity(mailboxReceiver);
+	destroyActivity(receiver);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @brief   Batch receive test
+ * @file    batchReceiveTest.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ *
+ * Sends several typed messages to a receiver before it waits, so they are received as one batch
+ * (waitForEvents_BEGIN()), and checks that every message's content is aligned and its fields are intact.
+ * Runs once for the mailbox and once for the message queue transport. Exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <semaphore.h>
+#include <defines.h>
+#include <log.h>
+#include <activity.h>
+
+#define NUMBER_OF_TEST_MESSAGES 3
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+	long long timestamp;
+	int amount;
+MESSAGE_CONTENT_DEFINITION_END(BatchTest, Sample)
+
+MESSAGE_DEFINITION_BEGIN
+	MESSAGE_CONTENT(BatchTest, Sample)
+MESSAGE_DEFINITION_END(BatchTest)
+
+MESSAGE_CONTENT_TYPE_MAPPING(BatchTest, Sample, 1)
+
+static void setUpReceiver(void *activity);
+static void runReceiver(void *activity);
+static void tearDownReceiver(void *activity);
+
+static ActivityDescriptor mailboxReceiverDescriptor = {
+	.name = "batchTestMailboxReceiver",
+	.setUp = setUpReceiver,
+	.run = runReceiver,
+	.tearDown = tearDownReceiver
+};
+
+static ActivityDescriptor queueReceiverDescriptor = {
+	.name = "batchTestQueueReceiver",
+	.setUp = setUpReceiver,
+	.run = runReceiver,
+	.tearDown = tearDownReceiver,
+	.transport = activityTransport_messageQueue
+};
+
+static sem_t messagesSent;
+static sem_t batchChecked;
+static int numberOfFailures = 0;
+
+static long long getTimestamp(int index) {
+	return 0x0123456789abcdefLL + index;
+}
+
+static void checkBatch(int result, ReceivedMessage *receivedMessages) {
+	if (result < 2) {
+		printf("  FAILED: %d message(s) received in the batch (expected at least 2)\n", result);
+		numberOfFailures++;
+
+		return;
+	}
+
+	forEachReceivedMessage_BEGIN(BatchTest)
+		if ((uintptr_t)message % __alignof__(BatchTestMessage) != 0) {
+			printf("  FAILED: Message %d is not aligned (%p)\n", messageIndex, (void *)message);
+			numberOfFailures++;
+		}
+		BatchTestSampleContent content = message->content.BatchTestSample;
+		if (content.timestamp != getTimestamp(messageIndex) || content.amount != 100 * messageIndex) {
+			printf("  FAILED: Message %d has wrong content (%llx, %d)\n", messageIndex, content.timestamp, content.amount);
+			numberOfFailures++;
+		}
+	forEachReceivedMessage_END
+}
+
+static void setUpReceiver(void *activity) {
+}
+
+static void runReceiver(void *activity) {
+	// Receive all test messages as one batch
+	sem_wait(&messagesSent);
+	waitForEvents_BEGIN(activity, 1000)
+		checkBatch(result, receivedMessages);
+	waitForEvents_END
+	sem_post(&batchChecked);
+
+	while (isActivityRunning(activity)) {
+		waitForEvents_BEGIN(activity, 100)
+		waitForEvents_END
+	}
+}
+
+static void tearDownReceiver(void *activity) {
+}
+
+static void testBatchReceive(ActivityDescriptor receiverDescriptor) {
+	printf("Batch receive (%s)...\n", receiverDescriptor.name);
+
+	Activity *receiver = createActivity(receiverDescriptor, messageQueue_blocking);
+
+	int i;
+	for (i = 0; i < NUMBER_OF_TEST_MESSAGES; i++) {
+		BatchTestMessage message = {
+			.type = BatchTestSampleType,
+			.content.BatchTestSample = {
+				.timestamp = getTimestamp(i),
+				.amount = 100 * i
+			}
+		};
+		if (sendMessage2(NULL, receiverDescriptor, MESSAGE_LENGTH(BatchTest, Sample), &message, messagePriority_medium) < 0) {
+			printf("  FAILED: Message %d could not be sent\n", i);
+			numberOfFailures++;
+		}
+	}
+	sem_post(&messagesSent);
+	sem_wait(&batchChecked);
+
+	destroyActivity(receiver);
+}
+
+int main(int argc, char **argv) {
+	sem_init(&messagesSent, 0, 0);
+	sem_init(&batchChecked, 0, 0);
+
+	internActivityDescriptor(&mailboxReceiverDescriptor);
+	internActivityDescriptor(&queueReceiverDescriptor);
+
+	testBatchReceive(mailboxReceiverDescriptor);
+	testBatchReceive(queueReceiverDescriptor);
+
+	printf("%s\n", numberOfFailures == 0 ? "All checks passed." : "Checks FAILED!");
+
+	return numberOfFailures == 0 ? 0 : 1;
+}
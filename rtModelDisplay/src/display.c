@@ -36,11 +36,13 @@
 
 #define WRITE_MESSAGE_EVENT 2
 #define MESSAGE_WRITTEN_EVENT 1
+#define STOP_EVENT 4
 
 static pthread_t workerThread;
 
 static char *messageBuffer = 0;
 static volatile int newMessage = 0;
+static volatile int isStopRequested = FALSE;
 
 static int displayDevice;
 
@@ -69,9 +71,8 @@ static void * runThread(void *argument) {
 			.tv_sec = 0
 	};
 
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-
-	while (TRUE) {
+	// (Stops cooperatively (on STOP_EVENT) instead of being cancelled asynchronously)
+	while (!isStopRequested) {
 		int result;
 		unsigned long raisedEvents;
 		//		if ((result = pthread_cond_wait(&isMessageToWriteConditionQueue, &writingMessageMutex))) {
@@ -79,10 +80,13 @@ static void * runThread(void *argument) {
 		//
 		//			//usleep(10000);
 		//		}
-		if ((result = rt_event_wait(&events, WRITE_MESSAGE_EVENT, &raisedEvents, EV_ALL, TM_INFINITE)) < 0) {
+		if ((result = rt_event_wait(&events, WRITE_MESSAGE_EVENT | STOP_EVENT, &raisedEvents, EV_ANY, TM_INFINITE)) < 0) {
 			logErr("[display] Error waiting for event: %s", strerror(result));
 		}
 		rt_event_clear(&events, WRITE_MESSAGE_EVENT, &raisedEvents);
+		if (isStopRequested) {
+			break;
+		}
 
 		//printf("Going to write message \"%s\"...\n", messageBuffer);
 
@@ -96,7 +100,7 @@ static void * runThread(void *argument) {
 		int isCharacter = 0;
 		while (TRUE) {
 			pthread_mutex_lock(&writingDisplayMutex);
-			if (newMessage) {
+			if (newMessage || isStopRequested) {
 				abort = TRUE;
 			}
 			pthread_mutex_unlock(&writingDisplayMutex);
@@ -145,7 +149,7 @@ static void * runThread(void *argument) {
 			}
 #elif defined(APPLICATION_LOGIC)
 			int i;
-			for (i = 0; i < (isCharacter ? 50 : 10); i++) {
+			for (i = 0; i < (isCharacter ? 50 : 10) && !isStopRequested; i++) {
 				read(displayDevice, NULL, 0);
 
 				struct timespec time;
@@ -353,7 +357,14 @@ void tearDownDisplay() {
 		logErr("[display] Error stopping motor!");
 	}
 
-	pthread_cancel(workerThread);
+	// Stop the worker thread (it finishes at the latest after the current display revolution)
+	pthread_mutex_lock(&writingDisplayMutex);
+	isStopRequested = TRUE;
+	pthread_mutex_unlock(&writingDisplayMutex);
+	int result;
+	if ((result = rt_event_signal(&events, STOP_EVENT)) < 0) {
+		logErr("[display] Error signaling event: %s", strerror(result));
+	}
 	pthread_join(workerThread, NULL);
 
 	pthread_mutex_destroy(&writingDisplayMutex);
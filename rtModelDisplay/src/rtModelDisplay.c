@@ -24,7 +24,9 @@ static ActivityDescriptor rtModelDisplay = {
 	.name = "rtModelDisplay",
 	.setUp = setUpRtModelDisplay,
 	.run = runRtModelDisplay,
-	.tearDown = tearDownRtModelDisplay
+	.tearDown = tearDownRtModelDisplay,
+	// yacm sends messages from another process
+	.transport = activityTransport_messageQueue
 };
 
 static Activity *this;
@@ -32,7 +34,7 @@ static Activity *this;
 //static ActivityDescriptor clientDescriptor;
 
 ActivityDescriptor getRtModelDisplayDescriptor() {
-	return rtModelDisplay;
+	return internActivityDescriptor(&rtModelDisplay);
 }
 
 static int isDisplaySetUp = FALSE;
@@ -50,7 +52,7 @@ static void setUpRtModelDisplay(void *activity) {
 static void runRtModelDisplay(void *activity) {
 	logInfo("[rtModelDisplay] Running...");
 
-	while (TRUE) {
+	while (isActivityRunning(this)) {
 		receiveMessage_BEGIN(this, RtModelDisplay)
 			if (error) {
 				//TODO Implement appropriate error handling
@@ -62,7 +64,7 @@ static void runRtModelDisplay(void *activity) {
 			if (result > 0) {
 				//TODO Implement business logic
 				MESSAGE_SELECTOR_BEGIN
-					MESSAGE_BY_TYPE_SELECTOR(message, RtModelDisplay, ShowMessageCommand)
+					MESSAGE_BY_TYPE_SELECTOR(*message, RtModelDisplay, ShowMessageCommand)
 						if (isDisplaySetUp) {
 							writeDisplay(content.message);
 							joinDisplay();
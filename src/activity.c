@@ -7,23 +7,168 @@
  */
 
 #define HAVE_MQUEUE_H
+// (For CPU affinity and querying a thread's attributes)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 
 #include <unistd.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <stdint.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
 #include <errno.h>
+#include "defines.h"
 #include "log.h"
 #include "activity.h"
-
-#define UNKNOWN_SENDER_DESCRIPTOR \
-	&(ActivityDescriptor) { \
-		.name = "<Unknown sender>" \
-	}
+#include "executor.h"
+#include "coroutine.h"
 
 #define NULL_FILE_DESCRIPTOR -999
 
+#define MAILBOX_FULL_YIELD_ATTEMPTS 1000
+
+// (The slots of the batch buffer are rounded up to keep every slot's message content aligned for any field type)
+#define BATCH_SLOT_SIZE ((MAX_MESSAGE_LENGTH + 1 + __alignof__(long long) - 1) & ~(__alignof__(long long) - 1))
+// (Fails to compile ('size of array is negative') if the message header would misalign the content)
+typedef char MessageHeaderAlignmentCheck[sizeof(MessageHeader) % __alignof__(long long) == 0 ? 1 : -1];
+
+// (A prefaulted stack is painted with this pattern, the peak stack use is where the pattern has been overwritten)
+#define STACK_PAINT_PATTERN 0xa5
+// (Room left below the painting function's frame)
+#define STACK_PAINT_MARGIN 1024
+
+/**
+ * Represents the messages an activity has received while awaiting a response.
+ * They are received again before any new message.
+ */
+typedef struct {
+	unsigned int first; /**< The index of the oldest deferred message. */
+	unsigned int count; /**< The number of deferred messages. */
+	unsigned int lengths[MAX_NUMBER_OF_DEFERRED_MESSAGES]; /**< The lengths of the (encoded) deferred messages. */
+	Byte buffers[MAX_NUMBER_OF_DEFERRED_MESSAGES][MAX_MESSAGE_LENGTH + 1]; /**< The (encoded) deferred messages. */
+} DeferredMessages;
+
+/**
+ * Represents the header preceding the data of a chunk of a bulk message.
+ */
+typedef struct {
+	DWord transferId; /**< The sequence number of the bulk message's first chunk. */
+	DWord totalLength; /**< The length of the whole bulk message. */
+	DWord offset; /**< The position of the chunk's data within the bulk message. */
+} ChunkHeader;
+
+/**
+ * Represents a bulk message being reassembled from its chunks.
+ */
+typedef struct {
+	unsigned int senderId; /**< The sender's activity id. */
+	DWord transferId; /**< The transfer id (0 if the entry is free). */
+	DWord totalLength; /**< The length of the whole bulk message. */
+	DWord receivedLength; /**< The length of the data received so far. */
+	Byte *buffer; /**< The bulk message's content. */
+} BulkTransfer;
+
+/**
+ * Represents the bulk messages an activity is receiving.
+ */
+typedef struct {
+	BulkTransfer transfers[MAX_NUMBER_OF_BULK_TRANSFERS]; /**< The bulk messages being reassembled. */
+	Byte *completedMessage; /**< The content of the bulk message received last (freed on the next receive). */
+} BulkTransfers;
+
+/**
+ * Represents an activity's message dispatch table.
+ * It is indexed by sender id (the rows of senders without handlers are not allocated) and message type.
+ */
+typedef struct {
+	MessageHandler *handlers[ANY_SENDER + 1]; /**< The handlers per sender (ANY_MESSAGE_TYPE + 1 entries each). */
+	DWord numberOfHandledMessages; /**< The number of messages passed to a handler. */
+	DWord numberOfUnhandledMessages[ANY_SENDER + 1]; /**< The number of messages without a handler per sender. */
+} MessageDispatcher;
+
+/**
+ * Represents a file descriptor (or timer) watched by an activity run on its own thread.
+ */
+typedef struct {
+	int fd; /**< The watched file descriptor. */
+	int isTimer; /**< Is the source a timer (owned by the activity)? */
+	EventSourceHandler handler; /**< The handler. */
+} WatchedSource;
+
+/**
+ * Represents the file descriptors and timers an activity watches (besides its incoming messages).
+ */
+typedef struct {
+	unsigned int count; /**< The number of watched sources. */
+	WatchedSource sources[MAX_NUMBER_OF_WATCHED_SOURCES]; /**< The watched sources. */
+} WatchedSources;
+
+/**
+ * Represents a message queue handle opened for sending.
+ * The handle is shared by the registry (while cached) and the senders using it, the last of them closes it.
+ */
+typedef struct {
+	mqd_t queue; /**< The message queue handle. */
+	unsigned int numberOfUsers; /**< The number of references to the handle (including the registry's). */
+} SendQueue;
+
+/**
+ * Represents an entry in the activity registry.
+ * The registry interns activity names (= assigns each activity name a small numeric id),
+ * resolves ids of received messages back to descriptors
+ * and caches the message queue handle used to send messages to the activity.
+ * It also owns the mailbox of activities using the mailbox transport:
+ * A mailbox is never freed, so senders can post to it without any locking.
+ */
+typedef struct {
+	ActivityDescriptor descriptor; /**< The activity's descriptor (as first registered). */
+	SendQueue *sendQueue; /**< The cached handle of the activity's message queue (opened for sending, NULL if none). */
+	Mailbox *mailbox; /**< The activity's mailbox (if the activity uses the mailbox transport). */
+	volatile int isMailboxOpen; /**< Is the activity running and receiving from its mailbox? */
+	BackpressureStatistics backpressureStatistics; /**< The statistics of the activity's queue (collected by the senders). */
+	Activity *activity; /**< The running activity (NULL if the activity is not running). */
+} ActivityRegistryEntry;
+
+/**
+ * Represents an entry in the topic registry (= a topic and the ids of its subscribers).
+ * Topics are registered on first subscription and are never removed.
+ */
+typedef struct {
+	char name[MAX_TOPIC_NAME_LENGTH]; /**< The topic's name. */
+	unsigned int numberOfSubscribers; /**< The number of subscribers. */
+	unsigned int subscriberIds[MAX_NUMBER_OF_TOPIC_SUBSCRIBERS]; /**< The activity ids of the subscribers. */
+} TopicRegistryEntry;
+
+static char *messagePriorityNames[NUMBER_OF_MESSAGE_PRIORITIES] = {
+	"low",
+	"medium",
+	"high"
+};
+
+static ActivityDescriptor unknownSenderDescriptor = {
+	.name = "<Unknown sender>"
+};
+
+static ActivityRegistryEntry activityRegistry[MAX_NUMBER_OF_ACTIVITIES];
+static unsigned int numberOfRegisteredActivities = 0;
+static pthread_mutex_t activityRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+
+// (Activities becoming ready are counted and announced to those waiting for them)
+static unsigned int activityReadinessCount = 0;
+static pthread_mutex_t activityReadinessLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t activityReadinessChanged = PTHREAD_COND_INITIALIZER;
+
+static TopicRegistryEntry topicRegistry[MAX_NUMBER_OF_TOPICS];
+static unsigned int numberOfRegisteredTopics = 0;
+static pthread_mutex_t topicRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+
 static char *createMessageQueueId(char *activityName) {
 	if (!activityName) {
 		logErr("["__FILE__"] null pointer at createMessageQueueId(activityName)!");
@@ -42,18 +187,46 @@ static char *createMessageQueueId(char *activityName) {
 
 #ifdef __XENO__
 #define mq_open __real_mq_open
+#define mq_close __real_mq_close
+#define mq_unlink __real_mq_unlink
+#define mq_getattr __real_mq_getattr
+#define mq_send __real_mq_send
+#define mq_timedsend __real_mq_timedsend
 #endif
 
-static mqd_t createMessageQueue(char *activityName, MessageQueueMode messageQueueMode) {
-	char *id = createMessageQueueId(activityName);
+/**
+ * Gets the maximum number of pending messages in the given activity's queue (per priority for a mailbox).
+ */
+static unsigned int getQueueCapacity(ActivityDescriptor *descriptor) {
+	if (descriptor->queueCapacity > 0) {
+		return descriptor->queueCapacity;
+	}
+
+	return descriptor->transport == activityTransport_mailbox ? MAILBOX_CAPACITY : MESSAGE_QUEUE_CAPACITY;
+}
+
+/**
+ * Gets the maximum length of an encoded message (header and content) the given activity can receive.
+ */
+static unsigned int getMaxEncodedMessageLength(ActivityDescriptor *descriptor) {
+	if (descriptor->maxMessageLength > 0 && sizeof(MessageHeader) + descriptor->maxMessageLength < MAX_MESSAGE_LENGTH) {
+		return sizeof(MessageHeader) + descriptor->maxMessageLength;
+	}
+
+	return MAX_MESSAGE_LENGTH;
+}
+
+static mqd_t createMessageQueue(ActivityDescriptor *descriptor, MessageQueueMode messageQueueMode) {
+	char *id = createMessageQueueId(descriptor->name);
 
 	if (mq_unlink(id) < 0) {
 		// Ignore any errors
 	}
 
+	// (Unprivileged processes can't create queues longer than /proc/sys/fs/mqueue/msg_max)
 	struct mq_attr attributes = {
-			.mq_maxmsg = 10,
-			.mq_msgsize = MAX_MESSAGE_LENGTH
+			.mq_maxmsg = getQueueCapacity(descriptor),
+			.mq_msgsize = getMaxEncodedMessageLength(descriptor)
 	};
 
 	mqd_t queue;
@@ -63,344 +236,2648 @@ static mqd_t createMessageQueue(char *activityName, MessageQueueMode messageQueu
 		queue = mq_open(id, O_CREAT | O_RDONLY, S_IRWXU | S_IRWXG, &attributes);
 	}
 
-	free(id);
-
 	if (queue < 0) {
-		logErr("[%s] Error creating message queue %s: %s", activityName, id, strerror(errno));
+		logErr("[%s] Error creating message queue %s: %s", descriptor->name, id, strerror(errno));
 	}
 
+	free(id);
+
 	return queue;
 }
 
-static void * runThread(void *argument) {
-	Activity *activity = (Activity *)argument;
-
-	logInfo("[%s] Launching...", activity->descriptor->name);
-
-	activity->descriptor->setUp(activity);
-	pthread_cleanup_push(activity->descriptor->tearDown, NULL);
+/**
+ * Looks up (or registers) the registry entry for the given activity.
+ * Must be called with the registry lock held.
+ */
+static unsigned int lookUpActivityId(ActivityDescriptor *descriptor) {
+	unsigned int i;
+	for (i = 0; i < numberOfRegisteredActivities; i++) {
+		if (strcmp(activityRegistry[i].descriptor.name, descriptor->name) == 0) {
+			return i + 1;
+		}
+	}
 
-	activity->descriptor->run(activity);
+	if (numberOfRegisteredActivities >= MAX_NUMBER_OF_ACTIVITIES) {
+		logErr("[%s] Error registering activity: Too many activities!", descriptor->name);
 
-	logInfo("[%s] Terminated.", activity->descriptor->name);
+		return NULL_ACTIVITY_ID;
+	}
 
-	pthread_cleanup_pop(1);
+	ActivityRegistryEntry *entry = &activityRegistry[numberOfRegisteredActivities];
+	memset(entry, 0, sizeof(ActivityRegistryEntry));
+	memcpy(&entry->descriptor, descriptor, sizeof(ActivityDescriptor));
+	entry->descriptor.name[MAX_ACTIVITY_NAME_LENGTH - 1] = '\0';
+	entry->descriptor.id = numberOfRegisteredActivities + 1;
 
-	return NULL;
+	return ++numberOfRegisteredActivities;
 }
 
-Activity *createActivity(ActivityDescriptor descriptor, MessageQueueMode messageQueueMode) {
-	// Create new activity instance
-	Activity *activity = (Activity *) malloc(sizeof(Activity));
-	memset(activity, 0, sizeof(Activity));
-
-	// Copy activity descriptor (from stack to heap)
-	ActivityDescriptor *descriptorCopy = (ActivityDescriptor *)malloc(sizeof(ActivityDescriptor));
-	memcpy(descriptorCopy, &descriptor, sizeof(ActivityDescriptor));
-	activity->descriptor = descriptorCopy;
-
-	if (descriptor.scope == activityScope_local) {
-		// Create new message queue (= queue for incoming messages)
-		mqd_t messageQueue = createMessageQueue(descriptor.name, messageQueueMode);
-		if (messageQueue < 0) {
-			logErr("[%s] Error creating activity's message queue for incoming messages: %s", descriptor.name, strerror(errno));
-
-			// TODO Error handling
-		}
-		activity->messageQueue = messageQueue;
-		activity->messageQueueMode = messageQueueMode;
-
-		activity->polling = NULL_FILE_DESCRIPTOR;
-
-		// Start new thread
-		pthread_t thread;
-		if (pthread_create(&thread, NULL, runThread, activity) < 0) {
-			logErr("[%s] Error creating new thread for activity: %s", descriptor.name, strerror(errno));
-			// TODO Error handling
+ActivityDescriptor internActivityDescriptor(ActivityDescriptor *descriptor) {
+	// The descriptor getters are called by any thread:
+	// The id is published atomically (and only once), so an interned descriptor is read without locking
+	unsigned int id = __atomic_load_n(&descriptor->id, __ATOMIC_ACQUIRE);
+	if (id == NULL_ACTIVITY_ID) {
+		// Critical section
+		pthread_mutex_lock(&activityRegistryLock);
+		id = descriptor->id;
+		if (id == NULL_ACTIVITY_ID) {
+			id = lookUpActivityId(descriptor);
+			if (id != NULL_ACTIVITY_ID) {
+				__atomic_store_n(&descriptor->id, id, __ATOMIC_RELEASE);
+			}
 		}
-		activity->thread = thread;
+		pthread_mutex_unlock(&activityRegistryLock);
 	}
 
-	return activity;
+	ActivityDescriptor internedDescriptor = *descriptor;
+	internedDescriptor.id = id;
+
+	return internedDescriptor;
 }
 
-#ifdef __XENO__
-#define mq_close __real_mq_close
-#define mq_unlink __real_mq_unlink
-#endif
+ActivityDescriptor *getActivityDescriptorById(unsigned int id) {
+	// Registry entries are never removed, so no locking is needed to read an entry
+	// whose id has been handed out before
+	if (id == NULL_ACTIVITY_ID || id > numberOfRegisteredActivities) {
+		return &unknownSenderDescriptor;
+	}
 
-void destroyActivity(Activity *activity) {
-	pthread_cancel(activity->thread);
-	pthread_join(activity->thread, NULL);
+	return &activityRegistry[id - 1].descriptor;
+}
 
-	if (activity->polling != NULL_FILE_DESCRIPTOR) {
-		close(activity->polling);
-		activity->polling = NULL_FILE_DESCRIPTOR;
+/**
+ * Releases a message queue handle taken by getSendQueue() (the handle is closed as soon as it is no longer used).
+ */
+static void releaseSendQueue(SendQueue *sendQueue) {
+	if (__sync_sub_and_fetch(&sendQueue->numberOfUsers, 1) == 0) {
+		mq_close(sendQueue->queue);
+		free(sendQueue);
 	}
+}
 
-	char *messageQueueId = createMessageQueueId(activity->descriptor->name);
-	if (mq_close(activity->messageQueue) < 0) {
-		logErr("[%s] Error closing activity's message queue for incoming messages: %s", activity->descriptor->name, strerror(errno));
-	}
-	if (mq_unlink(messageQueueId) < 0) {
-		logErr("[%s] Error destroying activity's message queue %s for incoming messages: %d: %s", activity->descriptor->name, messageQueueId, errno, strerror(errno));
+/**
+ * Drops the cached message queue handle of the given activity (if any).
+ * Has to be called whenever the activity's message queue is (re-)created or unlinked.
+ * (Senders which are still using the handle close it when they are done)
+ */
+static void invalidateSendQueue(unsigned int activityId) {
+	if (activityId == NULL_ACTIVITY_ID) {
+		return;
 	}
-	free(messageQueueId);
 
-	free(activity->descriptor);
-	free(activity);
-}
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	ActivityRegistryEntry *entry = &activityRegistry[activityId - 1];
+	SendQueue *sendQueue = entry->sendQueue;
+	entry->sendQueue = NULL;
+	pthread_mutex_unlock(&activityRegistryLock);
 
-int waitForEvent(Activity *activity, char *buffer, unsigned long length, unsigned int timeout) {
-	return waitForEvent2(activity, NULL, buffer, length, timeout);
+	if (sendQueue) {
+		releaseSendQueue(sendQueue);
+	}
 }
 
-int waitForEvent2(Activity *activity, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length, unsigned int timeout) {
-	//logInfo("[%s] Going to wait for an event...", activity->descriptor->name);
-
-	//int polling;
-	if (activity->polling == NULL_FILE_DESCRIPTOR) {
-		if ((/* polling */ activity->polling = epoll_create(1)) < 0) {
-			logErr("[%s] Error setting up event waiting: %s", activity->descriptor->name, strerror(errno));
+/**
+ * Opens a message queue for sending.
+ * Returns the handle (with one reference) or NULL on failure (errno is set).
+ */
+static SendQueue *openSendQueue(ActivityDescriptor *receiverDescriptor) {
+	char *id = createMessageQueueId(receiverDescriptor->name);
+	mqd_t queue = mq_open(id, O_WRONLY);
+	free(id);
+	if (queue < 0) {
+		return NULL;
+	}
 
-			close(activity->polling);
-			activity->polling = NULL_FILE_DESCRIPTOR;
+	SendQueue *sendQueue = (SendQueue *)malloc(sizeof(SendQueue));
+	if (!sendQueue) {
+		mq_close(queue);
+		errno = ENOMEM;
 
-			return -EFAULT;
-		}
+		return NULL;
+	}
+	sendQueue->queue = queue;
+	sendQueue->numberOfUsers = 1;
 
-		struct epoll_event messageQueueEventDescriptor = {
-				.events = EPOLLIN,
-				.data.fd = activity->messageQueue
-		};
-		if (epoll_ctl(/* polling */ activity->polling, EPOLL_CTL_ADD, messageQueueEventDescriptor.data.fd, &messageQueueEventDescriptor) < 0) {
-			logErr("[%s] Error registering message queue event source: %s", activity->descriptor->name, strerror(errno));
+	return sendQueue;
+}
 
-			//close(polling);
-			close(activity->polling);
-			activity->polling = NULL_FILE_DESCRIPTOR;
+/**
+ * Gets the message queue handle to send messages to the given receiver
+ * (the caller has to release it with releaseSendQueue()).
+ * Handles of local activities are opened once and then cached in the activity registry.
+ * Handles of external activities are not cached, because they may be restarted
+ * independently of this process (*isCached is set to FALSE).
+ * Returns NULL on failure (errno is set).
+ */
+static SendQueue *getSendQueue(ActivityDescriptor *receiverDescriptor, int *isCached) {
+	if (receiverDescriptor->scope != activityScope_local) {
+		*isCached = FALSE;
 
-			return -EFAULT;
-		}
+		return openSendQueue(receiverDescriptor);
 	}
-	int polling = activity->polling;
 
-	struct epoll_event firedEvents[1];
-	int numberOfFiredEvents;
-	numberOfFiredEvents = epoll_wait(polling, firedEvents, 1, timeout);
+	*isCached = TRUE;
 
-	//close(polling);
+	if (internActivityDescriptor(receiverDescriptor).id == NULL_ACTIVITY_ID) {
+		errno = ENOMEM;
 
-	if (numberOfFiredEvents < 0) {
-		logErr("[%s] Error waiting for event: %s", activity->descriptor->name, strerror(errno));
+		return NULL;
+	}
 
-		return -EFAULT;
-	} else if (numberOfFiredEvents == 1) {
-		//logInfo("[%s] Message received!", activity->descriptor->name);
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	ActivityRegistryEntry *entry = &activityRegistry[receiverDescriptor->id - 1];
+	if (!entry->sendQueue) {
+		// If the queue could not be opened (e.g. the receiver is not running yet),
+		// don't cache anything and try again next time
+		entry->sendQueue = openSendQueue(receiverDescriptor);
+	}
+	SendQueue *sendQueue = entry->sendQueue;
+	if (sendQueue) {
+		// (Taken while the registry still references the handle, so it cannot be closed meanwhile)
+		__sync_add_and_fetch(&sendQueue->numberOfUsers, 1);
+	}
+	pthread_mutex_unlock(&activityRegistryLock);
 
-		unsigned long incomingMessageLength = receiveMessage2(activity, senderDescriptor, buffer, length);
+	return sendQueue;
+}
 
-		return incomingMessageLength;
-	} else {
-		//logInfo("[%s] Timeout occured!", activity->descriptor->name);
+/**
+ * Opens the mailbox of the given (local) activity for receiving.
+ * The mailbox is created on first use (sized as declared by the activity's descriptor)
+ * and reused (without any pending messages) afterwards.
+ */
+static Mailbox *openMailbox(ActivityDescriptor *descriptor, MessageQueueMode messageQueueMode) {
+	if (descriptor->id == NULL_ACTIVITY_ID) {
+		return NULL;
+	}
 
-		return 0;
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	ActivityRegistryEntry *entry = &activityRegistry[descriptor->id - 1];
+	if (!entry->mailbox) {
+		entry->mailbox = createMailbox(getQueueCapacity(descriptor), getMaxEncodedMessageLength(descriptor));
 	}
+	if (entry->mailbox) {
+		resetMailbox(entry->mailbox, messageQueueMode == messageQueue_nonBlocking);
+		__sync_synchronize();
+		entry->isMailboxOpen = TRUE;
+	}
+	pthread_mutex_unlock(&activityRegistryLock);
+
+	return entry->mailbox;
 }
 
-#ifdef __XENO__
-#define mq_receive __real_mq_receive
-#endif
+/**
+ * Closes the mailbox of the given activity (senders will treat the activity as not running).
+ */
+static void closeMailbox(unsigned int activityId) {
+	if (activityId == NULL_ACTIVITY_ID) {
+		return;
+	}
 
-int receiveMessage(void *_receiver, char *buffer, unsigned long length) {
-	return receiveMessage2(_receiver, NULL, buffer, length);
+	activityRegistry[activityId - 1].isMailboxOpen = FALSE;
 }
 
-//int receiveMessage2(void *_receiver, char *senderName, char *buffer, unsigned long length) {
-int receiveMessage2(void *_receiver, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length) {
-	if (!_receiver) {
-		logErr("["__FILE__"] null pointer at receiveMessage(_receiver, ...)!");
-
-		return -EFAULT;
+/**
+ * Gets the mailbox to send messages to the given receiver
+ * or NULL if the receiver is not running.
+ */
+static Mailbox *getSendMailbox(ActivityDescriptor *receiverDescriptor) {
+	if (internActivityDescriptor(receiverDescriptor).id == NULL_ACTIVITY_ID) {
+		return NULL;
 	}
 
-	int result = 0;
+	ActivityRegistryEntry *entry = &activityRegistry[receiverDescriptor->id - 1];
 
-	Activity *receiver = (Activity *)_receiver;
+	return entry->isMailboxOpen ? entry->mailbox : NULL;
+}
 
-	//logInfo("[%s] Going to receive message...", receiver->descriptor->name);
+/**
+ * Gets the statistics of the given receiver's queue (or NULL if the receiver is unknown).
+ */
+static BackpressureStatistics *getBackpressureStatistics(ActivityDescriptor *receiverDescriptor) {
+	if (receiverDescriptor->id == NULL_ACTIVITY_ID || receiverDescriptor->id > numberOfRegisteredActivities) {
+		return NULL;
+	}
 
-	//char receiveBuffer[MAX_MESSAGE_LENGTH + 1];
-	void *receiveBuffer = NULL;
-	if (!(receiveBuffer = malloc(MAX_MESSAGE_LENGTH + 1))) {
-		logErr("[%s] Error allocating receiver buffer: %s", receiver->descriptor->name, strerror(errno));
+	return &activityRegistry[receiverDescriptor->id - 1].backpressureStatistics;
+}
 
-		return -EFAULT;
+/**
+ * Clears the statistics of the given activity's queue (when the queue is (re-)created).
+ */
+static void resetBackpressureStatistics(unsigned int activityId) {
+	if (activityId == NULL_ACTIVITY_ID) {
+		return;
 	}
 
-	ssize_t receiveLength;
-	if ((receiveLength = mq_receive(receiver->messageQueue, receiveBuffer, /* sizeof(receiveBuffer) */ MAX_MESSAGE_LENGTH + 1, NULL)) < 0) {
-		if (receiver->messageQueueMode != messageQueue_nonBlocking) {
-			logErr("[%s] Error receiving message: %s", receiver->descriptor->name, strerror(errno));
-
-			result = -EFAULT;
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	memset(&activityRegistry[activityId - 1].backpressureStatistics, 0, sizeof(BackpressureStatistics));
+	pthread_mutex_unlock(&activityRegistryLock);
+}
 
-			goto receiveMessage2_out;
-		}
+/**
+ * Registers (or unregisters, if activity is NULL) the running instance of an activity (e.g. for memory diagnostics).
+ */
+static void setRunningActivity(unsigned int activityId, Activity *activity) {
+	if (activityId == NULL_ACTIVITY_ID) {
+		return;
 	}
 
-	// Copy message length
-	unsigned long messageLength;
-	memcpy(&messageLength, receiveBuffer, sizeof(unsigned long));
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	activityRegistry[activityId - 1].activity = activity;
+	pthread_mutex_unlock(&activityRegistryLock);
+}
 
-	// Check length of the receive message
-	if (messageLength > length) {
-		logErr("[%s] Error receiving message: Message longer than expected!", receiver->descriptor->name);
+/**
+ * Raises the high-water mark of a receiver's queue to the given number of pending messages (if it is higher).
+ */
+static void accountQueueLength(ActivityDescriptor *receiverDescriptor, unsigned int queueLength) {
+	BackpressureStatistics *statistics = getBackpressureStatistics(receiverDescriptor);
+	if (!statistics) {
+		return;
+	}
 
-		result = -EFAULT;
+	DWord highWaterMark;
+	while (queueLength > (highWaterMark = statistics->highWaterMark)) {
+		if (__sync_bool_compare_and_swap(&statistics->highWaterMark, highWaterMark, queueLength)) {
+			break;
+		}
+	}
+}
 
-		goto receiveMessage2_out;
+/**
+ * Accounts a send which has had to wait for room in the receiver's queue.
+ */
+static void accountBlockedSend(ActivityDescriptor *receiverDescriptor, DWord blockedTime) {
+	BackpressureStatistics *statistics = getBackpressureStatistics(receiverDescriptor);
+	if (!statistics) {
+		return;
 	}
 
-	// Copy message
-	memcpy(buffer, receiveBuffer + sizeof(unsigned long), messageLength);
-	result = messageLength;
+	// (Blocked sends are rare, so a lock is fine here)
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	statistics->numberOfBlockedSends++;
+	statistics->totalBlockedTime += blockedTime;
+	if (blockedTime > statistics->maxBlockedTime) {
+		statistics->maxBlockedTime = blockedTime;
+	}
+	pthread_mutex_unlock(&activityRegistryLock);
+}
 
-	//char *_senderName = NULL;
-	ActivityDescriptor *_senderDescriptor = NULL;
-	if (receiveLength > sizeof(unsigned long) + messageLength) {
-		//_senderName = receiveBuffer + length;
-		_senderDescriptor = receiveBuffer + sizeof(unsigned long) + messageLength;
+/**
+ * Accounts a message which has not been sent because the receiver's queue was full.
+ */
+static void accountDroppedMessage(ActivityDescriptor *receiverDescriptor) {
+	BackpressureStatistics *statistics = getBackpressureStatistics(receiverDescriptor);
+	if (!statistics) {
+		return;
 	}
 
-	//if (senderName) {
-	if (senderDescriptor) {
-		// Copy sender name
-		//if (_senderName) {
-		if (_senderDescriptor) {
-			//memcpy(senderName, _senderName, MAX_ACTIVITY_NAME_LENGTH);
-			memcpy(senderDescriptor, _senderDescriptor, sizeof(ActivityDescriptor));
-		} else {
-			//senderName[0] = '\0';
-			//memcpy(senderName, UNKNOWN_SENDER_NAME, strlen(UNKNOWN_SENDER_NAME) + 1);
-			memcpy(senderDescriptor, UNKNOWN_SENDER_DESCRIPTOR, sizeof(ActivityDescriptor));
+	__sync_add_and_fetch(&statistics->numberOfDroppedMessages, 1);
+}
+
+/**
+ * Looks up the registry entry of the given topic (and registers the topic if isRegistered is TRUE).
+ * Returns NULL if there is no such topic.
+ * Must be called with the topic registry lock held.
+ */
+static TopicRegistryEntry *lookUpTopic(char *topic, int isRegistered) {
+	unsigned int i;
+	for (i = 0; i < numberOfRegisteredTopics; i++) {
+		if (strcmp(topicRegistry[i].name, topic) == 0) {
+			return &topicRegistry[i];
 		}
 	}
 
-	//if (_senderName) {
-	if (_senderDescriptor) {
-		//logInfo("[%s] Message received from %s (message length: %u)...", receiver->descriptor->name, _senderName, length);
-		//logInfo("[%s] Message received from %s (message length: %u)...", receiver->descriptor->name, _senderDescriptor->name, length);
-	} else {
-		//logInfo("[%s] Message received (message length: %u)...", receiver->descriptor->name, messageLength);
+	if (!isRegistered || numberOfRegisteredTopics >= MAX_NUMBER_OF_TOPICS) {
+		return NULL;
 	}
 
-receiveMessage2_out:
-	free(receiveBuffer);
+	TopicRegistryEntry *entry = &topicRegistry[numberOfRegisteredTopics++];
+	memset(entry, 0, sizeof(TopicRegistryEntry));
+	strncpy(entry->name, topic, MAX_TOPIC_NAME_LENGTH - 1);
 
-	return result;
+	return entry;
 }
 
-int sendMessage(ActivityDescriptor receiverDescriptor, char *buffer, unsigned long length, MessagePriority priority) {
-	return sendMessage2(NULL, receiverDescriptor, length, buffer, priority);
+/**
+ * Removes a subscriber from a topic (if it is subscribed).
+ * Must be called with the topic registry lock held.
+ */
+static void removeSubscriber(TopicRegistryEntry *entry, unsigned int subscriberId) {
+	unsigned int i;
+	for (i = 0; i < entry->numberOfSubscribers; i++) {
+		if (entry->subscriberIds[i] == subscriberId) {
+			entry->subscriberIds[i] = entry->subscriberIds[--entry->numberOfSubscribers];
+
+			return;
+		}
+	}
 }
 
-int sendMessage2(void *_sender, ActivityDescriptor receiverDescriptor, unsigned long length, void *buffer, MessagePriority priority) {
-//	if (!_sender) {
-//		logErr("["__FILE__"] null pointer at senderMessage(_sender, ...)!");
-//
-//		return -EFAULT;
-//	}
+/**
+ * Removes the given activity from the subscribers of all topics.
+ */
+static void unsubscribeFromAllTopics(unsigned int activityId) {
+	// Critical section
+	pthread_mutex_lock(&topicRegistryLock);
+	unsigned int i;
+	for (i = 0; i < numberOfRegisteredTopics; i++) {
+		removeSubscriber(&topicRegistry[i], activityId);
+	}
+	pthread_mutex_unlock(&topicRegistryLock);
+}
 
-	if (strcmp(receiverDescriptor.name, "<Null activity>") == 0) {
-		return 0;
+static int getSchedulingPolicy(ActivitySchedulingPolicy policy) {
+	switch (policy) {
+	case activitySchedulingPolicy_fifo:
+		return SCHED_FIFO;
+	case activitySchedulingPolicy_roundRobin:
+		return SCHED_RR;
+	default:
+		return SCHED_OTHER;
 	}
+}
 
-	int result = 0;
+static char *getSchedulingPolicyName(int policy) {
+	switch (policy) {
+	case SCHED_FIFO:
+		return "FIFO";
+	case SCHED_RR:
+		return "round robin";
+	default:
+		return "time sharing";
+	}
+}
 
-	Activity *sender = (Activity *)_sender;
+static int isRealTimeSchedulingPolicy(ActivitySchedulingPolicy policy) {
+	return policy == activitySchedulingPolicy_fifo || policy == activitySchedulingPolicy_roundRobin;
+}
 
-	unsigned long sendLength;
+/**
+ * Sets up the attributes of an activity's thread as declared by the activity's descriptor.
+ * (If isSchedulingApplied is FALSE, the thread inherits the creating thread's scheduling policy and priority)
+ */
+static void setUpThreadAttributes(ActivityDescriptor *descriptor, pthread_attr_t *attributes, int isSchedulingApplied) {
+	pthread_attr_init(attributes);
 
-	if (sender) {
-		sendLength = sizeof(ActivityDescriptor) + sizeof(length) + length;
-	} else {
-		sendLength = sizeof(length) + length;
-	}
+	if (isSchedulingApplied && descriptor->schedulingPolicy != activitySchedulingPolicy_inherited) {
+		int policy = getSchedulingPolicy(descriptor->schedulingPolicy);
+		struct sched_param parameter = {
+			.sched_priority = 0
+		};
+		if (isRealTimeSchedulingPolicy(descriptor->schedulingPolicy)) {
+			int minPriority = sched_get_priority_min(policy);
+			int maxPriority = sched_get_priority_max(policy);
+			parameter.sched_priority = (int)descriptor->schedulingPriority;
+			if (parameter.sched_priority < minPriority || parameter.sched_priority > maxPriority) {
+				logWarn("[%s] Scheduling priority %u out of range (%d .. %d)!", descriptor->name, descriptor->schedulingPriority, minPriority, maxPriority);
+				parameter.sched_priority = parameter.sched_priority < minPriority ? minPriority : maxPriority;
+			}
+		}
 
-	if (sendLength > MAX_MESSAGE_LENGTH) {
-		logErr("[%s] Error sending message: Message too long!", "<Sender>");
+		pthread_attr_setinheritsched(attributes, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attributes, policy);
+		pthread_attr_setschedparam(attributes, &parameter);
+	}
 
-		return -EFAULT;
+	if (descriptor->stackSize > 0) {
+		unsigned long stackSize = descriptor->stackSize < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : descriptor->stackSize;
+		if (pthread_attr_setstacksize(attributes, stackSize) != 0) {
+			logWarn("[%s] Invalid stack size %lu!", descriptor->name, stackSize);
+		}
 	}
 
-	char *receiverMessageQueueId = createMessageQueueId(receiverDescriptor.name);
+	if (descriptor->stackGuardSize > 0) {
+		pthread_attr_setguardsize(attributes, descriptor->stackGuardSize == NO_STACK_GUARD ? 0 : descriptor->stackGuardSize);
+	}
 
-	mqd_t receiverQueue = mq_open(receiverMessageQueueId, O_WRONLY);
-	free(receiverMessageQueueId);
-	if (receiverQueue < 0) {
-		// If there is no corresponding message queue, the receiver is probably not running
-		if (errno == ENOENT) {
-			logWarn("[%s] %s is not running?!", sender->descriptor->name, receiverDescriptor.name);
-		} else {
-			if (sender) {
-				logErr("[%s] Error opening message queue %s for sending: %s", sender->descriptor->name, receiverDescriptor.name, strerror(errno));
-			} else {
-				logErr("[%s] Error opening message queue %s for sending: %s", "<Sender>", receiverDescriptor.name, strerror(errno));
+#ifdef CPU_SET
+	if (descriptor->cpuAffinity != 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		unsigned int cpu;
+		for (cpu = 0; cpu < sizeof(descriptor->cpuAffinity) * CHAR_BIT && cpu < CPU_SETSIZE; cpu++) {
+			if (descriptor->cpuAffinity & (1UL << cpu)) {
+				CPU_SET(cpu, &cpus);
 			}
 		}
-
-		return -EFAULT;
+		pthread_attr_setaffinity_np(attributes, sizeof(cpus), &cpus);
 	}
+#endif
+}
 
-	if (sender) {
-		//logInfo("[%s] Sending message to %s (message length: %u)...", sender->descriptor->name, receiverDescriptor.name, length);
-	} else {
-		//logInfo("[%s] Sending message to %s (message length: %u)...", "<Sender>", receiverDescriptor.name, length);
+/**
+ * Records the bounds of the calling activity's thread stack and prefaults the stack if the activity's descriptor says so.
+ * (The stack is prefaulted by painting its unused part, which also allows measuring the peak stack use exactly)
+ */
+static void setUpStack(Activity *activity) {
+	pthread_attr_t attributes;
+	if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+		return;
+	}
+	void *stack = NULL;
+	size_t stackSize = 0;
+	pthread_attr_getstack(&attributes, &stack, &stackSize);
+	pthread_attr_destroy(&attributes);
+
+	if (activity->descriptor->isStackPrefaulted) {
+		// The stack grows downwards: paint from its lowest address up to (a margin below) the current frame
+		volatile Byte *position = (Byte *)stack;
+		volatile Byte *end = (Byte *)&attributes - STACK_PAINT_MARGIN;
+		while (position < end) {
+			*position++ = STACK_PAINT_PATTERN;
+		}
+		activity->isStackPainted = TRUE;
 	}
 
-	void *sendBuffer = 0;
-	//if (!(sendBuffer = malloc(MAX_ACTIVITY_NAME_LENGTH + length))) {
-	if (!(sendBuffer = malloc(sendLength))) {
-		logErr("[%s] Error allocating send buffer: %s", sender->descriptor->name, strerror(errno));
+	activity->stackSize = stackSize;
+	activity->stack = (Byte *)stack;
+}
 
-		result = -EFAULT;
+/**
+ * Gets the peak stack use of an activity's thread [bytes].
+ * (Without painting, it is the size of the stack pages which have been touched so far)
+ */
+static unsigned long getPeakStackUse(Activity *activity) {
+	if (activity->isStackPainted) {
+		unsigned long untouchedSize = 0;
+		while (untouchedSize < activity->stackSize && activity->stack[untouchedSize] == STACK_PAINT_PATTERN) {
+			untouchedSize++;
+		}
 
-		goto sendMessage2_out;
+		return activity->stackSize - untouchedSize;
 	}
 
-	// Copy message length
-	memcpy(sendBuffer, &length, sizeof(length));
-	// Copy message
-	memcpy(sendBuffer + sizeof(length), buffer, length);
+	unsigned long pageSize = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)activity->stack & ~(pageSize - 1);
+	unsigned long length = (uintptr_t)activity->stack + activity->stackSize - start;
+	unsigned long numberOfPages = (length + pageSize - 1) / pageSize;
+	unsigned char residency[numberOfPages];
+	if (mincore((void *)start, length, residency) < 0) {
+		return 0;
+	}
 
-	if (sender) {
-		// Copy sender name
-		//memcpy(sendBuffer + length, sender->descriptor->name, MAX_ACTIVITY_NAME_LENGTH);
-		// copy sender descriptor
-		memcpy(sendBuffer + sizeof(length) + length, sender->descriptor, sizeof(ActivityDescriptor));
-		//if (mq_send(receiverQueue, sendBuffer, MAX_ACTIVITY_NAME_LENGTH + length, priority) < 0) {
-		if (mq_send(receiverQueue, sendBuffer, sendLength, priority) < 0) {
-			logErr("[%s] Error sending message: %s", sender->descriptor->name, strerror(errno));
+	unsigned long numberOfResidentPages = 0;
+	unsigned long i;
+	for (i = 0; i < numberOfPages; i++) {
+		numberOfResidentPages += residency[i] & 1;
+	}
 
-			result = -EFAULT;
+	return numberOfResidentPages * pageSize < activity->stackSize ? numberOfResidentPages * pageSize : activity->stackSize;
+}
 
-			goto sendMessage2_out;
+/**
+ * Gets a memory size from the process status (e.g. "VmRSS") [KiB].
+ */
+static unsigned long getProcessMemoryStatus(char *name) {
+	FILE *status = fopen("/proc/self/status", "r");
+	if (!status) {
+		return 0;
+	}
+
+	unsigned long size = 0;
+	size_t nameLength = strlen(name);
+	char line[128];
+	while (fgets(line, sizeof(line), status)) {
+		if (strncmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+			size = strtoul(line + nameLength + 1, NULL, 10);
+
+			break;
+		}
+	}
+	fclose(status);
+
+	return size;
+}
+
+void logMemoryFootprint(void) {
+	unsigned long totalStackSize = 0;
+	unsigned long totalStackUse = 0;
+
+	// Critical section
+	pthread_mutex_lock(&activityRegistryLock);
+	unsigned int i;
+	for (i = 0; i < numberOfRegisteredActivities; i++) {
+		Activity *activity = activityRegistry[i].activity;
+		if (!activity || !activity->stack) {
+			continue;
+		}
+
+		unsigned long stackUse = getPeakStackUse(activity);
+		logInfo("[%s] Stack: %lu KiB of %lu KiB used%s",
+				activity->descriptor->name,
+				(stackUse + 1023) / 1024,
+				activity->stackSize / 1024,
+				activity->isStackPainted ? "" : " (touched pages)");
+
+		totalStackSize += activity->stackSize;
+		totalStackUse += stackUse;
+	}
+	pthread_mutex_unlock(&activityRegistryLock);
+
+	logInfo("[activity] Memory: %lu KiB resident (peak %lu KiB), activity stacks: %lu KiB of %lu KiB used",
+			getProcessMemoryStatus("VmRSS"),
+			getProcessMemoryStatus("VmHWM"),
+			(totalStackUse + 1023) / 1024,
+			totalStackSize / 1024);
+}
+
+/**
+ * Logs the effective scheduling policy, priority, CPU affinity and stack size of the calling activity's thread.
+ */
+static void logThreadSettings(Activity *activity) {
+	int policy = SCHED_OTHER;
+	struct sched_param parameter = {
+		.sched_priority = 0
+	};
+	pthread_getschedparam(pthread_self(), &policy, &parameter);
+
+	size_t stackSize = 0;
+	size_t guardSize = 0;
+	pthread_attr_t attributes;
+	if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+		pthread_attr_getstacksize(&attributes, &stackSize);
+		pthread_attr_getguardsize(&attributes, &guardSize);
+		pthread_attr_destroy(&attributes);
+	}
+
+	unsigned long cpuAffinity = 0;
+#ifdef CPU_SET
+	cpu_set_t cpus;
+	if (pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0) {
+		unsigned int cpu;
+		for (cpu = 0; cpu < sizeof(cpuAffinity) * CHAR_BIT && cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &cpus)) {
+				cpuAffinity |= 1UL << cpu;
+			}
+		}
+	}
+#endif
+
+	logInfo("[%s] Thread: %s scheduling (priority %d), CPUs 0x%lx, stack %lu KiB (guard %lu KiB%s)",
+			activity->descriptor->name,
+			getSchedulingPolicyName(policy),
+			parameter.sched_priority,
+			cpuAffinity,
+			(unsigned long)stackSize / 1024,
+			(unsigned long)guardSize / 1024,
+			activity->isStackPainted ? ", prefaulted" : "");
+}
+
+static DWord getMessageTime(void);
+
+/**
+ * Marks an activity as ready (its 'set up' handler has returned) and wakes up those waiting for it.
+ */
+static void setActivityReady(Activity *activity) {
+	// Critical section
+	pthread_mutex_lock(&activityReadinessLock);
+	activity->readyTime = getMessageTime();
+	activity->isReady = TRUE;
+	activityReadinessCount++;
+	pthread_cond_broadcast(&activityReadinessChanged);
+	pthread_mutex_unlock(&activityReadinessLock);
+}
+
+static void * runThread(void *argument) {
+	Activity *activity = (Activity *)argument;
+
+	logInfo("[%s] Launching...", activity->descriptor->name);
+	setUpStack(activity);
+	logThreadSettings(activity);
+
+	activity->descriptor->setUp(activity);
+	setActivityReady(activity);
+	pthread_cleanup_push(activity->descriptor->tearDown, NULL);
+
+	if (activity->descriptor->execution == activityExecution_coroutine) {
+		runCoroutines(activity);
+	} else {
+		activity->descriptor->run(activity);
+	}
+
+	logInfo("[%s] Terminated.", activity->descriptor->name);
+
+	pthread_cleanup_pop(1);
+
+	// (Lets stopActivity() wait for the termination with a deadline)
+	sem_post(&activity->terminated);
+
+	return NULL;
+}
+
+/**
+ * Starts an activity's thread.
+ * Falls back to the inherited scheduling policy if the process may not use the declared (real-time) one.
+ */
+static int startThread(Activity *activity) {
+	ActivityDescriptor *descriptor = activity->descriptor;
+
+	pthread_attr_t attributes;
+	setUpThreadAttributes(descriptor, &attributes, TRUE);
+	int error = pthread_create(&activity->thread, &attributes, runThread, activity);
+	pthread_attr_destroy(&attributes);
+
+	if (error == EPERM && descriptor->schedulingPolicy != activitySchedulingPolicy_inherited) {
+		logWarn("[%s] Not permitted to use the declared scheduling policy, inheriting the creator's one!", descriptor->name);
+
+		setUpThreadAttributes(descriptor, &attributes, FALSE);
+		error = pthread_create(&activity->thread, &attributes, runThread, activity);
+		pthread_attr_destroy(&attributes);
+	}
+	if (error != 0) {
+		logErr("[%s] Error creating new thread for activity: %s", descriptor->name, strerror(error));
+
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/**
+ * Starts running an activity (on its own thread or by the executor's worker threads).
+ */
+static int startActivity(Activity *activity) {
+	ActivityDescriptor *descriptor = activity->descriptor;
+
+	activity->isStopRequested = FALSE;
+	activity->isReady = FALSE;
+	setRunningActivity(descriptor->id, activity);
+
+	if (descriptor->execution == activityExecution_reactor) {
+		// Let the executor run the activity
+		if (attachToExecutor(activity) < 0) {
+			logErr("[%s] Error attaching activity to executor!", descriptor->name);
+
+			return -EFAULT;
+		}
+		// (The executor has run the 'set up' handler)
+		setActivityReady(activity);
+	} else {
+		// Start new thread
+		if (startThread(activity) < 0) {
+			return -EFAULT;
+		}
+	}
+	activity->isStarted = TRUE;
+
+	return 0;
+}
+
+Activity *createActivity(ActivityDescriptor descriptor, MessageQueueMode messageQueueMode) {
+	// Create new activity instance
+	Activity *activity = (Activity *) malloc(sizeof(Activity));
+	memset(activity, 0, sizeof(Activity));
+
+	// Copy activity descriptor (from stack to heap)
+	ActivityDescriptor *descriptorCopy = (ActivityDescriptor *)malloc(sizeof(ActivityDescriptor));
+	memcpy(descriptorCopy, &descriptor, sizeof(ActivityDescriptor));
+	internActivityDescriptor(descriptorCopy);
+	activity->descriptor = descriptorCopy;
+
+	if (descriptor.scope == activityScope_local) {
+		// Activities run by the executor must never block on their queue
+		if (descriptor.execution == activityExecution_reactor) {
+			messageQueueMode = messageQueue_nonBlocking;
+		}
+
+		if (descriptor.transport == activityTransport_messageQueue) {
+			// Creating the message queue replaces any previous queue with the same name,
+			// so a possibly cached handle would be stale
+			invalidateSendQueue(descriptorCopy->id);
+
+			// Create new message queue (= queue for incoming messages)
+			mqd_t messageQueue = createMessageQueue(descriptorCopy, messageQueueMode);
+			if (messageQueue < 0) {
+				logErr("[%s] Error creating activity's message queue for incoming messages: %s", descriptor.name, strerror(errno));
+
+				// TODO Error handling
+			}
+			activity->messageQueue = messageQueue;
+		} else {
+			// Open mailbox (= in-process queue for incoming messages)
+			activity->mailbox = openMailbox(descriptorCopy, messageQueueMode);
+			if (!activity->mailbox) {
+				logErr("[%s] Error creating activity's mailbox for incoming messages!", descriptor.name);
+
+				// TODO Error handling
+			}
+			activity->messageQueue = NULL_FILE_DESCRIPTOR;
+		}
+		activity->messageQueueMode = messageQueueMode;
+
+		resetBackpressureStatistics(descriptorCopy->id);
+
+		// Allocate receive buffer once (messages are received in place)
+		activity->receiveBuffer = (Byte *)malloc(MAX_MESSAGE_LENGTH + 1);
+
+		activity->polling = NULL_FILE_DESCRIPTOR;
+
+		sem_init(&activity->terminated, 0, 0);
+
+		// (The executor's worker threads are shared, so they cannot take on an activity's thread settings)
+		if (descriptor.execution == activityExecution_reactor
+			&& (descriptor.schedulingPolicy != activitySchedulingPolicy_inherited || descriptor.cpuAffinity != 0 || descriptor.stackSize > 0)) {
+			logWarn("[%s] Thread settings are ignored (the activity is run by the executor's worker threads)!", descriptor.name);
+		}
+
+		if (startActivity(activity) < 0) {
+			// TODO Error handling
+		}
+	}
+
+	return activity;
+}
+
+void destroyActivity(Activity *activity) {
+	stopActivity(activity, DEFAULT_STOP_TIMEOUT);
+
+	destroyCoroutines(activity);
+	free(activity->watchedSources);
+	activity->watchedSources = NULL;
+
+	if (activity->polling != NULL_FILE_DESCRIPTOR) {
+		close(activity->polling);
+		activity->polling = NULL_FILE_DESCRIPTOR;
+	}
+
+	unsubscribeFromAllTopics(activity->descriptor->id);
+
+	if (activity->mailbox) {
+		// The mailbox itself is kept by the activity registry (for a possible restart)
+		closeMailbox(activity->descriptor->id);
+		activity->mailbox = NULL;
+	} else {
+		invalidateSendQueue(activity->descriptor->id);
+
+		char *messageQueueId = createMessageQueueId(activity->descriptor->name);
+		if (mq_close(activity->messageQueue) < 0) {
+			logErr("[%s] Error closing activity's message queue for incoming messages: %s", activity->descriptor->name, strerror(errno));
+		}
+		if (mq_unlink(messageQueueId) < 0) {
+			logErr("[%s] Error destroying activity's message queue %s for incoming messages: %d: %s", activity->descriptor->name, messageQueueId, errno, strerror(errno));
+		}
+		free(messageQueueId);
+	}
+
+	logMessageQueueStatistics(activity);
+
+	free(activity->receiveBuffer);
+	free(activity->batchBuffer);
+	free(activity->deferredMessages);
+	if (activity->bulkTransfers) {
+		BulkTransfers *bulkTransfers = (BulkTransfers *)activity->bulkTransfers;
+		unsigned int i;
+		for (i = 0; i < MAX_NUMBER_OF_BULK_TRANSFERS; i++) {
+			free(bulkTransfers->transfers[i].buffer);
+		}
+		free(bulkTransfers->completedMessage);
+		free(bulkTransfers);
+	}
+	if (activity->dispatcher) {
+		MessageDispatcher *dispatcher = (MessageDispatcher *)activity->dispatcher;
+		unsigned int senderId;
+		for (senderId = 0; senderId <= ANY_SENDER; senderId++) {
+			free(dispatcher->handlers[senderId]);
+		}
+		free(dispatcher);
+	}
+	sem_destroy(&activity->terminated);
+	free(activity->descriptor);
+	free(activity);
+}
+
+int getMessageEventSource(Activity *activity) {
+	if (activity->mailbox) {
+		return getMailboxEventSource(activity->mailbox);
+	}
+
+	return activity->messageQueue;
+}
+
+void logMessageQueueStatistics(Activity *activity) {
+	unsigned int priority;
+	for (priority = 0; priority < NUMBER_OF_MESSAGE_PRIORITIES; priority++) {
+		MessageQueueStatistics *statistics = &activity->queueStatistics[priority];
+		if (statistics->numberOfMessages == 0 && statistics->numberOfExpiredMessages == 0) {
+			continue;
+		}
+
+		logInfo("[%s] %s priority messages: %u received (wait time: avg. %llu us, max. %u us), %u expired",
+				activity->descriptor->name,
+				messagePriorityNames[priority],
+				statistics->numberOfMessages,
+				statistics->numberOfMessages > 0 ? statistics->totalWaitTime / statistics->numberOfMessages : 0,
+				statistics->maxWaitTime,
+				statistics->numberOfExpiredMessages);
+	}
+
+	RequestStatistics *requestStatistics = &activity->requestStatistics;
+	if (requestStatistics->numberOfRequests > 0) {
+		logInfo("[%s] Requests: %u sent, %u answered (round trip time: avg. %llu us, max. %u us), %u timed out",
+				activity->descriptor->name,
+				requestStatistics->numberOfRequests,
+				requestStatistics->numberOfResponses,
+				requestStatistics->numberOfResponses > 0 ? requestStatistics->totalRoundTripTime / requestStatistics->numberOfResponses : 0,
+				requestStatistics->maxRoundTripTime,
+				requestStatistics->numberOfTimeouts);
+	}
+
+	MessageDispatcher *dispatcher = (MessageDispatcher *)activity->dispatcher;
+	if (dispatcher) {
+		unsigned int senderId;
+		for (senderId = 0; senderId <= ANY_SENDER; senderId++) {
+			if (dispatcher->numberOfUnhandledMessages[senderId] > 0) {
+				logInfo("[%s] Dispatched messages: %u unhandled from %s (of %u handled in total)",
+						activity->descriptor->name,
+						dispatcher->numberOfUnhandledMessages[senderId],
+						getActivityDescriptorById(senderId)->name,
+						dispatcher->numberOfHandledMessages);
+			}
+		}
+	}
+
+	BackpressureStatistics *backpressureStatistics = getBackpressureStatistics(activity->descriptor);
+	if (backpressureStatistics && backpressureStatistics->highWaterMark > 0) {
+		logInfo("[%s] Queue: up to %u of %u messages pending, %u blocked sends (blocked time: avg. %llu us, max. %u us), %u dropped",
+				activity->descriptor->name,
+				backpressureStatistics->highWaterMark,
+				getQueueCapacity(activity->descriptor),
+				backpressureStatistics->numberOfBlockedSends,
+				backpressureStatistics->numberOfBlockedSends > 0 ? backpressureStatistics->totalBlockedTime / backpressureStatistics->numberOfBlockedSends : 0,
+				backpressureStatistics->maxBlockedTime,
+				backpressureStatistics->numberOfDroppedMessages);
+	}
+}
+
+/**
+ * Gets the current time of the monotonic clock [us] (wraps around).
+ */
+static DWord getMessageTime(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (DWord)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Gets the pending request with the given token (or NULL).
+ */
+static PendingRequest *findPendingRequest(Activity *activity, RequestToken token) {
+	if (token == NULL_REQUEST_TOKEN) {
+		return NULL;
+	}
+
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_PENDING_REQUESTS; i++) {
+		if (activity->pendingRequests[i].token == token) {
+			return &activity->pendingRequests[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Starts tracking a sent request.
+ * If all entries are in use, the oldest request without a continuation is no longer tracked.
+ */
+static void trackRequest(Activity *activity, RequestToken token) {
+	DWord now = getMessageTime();
+
+	PendingRequest *request = NULL;
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_PENDING_REQUESTS; i++) {
+		PendingRequest *candidate = &activity->pendingRequests[i];
+		if (candidate->token == NULL_REQUEST_TOKEN) {
+			request = candidate;
+
+			break;
+		}
+		if (!candidate->handler && (!request || now - candidate->sendTime > now - request->sendTime)) {
+			request = candidate;
+		}
+	}
+	if (!request) {
+		logWarn("[%s] Too many pending requests, request %u is not tracked!", activity->descriptor->name, token);
+
+		return;
+	}
+
+	memset(request, 0, sizeof(PendingRequest));
+	request->token = token;
+	request->sendTime = now;
+
+	activity->requestStatistics.numberOfRequests++;
+}
+
+/**
+ * Stops tracking a request whose response has been received (and measures its round trip time).
+ */
+static void completeRequest(Activity *activity, PendingRequest *request) {
+	DWord roundTripTime = getMessageTime() - request->sendTime;
+
+	//logInfo("[%s] Response to request %u received after %u us", activity->descriptor->name, request->token, roundTripTime);
+
+	RequestStatistics *statistics = &activity->requestStatistics;
+	statistics->numberOfResponses++;
+	statistics->totalRoundTripTime += roundTripTime;
+	if (roundTripTime > statistics->maxRoundTripTime) {
+		statistics->maxRoundTripTime = roundTripTime;
+	}
+
+	request->token = NULL_REQUEST_TOKEN;
+}
+
+/**
+ * Completes the request a received response refers to (if it is tracked)
+ * and passes the response to the request's continuation (if there is one).
+ * Returns TRUE if the response has been consumed by a continuation.
+ */
+static int dispatchResponse(Activity *activity, MessageHeader *header, void *content) {
+	PendingRequest *request = findPendingRequest(activity, header->correlationId);
+	if (!request) {
+		return FALSE;
+	}
+
+	ResponseHandler handler = request->handler;
+	void *context = request->context;
+	completeRequest(activity, request);
+
+	if (!handler) {
+		return FALSE;
+	}
+
+	handler(activity, header, content, context);
+
+	return TRUE;
+}
+
+/**
+ * Calls the continuations of the requests which have timed out.
+ */
+static void expirePendingRequests(Activity *activity) {
+	DWord now = getMessageTime();
+
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_PENDING_REQUESTS; i++) {
+		PendingRequest *request = &activity->pendingRequests[i];
+		if (request->token != NULL_REQUEST_TOKEN && request->handler && request->hasTimeout && (int)(now - request->deadline) >= 0) {
+			ResponseHandler handler = request->handler;
+			void *context = request->context;
+			request->token = NULL_REQUEST_TOKEN;
+			activity->requestStatistics.numberOfTimeouts++;
+
+			handler(activity, NULL, NULL, context);
+		}
+	}
+}
+
+/**
+ * Limits a timeout [ms] to the time until the next request times out.
+ * Returns the timeout unchanged if there is no request with a timeout.
+ */
+static unsigned int getRequestTimeout(Activity *activity, unsigned int timeout) {
+	DWord now = getMessageTime();
+
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_PENDING_REQUESTS; i++) {
+		PendingRequest *request = &activity->pendingRequests[i];
+		if (request->token != NULL_REQUEST_TOKEN && request->handler && request->hasTimeout) {
+			int remainingTime = (int)(request->deadline - now);
+			unsigned int requestTimeout = remainingTime > 0 ? (remainingTime + 999) / 1000 : 0;
+			// (An infinite timeout (-1) is the largest unsigned value)
+			if (requestTimeout < timeout) {
+				timeout = requestTimeout;
+			}
+		}
+	}
+
+	return timeout;
+}
+
+/**
+ * Returns TRUE if there is a request whose continuation may time out.
+ */
+static int hasRequestTimeout(Activity *activity) {
+	return getRequestTimeout(activity, UINT_MAX) != UINT_MAX;
+}
+
+/**
+ * Returns TRUE if the activity has deferred messages.
+ */
+static int hasDeferredMessages(Activity *activity) {
+	return activity->deferredMessages && ((DeferredMessages *)activity->deferredMessages)->count > 0;
+}
+
+/**
+ * Defers an (encoded) message to be received again later.
+ */
+static int deferMessage(Activity *activity, Byte *buffer, ssize_t length) {
+	DeferredMessages *deferredMessages = (DeferredMessages *)activity->deferredMessages;
+	if (deferredMessages->count >= MAX_NUMBER_OF_DEFERRED_MESSAGES) {
+		return -ENOSPC;
+	}
+
+	unsigned int index = (deferredMessages->first + deferredMessages->count) % MAX_NUMBER_OF_DEFERRED_MESSAGES;
+	memcpy(deferredMessages->buffers[index], buffer, length);
+	deferredMessages->lengths[index] = length;
+	deferredMessages->count++;
+
+	return 0;
+}
+
+/**
+ * Takes the oldest deferred message.
+ * Returns the message length.
+ */
+static ssize_t takeDeferredMessage(Activity *activity, Byte *buffer) {
+	DeferredMessages *deferredMessages = (DeferredMessages *)activity->deferredMessages;
+
+	unsigned int index = deferredMessages->first;
+	ssize_t length = deferredMessages->lengths[index];
+	memcpy(buffer, deferredMessages->buffers[index], length);
+	deferredMessages->first = (index + 1) % MAX_NUMBER_OF_DEFERRED_MESSAGES;
+	deferredMessages->count--;
+
+	return length;
+}
+
+/**
+ * Sets up the activity's epoll instance (watching its incoming messages) unless it already exists.
+ */
+static int setUpPolling(Activity *activity) {
+	if (activity->polling != NULL_FILE_DESCRIPTOR) {
+		return 0;
+	}
+
+	int polling = epoll_create(MAX_NUMBER_OF_WATCHED_SOURCES + 1);
+	if (polling < 0) {
+		logErr("[%s] Error setting up event waiting: %s", activity->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	struct epoll_event messageQueueEventDescriptor = {
+			.events = EPOLLIN,
+			.data.fd = getMessageEventSource(activity)
+	};
+	if (epoll_ctl(polling, EPOLL_CTL_ADD, messageQueueEventDescriptor.data.fd, &messageQueueEventDescriptor) < 0) {
+		logErr("[%s] Error registering message queue event source: %s", activity->descriptor->name, strerror(errno));
+
+		close(polling);
+
+		return -EFAULT;
+	}
+	activity->polling = polling;
+
+	return 0;
+}
+
+/**
+ * Gets the watched source with the given file descriptor (or NULL).
+ */
+static WatchedSource *findWatchedSource(Activity *activity, int fd) {
+	WatchedSources *watchedSources = (WatchedSources *)activity->watchedSources;
+	if (!watchedSources) {
+		return NULL;
+	}
+
+	unsigned int i;
+	for (i = 0; i < watchedSources->count; i++) {
+		if (watchedSources->sources[i].fd == fd) {
+			return &watchedSources->sources[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int hasWatchedSources(Activity *activity) {
+	return activity->watchedSources && ((WatchedSources *)activity->watchedSources)->count > 0;
+}
+
+/**
+ * Calls the handler of a watched source which has fired.
+ */
+static void dispatchWatchedSource(Activity *activity, int fd) {
+	WatchedSource *source = findWatchedSource(activity, fd);
+	if (!source) {
+		// (A previous handler has unwatched the source meanwhile)
+		return;
+	}
+
+	if (source->isTimer) {
+		// Acknowledge the timer expiration(s)
+		uint64_t expirations;
+		if (read(fd, &expirations, sizeof(expirations)) < 0) {
+			// Ignore any errors (e.g. a spurious wake up)
+		}
+	}
+
+	source->handler(activity, fd);
+}
+
+/**
+ * Waits until there is an incoming message in the activity's mailbox or message queue or the timeout has elapsed.
+ * The handlers of the watched sources which fire meanwhile are called (and the waiting goes on).
+ * Returns 1 if there is a message, 0 if the timeout has elapsed or a negative error code.
+ */
+static int waitForSourceMessage(Activity *activity, unsigned int timeout) {
+	//logInfo("[%s] Going to wait for an event...", activity->descriptor->name);
+
+	if (setUpPolling(activity) < 0) {
+		return -EFAULT;
+	}
+	int polling = activity->polling;
+	int messageEventSource = getMessageEventSource(activity);
+
+	DWord deadline = getMessageTime() + (DWord)timeout * 1000;
+	unsigned int remainingTime = timeout;
+	while (TRUE) {
+		struct epoll_event firedEvents[MAX_NUMBER_OF_WATCHED_SOURCES + 1];
+		int numberOfFiredEvents;
+		if (isInCoroutine(activity)) {
+			// A coroutine lets the activity's other coroutines run meanwhile
+			// (The epoll instance itself becomes readable when one of its sources fires)
+			int result = awaitDevice(activity, polling, remainingTime);
+			if (result <= 0) {
+				return result;
+			}
+
+			numberOfFiredEvents = epoll_wait(polling, firedEvents, MAX_NUMBER_OF_WATCHED_SOURCES + 1, 0);
+		} else {
+			numberOfFiredEvents = epoll_wait(polling, firedEvents, MAX_NUMBER_OF_WATCHED_SOURCES + 1, remainingTime);
+		}
+
+		if (numberOfFiredEvents < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			logErr("[%s] Error waiting for event: %s", activity->descriptor->name, strerror(errno));
+
+			return -EFAULT;
+		}
+
+		int isMessagePending = FALSE;
+		int i;
+		for (i = 0; i < numberOfFiredEvents; i++) {
+			if (firedEvents[i].data.fd == messageEventSource) {
+				isMessagePending = TRUE;
+			} else {
+				dispatchWatchedSource(activity, firedEvents[i].data.fd);
+			}
+		}
+		if (isMessagePending) {
+			return 1;
+		}
+
+		// Only watched sources have fired: Go on waiting for the rest of the timeout
+		if (timeout != UINT_MAX) {
+			int remainingMicroseconds = (int)(deadline - getMessageTime());
+			if (remainingMicroseconds <= 0) {
+				//logInfo("[%s] Timeout occured!", activity->descriptor->name);
+
+				return 0;
+			}
+			remainingTime = (remainingMicroseconds + 999) / 1000;
+		}
+	}
+}
+
+/**
+ * Adds a source to the activity's epoll instance.
+ */
+static int addWatchedSource(Activity *activity, int fd, unsigned int events, int isTimer, EventSourceHandler handler) {
+	if (setUpPolling(activity) < 0) {
+		return -EFAULT;
+	}
+
+	if (!activity->watchedSources) {
+		activity->watchedSources = malloc(sizeof(WatchedSources));
+		if (!activity->watchedSources) {
+			logErr("[%s] Error watching file descriptor %d: Out of memory!", activity->descriptor->name, fd);
+
+			return -ENOMEM;
+		}
+		memset(activity->watchedSources, 0, sizeof(WatchedSources));
+	}
+	WatchedSources *watchedSources = (WatchedSources *)activity->watchedSources;
+	if (watchedSources->count >= MAX_NUMBER_OF_WATCHED_SOURCES) {
+		logErr("[%s] Error watching file descriptor %d: Too many watched sources!", activity->descriptor->name, fd);
+
+		return -ENOSPC;
+	}
+
+	struct epoll_event eventDescriptor = {
+		.events = events,
+		.data.fd = fd
+	};
+	if (epoll_ctl(activity->polling, EPOLL_CTL_ADD, fd, &eventDescriptor) < 0) {
+		logErr("[%s] Error registering event source (file descriptor: %d): %s", activity->descriptor->name, fd, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	WatchedSource *source = &watchedSources->sources[watchedSources->count++];
+	source->fd = fd;
+	source->isTimer = isTimer;
+	source->handler = handler;
+
+	return 0;
+}
+
+int watchFd(Activity *activity, int fd, unsigned int events, EventSourceHandler handler) {
+	if (!handler) {
+		return -EINVAL;
+	}
+
+	if (activity->descriptor->execution == activityExecution_reactor) {
+		return registerReactorSourceForEvents(activity, fd, events, handler);
+	}
+
+	return addWatchedSource(activity, fd, events, FALSE, handler);
+}
+
+int scheduleTimer(Activity *activity, unsigned int milliseconds, EventSourceHandler handler) {
+	if (!handler || milliseconds == 0) {
+		return -EINVAL;
+	}
+
+	if (activity->descriptor->execution == activityExecution_reactor) {
+		return registerReactorTimer(activity, milliseconds, handler);
+	}
+
+	int timer = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (timer < 0) {
+		logErr("[%s] Error creating timer: %s", activity->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	struct itimerspec timerSpecification = {
+		.it_interval = { .tv_sec = milliseconds / 1000, .tv_nsec = (milliseconds % 1000) * 1000000 },
+		.it_value = { .tv_sec = milliseconds / 1000, .tv_nsec = (milliseconds % 1000) * 1000000 }
+	};
+	if (timerfd_settime(timer, 0, &timerSpecification, NULL) < 0) {
+		logErr("[%s] Error starting timer: %s", activity->descriptor->name, strerror(errno));
+		close(timer);
+
+		return -EFAULT;
+	}
+
+	if (addWatchedSource(activity, timer, EPOLLIN, TRUE, handler) < 0) {
+		close(timer);
+
+		return -EFAULT;
+	}
+
+	return timer;
+}
+
+/**
+ * Removes a source from the activity's epoll instance (and closes it if it is a timer).
+ */
+static void removeWatchedSource(Activity *activity, WatchedSource *source) {
+	WatchedSources *watchedSources = (WatchedSources *)activity->watchedSources;
+
+	epoll_ctl(activity->polling, EPOLL_CTL_DEL, source->fd, NULL);
+	if (source->isTimer) {
+		close(source->fd);
+	}
+
+	// (The order of the sources does not matter)
+	*source = watchedSources->sources[--watchedSources->count];
+}
+
+void unwatchFd(Activity *activity, int fd) {
+	if (activity->descriptor->execution == activityExecution_reactor) {
+		unregisterReactorSource(activity, fd);
+
+		return;
+	}
+
+	WatchedSource *source = findWatchedSource(activity, fd);
+	if (source) {
+		removeWatchedSource(activity, source);
+	}
+}
+
+/**
+ * Unwatches all sources of an activity whose thread has terminated.
+ */
+static void unwatchAllSources(Activity *activity) {
+	WatchedSources *watchedSources = (WatchedSources *)activity->watchedSources;
+	if (!watchedSources) {
+		return;
+	}
+
+	while (watchedSources->count > 0) {
+		removeWatchedSource(activity, &watchedSources->sources[watchedSources->count - 1]);
+	}
+}
+
+/**
+ * Waits until there is an incoming (or deferred) message or the timeout has elapsed.
+ * Calls the continuations of requests which time out meanwhile.
+ * Returns 1 if there is a message, 0 if the timeout (or the timeout of a request) has elapsed or a negative error code.
+ */
+static int waitForMessage(Activity *activity, unsigned int timeout) {
+	if (hasDeferredMessages(activity)) {
+		return 1;
+	}
+
+	// (An activity which has been asked to stop only takes the messages which are already pending)
+	if (activity->isStopRequested) {
+		timeout = 0;
+	}
+
+	int result = waitForSourceMessage(activity, getRequestTimeout(activity, timeout));
+
+	expirePendingRequests(activity);
+
+	return result;
+}
+
+int waitForEvent2(Activity *activity, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length, unsigned int timeout) {
+	int result = waitForMessage(activity, timeout);
+	if (result <= 0) {
+		return result;
+	}
+
+	return receiveMessage2(activity, senderDescriptor, buffer, length);
+}
+
+int waitForEventInPlace(Activity *activity, MessageHeader *header, void **content, unsigned int timeout) {
+	memset(header, 0, sizeof(MessageHeader));
+
+	int result = waitForMessage(activity, timeout);
+	if (result <= 0) {
+		return result;
+	}
+
+	return receiveMessageInPlace(activity, header, content);
+}
+
+#ifdef __XENO__
+#define mq_receive __real_mq_receive
+#endif
+
+/**
+ * Decodes a received message (header and content) in place.
+ * Returns the length of the message content or a negative error code.
+ */
+static int decodeMessage(Activity *receiver, Byte *buffer, ssize_t receiveLength, MessageHeader *header, void **content) {
+	// Decode message header
+	if (receiveLength < sizeof(MessageHeader)) {
+		logErr("[%s] Error receiving message: Malformed message!", receiver->descriptor->name);
+
+		return -EFAULT;
+	}
+	memcpy(header, buffer, sizeof(MessageHeader));
+	if (header->version != MESSAGE_HEADER_VERSION) {
+		logErr("[%s] Error receiving message: Unsupported message version %u!", receiver->descriptor->name, header->version);
+		memset(header, 0, sizeof(MessageHeader));
+
+		return -EFAULT;
+	}
+	if (sizeof(MessageHeader) + header->length > receiveLength) {
+		logErr("[%s] Error receiving message: Malformed message!", receiver->descriptor->name);
+		memset(header, 0, sizeof(MessageHeader));
+
+		return -EFAULT;
+	}
+
+	*content = buffer + sizeof(MessageHeader);
+
+	//logInfo("[%s] Message received from %s (message length: %u)...", receiver->descriptor->name, getActivityDescriptorById(header->senderId)->name, header->length);
+
+	return header->length;
+}
+
+/**
+ * Updates the receiver's queue statistics with a received message.
+ * Returns TRUE if the message has to be dropped (it has expired or is a stop message).
+ */
+static int accountReceivedMessage(Activity *receiver, MessageHeader *header) {
+	// (A stop message just wakes up the receiver)
+	if (header->flags & MESSAGE_FLAG_STOP) {
+		return TRUE;
+	}
+
+	DWord now = getMessageTime();
+
+	MessageQueueStatistics *statistics = &receiver->queueStatistics[header->priority < NUMBER_OF_MESSAGE_PRIORITIES ? header->priority : messagePriority_high];
+
+	if ((header->flags & MESSAGE_FLAG_DEADLINE) && (int)(now - header->deadline) > 0) {
+		statistics->numberOfExpiredMessages++;
+
+		return TRUE;
+	}
+
+	DWord waitTime = now - header->sendTime;
+	statistics->numberOfMessages++;
+	statistics->totalWaitTime += waitTime;
+	if (waitTime > statistics->maxWaitTime) {
+		statistics->maxWaitTime = waitTime;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Frees the content of the bulk message received last (it is only valid until the next receive).
+ */
+static void releaseBulkMessage(Activity *receiver) {
+	if (receiver->bulkTransfers) {
+		BulkTransfers *bulkTransfers = (BulkTransfers *)receiver->bulkTransfers;
+		free(bulkTransfers->completedMessage);
+		bulkTransfers->completedMessage = NULL;
+	}
+}
+
+/**
+ * Adds a received chunk to the bulk message it belongs to.
+ * If the chunk completes the bulk message, header and content are replaced by the bulk message's.
+ * Returns the length of the completed bulk message, 0 if more chunks are needed or a negative error code.
+ */
+static int reassembleBulkMessage(Activity *receiver, MessageHeader *header, void **content) {
+	if (header->length < sizeof(ChunkHeader)) {
+		logErr("[%s] Error receiving bulk message: Malformed chunk!", receiver->descriptor->name);
+
+		return -EFAULT;
+	}
+	ChunkHeader chunkHeader;
+	memcpy(&chunkHeader, *content, sizeof(ChunkHeader));
+	Byte *data = (Byte *)*content + sizeof(ChunkHeader);
+	DWord dataLength = header->length - sizeof(ChunkHeader);
+
+	// Allocate the reassembly state once
+	if (!receiver->bulkTransfers) {
+		receiver->bulkTransfers = malloc(sizeof(BulkTransfers));
+		if (!receiver->bulkTransfers) {
+			logErr("[%s] Error receiving bulk message: Out of memory!", receiver->descriptor->name);
+
+			return -EFAULT;
+		}
+		memset(receiver->bulkTransfers, 0, sizeof(BulkTransfers));
+	}
+	BulkTransfers *bulkTransfers = (BulkTransfers *)receiver->bulkTransfers;
+
+	// Look up the transfer (a sender's chunks arrive in order, so a new transfer replaces an unfinished one)
+	BulkTransfer *transfer = NULL;
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_BULK_TRANSFERS; i++) {
+		BulkTransfer *candidate = &bulkTransfers->transfers[i];
+		if (candidate->buffer && candidate->senderId == header->senderId) {
+			transfer = candidate;
+
+			break;
+		}
+		if (!candidate->buffer && !transfer) {
+			transfer = candidate;
+		}
+	}
+	if (transfer && transfer->buffer && transfer->transferId != chunkHeader.transferId) {
+		logWarn("[%s] Unfinished bulk message from %s dropped!", receiver->descriptor->name, getActivityDescriptorById(header->senderId)->name);
+		free(transfer->buffer);
+		transfer->buffer = NULL;
+	}
+	if (!transfer) {
+		logErr("[%s] Error receiving bulk message from %s: Too many bulk messages at once!", receiver->descriptor->name, getActivityDescriptorById(header->senderId)->name);
+
+		return -EFAULT;
+	}
+
+	if (!transfer->buffer) {
+		if (chunkHeader.offset != 0 || chunkHeader.totalLength > MAX_BULK_MESSAGE_LENGTH) {
+			// (The first chunks have been lost, e.g. because they have expired)
+			logWarn("[%s] Incomplete bulk message from %s dropped!", receiver->descriptor->name, getActivityDescriptorById(header->senderId)->name);
+
+			return 0;
+		}
+
+		transfer->buffer = (Byte *)malloc(chunkHeader.totalLength);
+		if (!transfer->buffer) {
+			logErr("[%s] Error receiving bulk message: Out of memory!", receiver->descriptor->name);
+
+			return -EFAULT;
+		}
+		transfer->senderId = header->senderId;
+		transfer->transferId = chunkHeader.transferId;
+		transfer->totalLength = chunkHeader.totalLength;
+		transfer->receivedLength = 0;
+	}
+
+	if (chunkHeader.offset != transfer->receivedLength || transfer->receivedLength + dataLength > transfer->totalLength) {
+		logWarn("[%s] Incomplete bulk message from %s dropped!", receiver->descriptor->name, getActivityDescriptorById(header->senderId)->name);
+		free(transfer->buffer);
+		transfer->buffer = NULL;
+
+		return 0;
+	}
+
+	memcpy(transfer->buffer + transfer->receivedLength, data, dataLength);
+	transfer->receivedLength += dataLength;
+	if (transfer->receivedLength < transfer->totalLength) {
+		return 0;
+	}
+
+	// The bulk message is complete
+	free(bulkTransfers->completedMessage);
+	bulkTransfers->completedMessage = transfer->buffer;
+	transfer->buffer = NULL;
+
+	header->length = transfer->totalLength;
+	header->flags &= ~MESSAGE_FLAG_CHUNK;
+	*content = bulkTransfers->completedMessage;
+
+	return header->length;
+}
+
+/**
+ * Receives the next encoded message from the activity's mailbox or message queue.
+ * Returns the message length, 0 if there is no message (non-blocking only) or a negative error code.
+ */
+static ssize_t receiveSourceMessage(Activity *receiver, Byte *buffer, int isBlocking) {
+	ssize_t receiveLength;
+
+	if (receiver->mailbox) {
+		if (isBlocking) {
+			receiveLength = takeFromMailbox(receiver->mailbox, buffer, MAX_MESSAGE_LENGTH + 1);
+		} else {
+			receiveLength = tryTakeFromMailbox(receiver->mailbox, buffer, MAX_MESSAGE_LENGTH + 1);
+		}
+		if (receiveLength < 0) {
+			logErr("[%s] Error receiving message from mailbox: %s", receiver->descriptor->name, strerror(-receiveLength));
+
+			return -EFAULT;
+		}
+
+		return receiveLength;
+	}
+
+	if (!isBlocking && receiver->messageQueueMode == messageQueue_blocking) {
+		// Don't block on a blocking message queue if there is no pending message
+		struct mq_attr attributes;
+		if (mq_getattr(receiver->messageQueue, &attributes) < 0) {
+			logErr("[%s] Error receiving message: %s", receiver->descriptor->name, strerror(errno));
+
+			return -EFAULT;
+		}
+		if (attributes.mq_curmsgs == 0) {
+			return 0;
+		}
+	}
+
+	if ((receiveLength = mq_receive(receiver->messageQueue, (char *)buffer, MAX_MESSAGE_LENGTH + 1, NULL)) < 0) {
+		if (errno == EAGAIN) {
+			// No message available
+			return 0;
+		}
+
+		logErr("[%s] Error receiving message: %s", receiver->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	return receiveLength;
+}
+
+/**
+ * Receives the next encoded (deferred or incoming) message.
+ * Returns the message length, 0 if there is no message (non-blocking only) or a negative error code.
+ */
+static ssize_t receiveEncodedMessage(Activity *receiver, Byte *buffer, int isBlocking) {
+	if (hasDeferredMessages(receiver)) {
+		return takeDeferredMessage(receiver, buffer);
+	}
+
+	return receiveSourceMessage(receiver, buffer, isBlocking);
+}
+
+int receiveMessageInPlace(void *_receiver, MessageHeader *header, void **content) {
+	memset(header, 0, sizeof(MessageHeader));
+
+	if (!_receiver) {
+		logErr("["__FILE__"] null pointer at receiveMessageInPlace(_receiver, ...)!");
+
+		return -EFAULT;
+	}
+
+	Activity *receiver = (Activity *)_receiver;
+
+	//logInfo("[%s] Going to receive message...", receiver->descriptor->name);
+
+	releaseBulkMessage(receiver);
+
+	int isBlocking = receiver->messageQueueMode == messageQueue_blocking && !receiver->isStopRequested;
+	while (TRUE) {
+		// Don't block beyond the timeout of a pending request (or the other coroutines or the watched sources)
+		if (isBlocking && (hasRequestTimeout(receiver) || isInCoroutine(receiver) || hasWatchedSources(receiver))) {
+			int result = waitForMessage(receiver, UINT_MAX);
+			if (result <= 0) {
+				if (result < 0) {
+					return result;
+				}
+
+				continue;
+			}
+		}
+
+		ssize_t receiveLength = receiveEncodedMessage(receiver, receiver->receiveBuffer, isBlocking);
+		if (receiveLength <= 0) {
+			return receiveLength;
+		}
+
+		int result = decodeMessage(receiver, receiver->receiveBuffer, receiveLength, header, content);
+		if (result < 0) {
+			return result;
+		}
+		if (!accountReceivedMessage(receiver, header)) {
+			if (header->flags & MESSAGE_FLAG_CHUNK) {
+				result = reassembleBulkMessage(receiver, header, content);
+				if (result < 0) {
+					return result;
+				}
+			}
+			if (result > 0 && !dispatchResponse(receiver, header, *content)) {
+				return result;
+			}
+		}
+
+		// The message has expired (= is dropped), is an intermediate chunk of a bulk message
+		// or has been passed to a continuation:
+		// Take the next one (but don't wait for it)
+		memset(header, 0, sizeof(MessageHeader));
+		isBlocking = FALSE;
+	}
+}
+
+int receiveMessages(Activity *activity, ReceivedMessage *messages, unsigned int maxCount, unsigned int timeout) {
+	int result = waitForMessage(activity, timeout);
+	if (result <= 0) {
+		return result;
+	}
+
+	// Allocate batch buffer once (messages of a batch are received in place)
+	if (!activity->batchBuffer) {
+		activity->batchBuffer = (Byte *)malloc(MAX_MESSAGE_BATCH_SIZE * BATCH_SLOT_SIZE);
+		if (!activity->batchBuffer) {
+			logErr("[%s] Error receiving messages: Out of memory!", activity->descriptor->name);
+
+			return -EFAULT;
+		}
+	}
+
+	if (maxCount > MAX_MESSAGE_BATCH_SIZE) {
+		maxCount = MAX_MESSAGE_BATCH_SIZE;
+	}
+
+	releaseBulkMessage(activity);
+
+	// A (possibly blocking) message queue is drained by receiving only the messages which are already pending
+	unsigned int numberOfPendingMessages = UINT_MAX;
+	if (!activity->mailbox) {
+		struct mq_attr attributes;
+		if (mq_getattr(activity->messageQueue, &attributes) < 0) {
+			logErr("[%s] Error receiving messages: %s", activity->descriptor->name, strerror(errno));
+
+			return -EFAULT;
+		}
+		numberOfPendingMessages = attributes.mq_curmsgs;
+		if (hasDeferredMessages(activity)) {
+			numberOfPendingMessages += ((DeferredMessages *)activity->deferredMessages)->count;
+		}
+	}
+
+	unsigned int numberOfMessages = 0;
+	while (numberOfMessages < maxCount && numberOfPendingMessages-- > 0) {
+		Byte *buffer = activity->batchBuffer + numberOfMessages * BATCH_SLOT_SIZE;
+
+		// (Receiving from the message queue won't block, the message is already pending)
+		ssize_t receiveLength = receiveEncodedMessage(activity, buffer, !activity->mailbox);
+		if (receiveLength <= 0) {
+			if (receiveLength < 0) {
+				result = -EFAULT;
+			}
+
+			break;
+		}
+
+		if (decodeMessage(activity, buffer, receiveLength, &messages[numberOfMessages].header, &messages[numberOfMessages].content) < 0) {
+			result = -EFAULT;
+
+			break;
+		}
+
+		// Drop expired messages, intermediate chunks of bulk messages
+		// and responses passed to a continuation (their buffer is reused)
+		MessageHeader *header = &messages[numberOfMessages].header;
+		if (accountReceivedMessage(activity, header)) {
+			continue;
+		}
+		int isBulkMessage = FALSE;
+		if (header->flags & MESSAGE_FLAG_CHUNK) {
+			int length = reassembleBulkMessage(activity, header, &messages[numberOfMessages].content);
+			if (length <= 0) {
+				if (length < 0) {
+					result = -EFAULT;
+
+					break;
+				}
+
+				continue;
+			}
+			isBulkMessage = TRUE;
+		}
+		if (!dispatchResponse(activity, header, messages[numberOfMessages].content)) {
+			numberOfMessages++;
+		}
+
+		// (The content of a bulk message is only valid until the next bulk message is completed)
+		if (isBulkMessage) {
+			break;
+		}
+	}
+
+	// Don't lose the messages received before an error
+	if (numberOfMessages == 0 && result < 0) {
+		return result;
+	}
+
+	return numberOfMessages;
+}
+
+int receiveMessage2(void *_receiver, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length) {
+	MessageHeader header;
+	void *content;
+
+	int result = receiveMessageInPlace(_receiver, &header, &content);
+	if (result <= 0) {
+		return result;
+	}
+
+	// Check length of the receive message
+	if (header.length > length) {
+		logErr("[%s] Error receiving message: Message longer than expected!", ((Activity *)_receiver)->descriptor->name);
+
+		return -EFAULT;
+	}
+
+	// Copy message
+	memcpy(buffer, content, header.length);
+
+	if (senderDescriptor) {
+		// Copy sender descriptor
+		memcpy(senderDescriptor, getActivityDescriptorById(header.senderId), sizeof(ActivityDescriptor));
+	}
+
+	return result;
+}
+
+/**
+ * Posts an encoded message (or a reference to a shared message if sharedMessage is not NULL)
+ * to the mailbox of the given receiver.
+ * If the mailbox is full, waits until the receiver makes room (like a blocking mq_send())
+ * or returns -EAGAIN (if isBlocking is FALSE).
+ */
+static int postMessage(char *senderName, ActivityDescriptor *receiverDescriptor, MessagePriority priority, char *message, unsigned long length, SharedMessage *sharedMessage, int isBlocking) {
+	DWord blockedSince = 0;
+
+	unsigned int attempt;
+	for (attempt = 0; TRUE; attempt++) {
+		// Look up the mailbox again on each attempt, the receiver may have been destroyed meanwhile
+		Mailbox *mailbox = getSendMailbox(receiverDescriptor);
+		if (!mailbox) {
+			logWarn("[%s] %s is not running?!", senderName, receiverDescriptor->name);
+
+			return -EFAULT;
+		}
+
+		int result = sharedMessage
+				? postSharedToMailbox(mailbox, priority, sharedMessage, FALSE)
+				: postToMailbox(mailbox, priority, message, length, FALSE);
+		if (result == 0) {
+			if (attempt > 0) {
+				accountBlockedSend(receiverDescriptor, getMessageTime() - blockedSince);
+			}
+			accountQueueLength(receiverDescriptor, getMailboxLaneLength(mailbox, priority));
+
+			return 0;
+		}
+		if (result != -EAGAIN) {
+			logErr("[%s] Error sending message: %s", senderName, strerror(-result));
+
+			return -EFAULT;
+		}
+
+		// The mailbox is full
+		if (!isBlocking) {
+			accountDroppedMessage(receiverDescriptor);
+
+			return -EAGAIN;
+		}
+		if (attempt == 0) {
+			blockedSince = getMessageTime();
+		}
+
+		// Give the receiver a chance to catch up, back off if it does not
+		if (attempt < MAILBOX_FULL_YIELD_ATTEMPTS) {
+			sched_yield();
+		} else {
+			usleep(1000);
+		}
+	}
+}
+
+/**
+ * Encodes a message (header and content) into the given send buffer.
+ * Returns the length of the encoded message or a negative error code.
+ */
+static int encodeMessage(Activity *sender, ActivityDescriptor *receiverDescriptor, DWord correlationId, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer, char *sendBuffer) {
+	unsigned long sendLength = sizeof(MessageHeader) + length;
+	if (sendLength > MAX_MESSAGE_LENGTH) {
+		logErr("[%s] Error sending message: Message too long!", sender ? sender->descriptor->name : "<Sender>");
+
+		return -EFAULT;
+	}
+
+	//logInfo("[%s] Sending message to %s (message length: %u)...", senderName, receiverDescriptor->name, length);
+
+	DWord now = getMessageTime();
+
+	// Encode message header
+	MessageHeader header = {
+		.version = MESSAGE_HEADER_VERSION,
+		// Typed messages start with their type (see MESSAGE_DEFINITION_BEGIN)
+		.type = length > 0 ? *(Byte *)buffer : 0,
+		// Activity ids are only valid within this process,
+		// so messages to external activities don't carry a sender id
+		.senderId = sender && receiverDescriptor->scope == activityScope_local ? sender->descriptor->id : NULL_ACTIVITY_ID,
+		.length = length,
+		.priority = priority,
+		.flags = timeToLive != NO_DEADLINE ? MESSAGE_FLAG_DEADLINE : 0,
+		.sequenceNumber = sender ? __sync_add_and_fetch(&sender->sequenceNumber, 1) : 0,
+		.correlationId = correlationId,
+		.sendTime = now,
+		.deadline = timeToLive != NO_DEADLINE ? now + timeToLive * 1000 : 0
+	};
+	memcpy(sendBuffer, &header, sizeof(MessageHeader));
+	// Copy message
+	memcpy(sendBuffer + sizeof(MessageHeader), buffer, length);
+
+	return sendLength;
+}
+
+/**
+ * Returns TRUE if messages to the given receiver are posted to its mailbox.
+ */
+static int isMailboxReceiver(ActivityDescriptor *receiverDescriptor) {
+	return receiverDescriptor->scope == activityScope_local && receiverDescriptor->transport == activityTransport_mailbox;
+}
+
+/**
+ * Sends an encoded message to the given receiver (over its mailbox or message queue).
+ * If the receiver's queue is full, waits until the receiver makes room
+ * or returns -EAGAIN (if isBlocking is FALSE).
+ */
+static int sendEncodedMessage(char *senderName, ActivityDescriptor *receiverDescriptor, char *sendBuffer, unsigned long sendLength, MessagePriority priority, int isBlocking) {
+	if (sendLength > getMaxEncodedMessageLength(receiverDescriptor)) {
+		logErr("[%s] Error sending message: Message too long for %s!", senderName, receiverDescriptor->name);
+
+		return -EFAULT;
+	}
+
+	if (isMailboxReceiver(receiverDescriptor)) {
+		return postMessage(senderName, receiverDescriptor, priority, sendBuffer, sendLength, NULL, isBlocking);
+	}
+
+	int result = 0;
+
+	int isReceiverQueueCached;
+	SendQueue *sendQueue = getSendQueue(receiverDescriptor, &isReceiverQueueCached);
+	if (!sendQueue) {
+		// If there is no corresponding message queue, the receiver is probably not running
+		if (errno == ENOENT) {
+			logWarn("[%s] %s is not running?!", senderName, receiverDescriptor->name);
+		} else {
+			logErr("[%s] Error opening message queue %s for sending: %s", senderName, receiverDescriptor->name, strerror(errno));
+		}
+
+		return -EFAULT;
+	}
+	mqd_t receiverQueue = sendQueue->queue;
+
+	// Try to send without waiting first (a timeout in the past makes mq_timedsend() fail immediately if the queue is full)
+	struct timespec expiredTimeout = {
+		.tv_sec = 0,
+		.tv_nsec = 0
+	};
+	if (mq_timedsend(receiverQueue, sendBuffer, sendLength, priority, &expiredTimeout) < 0) {
+		if (errno != ETIMEDOUT) {
+			logErr("[%s] Error sending message: %s", senderName, strerror(errno));
+
+			result = -EFAULT;
+		} else if (!isBlocking) {
+			accountDroppedMessage(receiverDescriptor);
+
+			result = -EAGAIN;
+		} else {
+			// The queue is full: Wait until the receiver makes room
+			DWord blockedSince = getMessageTime();
+			if (mq_send(receiverQueue, sendBuffer, sendLength, priority) < 0) {
+				logErr("[%s] Error sending message: %s", senderName, strerror(errno));
+
+				result = -EFAULT;
+			} else {
+				accountBlockedSend(receiverDescriptor, getMessageTime() - blockedSince);
+			}
+		}
+	}
+
+	// (Only the queues of local activities are monitored)
+	if (result == 0 && isReceiverQueueCached) {
+		struct mq_attr attributes;
+		if (mq_getattr(receiverQueue, &attributes) == 0) {
+			accountQueueLength(receiverDescriptor, attributes.mq_curmsgs);
+		}
+	}
+
+	releaseSendQueue(sendQueue);
+
+	return result;
+}
+
+int sendMessage2(void *_sender, ActivityDescriptor receiverDescriptor, unsigned long length, void *buffer, MessagePriority priority) {
+	return sendMessage3(_sender, receiverDescriptor, priority, NO_DEADLINE, length, buffer);
+}
+
+/**
+ * Limits a message priority to the supported priorities.
+ */
+static MessagePriority getValidMessagePriority(MessagePriority priority) {
+	return priority < NUMBER_OF_MESSAGE_PRIORITIES ? priority : messagePriority_high;
+}
+
+/**
+ * Sends a message (which possibly responds to a request).
+ * Sets *sequenceNumber (if not NULL) to the message's sequence number.
+ */
+static int sendCorrelatedMessage(Activity *sender, ActivityDescriptor *receiverDescriptor, DWord correlationId, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer, DWord *sequenceNumber, int isBlocking) {
+//	if (!_sender) {
+//		logErr("["__FILE__"] null pointer at senderMessage(_sender, ...)!");
+//
+//		return -EFAULT;
+//	}
+
+	if (strcmp(receiverDescriptor->name, "<Null activity>") == 0) {
+		return 0;
+	}
+
+	char *senderName = sender ? sender->descriptor->name : "<Sender>";
+
+	char sendBuffer[MAX_MESSAGE_LENGTH] __attribute__((aligned(sizeof(void *))));
+	priority = getValidMessagePriority(priority);
+	int sendLength = encodeMessage(sender, receiverDescriptor, correlationId, priority, timeToLive, length, buffer, sendBuffer);
+	if (sendLength < 0) {
+		return sendLength;
+	}
+
+	if (sequenceNumber) {
+		*sequenceNumber = ((MessageHeader *)sendBuffer)->sequenceNumber;
+	}
+
+	return sendEncodedMessage(senderName, receiverDescriptor, sendBuffer, sendLength, priority, isBlocking);
+}
+
+int sendMessage3(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer) {
+	return sendCorrelatedMessage((Activity *)_sender, &receiverDescriptor, 0, priority, timeToLive, length, buffer, NULL, TRUE);
+}
+
+int trySendMessage(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer) {
+	return sendCorrelatedMessage((Activity *)_sender, &receiverDescriptor, 0, priority, timeToLive, length, buffer, NULL, FALSE);
+}
+
+RequestToken sendRequest(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned long length, void *buffer) {
+	Activity *sender = (Activity *)_sender;
+
+	DWord sequenceNumber = 0;
+	if (sendCorrelatedMessage(sender, &receiverDescriptor, 0, priority, NO_DEADLINE, length, buffer, &sequenceNumber, TRUE) < 0
+			|| !sender || sequenceNumber == 0) {
+		return NULL_REQUEST_TOKEN;
+	}
+
+	trackRequest(sender, sequenceNumber);
+
+	return sequenceNumber;
+}
+
+int sendResponse(void *_sender, ActivityDescriptor receiverDescriptor, DWord correlationId, MessagePriority priority, unsigned long length, void *buffer) {
+	return sendCorrelatedMessage((Activity *)_sender, &receiverDescriptor, correlationId, priority, NO_DEADLINE, length, buffer, NULL, TRUE);
+}
+
+int awaitResponse(Activity *activity, RequestToken token, MessageHeader *header, void **content, unsigned int timeout) {
+	memset(header, 0, sizeof(MessageHeader));
+
+	if (!findPendingRequest(activity, token)) {
+		logErr("[%s] Error awaiting response: Unknown request!", activity->descriptor->name);
+
+		return -EFAULT;
+	}
+
+	// Allocate the buffers for deferred messages once
+	if (!activity->deferredMessages) {
+		activity->deferredMessages = malloc(sizeof(DeferredMessages));
+		if (!activity->deferredMessages) {
+			logErr("[%s] Error awaiting response: Out of memory!", activity->descriptor->name);
+
+			return -EFAULT;
+		}
+		memset(activity->deferredMessages, 0, sizeof(DeferredMessages));
+	}
+
+	DWord deadline = getMessageTime() + timeout * 1000;
+	while (TRUE) {
+		int remainingTime = (int)(deadline - getMessageTime());
+		if (remainingTime <= 0) {
+			break;
+		}
+
+		int result = waitForSourceMessage(activity, getRequestTimeout(activity, (remainingTime + 999) / 1000));
+		expirePendingRequests(activity);
+		if (result <= 0) {
+			if (result < 0) {
+				return result;
+			}
+
+			continue;
+		}
+
+		ssize_t receiveLength = receiveSourceMessage(activity, activity->receiveBuffer, FALSE);
+		if (receiveLength <= 0) {
+			if (receiveLength < 0) {
+				return receiveLength;
+			}
+
+			continue;
+		}
+
+		int length = decodeMessage(activity, activity->receiveBuffer, receiveLength, header, content);
+		if (length < 0) {
+			return length;
+		}
+
+		// (Only the messages delivered here are accounted, deferred messages are accounted when they are received again)
+		if (header->correlationId == token) {
+			if (accountReceivedMessage(activity, header)) {
+				continue;
+			}
+
+			PendingRequest *request = findPendingRequest(activity, token);
+			if (request) {
+				completeRequest(activity, request);
+			}
+
+			return length;
+		}
+
+		PendingRequest *request = findPendingRequest(activity, header->correlationId);
+		if (request && request->handler) {
+			if (!accountReceivedMessage(activity, header)) {
+				dispatchResponse(activity, header, *content);
+			}
+
+			continue;
+		}
+
+		// Receive any other message later
+		if (deferMessage(activity, activity->receiveBuffer, receiveLength) < 0) {
+			logErr("[%s] Too many messages while awaiting response, message from %s dropped!", activity->descriptor->name, getActivityDescriptorById(header->senderId)->name);
+		}
+	}
+
+	// Timeout
+	PendingRequest *request = findPendingRequest(activity, token);
+	if (request) {
+		request->token = NULL_REQUEST_TOKEN;
+		activity->requestStatistics.numberOfTimeouts++;
+	}
+	memset(header, 0, sizeof(MessageHeader));
+
+	return 0;
+}
+
+int onResponse(Activity *activity, RequestToken token, ResponseHandler handler, void *context, unsigned int timeout) {
+	PendingRequest *request = findPendingRequest(activity, token);
+	if (!request) {
+		logErr("[%s] Error registering continuation: Unknown request!", activity->descriptor->name);
+
+		return -EFAULT;
+	}
+
+	request->handler = handler;
+	request->context = context;
+	request->hasTimeout = timeout != NO_TIMEOUT;
+	request->deadline = getMessageTime() + timeout * 1000;
+
+	return 0;
+}
+
+/**
+ * Wakes up the receivers of all messages posted with a deferred wake up.
+ */
+static void wakeUpMailboxes(Mailbox **mailboxes, unsigned int *numberOfPostedMessages, unsigned int *numberOfMailboxes) {
+	unsigned int i;
+	for (i = 0; i < *numberOfMailboxes; i++) {
+		wakeUpMailbox(mailboxes[i], numberOfPostedMessages[i]);
+	}
+	*numberOfMailboxes = 0;
+}
+
+int sendMessages(void *_sender, OutgoingMessage *messages, unsigned int numberOfMessages) {
+	if (numberOfMessages == 0) {
+		return 0;
+	}
+
+	Activity *sender = (Activity *)_sender;
+	char *senderName = sender ? sender->descriptor->name : "<Sender>";
+
+	// Mailbox receivers are woken up once after all messages have been posted
+	Mailbox *mailboxes[numberOfMessages];
+	unsigned int numberOfPostedMessages[numberOfMessages];
+	unsigned int numberOfMailboxes = 0;
+
+	int result = 0;
+
+	unsigned int i;
+	for (i = 0; i < numberOfMessages; i++) {
+		OutgoingMessage *message = &messages[i];
+
+		if (strcmp(message->receiver.name, "<Null activity>") == 0) {
+			continue;
+		}
+
+		char sendBuffer[MAX_MESSAGE_LENGTH] __attribute__((aligned(sizeof(void *))));
+		MessagePriority priority = getValidMessagePriority(message->priority);
+		int sendLength = encodeMessage(sender, &message->receiver, 0, priority, message->timeToLive, message->length, message->content, sendBuffer);
+		if (sendLength < 0) {
+			result = -EFAULT;
+
+			continue;
+		}
+
+		if (isMailboxReceiver(&message->receiver) && sendLength <= getMaxEncodedMessageLength(&message->receiver)) {
+			Mailbox *mailbox = getSendMailbox(&message->receiver);
+			if (mailbox && postToMailbox(mailbox, priority, sendBuffer, sendLength, TRUE) == 0) {
+				accountQueueLength(&message->receiver, getMailboxLaneLength(mailbox, priority));
+
+				unsigned int j;
+				for (j = 0; j < numberOfMailboxes && mailboxes[j] != mailbox; j++);
+				if (j == numberOfMailboxes) {
+					mailboxes[numberOfMailboxes] = mailbox;
+					numberOfPostedMessages[numberOfMailboxes++] = 0;
+				}
+				numberOfPostedMessages[j]++;
+
+				continue;
+			}
+
+			// The mailbox is full (or the receiver is not running):
+			// Let the receivers process the messages posted so far before waiting
+			wakeUpMailboxes(mailboxes, numberOfPostedMessages, &numberOfMailboxes);
 		}
+
+		if (sendEncodedMessage(senderName, &message->receiver, sendBuffer, sendLength, priority, TRUE) < 0) {
+			result = -EFAULT;
+		}
+	}
+
+	wakeUpMailboxes(mailboxes, numberOfPostedMessages, &numberOfMailboxes);
+
+	return result;
+}
+
+int subscribe(void *_subscriber, char *topic) {
+	Activity *subscriber = (Activity *)_subscriber;
+
+	// Critical section
+	pthread_mutex_lock(&topicRegistryLock);
+	int result = 0;
+	TopicRegistryEntry *entry = lookUpTopic(topic, TRUE);
+	if (!entry) {
+		logErr("[%s] Error subscribing to topic %s: Too many topics!", subscriber->descriptor->name, topic);
+
+		result = -EFAULT;
 	} else {
-		if (mq_send(receiverQueue, sendBuffer, sendLength, priority) < 0) {
-			logErr("[%s] Error sending message: %s", "<Sender>", strerror(errno));
+		// (Subscribing twice has no effect)
+		removeSubscriber(entry, subscriber->descriptor->id);
+		if (entry->numberOfSubscribers >= MAX_NUMBER_OF_TOPIC_SUBSCRIBERS) {
+			logErr("[%s] Error subscribing to topic %s: Too many subscribers!", subscriber->descriptor->name, topic);
 
 			result = -EFAULT;
+		} else {
+			entry->subscriberIds[entry->numberOfSubscribers++] = subscriber->descriptor->id;
+		}
+	}
+	pthread_mutex_unlock(&topicRegistryLock);
+
+	return result;
+}
+
+int unsubscribe(void *_subscriber, char *topic) {
+	Activity *subscriber = (Activity *)_subscriber;
+
+	// Critical section
+	pthread_mutex_lock(&topicRegistryLock);
+	TopicRegistryEntry *entry = lookUpTopic(topic, FALSE);
+	if (entry) {
+		removeSubscriber(entry, subscriber->descriptor->id);
+	}
+	pthread_mutex_unlock(&topicRegistryLock);
+
+	return 0;
+}
+
+int publishMessage(void *_publisher, char *topic, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer) {
+	Activity *publisher = (Activity *)_publisher;
+	char *publisherName = publisher ? publisher->descriptor->name : "<Publisher>";
+
+	// Take a snapshot of the subscribers (a subscriber may unsubscribe while the message is delivered)
+	unsigned int subscriberIds[MAX_NUMBER_OF_TOPIC_SUBSCRIBERS];
+	unsigned int numberOfSubscribers = 0;
+	// Critical section
+	pthread_mutex_lock(&topicRegistryLock);
+	TopicRegistryEntry *entry = lookUpTopic(topic, FALSE);
+	if (entry) {
+		numberOfSubscribers = entry->numberOfSubscribers;
+		memcpy(subscriberIds, entry->subscriberIds, numberOfSubscribers * sizeof(unsigned int));
+	}
+	pthread_mutex_unlock(&topicRegistryLock);
+
+	if (numberOfSubscribers == 0) {
+		return 0;
+	}
+
+	// Encode the message once (directly into the shared message)
+	SharedMessage *sharedMessage = createSharedMessage(sizeof(MessageHeader) + length);
+	if (!sharedMessage) {
+		logErr("[%s] Error publishing message to topic %s: Out of memory!", publisherName, topic);
+
+		return -EFAULT;
+	}
+	priority = getValidMessagePriority(priority);
+	// (All subscribers are local activities)
+	int sendLength = encodeMessage(publisher, getActivityDescriptorById(subscriberIds[0]), 0, priority, timeToLive, length, buffer, (char *)sharedMessage->message);
+	if (sendLength < 0) {
+		releaseSharedMessage(sharedMessage);
+
+		return sendLength;
+	}
+
+	int result = 0;
+
+	unsigned int i;
+	for (i = 0; i < numberOfSubscribers; i++) {
+		ActivityDescriptor *subscriberDescriptor = getActivityDescriptorById(subscriberIds[i]);
+
+		if (isMailboxReceiver(subscriberDescriptor)) {
+			// The subscriber's mailbox slot references the shared message
+			retainSharedMessage(sharedMessage);
+			if (postMessage(publisherName, subscriberDescriptor, priority, NULL, 0, sharedMessage, TRUE) < 0) {
+				releaseSharedMessage(sharedMessage);
+
+				result = -EFAULT;
+			}
+		} else {
+			if (sendEncodedMessage(publisherName, subscriberDescriptor, (char *)sharedMessage->message, sendLength, priority, TRUE) < 0) {
+				result = -EFAULT;
+			}
+		}
+	}
+
+	releaseSharedMessage(sharedMessage);
+
+	return result;
+}
+
+int registerMessageHandler(Activity *activity, unsigned int senderId, unsigned int type, MessageHandler handler) {
+	if (senderId > ANY_SENDER || type > ANY_MESSAGE_TYPE) {
+		logErr("[%s] Error registering message handler: Invalid sender %u or message type %u!", activity->descriptor->name, senderId, type);
+
+		return -EFAULT;
+	}
+
+	// Allocate the dispatch table (and its rows) on first use
+	if (!activity->dispatcher) {
+		activity->dispatcher = malloc(sizeof(MessageDispatcher));
+		if (!activity->dispatcher) {
+			logErr("[%s] Error registering message handler: Out of memory!", activity->descriptor->name);
+
+			return -EFAULT;
+		}
+		memset(activity->dispatcher, 0, sizeof(MessageDispatcher));
+	}
+	MessageDispatcher *dispatcher = (MessageDispatcher *)activity->dispatcher;
+
+	if (!dispatcher->handlers[senderId]) {
+		dispatcher->handlers[senderId] = (MessageHandler *)malloc((ANY_MESSAGE_TYPE + 1) * sizeof(MessageHandler));
+		if (!dispatcher->handlers[senderId]) {
+			logErr("[%s] Error registering message handler: Out of memory!", activity->descriptor->name);
+
+			return -EFAULT;
+		}
+		memset(dispatcher->handlers[senderId], 0, (ANY_MESSAGE_TYPE + 1) * sizeof(MessageHandler));
+	}
+
+	dispatcher->handlers[senderId][type] = handler;
+
+	return 0;
+}
+
+int dispatchMessage(Activity *activity, MessageHeader *header, void *message) {
+	MessageDispatcher *dispatcher = (MessageDispatcher *)activity->dispatcher;
+
+	unsigned int senderId = header->senderId <= MAX_NUMBER_OF_ACTIVITIES ? header->senderId : NULL_ACTIVITY_ID;
+	MessageHandler handler = NULL;
+	if (dispatcher) {
+		MessageHandler *handlers = dispatcher->handlers[senderId] ? dispatcher->handlers[senderId] : dispatcher->handlers[ANY_SENDER];
+		if (handlers) {
+			handler = header->type < MAX_NUMBER_OF_MESSAGE_TYPES && handlers[header->type] ? handlers[header->type] : handlers[ANY_MESSAGE_TYPE];
+		}
+	}
+
+	if (!handler) {
+		logWarn("[%s] Unexpected message %u from %s received!", activity->descriptor->name, header->type, getActivityDescriptorById(header->senderId)->name);
+		if (dispatcher) {
+			dispatcher->numberOfUnhandledMessages[senderId]++;
+		}
+
+		return FALSE;
+	}
+
+	handler(activity, header, message);
+	dispatcher->numberOfHandledMessages++;
+
+	return TRUE;
+}
+
+int sendBulkMessage(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned long length, void *buffer) {
+	Activity *sender = (Activity *)_sender;
+
+	unsigned int maxEncodedMessageLength = getMaxEncodedMessageLength(&receiverDescriptor);
+	if (sizeof(MessageHeader) + length <= maxEncodedMessageLength) {
+		// (Short enough for a single message)
+		return sendMessage3(sender, receiverDescriptor, priority, NO_DEADLINE, length, buffer);
+	}
+
+	char *senderName = sender ? sender->descriptor->name : "<Sender>";
+
+	if (length > MAX_BULK_MESSAGE_LENGTH) {
+		logErr("[%s] Error sending bulk message: Message too long!", senderName);
+
+		return -EFAULT;
+	}
+
+	if (strcmp(receiverDescriptor.name, "<Null activity>") == 0) {
+		return 0;
+	}
+
+	priority = getValidMessagePriority(priority);
+	unsigned long maxChunkDataLength = maxEncodedMessageLength - sizeof(MessageHeader) - sizeof(ChunkHeader);
+	DWord transferId = 0;
+
+	unsigned long offset;
+	for (offset = 0; offset < length; offset += maxChunkDataLength) {
+		unsigned long chunkDataLength = length - offset < maxChunkDataLength ? length - offset : maxChunkDataLength;
+
+		Byte chunk[sizeof(ChunkHeader) + chunkDataLength];
+		ChunkHeader chunkHeader = {
+			.transferId = transferId,
+			.totalLength = length,
+			.offset = offset
+		};
+		memcpy(chunk, &chunkHeader, sizeof(ChunkHeader));
+		memcpy(chunk + sizeof(ChunkHeader), (Byte *)buffer + offset, chunkDataLength);
+
+		char sendBuffer[MAX_MESSAGE_LENGTH] __attribute__((aligned(sizeof(void *))));
+		int sendLength = encodeMessage(sender, &receiverDescriptor, 0, priority, NO_DEADLINE, sizeof(ChunkHeader) + chunkDataLength, chunk, sendBuffer);
+		if (sendLength < 0) {
+			return sendLength;
+		}
+
+		// Mark the chunk (it carries the type of the bulk message)
+		MessageHeader *header = (MessageHeader *)sendBuffer;
+		header->type = *(Byte *)buffer;
+		header->flags |= MESSAGE_FLAG_CHUNK;
+		// (The transfer is identified by the sequence number of its first chunk)
+		if (offset == 0) {
+			transferId = header->sequenceNumber;
+			((ChunkHeader *)(sendBuffer + sizeof(MessageHeader)))->transferId = transferId;
+		}
+
+		int result = sendEncodedMessage(senderName, &receiverDescriptor, sendBuffer, sendLength, priority, TRUE);
+		if (result < 0) {
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the number of messages pending in an activity's mailbox or message queue (including its deferred messages).
+ */
+static unsigned int getNumberOfPendingMessages(Activity *activity) {
+	unsigned int numberOfPendingMessages = 0;
+	if (hasDeferredMessages(activity)) {
+		numberOfPendingMessages += ((DeferredMessages *)activity->deferredMessages)->count;
+	}
+
+	if (activity->mailbox) {
+		unsigned int lane;
+		for (lane = 0; lane < NUMBER_OF_MAILBOX_LANES; lane++) {
+			numberOfPendingMessages += getMailboxLaneLength(activity->mailbox, lane);
+		}
+	} else {
+		struct mq_attr attributes;
+		if (mq_getattr(activity->messageQueue, &attributes) == 0) {
+			numberOfPendingMessages += attributes.mq_curmsgs;
+		}
+	}
+
+	return numberOfPendingMessages;
+}
+
+/**
+ * Wakes up an activity which may be waiting for messages by sending it a stop message.
+ */
+static void sendStopMessage(Activity *activity) {
+	char sendBuffer[MAX_MESSAGE_LENGTH] __attribute__((aligned(sizeof(void *))));
+	Byte noContent = 0;
+	int sendLength = encodeMessage(NULL, activity->descriptor, 0, messagePriority_high, NO_DEADLINE, 0, &noContent, sendBuffer);
+	if (sendLength < 0) {
+		return;
+	}
+	((MessageHeader *)sendBuffer)->flags |= MESSAGE_FLAG_STOP;
+
+	// (If the queue is full, the activity does not wait for messages anyway)
+	sendEncodedMessage(activity->descriptor->name, activity->descriptor, sendBuffer, sendLength, messagePriority_high, FALSE);
+}
+
+/**
+ * Waits for an activity's thread to terminate (after its 'tear down' handler has been run)
+ * or for the executor to have drained a reactor activity's queue.
+ * Returns 0 on success or -ETIMEDOUT if this has not happened within the timeout [ms].
+ */
+static int waitForTermination(Activity *activity, unsigned int timeout) {
+	// (sem_timedwait() uses the real-time clock)
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	int result;
+	while ((result = sem_timedwait(&activity->terminated, &deadline)) < 0 && errno == EINTR);
+	if (result < 0) {
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+/**
+ * Drops the termination signals left over by an earlier stop (e.g. posted after its wait has timed out).
+ */
+static void drainTerminationSignals(Activity *activity) {
+	while (sem_trywait(&activity->terminated) == 0);
+}
+
+int stopActivity(Activity *activity, unsigned int timeout) {
+	ActivityDescriptor *descriptor = activity->descriptor;
+	if (!activity->isStarted) {
+		return 0;
+	}
+	activity->isStarted = FALSE;
+
+	setRunningActivity(descriptor->id, NULL);
+
+	// Ask the activity to stop (after having drained its queue)
+	DWord stopTime = getMessageTime();
+	activity->stopDeadline = stopTime + timeout / 2 * 1000;
+	__sync_synchronize();
+	activity->isStopRequested = TRUE;
+	__sync_synchronize();
+
+	int result = 0;
+	if (descriptor->execution == activityExecution_reactor) {
+		drainTerminationSignals(activity);
+
+		// The executor keeps calling the activity's 'run' handler while there are pending messages
+		// (and signals as soon as they have been drained)
+		if (getNumberOfPendingMessages(activity) > 0) {
+			waitForTermination(activity, timeout / 2);
+		}
+
+		detachFromExecutor(activity);
+	} else {
+		sendStopMessage(activity);
+
+		result = waitForTermination(activity, timeout);
+		if (result < 0) {
+			logWarn("[%s] Has not stopped within %u ms, cancelling it!", descriptor->name, timeout);
 
-			goto sendMessage2_out;
+			pthread_cancel(activity->thread);
 		}
+		pthread_join(activity->thread, NULL);
+
+		if (result < 0) {
+			// (The coroutines have been dropped in the middle of a wait)
+			destroyCoroutines(activity);
+		}
+
+		unwatchAllSources(activity);
+	}
+
+	unsigned int numberOfPendingMessages = getNumberOfPendingMessages(activity);
+	if (numberOfPendingMessages > 0) {
+		logWarn("[%s] %u message(s) have not been drained within %u ms!", descriptor->name, numberOfPendingMessages, timeout / 2);
+	}
+
+	logInfo("[%s] Stopped within %u ms.", descriptor->name, (unsigned int)((getMessageTime() - stopTime) / 1000));
+
+	return result;
+}
+
+int restartActivity(Activity *activity) {
+	stopActivity(activity, DEFAULT_STOP_TIMEOUT);
+
+	logInfo("[%s] Restarting...", activity->descriptor->name);
+
+	// Continuations of the previous run must not be called
+	memset(activity->pendingRequests, 0, sizeof(activity->pendingRequests));
+
+	// (A late termination signal of the previous run would end the next stop early)
+	drainTerminationSignals(activity);
+
+	return startActivity(activity);
+}
+
+int isActivityRunning(void *_activity) {
+	Activity *activity = (Activity *)_activity;
+	if (!activity->isStopRequested) {
+		return TRUE;
 	}
 
-sendMessage2_out:
-	free(sendBuffer);
+	// Drain the queue (until the drain deadline)
+	return (int)(getMessageTime() - activity->stopDeadline) < 0 && getNumberOfPendingMessages(activity) > 0;
+}
+
+int isActivityReady(Activity *activity) {
+	return activity->isReady;
+}
+
+unsigned int getActivityReadinessCount(void) {
+	// Critical section
+	pthread_mutex_lock(&activityReadinessLock);
+	unsigned int readinessCount = activityReadinessCount;
+	pthread_mutex_unlock(&activityReadinessLock);
+
+	return readinessCount;
+}
+
+int waitForActivityReadiness(unsigned int readinessCount, unsigned int timeout) {
+	// (pthread_cond_timedwait() uses the real-time clock)
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
 
-	mq_close(receiverQueue);
+	int result = 0;
+	// Critical section
+	pthread_mutex_lock(&activityReadinessLock);
+	while (activityReadinessCount == readinessCount && result == 0) {
+		if (pthread_cond_timedwait(&activityReadinessChanged, &activityReadinessLock, &deadline) == ETIMEDOUT) {
+			result = -ETIMEDOUT;
+		}
+	}
+	pthread_mutex_unlock(&activityReadinessLock);
 
 	return result;
 }
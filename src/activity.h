@@ -11,24 +11,77 @@
 #ifndef ACTIVITY_H_
 #define ACTIVITY_H_
 
+#include <stddef.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <mqueue.h>
+#include "mailbox.h"
 
 #define MAX_ACTIVITY_NAME_LENGTH 32
 
+#define MAX_NUMBER_OF_ACTIVITIES 32
+
 #define MAX_MESSAGE_LENGTH 400
 
+#define MAILBOX_CAPACITY 16
+
+#define MESSAGE_QUEUE_CAPACITY 10
+
+#define MAX_MESSAGE_BATCH_SIZE 16
+
+#define MESSAGE_HEADER_VERSION 3
+
+#define MESSAGE_FLAG_DEADLINE 0x01
+
+#define MESSAGE_FLAG_CHUNK 0x02
+
+#define MESSAGE_FLAG_STOP 0x04
+
+#define MAX_BULK_MESSAGE_LENGTH 65535
+
+#define MAX_NUMBER_OF_BULK_TRANSFERS 4
+
+#define NO_DEADLINE 0
+
+#define NUMBER_OF_MESSAGE_PRIORITIES 3
+
+#define MAX_NUMBER_OF_PENDING_REQUESTS 16
+
+#define MAX_NUMBER_OF_DEFERRED_MESSAGES MAILBOX_CAPACITY
+
+#define NULL_REQUEST_TOKEN 0
+
+#define NO_TIMEOUT 0
+
+#define MAX_NUMBER_OF_WATCHED_SOURCES 8
+
+// (An activity drains its queue during the first half of the timeout, the second half is left for its tear down)
+#define DEFAULT_STOP_TIMEOUT 1000
+
+#define NO_STACK_GUARD ((unsigned long)-1)
+
+// (The measured peak stack use of the activities is below 16 KiB, see logMemoryFootprint())
+#define SMALL_ACTIVITY_STACK_SIZE (64 * 1024)
+
+#define NULL_ACTIVITY_ID 0
+
+#define MAX_NUMBER_OF_TOPICS 16
+
+#define MAX_NUMBER_OF_TOPIC_SUBSCRIBERS 8
+
+#define MAX_TOPIC_NAME_LENGTH 32
+
+#define MAX_NUMBER_OF_MESSAGE_TYPES 32
+
+#define ANY_SENDER (MAX_NUMBER_OF_ACTIVITIES + 1)
+
+#define ANY_MESSAGE_TYPE MAX_NUMBER_OF_MESSAGE_TYPES
+
 typedef unsigned char Byte;
 typedef unsigned short Word;
 typedef unsigned int DWord;
 
-// Old message type
-typedef struct {
-	int intValue;
-	char stringValue[128];
-} SimpleMessage;
-
 #define COMMON_MESSAGE_CONTENT_DEFINITION_BEGIN MESSAGE_CONTENT_DEFINITION_BEGIN
 
 #define COMMON_MESSAGE_CONTENT_DEFINITION_END(name) MESSAGE_CONTENT_DEFINITION_END(Common, name)
@@ -36,9 +89,11 @@ typedef struct {
 #define MESSAGE_CONTENT_DEFINITION_BEGIN \
 	typedef struct {
 
+// (Fails to compile ('size of array is negative') if the content does not fit into a message)
 #define MESSAGE_CONTENT_DEFINITION_END(subsystem, name) \
 	} subsystem##name##Content; \
-	extern const Byte subsystem##name##Type;
+	extern const Byte subsystem##name##Type; \
+	typedef char subsystem##name##LengthCheck[sizeof(subsystem##name##Content) <= MAX_MESSAGE_CONTENT_LENGTH ? 1 : -1];
 
 #define COMMON_MESSAGE_CONTENT_REDEFINITION(subsystem, name) \
 	typedef Common##name##Content subsystem##name##Content; \
@@ -59,84 +114,194 @@ typedef struct {
 		} content; \
 	} name##Message;
 
-// Old messaging API
-#define receiveSimpleMessage_BEGIN(activity) \
-	{ \
-	ActivityDescriptor senderDescriptor; \
-	SimpleMessage message; \
-	int result = receiveMessage2(activity, &senderDescriptor, &message, sizeof(message));
+// (Only the type and the actual content of a typed message are sent, not the whole union)
+#define MESSAGE_LENGTH(subsystem, _content) \
+	(offsetof(subsystem##Message, content) + sizeof(subsystem##_content##Content))
 
 // New messaging API
+// (Messages are received in place: 'message' and 'senderDescriptor' point into the activity's receive buffer
+// and are valid until the end of the receive block)
 #define receiveGenericMessage_BEGIN(activity) \
 	{ \
-		ActivityDescriptor senderDescriptor; \
-		Byte message[MAX_MESSAGE_LENGTH]; \
-		int result = receiveMessage2(activity, &senderDescriptor, &message, MAX_MESSAGE_LENGTH); \
-		int __attribute__((__unused__)) error = result < 0 ? -result : 0;
+		MessageHeader header; \
+		Byte *message; \
+		int result = receiveMessageInPlace(activity, &header, (void **)&message); \
+		int __attribute__((__unused__)) error = result < 0 ? -result : 0; \
+		ActivityDescriptor __attribute__((__unused__)) *senderDescriptor = getActivityDescriptorById(header.senderId);
 
 #define receiveGenericMessage_END receiveMessage_END
 
 #define receiveMessage_BEGIN(activity, receiver) \
 	{ \
-		ActivityDescriptor senderDescriptor; \
-		receiver##Message message; \
-		int result = receiveMessage2(activity, &senderDescriptor, &message, sizeof(message)); \
-		int __attribute__((__unused__)) error = result < 0 ? -result : 0;
+		MessageHeader header; \
+		receiver##Message *message; \
+		int result = receiveMessageInPlace(activity, &header, (void **)&message); \
+		int __attribute__((__unused__)) error = result < 0 ? -result : 0; \
+		ActivityDescriptor __attribute__((__unused__)) *senderDescriptor = getActivityDescriptorById(header.senderId);
 
 #define receiveMessage_END \
 	}
 
 #define waitForEvent_BEGIN(activity, receiver, timeout) \
 	{ \
-		ActivityDescriptor senderDescriptor; \
-		receiver##Message message; \
-		int result = waitForEvent2(activity, &senderDescriptor, &message, sizeof(message), timeout); \
-		int __attribute__((__unused__)) error = result < 0 ? -result : 0;
+		MessageHeader header; \
+		receiver##Message *message; \
+		int result = waitForEventInPlace(activity, &header, (void **)&message, timeout); \
+		int __attribute__((__unused__)) error = result < 0 ? -result : 0; \
+		ActivityDescriptor __attribute__((__unused__)) *senderDescriptor = getActivityDescriptorById(header.senderId);
 
 #define waitForEvent_END receiveMessage_END
 
-// Old messaging API
-#define sendSimpleMessage(sender, receiver, _intValue) \
-	sendMessage2(sender, receiver, &(SimpleMessage) { \
-		.intValue = _intValue \
-	});
+// Batched messaging API
+// (All messages pending after one wake up are received at once: 'result' is the number of received messages
+// and the messages are iterated with forEachReceivedMessage_BEGIN/_END)
+#define waitForEvents_BEGIN(activity, timeout) \
+	{ \
+		ReceivedMessage receivedMessages[MAX_MESSAGE_BATCH_SIZE]; \
+		int result = receiveMessages(activity, receivedMessages, MAX_MESSAGE_BATCH_SIZE, timeout); \
+		int __attribute__((__unused__)) error = result < 0 ? -result : 0;
+
+#define waitForEvents_END receiveMessage_END
+
+#define forEachReceivedMessage_BEGIN(receiver) \
+	{ \
+		int messageIndex; \
+		for (messageIndex = 0; messageIndex < result; messageIndex++) { \
+			MessageHeader __attribute__((__unused__)) header = receivedMessages[messageIndex].header; \
+			receiver##Message *message = (receiver##Message *)receivedMessages[messageIndex].content; \
+			ActivityDescriptor __attribute__((__unused__)) *senderDescriptor = getActivityDescriptorById(header.senderId);
+
+#define forEachReceivedMessage_END \
+		} \
+	}
 
 // New messaging API
+// (Pending messages with a higher priority are received first.
+// A notification's time to live [ms] limits how long it may be pending before it is dropped (NO_DEADLINE = never))
 #define sendRequest_BEGIN(sender, receiver, _content) \
-	sendMessage2(sender, get##receiver##Descriptor(), sizeof(receiver##Message), &(receiver##Message) { \
+	sendPrioritizedRequest_BEGIN(sender, receiver, _content, messagePriority_medium)
+
+#define sendRequest_END sendMessage_END
+
+// (Evaluates to the request's token, e.g. 'RequestToken token = sendRequest_BEGIN(...) ... sendRequest_END')
+#define sendPrioritizedRequest_BEGIN(sender, receiver, _content, priority) \
+	sendRequest(sender, get##receiver##Descriptor(), priority, MESSAGE_LENGTH(receiver, _content), &(receiver##Message) { \
 		.type = receiver##_content##Type, \
 		.content.receiver##_content = {
 
-#define sendRequest_END sendMessage_END
+#define sendPrioritizedRequest_END sendMessage_END
 
 #define sendNotification_BEGIN(sender, notifier, receiver, _content) \
-	sendMessage2(sender, receiver, sizeof(notifier##Message), &(notifier##Message) { \
+	sendPrioritizedNotification_BEGIN(sender, notifier, receiver, _content, messagePriority_medium, NO_DEADLINE)
+
+#define sendNotification_END sendMessage_END
+
+#define sendPrioritizedNotification_BEGIN(sender, notifier, receiver, _content, priority, timeToLive) \
+	sendMessage3(sender, receiver, priority, timeToLive, MESSAGE_LENGTH(notifier, _content), &(notifier##Message) { \
 		.type = notifier##_content##Type, \
 		.content.notifier##_content = {
 
-#define sendNotification_END sendMessage_END
+#define sendPrioritizedNotification_END sendMessage_END
+
+// (Fails instead of waiting if the receiver's queue is full, see trySendMessage())
+#define trySendNotification_BEGIN(sender, notifier, receiver, _content) \
+	trySendMessage(sender, receiver, messagePriority_medium, NO_DEADLINE, MESSAGE_LENGTH(notifier, _content), &(notifier##Message) { \
+		.type = notifier##_content##Type, \
+		.content.notifier##_content = {
+
+#define trySendNotification_END sendMessage_END
 
 #define sendResponse_BEGIN(sender, responder, _content) \
-	sendMessage2(sender, senderDescriptor, sizeof(responder##Message), &(responder##Message) { \
+	sendPrioritizedResponse_BEGIN(sender, responder, _content, messagePriority_medium)
+
+#define sendResponse_END sendMessage_END
+
+// (Responds to the request which is currently processed ('senderDescriptor' and 'header' of a receive block))
+#define sendPrioritizedResponse_BEGIN(sender, responder, _content, priority) \
+	sendResponse(sender, *senderDescriptor, header.sequenceNumber, priority, MESSAGE_LENGTH(responder, _content), &(responder##Message) { \
 		.type = responder##_content##Type, \
 		.content.responder##_content = {
 
-#define sendResponse_END sendMessage_END
+#define sendPrioritizedResponse_END sendMessage_END
+
+// (Responds to a request which has been received before (its sender and sequence number have been saved))
+#define sendDeferredResponse_BEGIN(sender, responder, requester, correlationId, _content) \
+	sendResponse(sender, requester, correlationId, messagePriority_medium, MESSAGE_LENGTH(responder, _content), &(responder##Message) { \
+		.type = responder##_content##Type, \
+		.content.responder##_content = {
+
+#define sendDeferredResponse_END sendMessage_END
 
 #define sendMessage_END \
 		} \
-	}, messagePriority_medium);
+	});
+
+// Publish/subscribe API
+// (A notification is encoded once and delivered to all activities which have subscribed to the topic)
+#define publishNotification_BEGIN(publisher, notifier, topic, _content) \
+	publishPrioritizedNotification_BEGIN(publisher, notifier, topic, _content, messagePriority_medium, NO_DEADLINE)
+
+#define publishNotification_END sendMessage_END
+
+#define publishPrioritizedNotification_BEGIN(publisher, notifier, topic, _content, priority, timeToLive) \
+	publishMessage(publisher, topic, priority, timeToLive, MESSAGE_LENGTH(notifier, _content), &(notifier##Message) { \
+		.type = notifier##_content##Type, \
+		.content.notifier##_content = {
+
+#define publishPrioritizedNotification_END sendMessage_END
+
+// Batched messaging API
+// (The messages between sendMessages_BEGIN and sendMessages_END are sent in one call)
+#define sendMessages_BEGIN(sender) \
+	{ \
+		void *batchSender = (sender); \
+		OutgoingMessage outgoingMessages[] = {
+
+#define sendMessages_END \
+		}; \
+		sendMessages(batchSender, outgoingMessages, sizeof(outgoingMessages) / sizeof(OutgoingMessage)); \
+	}
+
+#define outgoingMessage_BEGIN(receiverDescriptor, messageType) \
+	outgoingPrioritizedMessage_BEGIN(receiverDescriptor, messageType, messagePriority_medium, NO_DEADLINE)
+
+#define outgoingMessage_END \
+				} \
+			},
+
+#define outgoingPrioritizedMessage_BEGIN(receiverDescriptor, messageType, _priority, _timeToLive) \
+	outgoingSizedMessage_BEGIN(receiverDescriptor, messageType, sizeof(messageType), _priority, _timeToLive)
+
+#define outgoingSizedMessage_BEGIN(receiverDescriptor, messageType, messageLength, _priority, _timeToLive) \
+			{ \
+				.receiver = receiverDescriptor, \
+				.priority = _priority, \
+				.timeToLive = _timeToLive, \
+				.length = messageLength, \
+				.content = &(messageType) {
+
+#define outgoingPrioritizedMessage_END outgoingMessage_END
+
+#define outgoingRequest_BEGIN(receiver, _content) \
+	outgoingPrioritizedRequest_BEGIN(receiver, _content, messagePriority_medium)
+
+#define outgoingRequest_END \
+		} \
+	outgoingMessage_END
+
+#define outgoingPrioritizedRequest_BEGIN(receiver, _content, priority) \
+	outgoingSizedMessage_BEGIN(get##receiver##Descriptor(), receiver##Message, MESSAGE_LENGTH(receiver, _content), priority, NO_DEADLINE) \
+		.type = receiver##_content##Type, \
+		.content.receiver##_content = {
+
+#define outgoingPrioritizedRequest_END outgoingRequest_END
 
 #define MESSAGE_SELECTOR_BEGIN \
 	if (0) {
 
-// Old message selector (still used by coffee supply)
-#define MESSAGE_SELECTOR(message, activityName) \
-	} else if (strcmp(message.activity.name, #activityName) == 0) {
-
 #define MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, sender) \
-	} else if (strcmp(senderDescriptor.name, get##sender##Descriptor().name) == 0) { \
-		sender##Message *specificMessage = (sender##Message *)&message;
+	} else if ((senderDescriptor)->id == get##sender##Descriptor().id) { \
+		sender##Message *specificMessage = (sender##Message *)(message);
 
 #define MESSAGE_BY_TYPE_SELECTOR(message, subsystem, _content) \
 	} else if ((message).type == subsystem##_content##Type) { \
@@ -148,6 +313,28 @@ typedef struct {
 #define MESSAGE_SELECTOR_END \
 	}
 
+// Message dispatch API
+// (Handlers are registered per sender and message type (e.g. in setUp) and called by dispatchMessage())
+#define MESSAGE_HANDLER(activity, sender, subsystem, _content, handler) \
+	registerMessageHandler(activity, get##sender##Descriptor().id, subsystem##_content##Type, handler);
+
+#define ANY_SENDER_MESSAGE_HANDLER(activity, subsystem, _content, handler) \
+	registerMessageHandler(activity, ANY_SENDER, subsystem##_content##Type, handler);
+
+// (Defines a handler: 'content', 'header' and 'senderDescriptor' are available like in a message selector)
+// (Messages too short for the content are not passed to the handler's body)
+#define MESSAGE_HANDLER_BEGIN(handlerName, subsystem, _content) \
+	static void handlerName(void *activity, MessageHeader *header, void *message) { \
+		if (header->length < MESSAGE_LENGTH(subsystem, _content)) { \
+			logWarn("[%s] Truncated message %u from %s received!", ((Activity *)activity)->descriptor->name, header->type, getActivityDescriptorById(header->senderId)->name); \
+			return; \
+		} \
+		subsystem##_content##Content __attribute__((__unused__)) content = ((subsystem##Message *)message)->content.subsystem##_content; \
+		ActivityDescriptor __attribute__((__unused__)) *senderDescriptor = getActivityDescriptorById(header->senderId);
+
+#define MESSAGE_HANDLER_END \
+	}
+
 #define NULL_ACTIVITY \
 	{ \
 		.name = "<Null activity>" \
@@ -160,6 +347,33 @@ typedef enum {
 	activityScope_external = 1
 } ActivityScope;
 
+/**
+ * Defines how messages are delivered to a local activity.
+ */
+typedef enum {
+	activityTransport_mailbox = 0, /**< In-process mailbox (only reachable from within the same process). */
+	activityTransport_messageQueue = 1 /**< POSIX message queue (also reachable from other processes). */
+} ActivityTransport;
+
+/**
+ * Defines how a local activity is run.
+ */
+typedef enum {
+	activityExecution_thread = 0, /**< On a dedicated thread ('run' loops until the activity is destroyed). */
+	activityExecution_reactor = 1, /**< By the executor's shared worker threads ('run' is called whenever there are incoming messages and must not block). */
+	activityExecution_coroutine = 2 /**< On a dedicated thread as the first of the activity's coroutines (waiting for messages, sleepFor() and awaitDevice() yield to the other coroutines). */
+} ActivityExecution;
+
+/**
+ * Defines the scheduling policy of a local activity's thread.
+ */
+typedef enum {
+	activitySchedulingPolicy_inherited = 0, /**< The creating thread's policy and priority. */
+	activitySchedulingPolicy_other = 1, /**< Time sharing (SCHED_OTHER). */
+	activitySchedulingPolicy_fifo = 2, /**< Real-time, runs until it blocks or a higher priority thread preempts it (SCHED_FIFO). */
+	activitySchedulingPolicy_roundRobin = 3 /**< Real-time, time sliced among threads with the same priority (SCHED_RR). */
+} ActivitySchedulingPolicy;
+
 typedef struct {
 	unsigned int id;
 	char name[MAX_ACTIVITY_NAME_LENGTH];
@@ -167,6 +381,16 @@ typedef struct {
 	ActivityRun run;
 	ActivityRun tearDown;
 	ActivityScope scope;
+	ActivityTransport transport;
+	ActivityExecution execution;
+	unsigned int queueCapacity; /**< The maximum number of pending incoming messages (per priority for a mailbox, 0 = MAILBOX_CAPACITY or MESSAGE_QUEUE_CAPACITY). */
+	unsigned int maxMessageLength; /**< The maximum length of an incoming message's content (0 = as long as possible). */
+	ActivitySchedulingPolicy schedulingPolicy; /**< The scheduling policy of the activity's thread (thread execution only). */
+	unsigned int schedulingPriority; /**< The priority of the activity's thread (1 .. 99 for a real-time policy, ignored otherwise). */
+	unsigned long cpuAffinity; /**< The CPUs the activity's thread may run on (bit mask, 0 = any CPU). */
+	unsigned long stackSize; /**< The stack size of the activity's thread (or of each of its coroutines) [bytes] (0 = default). */
+	unsigned long stackGuardSize; /**< The size of the inaccessible area below the thread's stack [bytes] (0 = default, NO_STACK_GUARD = none). */
+	int isStackPrefaulted; /**< Are all pages of the thread's stack touched when it is started (so page faults cannot delay it later)? */
 } ActivityDescriptor;
 
 typedef enum {
@@ -174,34 +398,251 @@ typedef enum {
 	messageQueue_nonBlocking
 } MessageQueueMode;
 
+typedef enum {
+	messagePriority_low = 0,
+	messagePriority_medium,
+	messagePriority_high,
+} MessagePriority;
+
+/**
+ * Represents the header preceding the content of every message.
+ */
+typedef struct {
+	Byte version; /**< The header version (MESSAGE_HEADER_VERSION). */
+	Byte type; /**< The message type (first byte of the message content). */
+	Word senderId; /**< The sender's activity id (NULL_ACTIVITY_ID if unknown). */
+	Word length; /**< The length of the message content. */
+	Byte priority; /**< The message priority (MessagePriority). */
+	Byte flags; /**< The message flags (MESSAGE_FLAG_...). */
+	DWord sequenceNumber; /**< The sender's message sequence number. */
+	DWord correlationId; /**< The sequence number of the request this message responds to (0 if it is no response). */
+	DWord sendTime; /**< The time the message has been sent [us] (monotonic clock, wraps around). */
+	DWord deadline; /**< The time the message expires [us] (only if MESSAGE_FLAG_DEADLINE is set). */
+} MessageHeader;
+
+// (The type byte is followed by the content, aligned to at most a long long)
+#define MAX_MESSAGE_CONTENT_LENGTH (MAX_MESSAGE_LENGTH - sizeof(MessageHeader) - sizeof(long long))
+
+/**
+ * Identifies a sent request (= the request's sequence number).
+ */
+typedef DWord RequestToken;
+
+/**
+ * Defines the signature of a continuation which is called when the response to a request has been received.
+ * (header and content are NULL if no response has been received within the timeout)
+ */
+typedef void (*ResponseHandler)(void *activity, MessageHeader *header, void *content, void *context);
+
+/**
+ * Represents a request an activity awaits a response for.
+ */
+typedef struct {
+	RequestToken token; /**< The request's token (NULL_REQUEST_TOKEN if the entry is free). */
+	DWord sendTime; /**< The time the request has been sent [us]. */
+	DWord deadline; /**< The time the continuation times out [us] (only if there is a timeout). */
+	int hasTimeout; /**< Does the continuation time out? */
+	ResponseHandler handler; /**< The continuation (or NULL). */
+	void *context; /**< The continuation's context. */
+} PendingRequest;
+
+/**
+ * Represents the statistics of the requests an activity has sent.
+ */
+typedef struct {
+	DWord numberOfRequests; /**< The number of sent requests. */
+	DWord numberOfResponses; /**< The number of received responses. */
+	DWord numberOfTimeouts; /**< The number of requests which have timed out. */
+	unsigned long long totalRoundTripTime; /**< The total time between sending the requests and receiving their responses [us]. */
+	DWord maxRoundTripTime; /**< The longest time between sending a request and receiving its response [us]. */
+} RequestStatistics;
+
+/**
+ * Represents the statistics of the messages an activity has received with a certain priority.
+ */
+typedef struct {
+	DWord numberOfMessages; /**< The number of received messages. */
+	DWord numberOfExpiredMessages; /**< The number of messages dropped because their deadline had passed. */
+	unsigned long long totalWaitTime; /**< The total time the received messages have been pending [us]. */
+	DWord maxWaitTime; /**< The longest time a received message has been pending [us]. */
+} MessageQueueStatistics;
+
+/**
+ * Defines the signature of a message handler (message points to the whole message, starting with its type).
+ */
+typedef void (*MessageHandler)(void *activity, MessageHeader *header, void *message);
+
+/**
+ * Defines the signature of a handler for a watched file descriptor or timer (fd is the timer's file descriptor).
+ */
+typedef void (*EventSourceHandler)(void *activity, int fd);
+
+/**
+ * Represents the statistics of how close to its capacity an activity's incoming message queue (or mailbox) is run.
+ * They are collected by the senders.
+ */
+typedef struct {
+	DWord highWaterMark; /**< The largest number of pending messages seen after sending (per priority for a mailbox). */
+	DWord numberOfBlockedSends; /**< The number of (blocking) sends which have had to wait for room in the queue. */
+	unsigned long long totalBlockedTime; /**< The total time senders have waited for room in the queue [us]. */
+	DWord maxBlockedTime; /**< The longest time a sender has waited for room in the queue [us]. */
+	DWord numberOfDroppedMessages; /**< The number of (non-blocking) sends which have failed because the queue was full. */
+} BackpressureStatistics;
+
 typedef struct {
 	ActivityDescriptor *descriptor;
 	pthread_t thread;
 	mqd_t messageQueue;
+	Mailbox *mailbox;
 	MessageQueueMode messageQueueMode;
 	int polling;
+	Byte *receiveBuffer;
+	Byte *batchBuffer;
+	DWord sequenceNumber;
+	void *reactor;
+	MessageQueueStatistics queueStatistics[NUMBER_OF_MESSAGE_PRIORITIES];
+	PendingRequest pendingRequests[MAX_NUMBER_OF_PENDING_REQUESTS];
+	RequestStatistics requestStatistics;
+	void *deferredMessages;
+	void *dispatcher;
+	void *bulkTransfers;
+	void *coroutines;
+	void *watchedSources;
+	volatile int isStopRequested;
+	DWord stopDeadline;
+	int isStarted;
+	volatile int isReady;
+	DWord readyTime;
+	sem_t terminated;
+	Byte *stack;
+	unsigned long stackSize;
+	int isStackPainted;
 } Activity;
 
-typedef enum {
-	messagePriority_low = 0,
-	messagePriority_medium,
-	messagePriority_high,
-} MessagePriority;
+/**
+ * Represents a message received as part of a batch.
+ */
+typedef struct {
+	MessageHeader header; /**< The message header. */
+	void *content; /**< The message content (points into the activity's batch buffer). */
+} ReceivedMessage;
+
+/**
+ * Represents a message to be sent as part of a batch.
+ */
+typedef struct {
+	ActivityDescriptor receiver; /**< The receiver. */
+	MessagePriority priority; /**< The message priority. */
+	unsigned int timeToLive; /**< The time the message may be pending before it is dropped [ms] (NO_DEADLINE = never). */
+	unsigned long length; /**< The length of the message content. */
+	void *content; /**< The message content. */
+} OutgoingMessage;
 
 // Activity creation/destruction API
 Activity *createActivity(ActivityDescriptor descriptor, MessageQueueMode messageQueueMode);
+// (Stops the activity (see stopActivity()) and frees its queue and allocations)
 void destroyActivity(Activity *activity);
-
-// Old messaging API (still used by coffee supply)
-int waitForEvent(Activity *activity, char *buffer, unsigned long length, unsigned int timeout);
-int receiveMessage(void *_receiver, char *buffer, unsigned long length);
-int sendMessage(ActivityDescriptor activity, char *buffer, unsigned long length, MessagePriority priority);
+// (Asks the activity to stop: A stop message wakes it up, it receives the messages which are already pending
+// until the drain deadline (half the timeout [ms]) and its 'run' handler returns, then its 'tear down' handler is run.
+// A thread which has not terminated within the timeout is reported and cancelled.
+// Returns 0 on success, -ETIMEDOUT if the activity had to be cancelled or another negative error code)
+int stopActivity(Activity *activity, unsigned int timeout);
+// (Stops the activity (if it is running) and starts it again, reusing its queue (including the pending messages),
+// its buffers and its subscriptions)
+int restartActivity(Activity *activity);
+// (Returns FALSE as soon as the activity has been asked to stop and has drained its queue (or the drain deadline has passed):
+// The 'run' handler of an activity run on a thread loops while its activity is running)
+int isActivityRunning(void *activity);
+// (An activity is ready as soon as its 'set up' handler has returned (= it receives its messages from then on))
+int isActivityReady(Activity *activity);
+// (Counts how many times an activity has become ready so far (e.g. to wait for the dependencies of another activity))
+unsigned int getActivityReadinessCount(void);
+// (Waits until the readiness count differs from the given one. Returns 0 or -ETIMEDOUT if the timeout [ms] has elapsed)
+int waitForActivityReadiness(unsigned int readinessCount, unsigned int timeout);
+
+// Gets the file descriptor which becomes readable when there are incoming messages (e.g. for epoll)
+int getMessageEventSource(Activity *activity);
+// Logs how long the received messages have been pending (per priority), the round trip times of the sent requests
+// and how close to its capacity the activity's queue has been run
+void logMessageQueueStatistics(Activity *activity);
+// Logs the peak stack use of every running activity's thread and the resident memory of the process
+// (The stack use of a prefaulted stack is measured exactly, otherwise it is the number of stack pages touched so far)
+void logMemoryFootprint(void);
+
+// Event source API
+// (File descriptors and timers are watched by the same epoll instance as the activity's incoming messages:
+// Their handlers are called from within the activity's wait and receive calls (or by the executor for reactor activities),
+// so an activity waits on its devices, timers and messages with a single call.
+// Must be called by the activity itself (e.g. in its 'set up' handler). All sources are unwatched when the activity stops)
+// (The handler has to consume the event (e.g. read the device), otherwise it is called again)
+int watchFd(Activity *activity, int fd, unsigned int events, EventSourceHandler handler);
+// (Starts a periodic timer [ms], returns the timer's file descriptor (to unwatch it) or a negative error code)
+int scheduleTimer(Activity *activity, unsigned int milliseconds, EventSourceHandler handler);
+// (A timer is also closed)
+void unwatchFd(Activity *activity, int fd);
+
+// Activity registry API
+ActivityDescriptor internActivityDescriptor(ActivityDescriptor *descriptor);
+ActivityDescriptor *getActivityDescriptorById(unsigned int id);
 
 // New messaging API
 int waitForEvent2(Activity *activity, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length, unsigned int timeout);
 //int receiveMessage2(void *_receiver, char *senderName, char *buffer, unsigned long length);
 int receiveMessage2(void *_receiver, ActivityDescriptor *senderDescriptor, void *buffer, unsigned long length);
 int sendMessage2(void *_sender, ActivityDescriptor activity, unsigned long length, void *buffer, MessagePriority priority);
+// (Messages with a time to live [ms] are dropped by the receiver if they have been pending for longer)
+int sendMessage3(void *_sender, ActivityDescriptor activity, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer);
+// (Never waits for room in the receiver's queue: Returns -EAGAIN (and counts the message as dropped) if the queue is full)
+int trySendMessage(void *_sender, ActivityDescriptor activity, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer);
+
+// Zero-copy messaging API
+// (The message content is left in the activity's receive buffer and is valid until the next receive)
+int waitForEventInPlace(Activity *activity, MessageHeader *header, void **content, unsigned int timeout);
+int receiveMessageInPlace(void *_receiver, MessageHeader *header, void **content);
+
+// Bulk messaging API
+// (Sends a message longer than the receiver's maximum message length (up to MAX_BULK_MESSAGE_LENGTH) in chunks.
+// The receiver reassembles the chunks and receives the message like any other message;
+// the content is valid until the next receive (a completed bulk message ends a batch))
+int sendBulkMessage(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned long length, void *buffer);
+
+// Request/response API
+// (Every request is tracked until its response is received and its round trip time is measured.
+// A response is delivered by awaitResponse() or to the request's continuation (if any);
+// otherwise it is received like any other message)
+RequestToken sendRequest(void *_sender, ActivityDescriptor receiverDescriptor, MessagePriority priority, unsigned long length, void *buffer);
+int sendResponse(void *_sender, ActivityDescriptor receiverDescriptor, DWord correlationId, MessagePriority priority, unsigned long length, void *buffer);
+// (Waits for the response to the given request, other messages received meanwhile are deferred (not for reactor activities).
+// The response content is left in the activity's receive buffer.
+// Returns the response's length, 0 if the timeout has elapsed or a negative error code)
+int awaitResponse(Activity *activity, RequestToken token, MessageHeader *header, void **content, unsigned int timeout);
+// (Registers a continuation for the response to the given request. The continuation is called
+// from within the activity's next receive call after the response has arrived (or the timeout [ms] has elapsed))
+int onResponse(Activity *activity, RequestToken token, ResponseHandler handler, void *context, unsigned int timeout);
+
+// Batched messaging API
+// (Waits once for incoming messages and then receives all pending messages (at most maxCount) without blocking again.
+// The message contents are left in the activity's batch buffer and are valid until the next batch is received.
+// Returns the number of received messages, 0 if the timeout has elapsed or a negative error code)
+int receiveMessages(Activity *activity, ReceivedMessage *messages, unsigned int maxCount, unsigned int timeout);
+// (Sends all messages in one call; receivers using a mailbox are woken up only once per batch)
+int sendMessages(void *_sender, OutgoingMessage *messages, unsigned int numberOfMessages);
+
+// Publish/subscribe API
+// (Subscriptions are kept until unsubscribe() is called or the subscriber is destroyed.
+// A message published to a topic is encoded once: Subscribers using a mailbox share a single
+// reference counted copy, subscribers using a message queue get the same encoded message sent)
+int subscribe(void *_subscriber, char *topic);
+int unsubscribe(void *_subscriber, char *topic);
+int publishMessage(void *_publisher, char *topic, MessagePriority priority, unsigned int timeToLive, unsigned long length, void *buffer);
+
+// Message dispatch API
+// (A message is dispatched with one table lookup: To the handler for its sender and type,
+// else to the handler for its sender and ANY_MESSAGE_TYPE. Only messages from senders without any handler
+// are dispatched to the handlers for ANY_SENDER. Messages without a handler are counted and logged)
+int registerMessageHandler(Activity *activity, unsigned int senderId, unsigned int type, MessageHandler handler);
+// (Returns TRUE if the message has been passed to a handler)
+int dispatchMessage(Activity *activity, MessageHeader *header, void *message);
 
 COMMON_MESSAGE_CONTENT_DEFINITION_BEGIN
 COMMON_MESSAGE_CONTENT_DEFINITION_END(InitCommand)
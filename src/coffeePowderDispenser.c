@@ -16,7 +16,8 @@
 #include "coffeePowderDispenser.h"
 #include "coffeeSupply.h"
 #include "activity.h"
-#include "stateMachineEngine.h"
+#include "coroutine.h"
+#include "stateMachineDescription.h"
 
 #define POWER_MAX 99
 #define FLASH_MAX 255
@@ -37,7 +38,7 @@ static void setUpMotorController(void *activity);
 static void runMotorController(void *activity);
 static void tearDownMotorController(void *activity);
 
-static StateMachine coffeePowderDispenserStateMachine;
+static StateMachineInstance coffeePowderDispenserStateMachine;
 static int currentMotorPower = 0;
 
 static Activity *coffeePowderDispenser;
@@ -48,23 +49,45 @@ static ActivityDescriptor coffeePowderDispenserDescriptor = {
 	.name = "coffeePowderDispenser",
 	.setUp = setUpCoffeePowderDispenser,
 	.run = runCoffeePowderDispenser,
-	.tearDown = tearDownCoffeePowderDispenser
+	.tearDown = tearDownCoffeePowderDispenser,
+	.execution = activityExecution_coroutine,
+	// (Controls the grinder motor: must not be delayed by the user interface activities)
+	.schedulingPolicy = activitySchedulingPolicy_fifo,
+	.schedulingPriority = 50,
+	// (Prefaulted (as well as its coroutine stacks), so page faults cannot delay it)
+	.stackSize = SMALL_ACTIVITY_STACK_SIZE,
+	.isStackPrefaulted = TRUE
 };
 
 static ActivityDescriptor fillStateMonitorDescriptor = {
 	.name = "coffeeBeansFillStateMonitor",
 	.setUp = setUpFillStateMonitor,
 	.run = runFillStateMonitor,
-	.tearDown = tearDownFillStateMonitor
+	.tearDown = tearDownFillStateMonitor,
+	.execution = activityExecution_reactor
 };
 
 static ActivityDescriptor motorControllerDescriptor = {
 	.name = "motorController",
 	.setUp = setUpMotorController,
 	.run = runMotorController,
-	.tearDown = tearDownMotorController
+	.tearDown = tearDownMotorController,
+	.execution = activityExecution_reactor
 };
 
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, InitCommand, 1)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, OffCommand, 2)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, StartCommand, 3)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, StopCommand, 4)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, Result, 5)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeePowderDispenser, BeanStatus, 6)
+
+MESSAGE_CONTENT_TYPE_MAPPING(FillStateMonitor, InitCommand, 1)
+MESSAGE_CONTENT_TYPE_MAPPING(FillStateMonitor, BeanStatus, 2)
+
+MESSAGE_CONTENT_TYPE_MAPPING(MotorController, StartCommand, 1)
+MESSAGE_CONTENT_TYPE_MAPPING(MotorController, StopCommand, 2)
+
 static int setMotor(int power) {
 	if (power > POWER_MAX) {
 		power = 99;
@@ -124,17 +147,9 @@ static int checkBeans(void) {
 		//logInfo("[fillStateMonitor] Beans state changed to %d",hasBeansState);
 		lastHasBeansState = hasBeansState;
 
-		if (hasBeansState) {
-			sendMessage(getCoffeePowderDispenser(), (char *)&(FillStateMonitorMessage) {
-				.activity = getCoffeeBeansFillStateMonitor(),
-				.intValue = POWDER_DISPENSER_BEANS_AVAILABLE_NOTIFICATION,
-			}, sizeof(FillStateMonitorMessage), messagePriority_high);
-		} else {
-			sendMessage(getCoffeePowderDispenser(), (char *)&(FillStateMonitorMessage) {
-				.activity = getCoffeeBeansFillStateMonitor(),
-				.intValue = POWDER_DISPENSER_NO_BEANS_ERROR,
-			}, sizeof(FillStateMonitorMessage), messagePriority_high);
-		}
+		sendPrioritizedNotification_BEGIN(fillStateMonitor, FillStateMonitor, getCoffeePowderDispenserDescriptor(), BeanStatus, messagePriority_high, NO_DEADLINE)
+			.availability = hasBeansState ? available : notAvailable
+		sendPrioritizedNotification_END
 	}
 
 	return hasBeansState;
@@ -150,29 +165,37 @@ static int checkBeans(void) {
 // initializing:
 // idle: bereit;
 // supplying;
+/**
+ * The coffee powder dispenser states (and their state objects)
+ */
+#define COFFEE_POWDER_DISPENSER_STATES(STATE, _) \
+	STATE(_, coffeePowderDispenserState_switchedOff, coffeePowderDispenserSwitchedOffState) \
+	STATE(_, coffeePowderDispenserState_initializing, coffeePowderDispenserInitializingState) \
+	STATE(_, coffeePowderDispenserState_idle, coffeePowderDispenserIdleState) \
+	STATE(_, coffeePowderDispenserState_supplying, coffeePowderDispenserSupplyingState)
+
 /**
  * Represents a coffee powder dispenser state
  */
-typedef enum {
-	coffeePowderDispenserState_switchedOff,
-	coffeePowderDispenserState_initializing,
-	coffeePowderDispenserState_idle,
-	coffeePowderDispenserState_supplying
-} CoffeePowderDispenserState;
+DECLARE_STATE_MACHINE_ENUM(CoffeePowderDispenserState, COFFEE_POWDER_DISPENSER_STATES)
 
 /**
- * Represents a coffeePowderDispenser event
+ * The coffee powder dispenser events
  */
-typedef enum {
-	coffeePowderDispenserEvent_init,
-	coffeePowderDispenserEvent_switchOff,
-	coffeePowderDispenserEvent_initialized,
-	coffeePowderDispenserEvent_startSupplying,
-	coffeePowderDispenserEvent_supplyingFinished,
-	coffeePowderDispenserEvent_stop,
-	coffeePowderDispenserEvent_noBeans,
-	coffeePowderDispenserEvent_beansAvailable,
-} CoffeePowderDispenserEvent;
+#define COFFEE_POWDER_DISPENSER_EVENTS(EVENT, _) \
+	EVENT(_, coffeePowderDispenserEvent_init) \
+	EVENT(_, coffeePowderDispenserEvent_switchOff) \
+	EVENT(_, coffeePowderDispenserEvent_initialized) \
+	EVENT(_, coffeePowderDispenserEvent_startSupplying) \
+	EVENT(_, coffeePowderDispenserEvent_supplyingFinished) \
+	EVENT(_, coffeePowderDispenserEvent_stop) \
+	EVENT(_, coffeePowderDispenserEvent_noBeans) \
+	EVENT(_, coffeePowderDispenserEvent_beansAvailable)
+
+/**
+ * Represents a coffee powder dispenser event
+ */
+DECLARE_STATE_MACHINE_ENUM(CoffeePowderDispenserEvent, COFFEE_POWDER_DISPENSER_EVENTS)
 
 /*
  ***************************************************************************
@@ -180,11 +203,11 @@ typedef enum {
  ***************************************************************************
  */
 
-static void coffeePowderDispenserSwitchedOffStateEntryAction() {
+static void coffeePowderDispenserSwitchedOffStateEntryAction(void *context) {
 	//logInfo("[coffeePowderDispenser] Entered SwitchedOff State...");
 }
 
-static Event coffeePowderDispenserSwitchedOffStateDoAction() {
+static Event coffeePowderDispenserSwitchedOffStateDoAction(void *context) {
 	return NO_EVENT;
 }
 
@@ -200,31 +223,40 @@ static State coffeePowderDispenserSwitchedOffState = {
  ***************************************************************************
  */
 
-static void coffeePowderDispenserInitializingStateEntryAction() {
-	// notifiy motorController:
-	sendMessage(getMotorController(), (char *)&(MotorControllerMessage) {
-		.activity = getCoffeePowderDispenser(),
-		.intValue = MOTOR_STOP_COMMAND,
-		.strValue = "stop motor",
-	}, sizeof(MotorControllerMessage), messagePriority_medium);
-	// notifiy motorController:
-	sendMessage(getCoffeeBeansFillStateMonitor(), (char *)&(FillStateMonitorMessage) {
-		.activity = getCoffeePowderDispenser(),
-		.intValue = INIT_COMMAND,
-		.strValue = "Init",
-	}, sizeof(FillStateMonitorMessage), messagePriority_medium);
+// The initialization runs as a coroutine, so commands are still handled meanwhile
+static CoroutineId initializingCoroutine = NULL_COROUTINE_ID;
+
+static void initializeCoffeePowderDispenser(void *activity, void *argument) {
+	if (sleepFor(coffeePowderDispenser, 1000) < 0) {
+		// Interrupted
+		return;
+	}
+
+	initializingCoroutine = NULL_COROUTINE_ID;
+	processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_initialized);
 }
 
-static Event coffeePowderDispenserInitializingStateDoAction() {
-	sleep(1);
-	return coffeePowderDispenserEvent_initialized;
+static void coffeePowderDispenserInitializingStateEntryAction(void *context) {
+	// notifiy motorController:
+	sendRequest_BEGIN(coffeePowderDispenser, MotorController, StopCommand)
+	sendRequest_END
+	// notifiy fillStateMonitor:
+	sendRequest_BEGIN(coffeePowderDispenser, FillStateMonitor, InitCommand)
+	sendRequest_END
+
+	initializingCoroutine = startCoroutine(coffeePowderDispenser, initializeCoffeePowderDispenser, NULL);
 }
 
+static void coffeePowderDispenserInitializingStateExitAction(void *context) {
+	// Cancel a pending initialization (e.g. if switched off meanwhile)
+	interruptCoroutine(coffeePowderDispenser, initializingCoroutine);
+	initializingCoroutine = NULL_COROUTINE_ID;
+}
 
 static State coffeePowderDispenserInitializingState = {
 	.stateIndex = coffeePowderDispenserState_initializing,
 	.entryAction = coffeePowderDispenserInitializingStateEntryAction,
-	.doAction = coffeePowderDispenserInitializingStateDoAction
+	.exitAction = coffeePowderDispenserInitializingStateExitAction
 };
 
 
@@ -234,11 +266,11 @@ static State coffeePowderDispenserInitializingState = {
  ***************************************************************************
  */
 
-static void coffeePowderDispenserIdleStateEntryAction() {
+static void coffeePowderDispenserIdleStateEntryAction(void *context) {
 	//logInfo("[coffeePowderDispenser] Entered Idle State...");
 }
 
-static Event coffeePowderDispenserIdleStateDoAction() {
+static Event coffeePowderDispenserIdleStateDoAction(void *context) {
 
 	return NO_EVENT;
 }
@@ -258,20 +290,17 @@ static State coffeePowderDispenserIdleState = {
 static DispenseResult dispenseResult;
 static int dispenseError;
 
-static void coffeePowderDispenserSupplyingStateEntryAction() {
+static void coffeePowderDispenserSupplyingStateEntryAction(void *context) {
 	//logInfo("[coffeePowderDispenser] Entered Supplying State...");
 	dispenseResult = dispenseResult_nok;
 	dispenseError = NO_ERROR;
 
 	// notifiy motorController:
-	sendMessage(getMotorController(), (char *)&(MotorControllerMessage) {
-		.activity = getCoffeePowderDispenser(),
-		.intValue = MOTOR_START_COMMAND,
-		.strValue = "start motor",
-	}, sizeof(MotorControllerMessage), messagePriority_medium);
+	sendRequest_BEGIN(coffeePowderDispenser, MotorController, StartCommand)
+	sendRequest_END
 }
 
-static Event coffeePowderDispenserSupplyingStateDoAction() {
+static Event coffeePowderDispenserSupplyingStateDoAction(void *context) {
 	// enough Powder
 	if (hasEnoughPowder()) {
 		logInfo("[coffeePowderDispenser] Enough powder!");
@@ -284,26 +313,26 @@ static Event coffeePowderDispenserSupplyingStateDoAction() {
 	return NO_EVENT;
 }
 
-static void coffeePowderDispenserSupplyingStateExitAction() {
+static void coffeePowderDispenserSupplyingStateExitAction(void *context) {
 	// notifiy motorController:
-	sendMessage(getMotorController(), (char *)&(MotorControllerMessage) {
-		.activity = getCoffeePowderDispenser(),
-		.intValue = MOTOR_STOP_COMMAND,
-		.strValue = "stop motor",
-	}, sizeof(MotorControllerMessage), messagePriority_medium);
+	sendRequest_BEGIN(coffeePowderDispenser, MotorController, StopCommand)
+	sendRequest_END
 	// notifiy coffeeSupply:
-	sendMessage(getCoffeeSupplyDescriptor(), (char *)&(SimpleCoffeeSupplyMessage) {
-		.activity = getCoffeePowderDispenser(),
-		.intValue = dispenseResult == dispenseResult_ok ? OK_RESULT : NOK_RESULT,
-		.strValue = "grinding complete",
-	}, sizeof(SimpleCoffeeSupplyMessage), messagePriority_medium);
+	sendNotification_BEGIN(coffeePowderDispenser, CoffeePowderDispenser, getCoffeeSupplyDescriptor(), Result)
+		.code = dispenseResult == dispenseResult_ok ? OK_RESULT : NOK_RESULT,
+		.errorCode = dispenseError
+	sendNotification_END
 }
 
 static State coffeePowderDispenserSupplyingState = {
 	.stateIndex = coffeePowderDispenserState_supplying,
 	.entryAction = coffeePowderDispenserSupplyingStateEntryAction,
 	.doAction = coffeePowderDispenserSupplyingStateDoAction,
-	.exitAction = coffeePowderDispenserSupplyingStateExitAction
+	.exitAction = coffeePowderDispenserSupplyingStateExitAction,
+	// (The powder amount and the motor potentiometer are checked while supplying)
+	.wakeUp = {
+		.period = 100
+	}
 };
 
 /*
@@ -312,60 +341,44 @@ static State coffeePowderDispenserSupplyingState = {
  ***************************************************************************
  */
 
-static StateMachine coffeePowderDispenserStateMachine = {
+/**
+ * The coffee powder dispenser transitions (grouped by source state, sorted by event)
+ */
+#define COFFEE_POWDER_DISPENSER_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, coffeePowderDispenserState_switchedOff, coffeePowderDispenserEvent_init, coffeePowderDispenserInitializingState) \
+	TRANSITION(_, coffeePowderDispenserState_initializing, coffeePowderDispenserEvent_switchOff, coffeePowderDispenserSwitchedOffState) \
+	TRANSITION(_, coffeePowderDispenserState_initializing, coffeePowderDispenserEvent_initialized, coffeePowderDispenserIdleState) \
+	TRANSITION(_, coffeePowderDispenserState_idle, coffeePowderDispenserEvent_init, coffeePowderDispenserInitializingState) \
+	TRANSITION(_, coffeePowderDispenserState_idle, coffeePowderDispenserEvent_switchOff, coffeePowderDispenserSwitchedOffState) \
+	TRANSITION(_, coffeePowderDispenserState_idle, coffeePowderDispenserEvent_startSupplying, coffeePowderDispenserSupplyingState) \
+	TRANSITION(_, coffeePowderDispenserState_supplying, coffeePowderDispenserEvent_switchOff, coffeePowderDispenserSwitchedOffState) \
+	TRANSITION(_, coffeePowderDispenserState_supplying, coffeePowderDispenserEvent_supplyingFinished, coffeePowderDispenserIdleState) \
+	TRANSITION(_, coffeePowderDispenserState_supplying, coffeePowderDispenserEvent_stop, coffeePowderDispenserIdleState) \
+	TRANSITION(_, coffeePowderDispenserState_supplying, coffeePowderDispenserEvent_noBeans, coffeePowderDispenserIdleState)
+
+DEFINE_STATE_MACHINE_TABLES(coffeePowderDispenser, COFFEE_POWDER_DISPENSER_STATES, COFFEE_POWDER_DISPENSER_EVENTS, COFFEE_POWDER_DISPENSER_TRANSITIONS)
+
+static const StateMachineDefinition coffeePowderDispenserStateMachineDefinition = {
 	.name = "coffeePowderDispenser",
-	.numberOfEvents = 8,
 	.initialState = &coffeePowderDispenserSwitchedOffState,
-	.transitions = {
-		/* coffeePowderDispenserState_switchedOff: */
-			/* coffeePowderDispenserEvent_init: */ &coffeePowderDispenserInitializingState,
-			/* coffeePowderDispenserEvent_switchOff: */ NULL,
-			/* coffeePowderDispenserEvent_initialized: */ NULL,
-			/* coffeePowderDispenservent_startSupplying: */ NULL,
-			/* coffeePowderDispenserEvent_supplyingFinished: */ NULL,
-			/* coffeePowderDispenserEvent_stop: */ NULL,
-			/* coffeePowderDispenserEvent_noBeans: */ NULL,
-			/* coffeePowderDispenserEvent_beansAvailable: */ NULL,
-		/* coffeePowderDispenserState_initializing: */
-			/* coffeePowderDispenserEvent_init: */ NULL,
-			/* coffeePowderDispenserEvent_switchOff: */ &coffeePowderDispenserSwitchedOffState,
-			/* coffeePowderDispenserEvent_initialized: */ &coffeePowderDispenserIdleState,
-			/* coffeePowderDispenserEvent_startSupplying: */ NULL,
-			/* coffeePowderDispenserEvent_supplyingFinished: */ NULL,
-			/* coffeePowderDispenserEvent_stop: */ NULL,
-			/* coffeePowderDispenserEvent_noBeans: */ NULL,
-			/* coffeePowderDispenserEvent_beansAvailable: */ NULL,
-		/* coffeePowderDispenserState_idle: */
-			/* coffeePowderDispenserEvent_init: */ &coffeePowderDispenserInitializingState,
-			/* coffeePowderDispenserEvent_switchOff: */ &coffeePowderDispenserSwitchedOffState,
-			/* coffeePowderDispenserEvent_initialized: */ NULL,
-			/* coffeePowderDispenserEvent_startSupplying: */ &coffeePowderDispenserSupplyingState,
-			/* coffeePowderDispenserEvent_supplyingFinished: */ NULL,
-			/* coffeePowderDispenserEvent_stop: */ NULL,
-			/* coffeePowderDispenserEvent_noBeans: */ NULL,
-			/* coffeePowderDispenserEvent_beansAvailable: */ NULL,
-		/* coffeePowderDispenserState_supplying: */
-			/* coffeePowderDispenserEvent_init: */ NULL,
-			/* coffeePowderDispenserEvent_switchOff: */ &coffeePowderDispenserSwitchedOffState,
-			/* coffeePowderDispenserEvent_initialized: */ NULL,
-			/* coffeePowderDispenserEvent_startSupplying: */ NULL,
-			/* coffeePowderDispenserEvent_supplyingFinished: */ &coffeePowderDispenserIdleState,
-			/* coffeePowderDispenserEvent_stop: */ &coffeePowderDispenserIdleState,
-			/* coffeePowderDispenserEvent_noBeans: */ &coffeePowderDispenserIdleState,
-			/* coffeePowderDispenserEvent_beansAvailable: */ NULL
-		}
+	.mode = stateMachineMode_runToCompletion,
+	STATE_MACHINE_TABLES(coffeePowderDispenser, COFFEE_POWDER_DISPENSER_STATES, COFFEE_POWDER_DISPENSER_EVENTS)
 };
 
-ActivityDescriptor getCoffeePowderDispenser() {
-	return coffeePowderDispenserDescriptor;
+static StateMachineInstance coffeePowderDispenserStateMachine = {
+	.definition = &coffeePowderDispenserStateMachineDefinition
+};
+
+ActivityDescriptor getCoffeePowderDispenserDescriptor() {
+	return internActivityDescriptor(&coffeePowderDispenserDescriptor);
 }
 
-ActivityDescriptor getCoffeeBeansFillStateMonitor() {
-	return fillStateMonitorDescriptor;
+ActivityDescriptor getFillStateMonitorDescriptor() {
+	return internActivityDescriptor(&fillStateMonitorDescriptor);
 }
 
-ActivityDescriptor getMotorController() {
-	return motorControllerDescriptor;
+ActivityDescriptor getMotorControllerDescriptor() {
+	return internActivityDescriptor(&motorControllerDescriptor);
 }
 
 static void setUpCoffeePowderDispenser(void *activityarg) {
@@ -375,67 +388,62 @@ static void setUpCoffeePowderDispenser(void *activityarg) {
 	if (!coffeePowderDispenserStateMachine.isInitialized) {
 		logErr("[coffeePowderDispenser] Statemachine init failed!");
 	}
-	createActivity(getCoffeeBeansFillStateMonitor(), messageQueue_blocking);
-	createActivity(getMotorController(), messageQueue_blocking);
+	createActivity(getFillStateMonitorDescriptor(), messageQueue_blocking);
+	createActivity(getMotorControllerDescriptor(), messageQueue_blocking);
 }
 
 static void runCoffeePowderDispenser(void *activity) {
 	//logInfo("[coffeePowderDispenser] Running...");
-	while (TRUE) {
+	while (isActivityRunning(coffeePowderDispenser)) {
 		// Wait for incoming message or time event
-		CoffeePowderDispenserMessage incomingMessage;
-		int result = waitForEvent(coffeePowderDispenser, (char *)&incomingMessage, sizeof(incomingMessage), 100);
-		if (result < 0) {
-			//TODO Implement appropriate error handling
-			sleep(10);
-			// Try to recover from error
-			continue;
-		}
-
-		// Check if there is an incoming message
-		if (result > 0) {
-			// Process incoming message
-			//logInfo("[coffeePowderDispenser] Processing incoming message...");
-			switch (incomingMessage.intValue) {
-				case INIT_COMMAND:
-					//logInfo("[coffeePowderDispenser] Received init command...");
-					processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_init);
-					break;
-				case OFF_COMMAND:
-					//logInfo("[coffeePowderDispenser] Received off command...");
-					processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_switchOff);
-					break;
-				case POWDER_DISPENSER_START_COMMAND:
-					//logInfo("[coffeePowderDispenser] Received start command...");
-					if (lastHasBeansState) {
-						processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_startSupplying);
-					}
-					break;
-				case POWDER_DISPENSER_STOP_COMMAND:
-					//logInfo("[coffeePowderDispenser] Received stop command...");
-					processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_stop);
-					break;
-				case POWDER_DISPENSER_NO_BEANS_ERROR:
-					//logInfo("[coffeePowderDispenser] Received no beans error...");
-					processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_noBeans);
-					dispenseError = SUPPLY_NO_BEANS_ERROR;
-					sendMessage(getCoffeeSupplyDescriptor(),(char *)&(SimpleCoffeeSupplyMessage){
-						.activity = getCoffeePowderDispenser(),
-						.intValue = SUPPLY_NO_BEANS_ERROR,
-						.strValue = "No beans"
-						}, sizeof(SimpleCoffeeSupplyMessage), messagePriority_medium);
-					break;
-				case POWDER_DISPENSER_BEANS_AVAILABLE_NOTIFICATION:
-					//logInfo("[coffeePowderDispenser] Received beans available notification...");
-					processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_beansAvailable);
-					sendMessage(getCoffeeSupplyDescriptor(),(char *)&(SimpleCoffeeSupplyMessage){
-						.activity = getCoffeePowderDispenser(),
-						.intValue = SUPPLY_BEANS_AVAILABLE_NOTIFICATION,
-						.strValue = "Beans available"
-						}, sizeof(SimpleCoffeeSupplyMessage), messagePriority_medium);
-					break;
+		// (Wait only until the active state's next wake-up)
+		waitForEvent_BEGIN(coffeePowderDispenser, CoffeePowderDispenser, getStateMachineTimeout(&coffeePowderDispenserStateMachine))
+			if (error) {
+				//TODO Implement appropriate error handling
+				sleepFor(coffeePowderDispenser, 10000);
+				// Try to recover from error
+				continue;
 			}
-		}
+
+			// Check if there is an incoming message
+			if (result > 0) {
+				// Process incoming message
+				//logInfo("[coffeePowderDispenser] Processing incoming message...");
+				MESSAGE_SELECTOR_BEGIN
+					// Bean status notifications from the fill state monitor
+					MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, FillStateMonitor)
+						MESSAGE_SELECTOR_BEGIN
+							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, FillStateMonitor, BeanStatus)
+								if (content.availability == available) {
+									//logInfo("[coffeePowderDispenser] Received beans available notification...");
+									processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_beansAvailable);
+								} else {
+									//logInfo("[coffeePowderDispenser] Received no beans notification...");
+									processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_noBeans);
+									dispenseError = NO_COFFEE_BEANS_ERROR;
+								}
+								sendNotification_BEGIN(coffeePowderDispenser, CoffeePowderDispenser, getCoffeeSupplyDescriptor(), BeanStatus)
+									.availability = content.availability
+								sendNotification_END
+						MESSAGE_SELECTOR_END
+					// Commands from coffee supply
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeePowderDispenser, InitCommand)
+						//logInfo("[coffeePowderDispenser] Received init command...");
+						processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_init);
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeePowderDispenser, OffCommand)
+						//logInfo("[coffeePowderDispenser] Received off command...");
+						processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_switchOff);
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeePowderDispenser, StartCommand)
+						//logInfo("[coffeePowderDispenser] Received start command...");
+						if (lastHasBeansState) {
+							processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_startSupplying);
+						}
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeePowderDispenser, StopCommand)
+						//logInfo("[coffeePowderDispenser] Received stop command...");
+						processStateMachineEvent(&coffeePowderDispenserStateMachine, coffeePowderDispenserEvent_stop);
+				MESSAGE_SELECTOR_END
+			}
+		waitForEvent_END
 		// Run state machine
 		runStateMachine(&coffeePowderDispenserStateMachine);
 	}
@@ -445,49 +453,40 @@ static void tearDownCoffeePowderDispenser(void *activity) {
 	//logInfo("[coffeePowderDispenser] Tearing down...");
 	destroyActivity(fillStateMonitor);
 	destroyActivity(motorController);
+	logStateMachineStatistics(&coffeePowderDispenserStateMachine);
+}
+
+static void checkBeansPeriodically(void *activity, int timer) {
+	checkBeans();
 }
 
 static void setUpFillStateMonitor(void *activityarg) {
 	//logInfo("[fillStateMonitor] Setting up...");
 	fillStateMonitor = activityarg;
 	lastHasBeansState = hasBeans();
-	if (lastHasBeansState) {
-		//logInfo("[fillStateMonitor] Init: sending Beans available");
-		sendMessage(getCoffeePowderDispenser(),(char *)&(SimpleCoffeeSupplyMessage){
-			.activity = getCoffeeBeansFillStateMonitor(),
-			.intValue = POWDER_DISPENSER_BEANS_AVAILABLE_NOTIFICATION,
-			.strValue = "Beans available"
-			}, sizeof(CoffeePowderDispenserMessage), messagePriority_medium);
-	} else {
-		//logInfo("[fillStateMonitor] Init: sending no beans error");
-		sendMessage(getCoffeePowderDispenser(),(char *)&(SimpleCoffeeSupplyMessage){
-			.activity = getCoffeeBeansFillStateMonitor(),
-			.intValue = POWDER_DISPENSER_NO_BEANS_ERROR,
-			.strValue = "No beans"
-			}, sizeof(CoffeePowderDispenserMessage), messagePriority_medium);
-	}
+	//logInfo("[fillStateMonitor] Init: sending bean status");
+	sendNotification_BEGIN(fillStateMonitor, FillStateMonitor, getCoffeePowderDispenserDescriptor(), BeanStatus)
+		.availability = lastHasBeansState ? available : notAvailable
+	sendNotification_END
+
+	// Check beans every 100ms
+	scheduleTimer(fillStateMonitor, 100, checkBeansPeriodically);
 }
 
 static void runFillStateMonitor(void *activity) {
-	//logInfo("[fillStateMonitor] Running...");
-
+	// Called by the executor whenever there are incoming messages
 	while (TRUE) {
-		// Wait for incoming message or time event
-		FillStateMonitorMessage incomingMessage;
-		int result = waitForEvent(fillStateMonitor, (char *)&incomingMessage, sizeof(incomingMessage), 100);
-		if (result < 0) {
-			//TODO Implement appropriate error handling
-			sleep(10);
-				// Try to recover from error
-			continue;
-		}
+		receiveMessage_BEGIN(fillStateMonitor, FillStateMonitor)
+			if (result <= 0) {
+				// No more messages
+				//TODO Implement appropriate error handling
+				break;
+			}
 
-		// Check if there is an incoming message
-		if (result > 0) {
 			// Process incoming message
 			//logInfo("[fillStateMonitor] Process incoming message...");
-		}
-		checkBeans();
+			// (The bean state is checked periodically anyway, so there is nothing to do on an init command)
+		receiveMessage_END
 	}
 }
 
@@ -501,29 +500,30 @@ static void setUpMotorController(void *activityarg) {
 	//setMotor(0);
 }
 
-static void runMotorController(void *activity) {
-	//logInfo("[motorController] Running...");
-
-	int previousMotorPower = -1;
+static int previousMotorPower = -1;
 
+static void runMotorController(void *activity) {
+	// Called by the executor whenever there are incoming messages
 	while (TRUE) {
 		//logInfo("[motorController] Going to receive message...");
-		MotorControllerMessage message;
-		receiveMessage(activity, (char *)&message, sizeof(message));
-		//logInfo("[motorController] Message received from %s (length: %ld): value: %d, message: %s", message.activity.name, messageLength, message.intValue, message.strValue);
-		switch (message.intValue) {
-			case MOTOR_START_COMMAND:
-				currentMotorPower = 0;
-				//setMotor(50);
-				previousMotorPower = setMotorPotentiometerControlled();
-				break;
-			case MOTOR_STOP_COMMAND:
-				//setMotor(0);
-				if (previousMotorPower != -1) {
-					setMotor(previousMotorPower);
-				}
+		receiveMessage_BEGIN(motorController, MotorController)
+			if (result <= 0) {
+				// No more messages
 				break;
-		}
+			}
+			//logInfo("[motorController] Message %u received from %s", message->type, senderDescriptor->name);
+			MESSAGE_SELECTOR_BEGIN
+				MESSAGE_BY_TYPE_SELECTOR(*message, MotorController, StartCommand)
+					currentMotorPower = 0;
+					//setMotor(50);
+					previousMotorPower = setMotorPotentiometerControlled();
+				MESSAGE_BY_TYPE_SELECTOR(*message, MotorController, StopCommand)
+					//setMotor(0);
+					if (previousMotorPower != -1) {
+						setMotor(previousMotorPower);
+					}
+			MESSAGE_SELECTOR_END
+		receiveMessage_END
 	}
 }
 
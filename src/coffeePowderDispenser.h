@@ -9,35 +9,64 @@
 #define COFFEEPOWDERDISPENSER_H_
 
 #include <mqueue.h>
+#include "defines.h"
 #include "activity.h"
 
-#define POWDER_DISPENSER_BEANS_AVAILABLE_NOTIFICATION 21301
-#define POWDER_DISPENSER_NO_BEANS_ERROR 21401
-#define POWDER_DISPENSER_START_COMMAND 21001
-#define POWDER_DISPENSER_STOP_COMMAND 21002
-#define MOTOR_START_COMMAND 22001
-#define MOTOR_STOP_COMMAND 22002
-
-typedef struct {
-	ActivityDescriptor activity;
-	int intValue;
-	char strValue[256];
-} CoffeePowderDispenserMessage;
-
-typedef struct {
-	ActivityDescriptor activity;
-	int intValue;
-	char strValue[256];
-} FillStateMonitorMessage;
-
-typedef struct {
-	ActivityDescriptor activity;
-	int intValue;
-	char strValue[256];
-} MotorControllerMessage;
-
-extern ActivityDescriptor getCoffeePowderDispenser(void);
-extern ActivityDescriptor getCoffeeBeansFillStateMonitor(void);
-extern ActivityDescriptor getMotorController(void);
+// Coffee powder dispenser messages
+// (Commands from coffee supply, results and bean status notifications to coffee supply)
+COMMON_MESSAGE_CONTENT_REDEFINITION(CoffeePowderDispenser, InitCommand)
+
+COMMON_MESSAGE_CONTENT_REDEFINITION(CoffeePowderDispenser, OffCommand)
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+MESSAGE_CONTENT_DEFINITION_END(CoffeePowderDispenser, StartCommand)
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+MESSAGE_CONTENT_DEFINITION_END(CoffeePowderDispenser, StopCommand)
+
+COMMON_MESSAGE_CONTENT_REDEFINITION(CoffeePowderDispenser, Result)
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+	Availability availability;
+MESSAGE_CONTENT_DEFINITION_END(CoffeePowderDispenser, BeanStatus)
+
+MESSAGE_DEFINITION_BEGIN
+	MESSAGE_CONTENT(CoffeePowderDispenser, InitCommand)
+	MESSAGE_CONTENT(CoffeePowderDispenser, OffCommand)
+	MESSAGE_CONTENT(CoffeePowderDispenser, StartCommand)
+	MESSAGE_CONTENT(CoffeePowderDispenser, StopCommand)
+	MESSAGE_CONTENT(CoffeePowderDispenser, Result)
+	MESSAGE_CONTENT(CoffeePowderDispenser, BeanStatus)
+MESSAGE_DEFINITION_END(CoffeePowderDispenser)
+
+// Fill state monitor messages
+// (Commands from the coffee powder dispenser, bean status notifications to the coffee powder dispenser)
+COMMON_MESSAGE_CONTENT_REDEFINITION(FillStateMonitor, InitCommand)
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+	Availability availability;
+MESSAGE_CONTENT_DEFINITION_END(FillStateMonitor, BeanStatus)
+
+MESSAGE_DEFINITION_BEGIN
+	MESSAGE_CONTENT(FillStateMonitor, InitCommand)
+	MESSAGE_CONTENT(FillStateMonitor, BeanStatus)
+MESSAGE_DEFINITION_END(FillStateMonitor)
+
+// Motor controller messages
+// (Commands from the coffee powder dispenser)
+MESSAGE_CONTENT_DEFINITION_BEGIN
+MESSAGE_CONTENT_DEFINITION_END(MotorController, StartCommand)
+
+MESSAGE_CONTENT_DEFINITION_BEGIN
+MESSAGE_CONTENT_DEFINITION_END(MotorController, StopCommand)
+
+MESSAGE_DEFINITION_BEGIN
+	MESSAGE_CONTENT(MotorController, StartCommand)
+	MESSAGE_CONTENT(MotorController, StopCommand)
+MESSAGE_DEFINITION_END(MotorController)
+
+extern ActivityDescriptor getCoffeePowderDispenserDescriptor(void);
+extern ActivityDescriptor getFillStateMonitorDescriptor(void);
+extern ActivityDescriptor getMotorControllerDescriptor(void);
 
 #endif /* COFFEEPOWDERDISPENSER_H_ */
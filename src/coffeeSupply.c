@@ -23,13 +23,14 @@
 #include "coffeeSupply.h"
 #include "coffeePowderDispenser.h"
 #include "activity.h"
-#include "stateMachineEngine.h"
+#include "coroutine.h"
+#include "stateMachineDescription.h"
 
 static void setUpCoffeeSupply(void *activity);
 static void runCoffeeSupply(void *activity);
 static void tearDownCoffeeSupply(void *activity);
 
-static StateMachine coffeeSupplyStateMachine;
+static StateMachineInstance coffeeSupplyStateMachine;
 
 static Activity *coffeeSupply;
 static Activity *coffeePowderDispenser;
@@ -38,14 +39,19 @@ static ActivityDescriptor coffeeSupplyDescriptor = {
 	.name = "coffeeSupply",
 	.setUp = setUpCoffeeSupply,
 	.run = runCoffeeSupply,
-	.tearDown = tearDownCoffeeSupply
+	.tearDown = tearDownCoffeeSupply,
+	.execution = activityExecution_coroutine,
+	.stackSize = SMALL_ACTIVITY_STACK_SIZE
 };
 
-MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, GrindCoffeePowderCommand, 1)
-MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, EjectCoffeeWasteCommand, 2)
-MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, Result, 3)
-MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, BeanStatus, 4)
-MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, WasteBinStatus, 5)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, InitCommand, 1)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, OffCommand, 2)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, GrindCoffeePowderCommand, 3)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, EjectCoffeeWasteCommand, 4)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, AbortCommand, 5)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, Result, 6)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, BeanStatus, 7)
+MESSAGE_CONTENT_TYPE_MAPPING(CoffeeSupply, WasteBinStatus, 8)
 
 static int ejectWaste(void) {
 	logInfo("[coffeeSupply] Eject coffee waste...");
@@ -65,6 +71,25 @@ static Availability lastHasBeans = notAvailable;
 // should waste be ejected
 static int wasteDisposable = FALSE;
 
+// the grind request to respond to (NULL_REQUEST_TOKEN if none)
+static ActivityDescriptor grindCallerDescriptor;
+static DWord grindRequestId = NULL_REQUEST_TOKEN;
+
+/**
+ * Responds to the pending grind request (once).
+ */
+static void sendGrindResult(int code, int errorCode) {
+	if (grindRequestId == NULL_REQUEST_TOKEN) {
+		return;
+	}
+
+	sendDeferredResponse_BEGIN(coffeeSupply, CoffeeSupply, grindCallerDescriptor, grindRequestId, Result)
+		.code = code,
+		.errorCode = errorCode
+	sendDeferredResponse_END
+	grindRequestId = NULL_REQUEST_TOKEN;
+}
+
 
 /*
  ***************************************************************************
@@ -76,29 +101,37 @@ static int wasteDisposable = FALSE;
 // initializing:
 // idle: bereit;
 // supplying;
+/**
+ * The coffee supply states (and their state objects)
+ */
+#define COFFEE_SUPPLY_STATES(STATE, _) \
+	STATE(_, coffeeSupplyState_switchedOff, coffeeSupplySwitchedOffState) \
+	STATE(_, coffeeSupplyState_initializing, coffeeSupplyInitializingState) \
+	STATE(_, coffeeSupplyState_idle, coffeeSupplyIdleState) \
+	STATE(_, coffeeSupplyState_supplying, coffeeSupplySupplyingState)
+
 /**
  * Represents a coffee supply state
  */
-typedef enum {
-	coffeeSupplyState_switchedOff,
-	coffeeSupplyState_initializing,
-	coffeeSupplyState_idle,
-	coffeeSupplyState_supplying
-} CoffeeSupplyState;
+DECLARE_STATE_MACHINE_ENUM(CoffeeSupplyState, COFFEE_SUPPLY_STATES)
+
+/**
+ * The coffee supply events
+ */
+#define COFFEE_SUPPLY_EVENTS(EVENT, _) \
+	EVENT(_, coffeeSupplyEvent_init) \
+	EVENT(_, coffeeSupplyEvent_switchOff) \
+	EVENT(_, coffeeSupplyEvent_initialized) \
+	EVENT(_, coffeeSupplyEvent_startSupplying) \
+	EVENT(_, coffeeSupplyEvent_supplyingFinished) \
+	EVENT(_, coffeeSupplyEvent_stop) \
+	EVENT(_, coffeeSupplyEvent_noBeans) \
+	EVENT(_, coffeeSupplyEvent_beansAvailable)
 
 /**
- * Represents a coffeeSupply event
+ * Represents a coffee supply event
  */
-typedef enum {
-	coffeeSupplyEvent_init,
-	coffeeSupplyEvent_switchOff,
-	coffeeSupplyEvent_initialized,
-	coffeeSupplyEvent_startSupplying,
-	coffeeSupplyEvent_supplyingFinished,
-	coffeeSupplyEvent_stop,
-	coffeeSupplyEvent_noBeans,
-	coffeeSupplyEvent_beansAvailable,
-} CoffeeSupplyEvent;
+DECLARE_STATE_MACHINE_ENUM(CoffeeSupplyEvent, COFFEE_SUPPLY_EVENTS)
 
 /*
  ***************************************************************************
@@ -106,11 +139,11 @@ typedef enum {
  ***************************************************************************
  */
 
-static void coffeeSupplySwitchedOffStateEntryAction() {
+static void coffeeSupplySwitchedOffStateEntryAction(void *context) {
 	//logInfo("[coffeeSupply] Entered SwitchedOff State...");
 }
 
-static Event coffeeSupplySwitchedOffStateDoAction() {
+static Event coffeeSupplySwitchedOffStateDoAction(void *context) {
 	return NO_EVENT;
 }
 
@@ -126,29 +159,41 @@ static State coffeeSupplySwitchedOffState = {
  ***************************************************************************
  */
 
-static void coffeeSupplyInitializingStateEntryAction() {
+// The initialization runs as a coroutine, so commands are still handled meanwhile
+static CoroutineId initializingCoroutine = NULL_COROUTINE_ID;
+
+static void initializeCoffeeSupply(void *activity, void *argument) {
+	// Eject waste
+	ejectWaste();
+	if (sleepFor(coffeeSupply, 1000) < 0) {
+		// Interrupted
+		return;
+	}
+
+	initializingCoroutine = NULL_COROUTINE_ID;
+	processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_initialized);
+}
+
+static void coffeeSupplyInitializingStateEntryAction(void *context) {
 	//logInfo("[coffeeSupply] Send Init message to coffeePowderDispenser...");
 	//Send init message to powder dispenser
-	sendMessage(getCoffeePowderDispenser(), (char *)&(CoffeePowderDispenserMessage){
-			.activity = getCoffeeSupplyDescriptor(),
-			.intValue = INIT_COMMAND,
-			.strValue = "init coffeePowderDispenser"
-			}, sizeof(CoffeePowderDispenserMessage), messagePriority_medium);
+	sendRequest_BEGIN(coffeeSupply, CoffeePowderDispenser, InitCommand)
+	sendRequest_END
 	//logInfo("[coffeeSupply] ...done. (send init message)");
-}
 
-static Event coffeeSupplyInitializingStateDoAction() {
-	// Eject waste
-	ejectWaste();
-	sleep(1);
-	return coffeeSupplyEvent_initialized;
+	initializingCoroutine = startCoroutine(coffeeSupply, initializeCoffeeSupply, NULL);
 }
 
+static void coffeeSupplyInitializingStateExitAction(void *context) {
+	// Cancel a pending initialization (e.g. if switched off meanwhile)
+	interruptCoroutine(coffeeSupply, initializingCoroutine);
+	initializingCoroutine = NULL_COROUTINE_ID;
+}
 
 static State coffeeSupplyInitializingState = {
 	.stateIndex = coffeeSupplyState_initializing,
 	.entryAction = coffeeSupplyInitializingStateEntryAction,
-	.doAction = coffeeSupplyInitializingStateDoAction
+	.exitAction = coffeeSupplyInitializingStateExitAction
 };
 
 /*
@@ -157,11 +202,11 @@ static State coffeeSupplyInitializingState = {
  ***************************************************************************
  */
 
-static void coffeeSupplyIdleStateEntryAction() {
+static void coffeeSupplyIdleStateEntryAction(void *context) {
 	;
 }
 
-static Event coffeeSupplyIdleStateDoAction() {
+static Event coffeeSupplyIdleStateDoAction(void *context) {
 
 	return NO_EVENT;
 }
@@ -178,7 +223,7 @@ static State coffeeSupplyIdleState = {
  ***************************************************************************
  */
 
-static void coffeeSupplySupplyingStateEntryAction() {
+static void coffeeSupplySupplyingStateEntryAction(void *context) {
 	//logInfo("[coffeeSupply] Entered Supplying State...");
 	//Check if we should eject waste
 	if (wasteDisposable) {
@@ -187,31 +232,23 @@ static void coffeeSupplySupplyingStateEntryAction() {
 		wasteDisposable = FALSE;
 	}
 	logInfo("[coffeeSupply] Going to grind coffee powder...");
-	//Send init message to powder dispenser
-	sendMessage(getCoffeePowderDispenser(), (char *)&(CoffeePowderDispenserMessage){
-		.activity = getCoffeeSupplyDescriptor(),
-		.intValue = POWDER_DISPENSER_START_COMMAND,
-		.strValue = "start coffeePowderDispenser"
-		}, sizeof(CoffeePowderDispenserMessage), messagePriority_medium);
+	//Send start message to powder dispenser
+	sendRequest_BEGIN(coffeeSupply, CoffeePowderDispenser, StartCommand)
+	sendRequest_END
 	//logInfo("[coffeeSupply] ...done. (send dispenser start message)");
 }
 
-static Event coffeeSupplySupplyingStateDoAction() {
+static Event coffeeSupplySupplyingStateDoAction(void *context) {
 	return NO_EVENT;
 }
 
-static void coffeeSupplySupplyingStateExitAction() {
+static void coffeeSupplySupplyingStateExitAction(void *context) {
 	wasteDisposable = TRUE;
 	logInfo("[coffeeSupply] ...done (grinding coffee powder)");
-	sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), Result)
-		.code = OK_RESULT
-	sendNotification_END
-	//Send init message to powder dispenser
-	sendMessage(getCoffeePowderDispenser(), (char *)&(CoffeePowderDispenserMessage){
-		.activity = getCoffeeSupplyDescriptor(),
-		.intValue = POWDER_DISPENSER_STOP_COMMAND,
-		.strValue = "stop coffeePowderDispenser"
-	}, sizeof(CoffeePowderDispenserMessage), messagePriority_medium);
+	sendGrindResult(OK_RESULT, NO_ERROR);
+	//Send stop message to powder dispenser
+	sendRequest_BEGIN(coffeeSupply, CoffeePowderDispenser, StopCommand)
+	sendRequest_END
 }
 
 static State coffeeSupplySupplyingState = {
@@ -227,176 +264,169 @@ static State coffeeSupplySupplyingState = {
  ***************************************************************************
  */
 
-static StateMachine coffeeSupplyStateMachine = {
+/**
+ * The coffee supply transitions (grouped by source state, sorted by event)
+ */
+#define COFFEE_SUPPLY_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, coffeeSupplyState_switchedOff, coffeeSupplyEvent_init, coffeeSupplyInitializingState) \
+	TRANSITION(_, coffeeSupplyState_initializing, coffeeSupplyEvent_switchOff, coffeeSupplySwitchedOffState) \
+	TRANSITION(_, coffeeSupplyState_initializing, coffeeSupplyEvent_initialized, coffeeSupplyIdleState) \
+	TRANSITION(_, coffeeSupplyState_idle, coffeeSupplyEvent_init, coffeeSupplyInitializingState) \
+	TRANSITION(_, coffeeSupplyState_idle, coffeeSupplyEvent_switchOff, coffeeSupplySwitchedOffState) \
+	TRANSITION(_, coffeeSupplyState_idle, coffeeSupplyEvent_startSupplying, coffeeSupplySupplyingState) \
+	TRANSITION(_, coffeeSupplyState_supplying, coffeeSupplyEvent_switchOff, coffeeSupplySwitchedOffState) \
+	TRANSITION(_, coffeeSupplyState_supplying, coffeeSupplyEvent_supplyingFinished, coffeeSupplyIdleState) \
+	TRANSITION(_, coffeeSupplyState_supplying, coffeeSupplyEvent_stop, coffeeSupplyIdleState) \
+	TRANSITION(_, coffeeSupplyState_supplying, coffeeSupplyEvent_noBeans, coffeeSupplyIdleState)
+
+DEFINE_STATE_MACHINE_TABLES(coffeeSupply, COFFEE_SUPPLY_STATES, COFFEE_SUPPLY_EVENTS, COFFEE_SUPPLY_TRANSITIONS)
+
+static const StateMachineDefinition coffeeSupplyStateMachineDefinition = {
 	.name = "coffeeSupply",
-	.numberOfEvents = 8,
 	.initialState = &coffeeSupplySwitchedOffState,
-	.transitions = {
-		/* coffeeSupplyState_switchedOff: */
-			/* coffeeSupplyEvent_init: */ &coffeeSupplyInitializingState,
-			/* coffeeSupplyEvent_switchOff: */ NULL,
-			/* coffeeSupplyEvent_initialized: */ NULL,
-			/* coffeeSupplyEvent_startSupplying: */ NULL,
-			/* coffeeSupplyEvent_supplyingFinished: */ NULL,
-			/* coffeeSupplyEvent_stop: */ NULL,
-			/* coffeeSupplyEvent_noBeans: */ NULL,
-			/* coffeeSupplyEvent_beansAvailable: */ NULL,
-		/* coffeeSupplyState_initializing: */
-			/* coffeeSupplyEvent_init: */ NULL,
-			/* coffeeSupplyEvent_switchOff: */ &coffeeSupplySwitchedOffState,
-			/* coffeeSupplyEvent_initialized: */ &coffeeSupplyIdleState,
-			/* coffeeSupplyEvent_startSupplying: */ NULL,
-			/* coffeeSupplyEvent_supplyingFinished: */ NULL,
-			/* coffeeSupplyEvent_stop: */ NULL,
-			/* coffeeSupplyEvent_noBeans: */ NULL,
-			/* coffeeSupplyEvent_beansAvailable: */ NULL,
-		/* coffeeSupplyState_idle: */
-			/* coffeeSupplyEvent_init: */ &coffeeSupplyInitializingState,
-			/* coffeeSupplyEvent_switchOff: */ &coffeeSupplySwitchedOffState,
-			/* coffeeSupplyEvent_initialized: */ NULL,
-			/* coffeeSupplyEvent_startSupplying: */ &coffeeSupplySupplyingState,
-			/* coffeeSupplyEvent_supplyingFinished: */ NULL,
-			/* coffeeSupplyEvent_stop: */ NULL,
-			/* coffeeSupplyEvent_noBeans: */ NULL,
-			/* coffeeSupplyEvent_beansAvailable: */ NULL,
-		/* coffeeSupplyState_supplying: */
-			/* coffeeSupplyEvent_init: */ NULL,
-			/* coffeeSupplyEvent_switchOff: */ &coffeeSupplySwitchedOffState,
-			/* coffeeSupplyEvent_initialized: */ NULL,
-			/* coffeeSupplyEvent_startSupplying: */ NULL,
-			/* coffeeSupplyEvent_supplyingFinished: */ &coffeeSupplyIdleState,
-			/* coffeeSupplyEvent_stop: */ &coffeeSupplyIdleState,
-			/* coffeeSupplyEvent_noBeans: */ &coffeeSupplyIdleState,
-			/* coffeeSupplyEvent_beansAvailable: */ NULL
-		}
+	.mode = stateMachineMode_runToCompletion,
+	STATE_MACHINE_TABLES(coffeeSupply, COFFEE_SUPPLY_STATES, COFFEE_SUPPLY_EVENTS)
+};
+
+static StateMachineInstance coffeeSupplyStateMachine = {
+	.definition = &coffeeSupplyStateMachineDefinition
 };
 
 ActivityDescriptor getCoffeeSupplyDescriptor() {
-	return coffeeSupplyDescriptor;
+	return internActivityDescriptor(&coffeeSupplyDescriptor);
+}
+
+/**
+ * How often the waste bin sensor is read [ms].
+ */
+#define WASTE_BIN_CHECK_PERIOD 1000
+
+static void checkWasteBinPeriodically(void *activity, int timer) {
+	int hasCoffeeWasteState = hasCoffeeWaste();
+
+	// Something happened with the waste bin?
+	if (hasCoffeeWasteState != lastHasCoffeeWasteState ) {
+		lastHasCoffeeWasteState = hasCoffeeWasteState;
+		sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), WasteBinStatus)
+			.isBinFull = lastHasCoffeeWasteState
+		sendNotification_END
+	}
 }
 
 static void setUpCoffeeSupply(void *activityarg) {
 	//logInfo("[coffeeSupply] Setting up...");
 	coffeeSupply = activityarg;
 	setUpStateMachine(&coffeeSupplyStateMachine);
-	coffeePowderDispenser = createActivity(getCoffeePowderDispenser(), messageQueue_blocking);
+	coffeePowderDispenser = createActivity(getCoffeePowderDispenserDescriptor(), messageQueue_blocking);
+
+	// Check the waste bin every second (independent of the state)
+	if (scheduleTimer(coffeeSupply, WASTE_BIN_CHECK_PERIOD, checkWasteBinPeriodically) < 0) {
+		logErr("[coffeeSupply] Could not schedule the waste bin check!");
+	}
 }
 
 static void runCoffeeSupply(void *activityarg) {
 	//logInfo("[coffeeSupply] Running...");
 
-	while (TRUE) {
-		// Wait for incoming message or time event
-		SimpleCoffeeSupplyMessage incomingMessage;
-		int result = waitForEvent(coffeeSupply, (char *)&incomingMessage, sizeof(incomingMessage), 1000);
-		if (result < 0) {
-			//TODO Implement appropriate error handling
-			sleep(10);
-				// Try to recover from error
-			continue;
-		}
-
-		// Check if there is an incoming message
-		if (result > 0) {
-			// Process incoming message
-			//logInfo("[coffeeSupply] Process incoming message...");
-			switch (incomingMessage.intValue) {
-			case INIT_COMMAND:
-				//logInfo("[coffeeSupply] Received init command");
-				processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_init);
-				break;
-			case OFF_COMMAND:
-				//logInfo("[coffeeSupply] Received off command");
-				processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_switchOff);
-				break;
-			case SUPPLY_START_COMMAND:
-				//logInfo("[coffeeSupply] Received supply start command");
-				if (lastHasBeans == available) {
-					//logInfo("[coffeeSupply] Beans available, starting supply");
-					processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_startSupplying);
-				} else {
-					logInfo("[coffeeSupply] No beans!");
-					sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), Result)
-						.code = NOK_RESULT,
-						.errorCode = NO_COFFEE_BEANS_ERROR
-					sendNotification_END
-				}
-				break;
-			case SUPPLY_STOP_COMMAND:
-				//logInfo("[coffeeSupply] Received supply stop command");
-				processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_stop);
-				break;
-			case SUPPLY_NO_BEANS_ERROR:
-				//logInfo("[coffeeSupply] Received no beans error");
-				if (coffeeSupplyStateMachine.activeState == &coffeeSupplySupplyingState) {
-					logInfo("[coffeeSupply] No beans!");
-					sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), Result)
-						.code = NOK_RESULT,
-						.errorCode = NO_COFFEE_BEANS_ERROR
-					sendNotification_END
-				}
-
-				processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_noBeans);
-				// notifiy mainController:
-				sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), BeanStatus)
-					.availability = notAvailable
-				sendNotification_END
-
-				lastHasBeans = notAvailable;
-				break;
-			case SUPPLY_BEANS_AVAILABLE_NOTIFICATION:
-				//logInfo("[coffeeSupply] Received beans available command");
-				processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_beansAvailable);
-
-				sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), BeanStatus)
-					.availability = available
-				sendNotification_END
-
-				lastHasBeans = available;
-				break;
-			case EJECT_COFFEE_WASTE_COMMAND:
-				//logInfo("[coffeeSupply] Received eject command");
-				if (coffeeSupplyStateMachine.activeState == &coffeeSupplyIdleState) {
-					ejectWaste();
-
-					logInfo("[coffeeSupply] Coffee waste ejected");
-
-					wasteDisposable = FALSE;
-
-					sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), Result)
-						.code = OK_RESULT
-					sendNotification_END
-				} else {
-					sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), Result)
-						.code = NOK_RESULT,
-						.errorCode = COFFEE_WASTE_EJECTION_NOT_POSSIBLE_ERROR
-					sendNotification_END
-				}
-				break;
-			case OK_RESULT:
-				//logInfo("[coffeeSupply] Received ok result");
+	while (isActivityRunning(coffeeSupply)) {
+		// Wait for incoming messages or time event
+		// (All pending messages are processed before the state machine is run)
+		// (Wait only until the active state's next wake-up, the waste bin is checked by its timer meanwhile)
+		waitForEvents_BEGIN(coffeeSupply, getStateMachineTimeout(&coffeeSupplyStateMachine))
+			if (error) {
+				//TODO Implement appropriate error handling
+				sleepFor(coffeeSupply, 10000);
+					// Try to recover from error
+				continue;
+			}
+
+			// Process incoming messages
+			forEachReceivedMessage_BEGIN(CoffeeSupply)
+				//logInfo("[coffeeSupply] Process incoming message...");
 				MESSAGE_SELECTOR_BEGIN
-				MESSAGE_SELECTOR(incomingMessage, coffeePowderDispenser)
-					processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_supplyingFinished);
+					// Results and bean status notifications from the powder dispenser
+					MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, CoffeePowderDispenser)
+						MESSAGE_SELECTOR_BEGIN
+							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, CoffeePowderDispenser, Result)
+								//logInfo("[coffeeSupply] Received result");
+								if (content.code == OK_RESULT) {
+									processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_supplyingFinished);
+								}
+							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, CoffeePowderDispenser, BeanStatus)
+								if (content.availability == available) {
+									//logInfo("[coffeeSupply] Received beans available notification");
+									processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_beansAvailable);
+								} else {
+									//logInfo("[coffeeSupply] Received no beans notification");
+									if (coffeeSupplyStateMachine.activeState == &coffeeSupplySupplyingState) {
+										logInfo("[coffeeSupply] No beans!");
+										sendGrindResult(NOK_RESULT, NO_COFFEE_BEANS_ERROR);
+									}
+
+									processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_noBeans);
+								}
+
+								// notifiy mainController:
+								sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), BeanStatus)
+									.availability = content.availability
+								sendNotification_END
+
+								lastHasBeans = content.availability;
+						MESSAGE_SELECTOR_END
+					// Commands from the main controller
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, InitCommand)
+						//logInfo("[coffeeSupply] Received init command");
+						processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_init);
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, OffCommand)
+						//logInfo("[coffeeSupply] Received off command");
+						processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_switchOff);
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, GrindCoffeePowderCommand)
+						//logInfo("[coffeeSupply] Received grind command");
+						if (lastHasBeans == available) {
+							//logInfo("[coffeeSupply] Beans available, starting supply");
+							// (Responded to as soon as the powder has been supplied)
+							grindCallerDescriptor = *senderDescriptor;
+							grindRequestId = header.sequenceNumber;
+							processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_startSupplying);
+						} else {
+							logInfo("[coffeeSupply] No beans!");
+							sendResponse_BEGIN(coffeeSupply, CoffeeSupply, Result)
+								.code = NOK_RESULT,
+								.errorCode = NO_COFFEE_BEANS_ERROR
+							sendResponse_END
+						}
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, AbortCommand)
+						//logInfo("[coffeeSupply] Received abort command");
+						processStateMachineEvent(&coffeeSupplyStateMachine, coffeeSupplyEvent_stop);
+					MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, EjectCoffeeWasteCommand)
+						//logInfo("[coffeeSupply] Received eject command");
+						if (coffeeSupplyStateMachine.activeState == &coffeeSupplyIdleState) {
+							ejectWaste();
+
+							logInfo("[coffeeSupply] Coffee waste ejected");
+
+							wasteDisposable = FALSE;
+
+							sendResponse_BEGIN(coffeeSupply, CoffeeSupply, Result)
+								.code = OK_RESULT
+							sendResponse_END
+						} else {
+							sendResponse_BEGIN(coffeeSupply, CoffeeSupply, Result)
+								.code = NOK_RESULT,
+								.errorCode = COFFEE_WASTE_EJECTION_NOT_POSSIBLE_ERROR
+							sendResponse_END
+						}
 				MESSAGE_SELECTOR_END
-				break;
-			}
-		}
+			forEachReceivedMessage_END
+		waitForEvents_END
+
 		// Run state machine
 		runStateMachine(&coffeeSupplyStateMachine);
-		int hasCoffeeWasteState = hasCoffeeWaste();
-
-		// Something happened with the waste bin?
-		if (hasCoffeeWasteState != lastHasCoffeeWasteState ) {
-			lastHasCoffeeWasteState = hasCoffeeWasteState;
-			sendNotification_BEGIN(coffeeSupply, CoffeeSupply, getMainControllerDescriptor(), WasteBinStatus)
-				.isBinFull = lastHasCoffeeWasteState
-			sendNotification_END
-		}
 	}
 }
 
 static void tearDownCoffeeSupply(void *activity) {
 	//logInfo("[coffee supply] Tearing down...");
 	destroyActivity(coffeePowderDispenser);
+	logStateMachineStatistics(&coffeeSupplyStateMachine);
 }
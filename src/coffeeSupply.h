@@ -13,20 +13,12 @@
 #include "defines.h"
 #include "activity.h"
 
-#define SUPPLY_START_COMMAND 2001
-#define SUPPLY_STOP_COMMAND 2002
-#define EJECT_COFFEE_WASTE_COMMAND 2003
-#define SUPPLY_BEANS_AVAILABLE_NOTIFICATION 2301
-#define SUPPLY_NO_BEANS_ERROR 2401
-
 #define NO_COFFEE_BEANS_ERROR 1
 #define COFFEE_WASTE_EJECTION_NOT_POSSIBLE_ERROR 2
 
-typedef struct {
-	ActivityDescriptor activity;
-	int intValue;
-	char strValue[256];
-} SimpleCoffeeSupplyMessage;
+COMMON_MESSAGE_CONTENT_REDEFINITION(CoffeeSupply, InitCommand)
+
+COMMON_MESSAGE_CONTENT_REDEFINITION(CoffeeSupply, OffCommand)
 
 MESSAGE_CONTENT_DEFINITION_BEGIN
 	unsigned int coffeePowderAmount; // [g]
@@ -48,8 +40,11 @@ MESSAGE_CONTENT_DEFINITION_BEGIN
 MESSAGE_CONTENT_DEFINITION_END(CoffeeSupply, WasteBinStatus)
 
 MESSAGE_DEFINITION_BEGIN
+	MESSAGE_CONTENT(CoffeeSupply, InitCommand)
+	MESSAGE_CONTENT(CoffeeSupply, OffCommand)
 	MESSAGE_CONTENT(CoffeeSupply, GrindCoffeePowderCommand)
 	MESSAGE_CONTENT(CoffeeSupply, EjectCoffeeWasteCommand)
+	MESSAGE_CONTENT(CoffeeSupply, AbortCommand)
 	MESSAGE_CONTENT(CoffeeSupply, Result)
 	MESSAGE_CONTENT(CoffeeSupply, BeanStatus)
 	MESSAGE_CONTENT(CoffeeSupply, WasteBinStatus)
@@ -0,0 +1,449 @@
+/**
+ * Coroutines
+ *
+ * Each coroutine has its own stack and user space context (ucontext).
+ * A scheduler running on the activity's thread stack resumes the ready coroutines one after the other.
+ * A waiting coroutine records the file descriptor and/or deadline it waits for and switches back to the scheduler.
+ * As soon as no coroutine is ready, the scheduler polls the file descriptors of all waiting coroutines
+ * up to the earliest deadline. The thread may only be cancelled during this poll,
+ * so it is never cancelled on a coroutine stack.
+ *
+ * @file    coroutine.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include "defines.h"
+#include "log.h"
+#include "coroutine.h"
+
+#define NO_COROUTINE -1
+#define NO_FILE_DESCRIPTOR -1
+
+/**
+ * Defines the states of a coroutine.
+ */
+typedef enum {
+	coroutineState_free = 0, /**< The slot is not used. */
+	coroutineState_ready, /**< Waits to be resumed by the scheduler. */
+	coroutineState_running, /**< Runs (there is at most one running coroutine). */
+	coroutineState_waiting /**< Waits for a file descriptor and/or a deadline. */
+} CoroutineState;
+
+/**
+ * Represents a coroutine.
+ */
+typedef struct {
+	CoroutineState state;
+	unsigned int generation; /**< Incremented whenever the slot is reused (makes ids of finished coroutines stale). */
+	ucontext_t context;
+	Byte *stack;
+	CoroutineFunction function;
+	void *argument;
+	int fd; /**< The awaited file descriptor (NO_FILE_DESCRIPTOR if none). */
+	int hasDeadline; /**< Does the wait time out? */
+	unsigned long long deadline; /**< The time the wait times out [ms] (monotonic clock). */
+	int waitResult; /**< The result of the wait (1 = readable, 0 = timeout, -EINTR = interrupted). */
+} Coroutine;
+
+/**
+ * Represents the coroutines of an activity.
+ */
+typedef struct {
+	Activity *activity;
+	ucontext_t schedulerContext;
+	unsigned long stackSize;
+	int current; /**< The running coroutine's index (NO_COROUTINE while the scheduler runs). */
+	Coroutine coroutines[MAX_NUMBER_OF_COROUTINES];
+} CoroutineScheduler;
+
+/**
+ * Gets the monotonic time [ms].
+ */
+static unsigned long long getMilliseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Gets (and creates if necessary) the activity's scheduler.
+ */
+static CoroutineScheduler *getScheduler(Activity *activity) {
+	if (!activity->coroutines) {
+		CoroutineScheduler *scheduler = (CoroutineScheduler *)malloc(sizeof(CoroutineScheduler));
+		if (!scheduler) {
+			return NULL;
+		}
+		memset(scheduler, 0, sizeof(CoroutineScheduler));
+
+		scheduler->activity = activity;
+		scheduler->stackSize = activity->descriptor->stackSize > 0 ? activity->descriptor->stackSize : COROUTINE_STACK_SIZE;
+		scheduler->current = NO_COROUTINE;
+
+		activity->coroutines = scheduler;
+	}
+
+	return (CoroutineScheduler *)activity->coroutines;
+}
+
+/**
+ * Gets a (living) coroutine by its id.
+ */
+static Coroutine *getCoroutine(CoroutineScheduler *scheduler, CoroutineId id) {
+	if (!scheduler || id <= NULL_COROUTINE_ID) {
+		return NULL;
+	}
+
+	Coroutine *coroutine = &scheduler->coroutines[(id - 1) % MAX_NUMBER_OF_COROUTINES];
+	if (coroutine->state == coroutineState_free
+		|| coroutine->generation != (unsigned int)(id - 1) / MAX_NUMBER_OF_COROUTINES) {
+		return NULL;
+	}
+
+	return coroutine;
+}
+
+/**
+ * Entry point of every coroutine (the scheduler is passed as two integers as makecontext() only passes integers).
+ * Returning resumes the scheduler (the context's successor).
+ */
+static void runCoroutine(unsigned int schedulerHigh, unsigned int schedulerLow) {
+	CoroutineScheduler *scheduler = (CoroutineScheduler *)(uintptr_t)(((unsigned long long)schedulerHigh << 32) | schedulerLow);
+	Coroutine *coroutine = &scheduler->coroutines[scheduler->current];
+
+	coroutine->function(scheduler->activity, coroutine->argument);
+
+	coroutine->state = coroutineState_free;
+}
+
+/**
+ * @copydoc startCoroutine
+ */
+CoroutineId startCoroutine(Activity *activity, CoroutineFunction function, void *argument) {
+	CoroutineScheduler *scheduler = getScheduler(activity);
+	if (!scheduler) {
+		logErr("[%s] Error setting up coroutines!", activity->descriptor->name);
+
+		return -ENOMEM;
+	}
+
+	int index;
+	for (index = 0; index < MAX_NUMBER_OF_COROUTINES && scheduler->coroutines[index].state != coroutineState_free; index++);
+	if (index >= MAX_NUMBER_OF_COROUTINES) {
+		logErr("[%s] Too many coroutines!", activity->descriptor->name);
+
+		return -ENOSPC;
+	}
+	Coroutine *coroutine = &scheduler->coroutines[index];
+
+	// Stacks are kept for reuse until the activity is destroyed
+	if (!coroutine->stack) {
+		coroutine->stack = (Byte *)malloc(scheduler->stackSize);
+		if (!coroutine->stack) {
+			logErr("[%s] Error allocating coroutine stack!", activity->descriptor->name);
+
+			return -ENOMEM;
+		}
+
+		if (activity->descriptor->isStackPrefaulted) {
+			memset(coroutine->stack, 0, scheduler->stackSize);
+		}
+	}
+
+	if (getcontext(&coroutine->context) < 0) {
+		logErr("[%s] Error setting up coroutine: %s", activity->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+	coroutine->context.uc_stack.ss_sp = coroutine->stack;
+	coroutine->context.uc_stack.ss_size = scheduler->stackSize;
+	coroutine->context.uc_link = &scheduler->schedulerContext;
+	uintptr_t schedulerAddress = (uintptr_t)scheduler;
+	makecontext(&coroutine->context, (void (*)(void))runCoroutine, 2,
+			(unsigned int)((unsigned long long)schedulerAddress >> 32), (unsigned int)schedulerAddress);
+
+	coroutine->function = function;
+	coroutine->argument = argument;
+	coroutine->fd = NO_FILE_DESCRIPTOR;
+	coroutine->hasDeadline = FALSE;
+	coroutine->waitResult = 0;
+	coroutine->generation = (coroutine->generation + 1) & 0xffffff;
+	coroutine->state = coroutineState_ready;
+
+	return coroutine->generation * MAX_NUMBER_OF_COROUTINES + index + 1;
+}
+
+/**
+ * Resumes a coroutine until it waits or finishes.
+ */
+static void resumeCoroutine(CoroutineScheduler *scheduler, int index) {
+	Coroutine *coroutine = &scheduler->coroutines[index];
+
+	scheduler->current = index;
+	coroutine->state = coroutineState_running;
+	swapcontext(&scheduler->schedulerContext, &coroutine->context);
+	scheduler->current = NO_COROUTINE;
+}
+
+/**
+ * Suspends the running coroutine (in the given state) and resumes the scheduler.
+ * Returns the coroutine's wait result.
+ */
+static int suspendCoroutine(CoroutineScheduler *scheduler, CoroutineState state) {
+	Coroutine *coroutine = &scheduler->coroutines[scheduler->current];
+
+	coroutine->state = state;
+	swapcontext(&coroutine->context, &scheduler->schedulerContext);
+
+	coroutine->fd = NO_FILE_DESCRIPTOR;
+	coroutine->hasDeadline = FALSE;
+
+	return coroutine->waitResult;
+}
+
+/**
+ * Waits for the file descriptors and deadlines of the waiting coroutines and makes the woken up ones ready.
+ * Returns 0 on success or a negative error code.
+ */
+static int pollWaitingCoroutines(CoroutineScheduler *scheduler, int isBlocking) {
+	struct pollfd descriptors[MAX_NUMBER_OF_COROUTINES];
+	int descriptorIndexes[MAX_NUMBER_OF_COROUTINES];
+	unsigned int numberOfDescriptors = 0;
+	int hasDeadline = FALSE;
+	unsigned long long earliestDeadline = 0;
+
+	int index;
+	for (index = 0; index < MAX_NUMBER_OF_COROUTINES; index++) {
+		Coroutine *coroutine = &scheduler->coroutines[index];
+		descriptorIndexes[index] = -1;
+		if (coroutine->state != coroutineState_waiting) {
+			continue;
+		}
+
+		if (coroutine->fd != NO_FILE_DESCRIPTOR) {
+			descriptors[numberOfDescriptors].fd = coroutine->fd;
+			descriptors[numberOfDescriptors].events = POLLIN;
+			descriptors[numberOfDescriptors].revents = 0;
+			descriptorIndexes[index] = numberOfDescriptors++;
+		}
+		if (coroutine->hasDeadline && (!hasDeadline || coroutine->deadline < earliestDeadline)) {
+			earliestDeadline = coroutine->deadline;
+			hasDeadline = TRUE;
+		}
+	}
+
+	int timeout = -1;
+	if (!isBlocking) {
+		timeout = 0;
+	} else if (hasDeadline) {
+		unsigned long long now = getMilliseconds();
+		timeout = earliestDeadline > now ? (int)(earliestDeadline - now) : 0;
+	}
+
+	// (This is the only point the activity's thread may be cancelled at)
+	int cancelState;
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancelState);
+	int result = poll(descriptors, numberOfDescriptors, timeout);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+
+	if (result < 0 && errno != EINTR) {
+		logErr("[%s] Error waiting for coroutine events: %s", scheduler->activity->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	unsigned long long now = getMilliseconds();
+	for (index = 0; index < MAX_NUMBER_OF_COROUTINES; index++) {
+		Coroutine *coroutine = &scheduler->coroutines[index];
+		if (coroutine->state != coroutineState_waiting) {
+			continue;
+		}
+
+		if (result > 0 && descriptorIndexes[index] >= 0 && descriptors[descriptorIndexes[index]].revents) {
+			coroutine->waitResult = 1;
+			coroutine->state = coroutineState_ready;
+		} else if (coroutine->hasDeadline && now >= coroutine->deadline) {
+			coroutine->waitResult = 0;
+			coroutine->state = coroutineState_ready;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Runs the activity's 'run' handler as a coroutine.
+ */
+static void runActivity(void *activity, void *argument) {
+	((Activity *)activity)->descriptor->run(activity);
+}
+
+/**
+ * @copydoc runCoroutines
+ */
+int runCoroutines(Activity *activity) {
+	CoroutineScheduler *scheduler = getScheduler(activity);
+	if (!scheduler) {
+		logErr("[%s] Error setting up coroutines!", activity->descriptor->name);
+
+		return -ENOMEM;
+	}
+
+	CoroutineId mainCoroutine = startCoroutine(activity, runActivity, NULL);
+	if (mainCoroutine < 0) {
+		return mainCoroutine;
+	}
+
+	int cancelState;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+
+	int result = 0;
+	while (TRUE) {
+		// Resume every ready coroutine once
+		int isAnyReady = FALSE;
+		int index;
+		for (index = 0; index < MAX_NUMBER_OF_COROUTINES; index++) {
+			if (scheduler->coroutines[index].state == coroutineState_ready) {
+				resumeCoroutine(scheduler, index);
+				if (scheduler->coroutines[index].state == coroutineState_ready) {
+					isAnyReady = TRUE;
+				}
+			}
+		}
+
+		if (!isCoroutineAlive(activity, mainCoroutine)) {
+			break;
+		}
+
+		// (Don't block if a coroutine has yielded or started another one)
+		for (index = 0; index < MAX_NUMBER_OF_COROUTINES && !isAnyReady; index++) {
+			isAnyReady = scheduler->coroutines[index].state == coroutineState_ready;
+		}
+
+		if ((result = pollWaitingCoroutines(scheduler, !isAnyReady)) < 0) {
+			break;
+		}
+	}
+
+	pthread_setcancelstate(cancelState, &cancelState);
+
+	// Drop the remaining coroutines (their stacks are kept for a restart)
+	int index;
+	for (index = 0; index < MAX_NUMBER_OF_COROUTINES; index++) {
+		scheduler->coroutines[index].state = coroutineState_free;
+	}
+
+	return result;
+}
+
+/**
+ * @copydoc destroyCoroutines
+ */
+void destroyCoroutines(Activity *activity) {
+	CoroutineScheduler *scheduler = (CoroutineScheduler *)activity->coroutines;
+	if (!scheduler) {
+		return;
+	}
+
+	int index;
+	for (index = 0; index < MAX_NUMBER_OF_COROUTINES; index++) {
+		free(scheduler->coroutines[index].stack);
+	}
+	free(scheduler);
+
+	activity->coroutines = NULL;
+}
+
+/**
+ * @copydoc interruptCoroutine
+ */
+void interruptCoroutine(Activity *activity, CoroutineId id) {
+	Coroutine *coroutine = getCoroutine((CoroutineScheduler *)activity->coroutines, id);
+	if (!coroutine || coroutine->state != coroutineState_waiting) {
+		return;
+	}
+
+	coroutine->waitResult = -EINTR;
+	coroutine->state = coroutineState_ready;
+}
+
+/**
+ * @copydoc isCoroutineAlive
+ */
+int isCoroutineAlive(Activity *activity, CoroutineId id) {
+	return getCoroutine((CoroutineScheduler *)activity->coroutines, id) != NULL;
+}
+
+/**
+ * @copydoc isInCoroutine
+ */
+int isInCoroutine(Activity *activity) {
+	return activity->coroutines && ((CoroutineScheduler *)activity->coroutines)->current != NO_COROUTINE;
+}
+
+/**
+ * @copydoc yieldCoroutine
+ */
+int yieldCoroutine(Activity *activity) {
+	if (!isInCoroutine(activity)) {
+		return 0;
+	}
+
+	CoroutineScheduler *scheduler = (CoroutineScheduler *)activity->coroutines;
+	scheduler->coroutines[scheduler->current].waitResult = 0;
+
+	return suspendCoroutine(scheduler, coroutineState_ready);
+}
+
+/**
+ * @copydoc awaitDevice
+ */
+int awaitDevice(Activity *activity, int fd, unsigned int timeout) {
+	if (!isInCoroutine(activity)) {
+		// Block the thread
+		struct pollfd descriptor = {
+			.fd = fd,
+			.events = POLLIN
+		};
+		int result = poll(&descriptor, fd != NO_FILE_DESCRIPTOR ? 1 : 0, timeout == WAIT_FOREVER ? -1 : (int)timeout);
+		if (result < 0) {
+			return errno == EINTR ? -EINTR : -EFAULT;
+		}
+
+		return result;
+	}
+
+	CoroutineScheduler *scheduler = (CoroutineScheduler *)activity->coroutines;
+	Coroutine *coroutine = &scheduler->coroutines[scheduler->current];
+	coroutine->fd = fd;
+	coroutine->hasDeadline = timeout != WAIT_FOREVER;
+	coroutine->deadline = getMilliseconds() + timeout;
+	coroutine->waitResult = 0;
+
+	return suspendCoroutine(scheduler, coroutineState_waiting);
+}
+
+/**
+ * @copydoc sleepFor
+ */
+int sleepFor(Activity *activity, unsigned int milliseconds) {
+	return awaitDevice(activity, NO_FILE_DESCRIPTOR, milliseconds);
+}
+
+/**
+ * @copydoc awaitMessage
+ */
+int awaitMessage(Activity *activity, MessageHeader *header, void **content, unsigned int timeout) {
+	return waitForEventInPlace(activity, header, content, timeout);
+}
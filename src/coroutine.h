@@ -0,0 +1,150 @@
+/**
+ * Coroutines
+ *
+ * Runs activities declared with activityExecution_coroutine as a set of cooperative coroutines
+ * sharing the activity's thread. The activity's 'run' handler is the first coroutine,
+ * it can start further coroutines for long running actions.
+ * Waiting with sleepFor(), awaitDevice(), awaitMessage() (or any other receive function of the activity)
+ * suspends the calling coroutine and resumes the others, so the activity keeps handling
+ * its incoming messages while an action is in progress.
+ * Coroutines are never preempted: Between two waits a coroutine has exclusive access to the activity's state.
+ *
+ * @file    coroutine.h
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+#include <limits.h>
+#include "activity.h"
+
+/**
+ * The maximum number of (simultaneously existing) coroutines per activity.
+ */
+#define MAX_NUMBER_OF_COROUTINES 8
+
+/**
+ * The stack size of a coroutine if the activity does not declare one.
+ */
+#define COROUTINE_STACK_SIZE SMALL_ACTIVITY_STACK_SIZE
+
+/**
+ * Waits without a timeout.
+ */
+#define WAIT_FOREVER UINT_MAX
+
+/**
+ * Identifies a coroutine within its activity.
+ */
+typedef int CoroutineId;
+
+#define NULL_COROUTINE_ID 0
+
+/**
+ * Defines the signature of a coroutine.
+ */
+typedef void (*CoroutineFunction)(void *activity, void *argument);
+
+/**
+ * Runs the activity's 'run' handler and the coroutines it starts until the 'run' handler returns
+ * (coroutines which have not finished by then are dropped).
+ * Called on the activity's thread (instead of the 'run' handler).
+ * The thread may only be cancelled while all coroutines are waiting.
+ *
+ * @param activity The activity
+ * @return Returns 0 on success or a negative error code
+ */
+extern int runCoroutines(Activity *activity);
+
+/**
+ * Frees the coroutines (and their stacks) of an activity whose thread has terminated.
+ *
+ * @param activity The activity
+ */
+extern void destroyCoroutines(Activity *activity);
+
+/**
+ * Starts a new coroutine (it is first run when the calling coroutine waits the next time).
+ * Must be called on the activity's thread (e.g. by one of its coroutines or its 'set up' handler).
+ *
+ * @param activity The activity
+ * @param function The coroutine
+ * @param argument The argument passed to the coroutine
+ * @return Returns the coroutine's id or a negative error code
+ */
+extern CoroutineId startCoroutine(Activity *activity, CoroutineFunction function, void *argument);
+
+/**
+ * Interrupts a waiting coroutine: Its pending wait returns -EINTR.
+ * Does nothing if the coroutine is not waiting (or has already finished).
+ * Must be called by one of the activity's coroutines.
+ *
+ * @param activity The activity
+ * @param coroutine The coroutine's id
+ */
+extern void interruptCoroutine(Activity *activity, CoroutineId coroutine);
+
+/**
+ * Checks whether a coroutine is still running (or waiting).
+ *
+ * @param activity The activity
+ * @param coroutine The coroutine's id
+ * @return Returns TRUE if the coroutine has not finished yet
+ */
+extern int isCoroutineAlive(Activity *activity, CoroutineId coroutine);
+
+/**
+ * Checks whether the caller runs as one of the activity's coroutines (and its waits therefore yield).
+ *
+ * @param activity The activity
+ * @return Returns TRUE if called by one of the activity's coroutines
+ */
+extern int isInCoroutine(Activity *activity);
+
+/**
+ * Lets the activity's other ready coroutines run.
+ *
+ * @param activity The activity
+ * @return Returns 0 or -EINTR if the calling coroutine has been interrupted
+ */
+extern int yieldCoroutine(Activity *activity);
+
+/**
+ * Suspends the calling coroutine for some time.
+ * Blocks the thread if not called by a coroutine.
+ *
+ * @param activity The activity
+ * @param milliseconds The time to sleep [ms]
+ * @return Returns 0 when the time has elapsed or -EINTR if the coroutine has been interrupted
+ */
+extern int sleepFor(Activity *activity, unsigned int milliseconds);
+
+/**
+ * Suspends the calling coroutine until a file descriptor is readable or the timeout has elapsed.
+ * Blocks the thread if not called by a coroutine.
+ *
+ * @param activity The activity
+ * @param fd The file descriptor
+ * @param timeout The timeout [ms] (WAIT_FOREVER = none)
+ * @return Returns 1 if the file descriptor is readable, 0 if the timeout has elapsed,
+ * -EINTR if the coroutine has been interrupted or another negative error code
+ */
+extern int awaitDevice(Activity *activity, int fd, unsigned int timeout);
+
+/**
+ * Suspends the calling coroutine until a message is received or the timeout has elapsed
+ * (like waitForEventInPlace(), which also yields if called by a coroutine).
+ *
+ * @param activity The activity
+ * @param header The received message's header
+ * @param content The received message's content (points into the activity's receive buffer)
+ * @param timeout The timeout [ms] (WAIT_FOREVER = none)
+ * @return Returns the message length, 0 if the timeout has elapsed,
+ * -EINTR if the coroutine has been interrupted or another negative error code
+ */
+extern int awaitMessage(Activity *activity, MessageHeader *header, void **content, unsigned int timeout);
+
+#endif /* COROUTINE_H_ */
@@ -33,7 +33,11 @@ static ActivityDescriptor display = {
 		.name = "display",
 		.setUp = setUpDisplay,
 		.run = runDisplay,
-		.tearDown = tearDownDisplay
+		.tearDown = tearDownDisplay,
+		.execution = activityExecution_reactor,
+		// (View changes come in bursts, but are small)
+		.queueCapacity = 32,
+		.maxMessageLength = sizeof(DisplayMessage)
 };
 
 MESSAGE_CONTENT_TYPE_MAPPING(Display, ChangeViewCommand, 1)
@@ -43,7 +47,7 @@ MESSAGE_CONTENT_TYPE_MAPPING(Display, Result, 3)
 static Activity *this = NULL;
 
 ActivityDescriptor getDisplayDescriptor() {
-	return display;
+	return internActivityDescriptor(&display);
 }
 
 static void writeDisplay(char *message) {
@@ -69,49 +73,45 @@ static void runDisplay(void *activity) {
 	char ledsBitFieldString[5];
 	char viewString[301];
 
-	logInfo("[display] Running...");
-
+	// Called by the executor whenever there are incoming messages
 	while(TRUE) {
-		waitForEvent_BEGIN(this, Display, 1000)
-		if (error) {
+		receiveMessage_BEGIN(this, Display)
+		if (result <= 0) {
+			// No more messages
 			//TODO Implement appropriate error handling
-			sleep(10);
-
-			// Try again
-			continue;
+			break;
 		}
-		if (result > 0) {
-			MESSAGE_SELECTOR_BEGIN
-				MESSAGE_BY_TYPE_SELECTOR(message, Display, ChangeViewCommand)
-					//logInfo("[display] Going to change view...");
-
-					powerState = content.powerState;
-					machineState = content.machineState;
-					withMilk = content.withMilk;
-					if (content.coffeeAvailability == available &&
-						content.waterAvailability == available &&
-						content.milkAvailability == available) {
-						ingredientsMissing = FALSE;
-					} else {
-						ingredientsMissing = TRUE;
-					}
-					productIndex = content.productIndex;
-					wasteBinFull = content.wasteBinFull;
-					// setup bitfield:
-					ledsBitField = (powerState << LED_POWER_SWITCH);
-					ledsBitField += (withMilk << LED_WITH_MILK);
-					ledsBitField += (ingredientsMissing << LED_INGREDIENTS_MISSING);
-					ledsBitField += LED_PRODUCT_BUTTON_BY_INDEX(productIndex);
-					ledsBitField += (wasteBinFull << LED_WASTE_BIN_FULL);
-					// write bitfield to string:
-					snprintf(ledsBitFieldString, 4, "%d", ledsBitField);
-					snprintf(viewString, 300, "New view: powerState=%d, machineState=%d, withMilk=%d, ingredientsMissing=%d, productIndex=%d, wasteBinFull=%d",
-						powerState,
-						machineState,
-						withMilk,
-						ingredientsMissing,
-						productIndex,
-						wasteBinFull);
+		MESSAGE_SELECTOR_BEGIN
+			MESSAGE_BY_TYPE_SELECTOR(*message, Display, ChangeViewCommand)
+				//logInfo("[display] Going to change view...");
+
+				powerState = content.powerState;
+				machineState = content.machineState;
+				withMilk = content.withMilk;
+				if (content.coffeeAvailability == available &&
+					content.waterAvailability == available &&
+					content.milkAvailability == available) {
+					ingredientsMissing = FALSE;
+				} else {
+					ingredientsMissing = TRUE;
+				}
+				productIndex = content.productIndex;
+				wasteBinFull = content.wasteBinFull;
+				// setup bitfield:
+				ledsBitField = (powerState << LED_POWER_SWITCH);
+				ledsBitField += (withMilk << LED_WITH_MILK);
+				ledsBitField += (ingredientsMissing << LED_INGREDIENTS_MISSING);
+				ledsBitField += LED_PRODUCT_BUTTON_BY_INDEX(productIndex);
+				ledsBitField += (wasteBinFull << LED_WASTE_BIN_FULL);
+				// write bitfield to string:
+				snprintf(ledsBitFieldString, 4, "%d", ledsBitField);
+				snprintf(viewString, 300, "New view: powerState=%d, machineState=%d, withMilk=%d, ingredientsMissing=%d, productIndex=%d, wasteBinFull=%d",
+					powerState,
+					machineState,
+					withMilk,
+					ingredientsMissing,
+					productIndex,
+					wasteBinFull);
 //					logInfo("[%s] powerState=%d, machineState=%d, withMilk=%d, ingredientsMissing=%d, productIndex=%d, wasteBinFull=%d, ledsBitField=%d, ledBitFieldStr=%s",
 //						this->descriptor->name,
 //						powerState,
@@ -122,17 +122,16 @@ static void runDisplay(void *activity) {
 //						wasteBinFull,
 //						ledsBitField,
 //						ledsBitFieldString);
-					if (!writeNonBlockingDevice("/dev/leds", ledsBitFieldString, wrm_replace, FALSE)) {
-						logErr("[%s] Could not update leds!", this->descriptor->name);
-					}
-					if (!writeNonBlockingDevice("./dev/display", viewString, wrm_append, TRUE)) {
-						logErr("[%s] Could not write to display!", this->descriptor->name);
-					}
-				MESSAGE_BY_TYPE_SELECTOR(message, Display, ShowErrorCommand)
-					writeDisplay(content.message);
-			MESSAGE_SELECTOR_END
-		}
-		waitForEvent_END
+				if (!writeNonBlockingDevice("/dev/leds", ledsBitFieldString, wrm_replace, FALSE)) {
+					logErr("[%s] Could not update leds!", this->descriptor->name);
+				}
+				if (!writeNonBlockingDevice("./dev/display", viewString, wrm_append, TRUE)) {
+					logErr("[%s] Could not write to display!", this->descriptor->name);
+				}
+			MESSAGE_BY_TYPE_SELECTOR(*message, Display, ShowErrorCommand)
+				writeDisplay(content.message);
+		MESSAGE_SELECTOR_END
+		receiveMessage_END
 	}
 }
 
@@ -0,0 +1,436 @@
+/**
+ * Activity executor
+ *
+ * The workers share one epoll instance. Every event source is registered one-shot,
+ * so an event is dispatched to exactly one worker and re-armed after the handler returned.
+ * A per-activity lock serializes the handlers of one activity.
+ *
+ * Bookkeeping of detached activities and unregistered sources is only freed when the executor
+ * is torn down, because a worker may still hold a pointer to it (the executor is set up once
+ * and activities are rarely destroyed, so this costs next to nothing).
+ *
+ * @file    executor.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "defines.h"
+#include "log.h"
+#include "executor.h"
+
+#define MAX_NUMBER_OF_EXECUTOR_WORKERS 8
+
+struct ReactorActivity;
+
+/**
+ * Represents an event source watched on behalf of an activity.
+ */
+typedef struct ReactorSource {
+	struct ReactorActivity *owner; /**< The activity watching the source. */
+	int fd; /**< The watched file descriptor. */
+	int isTimer; /**< Is the source a timer (owned by the executor)? */
+	int isMessageSource; /**< Is the source the activity's message queue or mailbox? */
+	unsigned int events; /**< The watched events (e.g. EPOLLIN). */
+	ReactorHandler handler; /**< The handler (not used for the message source). */
+	volatile int isRegistered; /**< Is the source still watched? */
+	struct ReactorSource *next; /**< The next source of the same activity (or the next retired source). */
+} ReactorSource;
+
+/**
+ * Represents the executor's bookkeeping of an attached activity.
+ */
+typedef struct ReactorActivity {
+	Activity *activity; /**< The activity. */
+	pthread_mutex_t lock; /**< Serializes the activity's handlers. */
+	volatile pthread_t holder; /**< The thread currently holding the lock. */
+	volatile int isHeld; /**< Is the lock held? */
+	volatile int isDetached; /**< Is the activity detached? */
+	ReactorSource *sources; /**< The activity's event sources. */
+	struct ReactorActivity *nextRetired; /**< The next retired activity. */
+} ReactorActivity;
+
+static int reactor = -1;
+static int stopEvent = -1;
+static ReactorSource stopSource;
+static pthread_t workers[MAX_NUMBER_OF_EXECUTOR_WORKERS];
+static unsigned int numberOfWorkers = 0;
+
+static pthread_mutex_t executorLock = PTHREAD_MUTEX_INITIALIZER;
+static ReactorActivity *retiredActivities = NULL;
+static ReactorSource *retiredSources = NULL;
+
+/**
+ * Locks an activity, unless the calling thread already holds the lock
+ * (e.g. when a handler registers another source).
+ * Returns TRUE if the lock has been acquired (and has to be released).
+ */
+static int lockReactorActivity(ReactorActivity *reactorActivity) {
+	if (reactorActivity->isHeld && pthread_equal(reactorActivity->holder, pthread_self())) {
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&reactorActivity->lock);
+	reactorActivity->holder = pthread_self();
+	reactorActivity->isHeld = TRUE;
+
+	return TRUE;
+}
+
+static void unlockReactorActivity(ReactorActivity *reactorActivity, int isLocked) {
+	if (!isLocked) {
+		return;
+	}
+
+	reactorActivity->isHeld = FALSE;
+	pthread_mutex_unlock(&reactorActivity->lock);
+}
+
+static int armSource(ReactorSource *source, int operation) {
+	struct epoll_event eventDescriptor = {
+		.events = source->events | EPOLLONESHOT,
+		.data.ptr = source
+	};
+
+	return epoll_ctl(reactor, operation, source->fd, &eventDescriptor);
+}
+
+static void dispatch(ReactorSource *source) {
+	ReactorActivity *owner = source->owner;
+
+	int isLocked = lockReactorActivity(owner);
+	if (!owner->isDetached && source->isRegistered) {
+		if (source->isTimer) {
+			// Acknowledge the timer expiration(s)
+			uint64_t expirations;
+			if (read(source->fd, &expirations, sizeof(expirations)) < 0) {
+				// Ignore any errors (e.g. a spurious wake up)
+			}
+		}
+
+		if (source->isMessageSource) {
+			owner->activity->descriptor->run(owner->activity);
+
+			// (Lets stopActivity() wait for the queue to be drained with a deadline)
+			if (!isActivityRunning(owner->activity)) {
+				sem_post(&owner->activity->terminated);
+			}
+		} else {
+			source->handler(owner->activity, source->fd);
+		}
+
+		// The handler may have unregistered the source or its activity meanwhile
+		if (!owner->isDetached && source->isRegistered) {
+			if (armSource(source, EPOLL_CTL_MOD) < 0) {
+				logErr("[%s] Error re-arming event source (file descriptor: %d): %s", owner->activity->descriptor->name, source->fd, strerror(errno));
+			}
+		}
+	}
+	unlockReactorActivity(owner, isLocked);
+}
+
+static void * runWorker(void *argument) {
+	while (TRUE) {
+		struct epoll_event firedEvent;
+		int numberOfFiredEvents = epoll_wait(reactor, &firedEvent, 1, -1);
+		if (numberOfFiredEvents < 0) {
+			if (errno != EINTR) {
+				logErr("[executor] Error waiting for event: %s", strerror(errno));
+			}
+
+			continue;
+		}
+		if (numberOfFiredEvents == 0) {
+			continue;
+		}
+
+		ReactorSource *source = (ReactorSource *)firedEvent.data.ptr;
+		if (source == &stopSource) {
+			// The stop event stays signaled, so every worker sees it
+			break;
+		}
+
+		dispatch(source);
+	}
+
+	return NULL;
+}
+
+/**
+ * @copydoc setUpExecutor
+ */
+int setUpExecutor(unsigned int requestedNumberOfWorkers) {
+	int result = 0;
+
+	// Critical section
+	pthread_mutex_lock(&executorLock);
+	if (reactor >= 0) {
+		pthread_mutex_unlock(&executorLock);
+
+		return 0;
+	}
+
+	if (requestedNumberOfWorkers < 1) {
+		requestedNumberOfWorkers = 1;
+	}
+	if (requestedNumberOfWorkers > MAX_NUMBER_OF_EXECUTOR_WORKERS) {
+		requestedNumberOfWorkers = MAX_NUMBER_OF_EXECUTOR_WORKERS;
+	}
+
+	if ((reactor = epoll_create(MAX_NUMBER_OF_ACTIVITIES)) < 0
+		|| (stopEvent = eventfd(0, 0)) < 0) {
+		logErr("[executor] Error setting up reactor: %s", strerror(errno));
+
+		result = -EFAULT;
+	} else {
+		stopSource.fd = stopEvent;
+		struct epoll_event stopEventDescriptor = {
+			.events = EPOLLIN,
+			.data.ptr = &stopSource
+		};
+		if (epoll_ctl(reactor, EPOLL_CTL_ADD, stopEvent, &stopEventDescriptor) < 0) {
+			logErr("[executor] Error registering stop event: %s", strerror(errno));
+
+			result = -EFAULT;
+		}
+	}
+
+	if (result == 0) {
+		for (numberOfWorkers = 0; numberOfWorkers < requestedNumberOfWorkers; numberOfWorkers++) {
+			if (pthread_create(&workers[numberOfWorkers], NULL, runWorker, NULL) != 0) {
+				logErr("[executor] Error creating worker thread: %s", strerror(errno));
+
+				break;
+			}
+		}
+		logInfo("[executor] Running with %u worker thread(s).", numberOfWorkers);
+	}
+	pthread_mutex_unlock(&executorLock);
+
+	return result;
+}
+
+/**
+ * @copydoc tearDownExecutor
+ */
+void tearDownExecutor(void) {
+	if (reactor < 0) {
+		return;
+	}
+
+	if (eventfd_write(stopEvent, 1) < 0) {
+		logErr("[executor] Error stopping workers: %s", strerror(errno));
+	}
+
+	unsigned int i;
+	for (i = 0; i < numberOfWorkers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	numberOfWorkers = 0;
+
+	close(stopEvent);
+	stopEvent = -1;
+	close(reactor);
+	reactor = -1;
+
+	// Now nobody can refer to retired bookkeeping anymore
+	while (retiredSources) {
+		ReactorSource *source = retiredSources;
+		retiredSources = source->next;
+		free(source);
+	}
+	while (retiredActivities) {
+		ReactorActivity *reactorActivity = retiredActivities;
+		retiredActivities = reactorActivity->nextRetired;
+		pthread_mutex_destroy(&reactorActivity->lock);
+		free(reactorActivity);
+	}
+}
+
+static void retireSource(ReactorSource *source) {
+	// Critical section
+	pthread_mutex_lock(&executorLock);
+	source->next = retiredSources;
+	retiredSources = source;
+	pthread_mutex_unlock(&executorLock);
+}
+
+static int addSource(Activity *activity, int fd, unsigned int events, int isTimer, int isMessageSource, ReactorHandler handler) {
+	ReactorActivity *reactorActivity = (ReactorActivity *)activity->reactor;
+	if (!reactorActivity) {
+		logErr("[%s] Error registering event source: Activity is not attached to the executor!", activity->descriptor->name);
+
+		return -EFAULT;
+	}
+
+	ReactorSource *source = (ReactorSource *)malloc(sizeof(ReactorSource));
+	memset(source, 0, sizeof(ReactorSource));
+	source->owner = reactorActivity;
+	source->fd = fd;
+	source->isTimer = isTimer;
+	source->isMessageSource = isMessageSource;
+	source->events = events;
+	source->handler = handler;
+	source->isRegistered = TRUE;
+
+	int isLocked = lockReactorActivity(reactorActivity);
+	source->next = reactorActivity->sources;
+	reactorActivity->sources = source;
+	int result = armSource(source, EPOLL_CTL_ADD);
+	if (result < 0) {
+		logErr("[%s] Error registering event source (file descriptor: %d): %s", activity->descriptor->name, fd, strerror(errno));
+
+		reactorActivity->sources = source->next;
+		free(source);
+	}
+	unlockReactorActivity(reactorActivity, isLocked);
+
+	return result < 0 ? -EFAULT : 0;
+}
+
+/**
+ * @copydoc attachToExecutor
+ */
+int attachToExecutor(Activity *activity) {
+	if (setUpExecutor(DEFAULT_NUMBER_OF_EXECUTOR_WORKERS) < 0) {
+		return -EFAULT;
+	}
+
+	ReactorActivity *reactorActivity = (ReactorActivity *)malloc(sizeof(ReactorActivity));
+	memset(reactorActivity, 0, sizeof(ReactorActivity));
+	reactorActivity->activity = activity;
+	pthread_mutex_init(&reactorActivity->lock, NULL);
+	activity->reactor = reactorActivity;
+
+	logInfo("[%s] Attaching to executor...", activity->descriptor->name);
+
+	// Set up the activity before any of its handlers may run
+	int isLocked = lockReactorActivity(reactorActivity);
+	activity->descriptor->setUp(activity);
+	int result = addSource(activity, getMessageEventSource(activity), EPOLLIN, FALSE, TRUE, NULL);
+	unlockReactorActivity(reactorActivity, isLocked);
+
+	return result;
+}
+
+/**
+ * @copydoc detachFromExecutor
+ */
+void detachFromExecutor(Activity *activity) {
+	ReactorActivity *reactorActivity = (ReactorActivity *)activity->reactor;
+	if (!reactorActivity) {
+		return;
+	}
+
+	// Waits for a possibly running handler
+	int isLocked = lockReactorActivity(reactorActivity);
+	reactorActivity->isDetached = TRUE;
+	while (reactorActivity->sources) {
+		ReactorSource *source = reactorActivity->sources;
+		reactorActivity->sources = source->next;
+
+		source->isRegistered = FALSE;
+		epoll_ctl(reactor, EPOLL_CTL_DEL, source->fd, NULL);
+		if (source->isTimer) {
+			close(source->fd);
+		}
+		retireSource(source);
+	}
+
+	activity->descriptor->tearDown(activity);
+
+	logInfo("[%s] Detached from executor.", activity->descriptor->name);
+	unlockReactorActivity(reactorActivity, isLocked);
+
+	activity->reactor = NULL;
+
+	// Critical section
+	pthread_mutex_lock(&executorLock);
+	reactorActivity->nextRetired = retiredActivities;
+	retiredActivities = reactorActivity;
+	pthread_mutex_unlock(&executorLock);
+}
+
+/**
+ * @copydoc registerReactorSource
+ */
+int registerReactorSource(Activity *activity, int fd, ReactorHandler handler) {
+	return addSource(activity, fd, EPOLLIN, FALSE, FALSE, handler);
+}
+
+/**
+ * @copydoc registerReactorSourceForEvents
+ */
+int registerReactorSourceForEvents(Activity *activity, int fd, unsigned int events, ReactorHandler handler) {
+	return addSource(activity, fd, events, FALSE, FALSE, handler);
+}
+
+/**
+ * @copydoc registerReactorTimer
+ */
+int registerReactorTimer(Activity *activity, unsigned int interval, ReactorHandler handler) {
+	int timer = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (timer < 0) {
+		logErr("[%s] Error creating timer: %s", activity->descriptor->name, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	struct itimerspec timerSpecification = {
+		.it_interval = { .tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1000000 },
+		.it_value = { .tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1000000 }
+	};
+	if (timerfd_settime(timer, 0, &timerSpecification, NULL) < 0) {
+		logErr("[%s] Error starting timer: %s", activity->descriptor->name, strerror(errno));
+		close(timer);
+
+		return -EFAULT;
+	}
+
+	if (addSource(activity, timer, EPOLLIN, TRUE, FALSE, handler) < 0) {
+		close(timer);
+
+		return -EFAULT;
+	}
+
+	return timer;
+}
+
+/**
+ * @copydoc unregisterReactorSource
+ */
+void unregisterReactorSource(Activity *activity, int fd) {
+	ReactorActivity *reactorActivity = (ReactorActivity *)activity->reactor;
+	if (!reactorActivity) {
+		return;
+	}
+
+	int isLocked = lockReactorActivity(reactorActivity);
+	ReactorSource **link = &reactorActivity->sources;
+	while (*link) {
+		ReactorSource *source = *link;
+		if (source->fd == fd && !source->isMessageSource) {
+			*link = source->next;
+
+			source->isRegistered = FALSE;
+			epoll_ctl(reactor, EPOLL_CTL_DEL, source->fd, NULL);
+			if (source->isTimer) {
+				close(source->fd);
+			}
+			retireSource(source);
+
+			break;
+		}
+		link = &source->next;
+	}
+	unlockReactorActivity(reactorActivity, isLocked);
+}
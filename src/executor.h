@@ -0,0 +1,103 @@
+/**
+ * Activity executor
+ *
+ * Runs activities declared with activityExecution_reactor on a small pool of worker threads
+ * instead of a dedicated thread per activity. All event sources (incoming messages,
+ * file descriptors and timers) of these activities are watched by one shared epoll reactor.
+ * A handler is never run concurrently for the same activity.
+ *
+ * @file    executor.h
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include "activity.h"
+
+/**
+ * Default number of worker threads if the executor is started implicitly.
+ */
+#define DEFAULT_NUMBER_OF_EXECUTOR_WORKERS 1
+
+/**
+ * Defines the signature of a handler for a file descriptor or timer event.
+ */
+typedef void (*ReactorHandler)(void *activity, int fd);
+
+/**
+ * Starts the executor (does nothing if it is already running).
+ *
+ * @param numberOfWorkers The number of worker threads
+ * @return Returns 0 on success or a negative error code
+ */
+extern int setUpExecutor(unsigned int numberOfWorkers);
+
+/**
+ * Stops the executor and waits for its worker threads.
+ * All activities have to be detached before.
+ */
+extern void tearDownExecutor(void);
+
+/**
+ * Attaches an activity to the executor.
+ * Runs the activity's 'set up' handler and starts watching its incoming messages:
+ * The activity's 'run' handler is called whenever there are incoming messages.
+ * It must not block and should receive messages until there are no more.
+ *
+ * @param activity The activity (its message queue or mailbox must be in non-blocking mode)
+ * @return Returns 0 on success or a negative error code
+ */
+extern int attachToExecutor(Activity *activity);
+
+/**
+ * Detaches an activity from the executor.
+ * Stops watching all of the activity's event sources and runs its 'tear down' handler.
+ *
+ * @param activity The activity
+ */
+extern void detachFromExecutor(Activity *activity);
+
+/**
+ * Watches a file descriptor on behalf of an activity.
+ *
+ * @param activity The activity
+ * @param fd The file descriptor
+ * @param handler The handler which is called when the file descriptor is readable
+ * @return Returns 0 on success or a negative error code
+ */
+extern int registerReactorSource(Activity *activity, int fd, ReactorHandler handler);
+
+/**
+ * Watches a file descriptor for the given events on behalf of an activity.
+ *
+ * @param activity The activity
+ * @param fd The file descriptor
+ * @param events The events (e.g. EPOLLIN | EPOLLPRI)
+ * @param handler The handler which is called when one of the events occurs
+ * @return Returns 0 on success or a negative error code
+ */
+extern int registerReactorSourceForEvents(Activity *activity, int fd, unsigned int events, ReactorHandler handler);
+
+/**
+ * Sets up a periodic timer on behalf of an activity.
+ *
+ * @param activity The activity
+ * @param interval The timer interval [ms]
+ * @param handler The handler which is called when the timer elapses
+ * @return Returns the timer's file descriptor or a negative error code
+ */
+extern int registerReactorTimer(Activity *activity, unsigned int interval, ReactorHandler handler);
+
+/**
+ * Stops watching a file descriptor or timer.
+ * (A timer's file descriptor is closed.)
+ *
+ * @param activity The activity
+ * @param fd The file descriptor
+ */
+extern void unregisterReactorSource(Activity *activity, int fd);
+
+#endif /* EXECUTOR_H_ */
@@ -13,16 +13,51 @@
 #include <signal.h>
 #include "log.h"
 #include "activity.h"
+#include "executor.h"
 #include "coffeeSupply.h"
 #include "waterSupply.h"
 #include "milkSupply.h"
 #include "userInterface.h"
 #include "serviceInterface.h"
 #include "mainController.h"
+#include "startup.h"
+#include "stateMachineEngine.h"
+
+/**
+ * Number of executor worker threads
+ * (shared by all activities declared with activityExecution_reactor,
+ * can be overridden by the first command line argument)
+ */
+#define NUMBER_OF_EXECUTOR_WORKERS 1
+
+/**
+ * The subsystems and their dependencies
+ * (an activity is started as soon as the activities it sends messages to at startup are ready,
+ * the others are started in parallel)
+ */
+static StartupEntry subsystems[] = {
+	{ .descriptor = getMainControllerDescriptor },
+	{ .descriptor = getServiceInterfaceDescriptor },
+	// (Reports the bean and waste bin status to the main controller)
+	{ .descriptor = getCoffeeSupplyDescriptor, .dependencies = { getMainControllerDescriptor } },
+	{ .descriptor = getWaterSupplyDescriptor },
+	{ .descriptor = getMilkSupplyDescriptor },
+	// (Sends the initial switches state to the main controller, which then switches the supplies on)
+	{ .descriptor = getUserInterfaceDescriptor, .dependencies = { getMainControllerDescriptor, getCoffeeSupplyDescriptor, getWaterSupplyDescriptor, getMilkSupplyDescriptor } }
+};
+
+#define NUMBER_OF_SUBSYSTEMS (sizeof(subsystems) / sizeof(StartupEntry))
+
+static volatile sig_atomic_t isTearDownRequested = 0;
 
 static void sigCtrlC(int sig)
 {
-	// Do nothing here
+	isTearDownRequested = 1;
+}
+
+static void sigUsr1(int sig)
+{
+	// Do nothing here (the memory footprint and the transition tables are logged by the main thread)
 }
 
 int main(int argc, char **argv) {
@@ -30,28 +65,43 @@ int main(int argc, char **argv) {
 
 	setUpSyslog();
 
-	Activity *coffeeSupply = createActivity(getCoffeeSupplyDescriptor(), messageQueue_blocking);
-	Activity *waterSupply = createActivity(getWaterSupplyDescriptor(), messageQueue_blocking);
-	Activity *milkSupply = createActivity(getMilkSupplyDescriptor(), messageQueue_blocking);
-	Activity *userInterface = createActivity(getUserInterfaceDescriptor(), messageQueue_blocking);
-	Activity *serviceInterface = createActivity(getServiceInterfaceDescriptor(), messageQueue_blocking);
-	Activity *mainController = createActivity(getMainControllerDescriptor(), messageQueue_blocking);
+	unsigned int numberOfExecutorWorkers = NUMBER_OF_EXECUTOR_WORKERS;
+	if (argc > 1) {
+		numberOfExecutorWorkers = strtoul(argv[1], NULL, 10);
+	}
+	setUpExecutor(numberOfExecutorWorkers);
+
+	if (startUpActivities(subsystems, NUMBER_OF_SUBSYSTEMS, DEFAULT_STARTUP_TIMEOUT) < 0) {
+		logErr("[init] Not all subsystems have been started!");
+	}
+	logStartupTimeline();
 
-	// Establish the signal handler
+	// Establish the signal handlers
 	(void) signal(SIGINT, sigCtrlC);
+	(void) signal(SIGUSR1, sigUsr1);
 
 	// Wait for SIGINT signal
-	pause();
+	// (SIGUSR1 logs the memory footprint and the state machines' transition tables at steady state)
+	while (!isTearDownRequested) {
+		pause();
+
+		if (!isTearDownRequested) {
+			logMemoryFootprint();
+			logStateMachineTables();
+		}
+	}
+
+	logMemoryFootprint();
+	logStateMachineTables();
+
+	// (Including the activities created on their first use and the milestones reached meanwhile)
+	logStartupTimeline();
 
 	logInfo("[init] Tearing down subsystems...");
 
-	destroyActivity(mainController);
-	destroyActivity(serviceInterface);
-	destroyActivity(userInterface);
-	destroyActivity(milkSupply);
-	destroyActivity(waterSupply);
+	tearDownActivities(subsystems, NUMBER_OF_SUBSYSTEMS);
 
-	destroyActivity(coffeeSupply);
+	tearDownExecutor();
 	logInfo("[init] ...done. (tear down subsystems)");
 
 	tearDownSyslog();
@@ -0,0 +1,373 @@
+/**
+ * In-process mailbox
+ *
+ * The ring follows the well-known bounded queue design with a sequence number per slot:
+ * Producers claim a slot by advancing the tail with compare-and-swap,
+ * the single consumer releases a slot by advancing its sequence number by one lap.
+ * The event file descriptor is a (non-blocking) semaphore counting the published messages of all lanes.
+ * A slot referencing a shared message holds one of its references until the consumer has taken the message.
+ *
+ * @file    mailbox.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#include <unistd.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include "defines.h"
+#include "mailbox.h"
+
+/**
+ * How many times the consumer yields before it sleeps while waiting for a producer to publish a claimed slot.
+ */
+#define PUBLICATION_YIELD_ATTEMPTS 100
+
+/**
+ * @copydoc createMailbox
+ */
+Mailbox *createMailbox(unsigned int capacity, unsigned int messageSize) {
+	unsigned int slotCapacity = 1;
+	while (slotCapacity < capacity) {
+		slotCapacity <<= 1;
+	}
+
+	Mailbox *mailbox = (Mailbox *)malloc(sizeof(Mailbox));
+	if (!mailbox) {
+		return NULL;
+	}
+	memset(mailbox, 0, sizeof(Mailbox));
+
+	mailbox->capacity = slotCapacity;
+	mailbox->messageSize = messageSize;
+	mailbox->slots = (MailboxSlot *)malloc(NUMBER_OF_MAILBOX_LANES * slotCapacity * sizeof(MailboxSlot));
+	mailbox->buffer = (unsigned char *)malloc(NUMBER_OF_MAILBOX_LANES * slotCapacity * messageSize);
+	mailbox->event = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK);
+	if (!mailbox->slots || !mailbox->buffer || mailbox->event < 0) {
+		destroyMailbox(mailbox);
+
+		return NULL;
+	}
+
+	unsigned int lane;
+	for (lane = 0; lane < NUMBER_OF_MAILBOX_LANES; lane++) {
+		mailbox->lanes[lane].slots = mailbox->slots + lane * slotCapacity;
+
+		unsigned int i;
+		for (i = 0; i < slotCapacity; i++) {
+			mailbox->lanes[lane].slots[i].sequence = i;
+			mailbox->lanes[lane].slots[i].length = 0;
+			mailbox->lanes[lane].slots[i].sharedMessage = NULL;
+			mailbox->lanes[lane].slots[i].message = mailbox->buffer + (lane * slotCapacity + i) * messageSize;
+		}
+	}
+
+	return mailbox;
+}
+
+/**
+ * @copydoc destroyMailbox
+ */
+void destroyMailbox(Mailbox *mailbox) {
+	if (!mailbox) {
+		return;
+	}
+
+	if (mailbox->event >= 0) {
+		// Release the shared messages referenced by pending messages
+		if (mailbox->slots && mailbox->buffer) {
+			resetMailbox(mailbox, TRUE);
+		}
+
+		close(mailbox->event);
+	}
+	free(mailbox->buffer);
+	free(mailbox->slots);
+	free(mailbox);
+}
+
+/**
+ * Removes the next published message from a lane (without touching the event file descriptor).
+ * Returns the message length or -EAGAIN if the lane is empty.
+ */
+static int popLaneMessage(Mailbox *mailbox, MailboxLane *lane, void *buffer, unsigned long length) {
+	unsigned int position = lane->head;
+	MailboxSlot *slot = &lane->slots[position & (mailbox->capacity - 1)];
+
+	int difference = (int)(slot->sequence - (position + 1));
+	if (difference < 0) {
+		return -EAGAIN;
+	}
+	// Read the message only after the producer's sequence update is visible
+	__sync_synchronize();
+
+	SharedMessage *sharedMessage = slot->sharedMessage;
+	slot->sharedMessage = NULL;
+
+	int result = slot->length;
+	if (slot->length > length) {
+		result = -EMSGSIZE;
+	} else {
+		memcpy(buffer, sharedMessage ? sharedMessage->message : slot->message, slot->length);
+	}
+
+	// Hand the slot back to the producers (one lap later)
+	__sync_synchronize();
+	slot->sequence = position + mailbox->capacity;
+	lane->head = position + 1;
+
+	if (sharedMessage) {
+		releaseSharedMessage(sharedMessage);
+	}
+
+	return result;
+}
+
+/**
+ * Removes the next published message from the highest non-empty lane.
+ * If a producer has claimed a lane's next slot but not yet published it, waits until it does
+ * (its message may already have been counted: another producer's later slot can be published first).
+ * Returns the message length or -EAGAIN if all lanes are empty.
+ */
+static int popMessage(Mailbox *mailbox, void *buffer, unsigned long length) {
+	unsigned int attempt;
+	for (attempt = 0; ; attempt++) {
+		int isAnySlotClaimed = FALSE;
+
+		int lane;
+		for (lane = NUMBER_OF_MAILBOX_LANES - 1; lane >= 0; lane--) {
+			int result = popLaneMessage(mailbox, &mailbox->lanes[lane], buffer, length);
+			if (result != -EAGAIN) {
+				return result;
+			}
+			if (mailbox->lanes[lane].tail != mailbox->lanes[lane].head) {
+				isAnySlotClaimed = TRUE;
+			}
+		}
+		if (!isAnySlotClaimed) {
+			return -EAGAIN;
+		}
+
+		// Give the producer a chance to publish its slot, back off if it does not
+		// (it may run with a lower priority on the same CPU)
+		if (attempt < PUBLICATION_YIELD_ATTEMPTS) {
+			sched_yield();
+		} else {
+			usleep(100);
+		}
+	}
+}
+
+/**
+ * @copydoc resetMailbox
+ */
+void resetMailbox(Mailbox *mailbox, int isNonBlocking) {
+	// Discard pending wake ups and messages
+	// (A message's wake up may be deferred, so they are not necessarily discarded pairwise)
+	eventfd_t value;
+	while (read(mailbox->event, &value, sizeof(value)) > 0 || errno == EINTR);
+	unsigned char discardBuffer[mailbox->messageSize];
+	while (popMessage(mailbox, discardBuffer, mailbox->messageSize) != -EAGAIN);
+
+	mailbox->isNonBlocking = isNonBlocking;
+}
+
+/**
+ * Claims a free slot of a lane.
+ * Returns the slot (and its position) or NULL if the lane is full.
+ */
+static MailboxSlot *claimSlot(Mailbox *mailbox, MailboxLane *lane, unsigned int *position) {
+	MailboxSlot *slot;
+	*position = lane->tail;
+	while (TRUE) {
+		slot = &lane->slots[*position & (mailbox->capacity - 1)];
+
+		int difference = (int)(slot->sequence - *position);
+		if (difference == 0) {
+			if (__sync_bool_compare_and_swap(&lane->tail, *position, *position + 1)) {
+				return slot;
+			}
+			*position = lane->tail;
+		} else if (difference < 0) {
+			// The consumer has not yet released this slot: the lane is full
+			return NULL;
+		} else {
+			// Another producer claimed this slot
+			*position = lane->tail;
+		}
+	}
+}
+
+/**
+ * Publishes a filled slot (and wakes up the consumer unless the wake up is deferred).
+ */
+static int publishSlot(Mailbox *mailbox, MailboxSlot *slot, unsigned int position, int isWakeUpDeferred) {
+	__sync_synchronize();
+	slot->sequence = position + 1;
+
+	if (isWakeUpDeferred) {
+		return 0;
+	}
+
+	// Wake up the consumer
+	return wakeUpMailbox(mailbox, 1);
+}
+
+/**
+ * @copydoc postToMailbox
+ */
+int postToMailbox(Mailbox *mailbox, unsigned int laneIndex, const void *message, unsigned long length, int isWakeUpDeferred) {
+	if (laneIndex >= NUMBER_OF_MAILBOX_LANES) {
+		return -EINVAL;
+	}
+	if (length > mailbox->messageSize) {
+		return -EMSGSIZE;
+	}
+
+	unsigned int position;
+	MailboxSlot *slot = claimSlot(mailbox, &mailbox->lanes[laneIndex], &position);
+	if (!slot) {
+		return -EAGAIN;
+	}
+
+	// Fill and publish the slot
+	memcpy(slot->message, message, length);
+	slot->length = length;
+
+	return publishSlot(mailbox, slot, position, isWakeUpDeferred);
+}
+
+/**
+ * @copydoc postSharedToMailbox
+ */
+int postSharedToMailbox(Mailbox *mailbox, unsigned int laneIndex, SharedMessage *sharedMessage, int isWakeUpDeferred) {
+	if (laneIndex >= NUMBER_OF_MAILBOX_LANES) {
+		return -EINVAL;
+	}
+	if (sharedMessage->length > mailbox->messageSize) {
+		return -EMSGSIZE;
+	}
+
+	unsigned int position;
+	MailboxSlot *slot = claimSlot(mailbox, &mailbox->lanes[laneIndex], &position);
+	if (!slot) {
+		return -EAGAIN;
+	}
+
+	// Reference (instead of copy) the message and publish the slot
+	slot->sharedMessage = sharedMessage;
+	slot->length = sharedMessage->length;
+
+	return publishSlot(mailbox, slot, position, isWakeUpDeferred);
+}
+
+/**
+ * @copydoc wakeUpMailbox
+ */
+int wakeUpMailbox(Mailbox *mailbox, unsigned int numberOfMessages) {
+	if (numberOfMessages > 0 && eventfd_write(mailbox->event, numberOfMessages) < 0) {
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/**
+ * @copydoc takeFromMailbox
+ */
+int takeFromMailbox(Mailbox *mailbox, void *buffer, unsigned long length) {
+	while (TRUE) {
+		int result = tryTakeFromMailbox(mailbox, buffer, length);
+		if (result != 0 || mailbox->isNonBlocking) {
+			return result;
+		}
+
+		// Wait for the next message
+		struct pollfd eventDescriptor = {
+			.fd = mailbox->event,
+			.events = POLLIN
+		};
+		if (poll(&eventDescriptor, 1, -1) < 0 && errno != EINTR) {
+			return -EFAULT;
+		}
+	}
+}
+
+/**
+ * @copydoc tryTakeFromMailbox
+ */
+int tryTakeFromMailbox(Mailbox *mailbox, void *buffer, unsigned long length) {
+	// Every published message increments the semaphore by one,
+	// so after a successful read there is a message to pop (possibly behind a slot still being filled)
+	eventfd_t value;
+	while (read(mailbox->event, &value, sizeof(value)) < 0) {
+		if (errno == EAGAIN) {
+			// No message available
+			return 0;
+		}
+		if (errno != EINTR) {
+			return -EFAULT;
+		}
+	}
+
+	int result = popMessage(mailbox, buffer, length);
+	if (result == -EAGAIN) {
+		// A deferred wake up for messages which have already been taken (or discarded by a reset)
+		return 0;
+	}
+
+	return result;
+}
+
+/**
+ * @copydoc createSharedMessage
+ */
+SharedMessage *createSharedMessage(unsigned long length) {
+	SharedMessage *sharedMessage = (SharedMessage *)malloc(sizeof(SharedMessage) + length);
+	if (!sharedMessage) {
+		return NULL;
+	}
+
+	sharedMessage->referenceCount = 1;
+	sharedMessage->length = length;
+
+	return sharedMessage;
+}
+
+/**
+ * @copydoc retainSharedMessage
+ */
+void retainSharedMessage(SharedMessage *sharedMessage) {
+	__sync_add_and_fetch(&sharedMessage->referenceCount, 1);
+}
+
+/**
+ * @copydoc releaseSharedMessage
+ */
+void releaseSharedMessage(SharedMessage *sharedMessage) {
+	if (__sync_sub_and_fetch(&sharedMessage->referenceCount, 1) == 0) {
+		free(sharedMessage);
+	}
+}
+
+/**
+ * @copydoc getMailboxLaneLength
+ */
+unsigned int getMailboxLaneLength(Mailbox *mailbox, unsigned int laneIndex) {
+	MailboxLane *lane = &mailbox->lanes[laneIndex];
+
+	return lane->tail - lane->head;
+}
+
+/**
+ * @copydoc getMailboxEventSource
+ */
+int getMailboxEventSource(Mailbox *mailbox) {
+	return mailbox->event;
+}
@@ -0,0 +1,188 @@
+/**
+ * In-process mailbox
+ *
+ * A bounded, lock-free multi producer/single consumer message ring.
+ * Activities living in the same process exchange messages over mailboxes
+ * instead of kernel message queues. An event file descriptor signals pending messages,
+ * so a mailbox can be waited on with epoll just like a message queue.
+ * Messages are posted to one of several lanes (one per message priority):
+ * Messages in higher lanes are taken first and a full lane does not block the other lanes.
+ * A message to be delivered to several mailboxes can be shared:
+ * Its slots then just reference the (reference counted) message instead of holding a copy.
+ *
+ * @file    mailbox.h
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#define NUMBER_OF_MAILBOX_LANES 3
+
+/**
+ * Represents a message which is posted to several mailboxes without being copied.
+ * It is freed as soon as the last reference has been released.
+ */
+typedef struct {
+	volatile unsigned int referenceCount; /**< The number of references (the creator's and one per mailbox slot). */
+	unsigned int length; /**< The message length. */
+	unsigned char message[]; /**< The message. */
+} SharedMessage;
+
+/**
+ * Represents a message slot within a mailbox.
+ */
+typedef struct {
+	volatile unsigned int sequence; /**< The slot's sequence number (synchronizes producers and the consumer). */
+	unsigned int length; /**< The length of the message stored in the slot. */
+	unsigned char *message; /**< The slot's message buffer. */
+	SharedMessage *sharedMessage; /**< The shared message referenced by the slot (NULL if the message is stored in the slot's buffer). */
+} MailboxSlot;
+
+/**
+ * Represents a lane (= message ring) within a mailbox.
+ */
+typedef struct {
+	volatile unsigned int head; /**< The consumer's position. */
+	volatile unsigned int tail; /**< The producers' position. */
+	MailboxSlot *slots; /**< The lane's message slots. */
+} MailboxLane;
+
+/**
+ * Represents a mailbox.
+ */
+typedef struct {
+	unsigned int capacity; /**< The number of slots per lane (a power of two). */
+	unsigned int messageSize; /**< The maximum message length. */
+	MailboxLane lanes[NUMBER_OF_MAILBOX_LANES]; /**< The lanes (messages in higher lanes are taken first). */
+	int event; /**< The event file descriptor (readable as long as there are messages). */
+	int isNonBlocking; /**< Does takeFromMailbox() return immediately if there is no message? */
+	MailboxSlot *slots; /**< The message slots of all lanes. */
+	unsigned char *buffer; /**< The memory of all message buffers. */
+} Mailbox;
+
+/**
+ * Creates a new mailbox.
+ *
+ * @param capacity The maximum number of pending messages per lane (rounded up to a power of two)
+ * @param messageSize The maximum message length
+ * @return Returns the new mailbox or NULL on error
+ */
+extern Mailbox *createMailbox(unsigned int capacity, unsigned int messageSize);
+
+/**
+ * Destroys a mailbox.
+ *
+ * @param mailbox The mailbox
+ */
+extern void destroyMailbox(Mailbox *mailbox);
+
+/**
+ * Discards all pending messages and sets the blocking mode for taking messages.
+ * Must only be called while there is no consumer.
+ *
+ * @param mailbox The mailbox
+ * @param isNonBlocking Should takeFromMailbox() return immediately if there is no message?
+ */
+extern void resetMailbox(Mailbox *mailbox, int isNonBlocking);
+
+/**
+ * Posts a message to a mailbox. Never blocks.
+ *
+ * @param mailbox The mailbox
+ * @param laneIndex The lane (0 .. NUMBER_OF_MAILBOX_LANES - 1, messages in higher lanes are taken first)
+ * @param message The message
+ * @param length The message length
+ * @param isWakeUpDeferred If TRUE, the consumer is not woken up (the caller has to call wakeUpMailbox() later,
+ *		the consumer may take the message before with another message's wake up)
+ * @return Returns 0 on success, -EAGAIN if the lane is full or another negative error code
+ */
+extern int postToMailbox(Mailbox *mailbox, unsigned int laneIndex, const void *message, unsigned long length, int isWakeUpDeferred);
+
+/**
+ * Posts a reference to a shared message to a mailbox. Never blocks.
+ * On success, the mailbox takes over one reference (the caller has to retain the message before).
+ *
+ * @param mailbox The mailbox
+ * @param laneIndex The lane (0 .. NUMBER_OF_MAILBOX_LANES - 1, messages in higher lanes are taken first)
+ * @param sharedMessage The shared message
+ * @param isWakeUpDeferred If TRUE, the consumer is not woken up (the caller has to call wakeUpMailbox() later,
+ *		the consumer may take the message before with another message's wake up)
+ * @return Returns 0 on success, -EAGAIN if the lane is full or another negative error code
+ */
+extern int postSharedToMailbox(Mailbox *mailbox, unsigned int laneIndex, SharedMessage *sharedMessage, int isWakeUpDeferred);
+
+/**
+ * Wakes up the consumer for messages posted with a deferred wake up.
+ * The consumer ignores wake ups for messages it has already taken.
+ *
+ * @param mailbox The mailbox
+ * @param numberOfMessages The number of messages posted with a deferred wake up
+ * @return Returns 0 on success or a negative error code
+ */
+extern int wakeUpMailbox(Mailbox *mailbox, unsigned int numberOfMessages);
+
+/**
+ * Takes the next message (from the highest non-empty lane) from a mailbox.
+ * Must only be called by the mailbox's (single) consumer.
+ *
+ * @param mailbox The mailbox
+ * @param buffer The buffer to copy the message to
+ * @param length The buffer length
+ * @return Returns the message length, 0 if there is no message (non-blocking mode only) or a negative error code
+ */
+extern int takeFromMailbox(Mailbox *mailbox, void *buffer, unsigned long length);
+
+/**
+ * Takes the next message from a mailbox if there is one (never blocks).
+ * Must only be called by the mailbox's (single) consumer.
+ *
+ * @param mailbox The mailbox
+ * @param buffer The buffer to copy the message to
+ * @param length The buffer length
+ * @return Returns the message length, 0 if there is no message or a negative error code
+ */
+extern int tryTakeFromMailbox(Mailbox *mailbox, void *buffer, unsigned long length);
+
+/**
+ * Creates a new shared message (holding one reference for the creator).
+ *
+ * @param length The message length (the message has to be filled in by the creator)
+ * @return Returns the new shared message or NULL on error
+ */
+extern SharedMessage *createSharedMessage(unsigned long length);
+
+/**
+ * Adds a reference to a shared message.
+ *
+ * @param sharedMessage The shared message
+ */
+extern void retainSharedMessage(SharedMessage *sharedMessage);
+
+/**
+ * Releases a reference to a shared message (and frees it if it was the last one).
+ *
+ * @param sharedMessage The shared message
+ */
+extern void releaseSharedMessage(SharedMessage *sharedMessage);
+
+/**
+ * Gets the number of pending messages in a lane (a snapshot, producers and the consumer may change it anytime).
+ *
+ * @param mailbox The mailbox
+ * @param laneIndex The lane
+ * @return Returns the number of pending messages
+ */
+extern unsigned int getMailboxLaneLength(Mailbox *mailbox, unsigned int laneIndex);
+
+/**
+ * Gets the file descriptor which can be polled for pending messages.
+ *
+ * @param mailbox The mailbox
+ * @return Returns the event file descriptor
+ */
+extern int getMailboxEventSource(Mailbox *mailbox);
+
+#endif /* MAILBOX_H_ */
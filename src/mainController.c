@@ -14,10 +14,11 @@
 #include "device.h"
 #include "log.h"
 #include "memoryManagement.h"
-#include "stateMachineEngine.h"
+#include "stateMachineDescription.h"
 #include "coffeeSupply.h"
 #include "waterSupply.h"
 #include "milkSupply.h"
+#include "startup.h"
 #include "mainController.h"
 
 typedef enum {
@@ -31,11 +32,16 @@ static void tearDownMainController(void *activity);
 
 static void sendError(int code);
 
+static void coffeeSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context);
+static void waterSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context);
+static void milkSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context);
+
 static ActivityDescriptor mainControllerDescriptor = {
 		.name = "mainController",
 		.setUp = setUpMainController,
 		.run = runMainController,
-		.tearDown = tearDownMainController
+		.tearDown = tearDownMainController,
+		.stackSize = SMALL_ACTIVITY_STACK_SIZE
 };
 
 MESSAGE_CONTENT_TYPE_MAPPING(MainController, InitCommand, 1)
@@ -51,38 +57,41 @@ MESSAGE_CONTENT_TYPE_MAPPING(MainController, CoffeeWasteBinStateChangedNotificat
 
 static Activity *this;
 
-static unsigned productToProduceIndex = 0;
-static unsigned int produceWithMilk = FALSE;
-
-static ActivityDescriptor clientDescriptor = NULL_ACTIVITY;
-
 ActivityDescriptor getMainControllerDescriptor() {
-	return mainControllerDescriptor;
+	return internActivityDescriptor(&mainControllerDescriptor);
 }
 
+/**
+ * The activities (= states) of the coffee making process (and their state objects).
+ */
+#define COFFEE_MAKING_PROCESS_STATES(STATE, _) \
+	STATE(_, coffeeMakingActivity_checkingCupFillState, checkingCupFillStateActivity) \
+	STATE(_, coffeeMakingActivity_preparing, preparingActivity) \
+	STATE(_, coffeeMakingActivity_supplyingWater, supplyingWaterActivity) \
+	STATE(_, coffeeMakingActivity_withMilkGateway, withMilkGateway) \
+	STATE(_, coffeeMakingActivity_supplyingMilk, supplyingMilkActivity) \
+	STATE(_, coffeeMakingActivity_ejectingCoffeeWaste, ejectingCoffeeWasteActivity) \
+	STATE(_, coffeeMakingActivity_finished, finishedState) \
+	STATE(_, coffeeMakingActivity_error, errorState)
+
 /**
  * Represents an activity (= state) within the coffee making process.
  */
-typedef enum {
-	coffeeMakingActivity_warmingUp,
-	coffeeMakingActivity_checkingCupFillState,
-	coffeeMakingActivity_grindingCoffeePowder,
-	coffeeMakingActivity_supplyingWater,
-	coffeeMakingActivity_withMilkGateway,
-	coffeeMakingActivity_supplyingMilk,
-	coffeeMakingActivity_ejectingCoffeeWaste,
-	coffeeMakingActivity_finished,
-	coffeeMakingActivity_error,
-	coffeeMakingActivity_undefined
-} CoffeeMakingActivity;
+DECLARE_STATE_MACHINE_ENUM(CoffeeMakingActivity, COFFEE_MAKING_PROCESS_STATES)
 
 /**
  * Represents an ongoing coffee making process instance.
  */
 typedef struct {
+	StateMachineInstance machine; /**< The process's state machine instance (its context is the process instance). */
+	StateMachineInstance *owner; /**< The state machine which is notified when the process has finished or failed. */
 	unsigned int productIndex; /**< The product currently produced. */
 	int withMilk; /**< Is the product produced with milk? */
 	CoffeeMakingActivity currentActivity; /**< The activity which is currently executed. */
+	int warmUpTimer; /**< The timer ending the warm up (or -1). */
+	RequestToken supplyRequest; /**< The supply request the process is waiting for (NULL_REQUEST_TOKEN if none). */
+	ProductionResult result; /**< The process's result. */
+	int error; /**< The error which has made the process fail (or NO_ERROR). */
 } MakeCoffeeProcessInstance;
 
 /**
@@ -98,7 +107,9 @@ typedef struct {
 	Availability isMilkAvailable;
 	int isCoffeeWasteBinFull;
 	//ProductListElement *products; /**< The product definition collection. */
+	MakeCoffeeProcessInstance *requestedCoffeeMaking; /**< The process instance for the selected product (until it is started or rejected). */
 	MakeCoffeeProcessInstance *ongoingCoffeeMaking; /**< A possibly ongoing coffee making process instance. */
+	MakeCoffeeProcessInstance *retiredCoffeeMaking; /**< A process instance which has ended (deleted as soon as it has finished processing). */
 } CoffeeMaker;
 
 /**
@@ -120,48 +131,60 @@ static CoffeeMaker coffeeMaker = {
 // Main state machine
 // =============================================================================
 
-static StateMachine coffeeMakingProcessMachine;
+static StateMachineInstance stateMachine;
+static const StateMachineDefinition coffeeMakingProcessDefinition;
 
 // -----------------------------------------------------------------------------
 // Events
 // -----------------------------------------------------------------------------
 
+/**
+ * The coffee maker events.
+ */
+#define MAIN_CONTROLLER_EVENTS(EVENT, _) \
+	EVENT(_, event_switchedOn) \
+	EVENT(_, event_switchedOff) \
+	EVENT(_, event_isInitialized) \
+	EVENT(_, event_productSelected) \
+	EVENT(_, event_productionProcessAborted) \
+	EVENT(_, event_productionProcessIsFinished) \
+	EVENT(_, event_ingredientTankIsEmpty)
+
 /**
  * Represents a coffee maker event.
  */
-typedef enum {
-	event_switchedOn,
-	event_switchedOff,
-	event_isInitialized,
-	event_productSelected,
-	event_productionProcessAborted,
-	event_productionProcessIsFinished,
-	event_ingredientTankIsEmpty
-} MainControllerEvent;
+DECLARE_STATE_MACHINE_ENUM(MainControllerEvent, MAIN_CONTROLLER_EVENTS)
 
 // -----------------------------------------------------------------------------
 // Off state
 // -----------------------------------------------------------------------------
 
-static void offStateEntryAction() {
-	// Switch off milk supply
-	sendRequest_BEGIN(this, MilkSupply, OffCommand)
-	sendRequest_END
-	// Switch off water supply
-	sendRequest_BEGIN(this, WaterSupply, OffCommand)
-	sendRequest_END
-	// Switch off coffee supply
-	// Old message format
-	sendMessage2(this, getCoffeeSupplyDescriptor(), sizeof(SimpleCoffeeSupplyMessage), &(SimpleCoffeeSupplyMessage) {
-		.intValue = OFF_COMMAND
-	}, messagePriority_medium);
+// (The supplies start switched off, so the initial off state does not depend on them)
+static int areSuppliesSwitchedOn = FALSE;
+
+static void offStateEntryAction(void *context) {
+	if (areSuppliesSwitchedOn) {
+		// (Switching off takes precedence over any pending routine message)
+		sendMessages_BEGIN(this)
+			// Switch off milk supply
+			outgoingPrioritizedRequest_BEGIN(MilkSupply, OffCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+			// Switch off water supply
+			outgoingPrioritizedRequest_BEGIN(WaterSupply, OffCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+			// Switch off coffee supply
+			outgoingPrioritizedRequest_BEGIN(CoffeeSupply, OffCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+		sendMessages_END
+		areSuppliesSwitchedOn = FALSE;
+	}
 
 	setMachineState(machineState_off);
 
-	// Notifiy client
-	sendNotification_BEGIN(this, MainController, clientDescriptor, MachineStateChangedNotification)
+	// Notify subscribers
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, MachineStateChangedNotification)
 		.state = machineState_off
-	sendNotification_END
+	publishNotification_END
 }
 
 static State offState = {
@@ -173,28 +196,31 @@ static State offState = {
 // Initializing state
 // -----------------------------------------------------------------------------
 
-static void initializingStateEntryAction() {
+static void initializingStateEntryAction(void *context) {
+	reportStartupMilestone("Machine switched on");
+
 	setMachineState(machineState_initializing);
 
-	// Notifiy client
-	sendNotification_BEGIN(this, MainController, clientDescriptor, MachineStateChangedNotification)
+	// Notify subscribers
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, MachineStateChangedNotification)
 		.state = machineState_initializing
-	sendNotification_END
-
-	// Switch on coffee supply
-	// Old message format
-	sendMessage2(this, getCoffeeSupplyDescriptor(), sizeof(SimpleCoffeeSupplyMessage), &(SimpleCoffeeSupplyMessage) {
-		.intValue = INIT_COMMAND
-	}, messagePriority_medium);
-	// Switch on water supply
-	sendRequest_BEGIN(this, WaterSupply, InitCommand)
-	sendRequest_END
-	// Switch on milk supply
-	sendRequest_BEGIN(this, MilkSupply, InitCommand)
-	sendRequest_END
+	publishNotification_END
+
+	sendMessages_BEGIN(this)
+		// Switch on coffee supply
+		outgoingRequest_BEGIN(CoffeeSupply, InitCommand)
+		outgoingRequest_END
+		// Switch on water supply
+		outgoingRequest_BEGIN(WaterSupply, InitCommand)
+		outgoingRequest_END
+		// Switch on milk supply
+		outgoingRequest_BEGIN(MilkSupply, InitCommand)
+		outgoingRequest_END
+	sendMessages_END
+	areSuppliesSwitchedOn = TRUE;
 }
 
-static Event initializingStateDoAction() {
+static Event initializingStateDoAction(void *context) {
 	return event_isInitialized;
 }
 
@@ -208,15 +234,17 @@ static State initializingState = {
 // Idle state
 // -----------------------------------------------------------------------------
 
-static void idleStateEntryAction() {
+static void idleStateEntryAction(void *context) {
 	logInfo("[mainController] Idle... awaiting command...");
 
+	reportStartupMilestone("Machine ready (idle)");
+
 	setMachineState(machineState_idle);
 
-	// Notifiy client
-	sendNotification_BEGIN(this, MainController, clientDescriptor, MachineStateChangedNotification)
+	// Notify subscribers
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, MachineStateChangedNotification)
 		.state = machineState_idle
-	sendNotification_END
+	publishNotification_END
 }
 
 static State idleState = {
@@ -228,9 +256,7 @@ static State idleState = {
 // Producing state
 // -----------------------------------------------------------------------------
 
-static int producingError;
-
-static int producingStatePrecondition() {
+static int producingStatePrecondition(void *context) {
 	// Only start production if...
 	// - no coffee making process is already running (Paranoia)
 	// - coffee beans are available
@@ -240,37 +266,43 @@ static int producingStatePrecondition() {
 	// - coffee waste bin is not full
 	// - selected product is defined
 
-	producingError = NO_ERROR;
+	CoffeeMaker *maker = context;
+	MakeCoffeeProcessInstance *process = maker->requestedCoffeeMaking;
+	if (!process) {
+		return FALSE;
+	}
+
+	process->error = NO_ERROR;
 
 	char *violation = NULL;
 
-	if (coffeeMaker.ongoingCoffeeMaking) {
+	if (maker->ongoingCoffeeMaking) {
 		violation = "Coffee making process already started!";
 	}
 
-	if (coffeeMaker.areCoffeeBeansAvailable != available) {
+	if (maker->areCoffeeBeansAvailable != available) {
 		violation = "No coffee beans!";
-		producingError = PROCESS_NO_COFFEE_BEANS_ERROR;
+		process->error = PROCESS_NO_COFFEE_BEANS_ERROR;
 	}
 
-	if (coffeeMaker.isWaterAvailable != available) {
+	if (maker->isWaterAvailable != available) {
 		violation = "No water!";
-		producingError = PROCESS_NO_WATER_ERROR;
+		process->error = PROCESS_NO_WATER_ERROR;
 	}
 
-	if (produceWithMilk && (coffeeMaker.isMilkAvailable != available)) {
+	if (process->withMilk && (maker->isMilkAvailable != available)) {
 		violation = "No milk!";
-		producingError = PROCESS_NO_MILK_ERROR;
+		process->error = PROCESS_NO_MILK_ERROR;
 	}
 
-	if (coffeeMaker.isCoffeeWasteBinFull) {
+	if (maker->isCoffeeWasteBinFull) {
 		violation = "Coffee waste bin full!";
-		producingError = PROCESS_COFFEE_WASTE_BIN_IS_FULL_ERROR;
+		process->error = PROCESS_COFFEE_WASTE_BIN_IS_FULL_ERROR;
 	}
 
-	if (productToProduceIndex > getNumberOfProducts()) {
+	if (process->productIndex > getNumberOfProducts()) {
 		violation = "Undefined product!";
-		producingError = PROCESS_UNDEFINED_PRODUCT_ERROR;
+		process->error = PROCESS_UNDEFINED_PRODUCT_ERROR;
 	}
 
 	if (violation) {
@@ -282,46 +314,135 @@ static int producingStatePrecondition() {
 	return TRUE;
 }
 
-static void startMakeCoffeeProcess(unsigned int productIndex) {
-	coffeeMaker.ongoingCoffeeMaking = newObject(&(MakeCoffeeProcessInstance) {
+/**
+ * Creates a coffee making process instance for the selected product (not started yet).
+ */
+static MakeCoffeeProcessInstance *newMakeCoffeeProcessInstance(unsigned int productIndex, int withMilk) {
+	MakeCoffeeProcessInstance *process = newObject(&(MakeCoffeeProcessInstance) {
+		.owner = &stateMachine,
 		.productIndex = productIndex,
-		.withMilk = produceWithMilk
+		.withMilk = withMilk,
+		.warmUpTimer = -1,
+		.supplyRequest = NULL_REQUEST_TOKEN,
+		.error = NO_ERROR
 	}, sizeof(MakeCoffeeProcessInstance));
+	if (process) {
+		initStateMachineInstance(&process->machine, &coffeeMakingProcessDefinition, process);
+	}
 
-	setUpStateMachine(&coffeeMakingProcessMachine);
+	return process;
 }
 
-static void producingStateEntryAction() {
+/**
+ * Deletes the requested process instance if it has not been started.
+ */
+static void deleteRequestedMakeCoffeeProcessInstance(CoffeeMaker *maker) {
+	if (maker->requestedCoffeeMaking) {
+		deleteObject(maker->requestedCoffeeMaking);
+		maker->requestedCoffeeMaking = NULL;
+	}
+}
+
+static void startMakeCoffeeProcess(CoffeeMaker *maker) {
+	MakeCoffeeProcessInstance *process = maker->requestedCoffeeMaking;
+	maker->requestedCoffeeMaking = NULL;
+	maker->ongoingCoffeeMaking = process;
+
+	setUpStateMachine(&process->machine);
+}
+
+static void producingStateEntryAction(void *context) {
+	CoffeeMaker *maker = context;
+
 	setMachineState(machineState_producing);
 
-	// Notifiy client
-	sendNotification_BEGIN(this, MainController, clientDescriptor, MachineStateChangedNotification)
+	// Notify subscribers
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, MachineStateChangedNotification)
 		.state = machineState_producing
-	sendNotification_END
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ProducingProductNotification)
-		.productIndex = productToProduceIndex
-	sendNotification_END
+	publishNotification_END
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ProducingProductNotification)
+		.productIndex = maker->requestedCoffeeMaking->productIndex
+	publishNotification_END
 
-	startMakeCoffeeProcess(productToProduceIndex);
+	startMakeCoffeeProcess(maker);
 }
 
-static void abortMakeCoffeeProcessInstance() {
-	if (coffeeMaker.ongoingCoffeeMaking) {
-		abortStateMachine(&coffeeMakingProcessMachine);
+/**
+ * Deletes the retired process instance unless it is still processing an event.
+ * (If the process has signaled its end itself, it is still processing that event: It is deleted afterwards)
+ */
+static void deleteRetiredMakeCoffeeProcessInstance(CoffeeMaker *maker) {
+	if (maker->retiredCoffeeMaking && !maker->retiredCoffeeMaking->machine.isProcessing) {
+		deleteObject(maker->retiredCoffeeMaking);
+		maker->retiredCoffeeMaking = NULL;
+	}
+}
+
+static void abortMakeCoffeeProcessInstance(CoffeeMaker *maker) {
+	MakeCoffeeProcessInstance *process = maker->ongoingCoffeeMaking;
+	if (process) {
+		abortStateMachine(&process->machine);
+		logStateMachineStatistics(&process->machine);
+
+		// (Its error is reported by the post action)
+		deleteRetiredMakeCoffeeProcessInstance(maker);
+		maker->ongoingCoffeeMaking = NULL;
+		maker->retiredCoffeeMaking = process;
+	}
+}
 
-		deleteObject(coffeeMaker.ongoingCoffeeMaking);
-		coffeeMaker.ongoingCoffeeMaking = NULL;
+/**
+ * Gets the ongoing coffee making process instance waiting for the given supply request
+ * (or NULL if the process has ended meanwhile).
+ */
+static MakeCoffeeProcessInstance *findMakeCoffeeProcessByRequest(CoffeeMaker *maker, RequestToken request) {
+	MakeCoffeeProcessInstance *process = maker->ongoingCoffeeMaking;
+	if (process && request != NULL_REQUEST_TOKEN && process->supplyRequest == request) {
+		return process;
 	}
+
+	return NULL;
 }
 
-static void producingStateExitAction() {
-	abortMakeCoffeeProcessInstance();
+/**
+ * Gets the ongoing coffee making process instance warming up with the given timer
+ * (or NULL if the process has ended meanwhile).
+ */
+static MakeCoffeeProcessInstance *findMakeCoffeeProcessByTimer(CoffeeMaker *maker, int timer) {
+	MakeCoffeeProcessInstance *process = maker->ongoingCoffeeMaking;
+	if (process && timer >= 0 && process->warmUpTimer == timer) {
+		return process;
+	}
+
+	return NULL;
 }
 
-static void producingStatePostAction() {
-	if (producingError != NO_ERROR) {
-		sendError(producingError);
+/**
+ * Signals an event to a coffee making process instance (if any).
+ */
+static void processMakeCoffeeProcessEvent(CoffeeMaker *maker, MakeCoffeeProcessInstance *process, Event event) {
+	if (process) {
+		processStateMachineEvent(&process->machine, event);
 	}
+
+	deleteRetiredMakeCoffeeProcessInstance(maker);
+}
+
+static void producingStateExitAction(void *context) {
+	abortMakeCoffeeProcessInstance(context);
+}
+
+static void producingStatePostAction(void *context) {
+	CoffeeMaker *maker = context;
+
+	// Report the error of the process instance which has been rejected (precondition not met) or has ended
+	MakeCoffeeProcessInstance *process = maker->requestedCoffeeMaking ? maker->requestedCoffeeMaking : maker->retiredCoffeeMaking;
+	if (process && process->error != NO_ERROR) {
+		sendError(process->error);
+	}
+
+	deleteRequestedMakeCoffeeProcessInstance(maker);
+	deleteRetiredMakeCoffeeProcessInstance(maker);
 }
 
 static State producingState = {
@@ -336,44 +457,40 @@ static State producingState = {
 // State transitions
 // -----------------------------------------------------------------------------
 
-static StateMachine stateMachine = {
+/**
+ * The coffee maker states (the indices are the shared machine states, see MachineState).
+ */
+#define MAIN_CONTROLLER_STATES(STATE, _) \
+	STATE(_, machineState_off, offState) \
+	STATE(_, machineState_initializing, initializingState) \
+	STATE(_, machineState_idle, idleState) \
+	STATE(_, machineState_producing, producingState)
+
+/**
+ * The coffee maker transitions (grouped by source state, sorted by event).
+ */
+#define MAIN_CONTROLLER_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, machineState_off, event_switchedOn, initializingState) \
+	TRANSITION(_, machineState_initializing, event_isInitialized, idleState) \
+	TRANSITION(_, machineState_idle, event_switchedOff, offState) \
+	TRANSITION(_, machineState_idle, event_productSelected, producingState) \
+	TRANSITION(_, machineState_producing, event_switchedOff, offState) \
+	TRANSITION(_, machineState_producing, event_productionProcessAborted, idleState) \
+	TRANSITION(_, machineState_producing, event_productionProcessIsFinished, idleState) \
+	TRANSITION(_, machineState_producing, event_ingredientTankIsEmpty, idleState)
+
+DEFINE_STATE_MACHINE_TABLES(mainController, MAIN_CONTROLLER_STATES, MAIN_CONTROLLER_EVENTS, MAIN_CONTROLLER_TRANSITIONS)
+
+static const StateMachineDefinition mainControllerDefinition = {
 	.name = "mainController",
-	.numberOfEvents = 7,
 	.initialState = &offState,
-	.transitions = {
-		/* coffeeMaker_off: */
-			/* event_switchedOn: */ &initializingState,
-			/* event_switchedOff: */ NULL,
-			/* event_isInitialized: */ NULL,
-			/* event_productSelected: */ NULL,
-			/* event_productionProcessAborted: */ NULL,
-			/* event_productionProcessIsFinished: */ NULL,
-			/* event_ingredientTankIsEmpty: */ NULL,
-		/* coffeeMaker_initializing: */
-			/* event_switchedOn: */ NULL,
-			/* event_switchedOff: */ NULL,
-			/* event_isInitialized: */ &idleState,
-			/* event_productSelected: */ NULL,
-			/* event_productionProcessAborted: */ NULL,
-			/* event_productionProcessIsFinished: */ NULL,
-			/* event_ingredientTankIsEmpty: */ NULL,
-		/* coffeeMaker_idle: */
-			/* event_switchedOn: */ NULL,
-			/* event_switchedOff: */ &offState,
-			/* event_isInitialized: */ NULL,
-			/* event_productSelected: */ &producingState,
-			/* event_productionProcessAborted: */ NULL,
-			/* event_productionProcessIsFinished: */ NULL,
-			/* event_ingredientTankIsEmpty: */ NULL,
-		/* coffeeMaker_producing: */
-			/* event_switchedOn: */ NULL,
-			/* event_switchedOff: */ &offState,
-			/* event_isInitialized: */ NULL,
-			/* event_productSelected: */ NULL,
-			/* event_productionProcessAborted: */ &idleState,
-			/* event_productionProcessIsFinished: */ &idleState,
-			/* event_ingredientTankIsEmpty: */ &idleState
-		}
+	.mode = stateMachineMode_runToCompletion,
+	STATE_MACHINE_TABLES(mainController, MAIN_CONTROLLER_STATES, MAIN_CONTROLLER_EVENTS)
+};
+
+static StateMachineInstance stateMachine = {
+	.definition = &mainControllerDefinition,
+	.context = &coffeeMaker
 };
 
 // =============================================================================
@@ -385,76 +502,55 @@ static StateMachine stateMachine = {
 // -----------------------------------------------------------------------------
 
 /**
- * Represents a coffee making event.
+ * The coffee making events.
  */
-typedef enum {
-	coffeeMakingEvent_isWarmedUp,
-	coffeeMakingEvent_cupIsEmpty,
-	coffeeMakingEvent_cupIsNotEmpty,
-	coffeeMakingEvent_grindCoffeePowder,
-	coffeeMakingEvent_coffeePowderGrinded,
-	coffeeMakingEvent_supplyWater,
-	coffeeMakingEvent_waterSupplied,
-	coffeeMakingEvent_supplyMilk,
-	coffeeMakingEvent_milkSupplied,
-	coffeeMakingEvent_ejectCoffeeWaste,
-	coffeeMakingEvent_coffeeWasteEjected,
-	coffeeMakingEvent_errorOccured
-} CoffeeMakingEvent;
-
-
-static ProductionResult productionResult;
+#define COFFEE_MAKING_PROCESS_EVENTS(EVENT, _) \
+	EVENT(_, coffeeMakingEvent_isWarmedUp) \
+	EVENT(_, coffeeMakingEvent_cupIsEmpty) \
+	EVENT(_, coffeeMakingEvent_cupIsNotEmpty) \
+	EVENT(_, coffeeMakingEvent_coffeePowderGrinded) \
+	EVENT(_, coffeeMakingEvent_isPrepared) \
+	EVENT(_, coffeeMakingEvent_waterSupplied) \
+	EVENT(_, coffeeMakingEvent_supplyMilk) \
+	EVENT(_, coffeeMakingEvent_milkSupplied) \
+	EVENT(_, coffeeMakingEvent_ejectCoffeeWaste) \
+	EVENT(_, coffeeMakingEvent_coffeeWasteEjected) \
+	EVENT(_, coffeeMakingEvent_errorOccured)
 
-// -----------------------------------------------------------------------------
-// Set up action
-// -----------------------------------------------------------------------------
+/**
+ * Represents a coffee making event.
+ */
+DECLARE_STATE_MACHINE_ENUM(CoffeeMakingEvent, COFFEE_MAKING_PROCESS_EVENTS)
 
-static void coffeeMakingProcessSetUpAction() {
-	productionResult = productionResult_nok;
-}
 
 // -----------------------------------------------------------------------------
-// Warming Up activity
+// Set up action
 // -----------------------------------------------------------------------------
 
-static void warmingUpActivityEntryAction() {
-	logInfo("[mainController] [makeCoffee process] Warming up...");
-
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_warmingUp;
+static void coffeeMakingProcessSetUpAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
-		.activityIndex = PROCESS_WARMING_UP_ACTIVITY
-	sendNotification_END
-}
-
-static Event warmingUpActivityDoAction() {
-	sleep(5);
-
-	return coffeeMakingEvent_isWarmedUp;
+	process->result = productionResult_nok;
 }
 
-static State warmingUpActivity = {
-	.stateIndex = coffeeMakingActivity_warmingUp,
-	.entryAction = warmingUpActivityEntryAction,
-	.doAction = warmingUpActivityDoAction
-};
-
 // -----------------------------------------------------------------------------
 // Checking Cup Fill State activity
 // -----------------------------------------------------------------------------
 
-static Event checkingCupFillStateActivityDoAction() {
+static Event checkingCupFillStateActivityDoAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Checking cup fill state...");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_checkingCupFillState;
+	process->currentActivity = coffeeMakingActivity_checkingCupFillState;
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_CHECKING_CUP_FILL_STATE_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
 	if (readNonBlockingDevice("./dev/cupFillStateSensor") > 0) {
 		logInfo("[mainController] [makeCoffee process] Cup is not empty!");
-		producingError = PROCESS_CUP_IS_NOT_EMPTY_ERROR;
+		process->error = PROCESS_CUP_IS_NOT_EMPTY_ERROR;
 
 		return coffeeMakingEvent_cupIsNotEmpty;
 	}
@@ -468,54 +564,195 @@ static State checkingCupFillStateActivity = {
 };
 
 // -----------------------------------------------------------------------------
-// Grinding Coffee Powder activity
+// Preparing activity
+// (A composite state: The machine warms up and grinds the coffee powder in parallel,
+// water is supplied as soon as both are done)
 // -----------------------------------------------------------------------------
 
-static void grindingCoffeePowderActivityEntryAction() {
-	logInfo("[mainController] [makeCoffee process] Going to grind coffee powder...");
+// Warming Up region
+
+/**
+ * The states of the warming up region (and their state objects).
+ */
+#define WARMING_UP_REGION_STATES(STATE, _) \
+	STATE(_, warmingUpRegionState_warmingUp, warmingUpActivity) \
+	STATE(_, warmingUpRegionState_warmedUp, warmedUpState)
+
+DECLARE_STATE_MACHINE_ENUM(WarmingUpRegionState, WARMING_UP_REGION_STATES)
+
+/**
+ * The time the machine takes to warm up [ms].
+ */
+#define WARM_UP_TIME 5000
+
+static void warmUpTimerElapsed(void *activity, int timer) {
+	unwatchFd(this, timer);
+
+	MakeCoffeeProcessInstance *process = findMakeCoffeeProcessByTimer(&coffeeMaker, timer);
+	if (process) {
+		process->warmUpTimer = -1;
+
+		processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_isWarmedUp);
+	}
+}
+
+static void warmingUpActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	logInfo("[mainController] [makeCoffee process] Warming up...");
+
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
+		.activityIndex = PROCESS_WARMING_UP_ACTIVITY
+	publishNotification_END
+
+	// (The warm up timer is served while waiting for the supplies' results, so nothing is blocked meanwhile)
+	process->warmUpTimer = scheduleTimer(this, WARM_UP_TIME, warmUpTimerElapsed);
+	if (process->warmUpTimer < 0) {
+		logErr("[mainController] [makeCoffee process] Cannot start warm up timer!");
+	}
+}
+
+static Event warmingUpActivityDoAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	// (Without a timer the warm up cannot be awaited)
+	if (process->warmUpTimer < 0) {
+		return coffeeMakingEvent_isWarmedUp;
+	}
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_grindingCoffeePowder;
+	return NO_EVENT;
+}
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+static void warmingUpActivityExitAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	if (process->warmUpTimer >= 0) {
+		unwatchFd(this, process->warmUpTimer);
+		process->warmUpTimer = -1;
+	}
+}
+
+static State warmingUpActivity = {
+	.stateIndex = warmingUpRegionState_warmingUp,
+	.entryAction = warmingUpActivityEntryAction,
+	.doAction = warmingUpActivityDoAction,
+	.exitAction = warmingUpActivityExitAction
+};
+
+static State warmedUpState = {
+	.stateIndex = warmingUpRegionState_warmedUp
+};
+
+#define WARMING_UP_REGION_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, warmingUpRegionState_warmingUp, coffeeMakingEvent_isWarmedUp, warmedUpState)
+
+DEFINE_STATE_MACHINE_TABLES(warmingUpRegion, WARMING_UP_REGION_STATES, COFFEE_MAKING_PROCESS_EVENTS, WARMING_UP_REGION_TRANSITIONS)
+
+static const StateMachineDefinition warmingUpRegionDefinition = {
+	.name = "warmingUpRegion",
+	.initialState = &warmingUpActivity,
+	.finalState = &warmedUpState,
+	STATE_MACHINE_TABLES(warmingUpRegion, WARMING_UP_REGION_STATES, COFFEE_MAKING_PROCESS_EVENTS)
+};
+
+// Grinding region
+// (The coffee supply grinds the coffee powder while the machine warms up)
+
+/**
+ * The states of the grinding region (and their state objects).
+ */
+#define GRINDING_REGION_STATES(STATE, _) \
+	STATE(_, grindingRegionState_grindingCoffeePowder, grindingCoffeePowderActivity) \
+	STATE(_, grindingRegionState_coffeePowderGrinded, coffeePowderGrindedState)
+
+DECLARE_STATE_MACHINE_ENUM(GrindingRegionState, GRINDING_REGION_STATES)
+
+static void grindingCoffeePowderActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	logInfo("[mainController] [makeCoffee process] Going to grind coffee powder...");
+
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_GRINDING_COFFEE_POWDER_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
-	// Old message format
-	sendMessage2(this, getCoffeeSupplyDescriptor(), sizeof(SimpleCoffeeSupplyMessage), &(SimpleCoffeeSupplyMessage) {
-		.intValue = SUPPLY_START_COMMAND
-	}, messagePriority_medium);
+	RequestToken request = sendRequest_BEGIN(this, CoffeeSupply, GrindCoffeePowderCommand)
+		//TODO Determine coffee powder amount on the basis of the product definition
+		.coffeePowderAmount = 0
+	sendRequest_END
+	process->supplyRequest = request;
+	onResponse(this, request, coffeeSupplyResultReceived, NULL, NO_TIMEOUT);
 }
 
-static void grindingCoffeePowderActivityExitAction() {
+static void grindingCoffeePowderActivityExitAction(void *context) {
 
 }
 
 static State grindingCoffeePowderActivity = {
-	.stateIndex = coffeeMakingActivity_grindingCoffeePowder,
+	.stateIndex = grindingRegionState_grindingCoffeePowder,
 	.entryAction = grindingCoffeePowderActivityEntryAction,
 	.exitAction = grindingCoffeePowderActivityExitAction
 };
 
+static State coffeePowderGrindedState = {
+	.stateIndex = grindingRegionState_coffeePowderGrinded
+};
+
+#define GRINDING_REGION_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, grindingRegionState_grindingCoffeePowder, coffeeMakingEvent_coffeePowderGrinded, coffeePowderGrindedState)
+
+DEFINE_STATE_MACHINE_TABLES(grindingRegion, GRINDING_REGION_STATES, COFFEE_MAKING_PROCESS_EVENTS, GRINDING_REGION_TRANSITIONS)
+
+static const StateMachineDefinition grindingRegionDefinition = {
+	.name = "grindingRegion",
+	.initialState = &grindingCoffeePowderActivity,
+	.finalState = &coffeePowderGrindedState,
+	STATE_MACHINE_TABLES(grindingRegion, GRINDING_REGION_STATES, COFFEE_MAKING_PROCESS_EVENTS)
+};
+
+static const StateMachineDefinition *const preparingRegions[] = {
+	&warmingUpRegionDefinition,
+	&grindingRegionDefinition,
+	NULL
+};
+
+static void preparingActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	process->currentActivity = coffeeMakingActivity_preparing;
+}
+
+static State preparingActivity = {
+	.stateIndex = coffeeMakingActivity_preparing,
+	.entryAction = preparingActivityEntryAction,
+	.regions = preparingRegions,
+	.completionEvent = coffeeMakingEvent_isPrepared
+};
+
 // -----------------------------------------------------------------------------
 // Supplying Water activity
 // -----------------------------------------------------------------------------
 
-static void supplyingWaterActivityEntryAction() {
+static void supplyingWaterActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Going to supply water...");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_supplyingWater;
+	process->currentActivity = coffeeMakingActivity_supplyingWater;
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_SUPPLYING_WATER_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
-	sendRequest_BEGIN(this, WaterSupply, SupplyWaterCommand)
+	RequestToken request = sendRequest_BEGIN(this, WaterSupply, SupplyWaterCommand)
 		//TODO Determine water amount on the basis of the product definition
-		.waterAmount = coffeeMaker.ongoingCoffeeMaking->productIndex * 100
+		.waterAmount = process->productIndex * 100
 	sendRequest_END
+	process->supplyRequest = request;
+	onResponse(this, request, waterSupplyResultReceived, NULL, NO_TIMEOUT);
 }
 
-static void supplyingWaterActivityExitAction() {
+static void supplyingWaterActivityExitAction(void *context) {
 
 }
 
@@ -529,8 +766,10 @@ static State supplyingWaterActivity = {
 // With Milk gateway
 // -----------------------------------------------------------------------------
 
-static Event withMilkGatewayDoAction() {
-	if (coffeeMaker.ongoingCoffeeMaking->withMilk) {
+static Event withMilkGatewayDoAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	if (process->withMilk) {
 		return coffeeMakingEvent_supplyMilk;
 	} else {
 		return coffeeMakingEvent_ejectCoffeeWaste;
@@ -548,22 +787,26 @@ static State withMilkGateway = {
 // Supplying Milk activity
 // -----------------------------------------------------------------------------
 
-static void supplyingMilkActivityEntryAction() {
+static void supplyingMilkActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Going to supply milk...");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_supplyingMilk;
+	process->currentActivity = coffeeMakingActivity_supplyingMilk;
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_SUPPLYING_MILK_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
-	sendRequest_BEGIN(this, MilkSupply, SupplyMilkCommand)
+	RequestToken request = sendRequest_BEGIN(this, MilkSupply, SupplyMilkCommand)
 		//TODO Determine milk amount on the basis of the product definition
 		.milkAmount = 20
 	sendRequest_END
+	process->supplyRequest = request;
+	onResponse(this, request, milkSupplyResultReceived, NULL, NO_TIMEOUT);
 }
 
-static void supplyingMilkActivityExitAction() {
+static void supplyingMilkActivityExitAction(void *context) {
 
 }
 
@@ -577,22 +820,24 @@ static State supplyingMilkActivity = {
 // Ejecting Coffee Waste activity
 // -----------------------------------------------------------------------------
 
-static void ejectingCoffeeWasteActivityEntryAction() {
+static void ejectingCoffeeWasteActivityEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Going to eject coffee waste...");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_ejectingCoffeeWaste;
+	process->currentActivity = coffeeMakingActivity_ejectingCoffeeWaste;
 
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_EJECTING_COFFEE_WASTE_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
-	// Old message format
-	sendMessage2(this, getCoffeeSupplyDescriptor(), sizeof(SimpleCoffeeSupplyMessage), &(SimpleCoffeeSupplyMessage) {
-		.intValue = EJECT_COFFEE_WASTE_COMMAND
-	}, messagePriority_medium);
+	RequestToken request = sendRequest_BEGIN(this, CoffeeSupply, EjectCoffeeWasteCommand)
+	sendRequest_END
+	process->supplyRequest = request;
+	onResponse(this, request, coffeeSupplyResultReceived, NULL, NO_TIMEOUT);
 }
 
-static void ejectingCoffeeWasteActivityExitAction() {
+static void ejectingCoffeeWasteActivityExitAction(void *context) {
 
 }
 
@@ -606,14 +851,16 @@ static State ejectingCoffeeWasteActivity = {
 // Finished state
 // -----------------------------------------------------------------------------
 
-static void finishedStateEntryAction() {
+static void finishedStateEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Finished.");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_finished;
+	process->currentActivity = coffeeMakingActivity_finished;
 
-	productionResult = productionResult_ok;
+	process->result = productionResult_ok;
 
-	processStateMachineEvent(&stateMachine, event_productionProcessIsFinished);
+	processStateMachineEvent(process->owner, event_productionProcessIsFinished);
 }
 
 static State finishedState = {
@@ -625,13 +872,15 @@ static State finishedState = {
 // Error state
 // -----------------------------------------------------------------------------
 
-static void errorStateEntryAction() {
+static void errorStateEntryAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
 	logInfo("[mainController] [makeCoffee process] Error occured!");
 	logInfo("[mainController] [makeCoffee process] Going to abort process...");
 
-	coffeeMaker.ongoingCoffeeMaking->currentActivity = coffeeMakingActivity_error;
+	process->currentActivity = coffeeMakingActivity_error;
 
-	processStateMachineEvent(&stateMachine, event_productionProcessAborted);
+	processStateMachineEvent(process->owner, event_productionProcessAborted);
 }
 
 static State errorState = {
@@ -643,137 +892,165 @@ static State errorState = {
 // Abort action
 // -----------------------------------------------------------------------------
 
-static void coffeeMakingProcessAbortAction() {
-	sendNotification_BEGIN(this, MainController, clientDescriptor, ExecutingActivityNotification)
+static void coffeeMakingProcessAbortAction(void *context) {
+	MakeCoffeeProcessInstance *process = context;
+
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, ExecutingActivityNotification)
 		.activityIndex = PROCESS_NO_ACTIVITY
-	sendNotification_END
+	publishNotification_END
 
-	if (productionResult != productionResult_ok) {
+	if (process->result != productionResult_ok) {
 		logErr("[mainController] [makeCoffee process] Aborting...");
 
-		// Abort coffee supply
-		// Old message format
-		sendMessage2(this, getCoffeeSupplyDescriptor(), sizeof(SimpleCoffeeSupplyMessage), &(SimpleCoffeeSupplyMessage) {
-			.intValue = SUPPLY_STOP_COMMAND
-		}, messagePriority_medium);
-		// Abort water supply
-		sendRequest_BEGIN(this, WaterSupply, AbortCommand)
-		sendRequest_END
-		// Abort milk supply
-		// Not yet supported!
-		//sendRequest_BEGIN(this, MilkSupply, AbortCommand)
-		//sendRequest_END
+		sendMessages_BEGIN(this)
+			// Abort coffee supply
+			outgoingPrioritizedRequest_BEGIN(CoffeeSupply, AbortCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+			// Abort water supply
+			outgoingPrioritizedRequest_BEGIN(WaterSupply, AbortCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+			// Abort milk supply
+			outgoingPrioritizedRequest_BEGIN(MilkSupply, AbortCommand, messagePriority_high)
+			outgoingPrioritizedRequest_END
+		sendMessages_END
 	}
 }
 
 // -----------------------------------------------------------------------------
 // Activity/state transitions
 // -----------------------------------------------------------------------------
-static StateMachine coffeeMakingProcessMachine = {
+/**
+ * The coffee making process transitions (grouped by activity, sorted by event).
+ */
+#define COFFEE_MAKING_PROCESS_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, coffeeMakingActivity_checkingCupFillState, coffeeMakingEvent_cupIsEmpty, preparingActivity) \
+	TRANSITION(_, coffeeMakingActivity_checkingCupFillState, coffeeMakingEvent_cupIsNotEmpty, errorState) \
+	TRANSITION(_, coffeeMakingActivity_preparing, coffeeMakingEvent_isPrepared, supplyingWaterActivity) \
+	TRANSITION(_, coffeeMakingActivity_preparing, coffeeMakingEvent_errorOccured, errorState) \
+	TRANSITION(_, coffeeMakingActivity_supplyingWater, coffeeMakingEvent_waterSupplied, withMilkGateway) \
+	TRANSITION(_, coffeeMakingActivity_supplyingWater, coffeeMakingEvent_errorOccured, errorState) \
+	TRANSITION(_, coffeeMakingActivity_withMilkGateway, coffeeMakingEvent_supplyMilk, supplyingMilkActivity) \
+	TRANSITION(_, coffeeMakingActivity_withMilkGateway, coffeeMakingEvent_ejectCoffeeWaste, ejectingCoffeeWasteActivity) \
+	TRANSITION(_, coffeeMakingActivity_supplyingMilk, coffeeMakingEvent_milkSupplied, ejectingCoffeeWasteActivity) \
+	TRANSITION(_, coffeeMakingActivity_supplyingMilk, coffeeMakingEvent_errorOccured, errorState) \
+	TRANSITION(_, coffeeMakingActivity_ejectingCoffeeWaste, coffeeMakingEvent_coffeeWasteEjected, finishedState) \
+	TRANSITION(_, coffeeMakingActivity_ejectingCoffeeWaste, coffeeMakingEvent_errorOccured, errorState)
+
+DEFINE_STATE_MACHINE_TABLES(coffeeMakingProcess, COFFEE_MAKING_PROCESS_STATES, COFFEE_MAKING_PROCESS_EVENTS, COFFEE_MAKING_PROCESS_TRANSITIONS)
+
+static const StateMachineDefinition coffeeMakingProcessDefinition = {
 	.name = "coffeeMakingProcess",
-	.numberOfEvents = 12,
 	.setUpAction = coffeeMakingProcessSetUpAction,
 	.abortAction = coffeeMakingProcessAbortAction,
-	.initialState = &warmingUpActivity,
-	.transitions = {
-		/* coffeeMakingActivity_warmingUp: */
-			/* coffeeMakingEvent_isWarmedUp: */ &checkingCupFillStateActivity,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ NULL,
-		/* coffeeMakingActivity_checkingCupFillState: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ &grindingCoffeePowderActivity,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ &errorState,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ NULL,
-		/* coffeeMakingActivity_grindingCoffeePowder: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ &supplyingWaterActivity,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ &errorState,
-		/* coffeeMakingActivity_supplyingWater: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ &withMilkGateway,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ &errorState,
-		/* coffeeMakingActivity_withMilkGateway: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ &supplyingMilkActivity,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ &ejectingCoffeeWasteActivity,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ NULL,
-		/* coffeeMakingActivity_supplyingMilk: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ &ejectingCoffeeWasteActivity,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ NULL,
-			/* coffeeMakingEvent_errorOccured: */ &errorState,
-		/* coffeeMakingActivity_ejectingCoffeeWaste: */
-			/* coffeeMakingEvent_isWarmedUp: */ NULL,
-			/* coffeeMakingEvent_cupIsEmpty: */ NULL,
-			/* coffeeMakingEvent_cubIsNotEmpty: */ NULL,
-			/* coffeeMakingEvent_grindCoffeePowder: */ NULL,
-			/* coffeeMakingEvent_coffeePowderGrinded: */ NULL,
-			/* coffeeMakingEvent_supplyWater: */ NULL,
-			/* coffeeMakingEvent_waterSupplied: */ NULL,
-			/* coffeeMakingEvent_supplyMilk: */ NULL,
-			/* coffeeMakingEvent_milkSupplied: */ NULL,
-			/* coffeeMakingEvent_ejectCoffeeWaste: */ NULL,
-			/* coffeeMakingEvent_coffeeWasteEjected: */ &finishedState,
-			/* coffeeMakingEvent_errorOccured: */ &errorState,
-		}
+	.initialState = &checkingCupFillStateActivity,
+	.mode = stateMachineMode_runToCompletion,
+	STATE_MACHINE_TABLES(coffeeMakingProcess, COFFEE_MAKING_PROCESS_STATES, COFFEE_MAKING_PROCESS_EVENTS)
 };
 
+// -----------------------------------------------------------------------------
+// Message handlers
+// -----------------------------------------------------------------------------
+
+// If we got a bean status update from coffee supply...
+MESSAGE_HANDLER_BEGIN(coffeeBeanStatusReceived, CoffeeSupply, BeanStatus)
+	coffeeMaker.areCoffeeBeansAvailable = content.availability;
+
+	// Send notification to client
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, IngredientAvailabilityChangedNotification)
+		.ingredientIndex = COFFEE_INDEX,
+		.availability = coffeeMaker.areCoffeeBeansAvailable
+	publishNotification_END
+MESSAGE_HANDLER_END
+
+// If we got a waste bin status update from coffee supply...
+MESSAGE_HANDLER_BEGIN(coffeeWasteBinStatusReceived, CoffeeSupply, WasteBinStatus)
+	coffeeMaker.isCoffeeWasteBinFull = content.isBinFull;
+
+	// Send notification to client
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, CoffeeWasteBinStateChangedNotification)
+		.isBinFull = coffeeMaker.isCoffeeWasteBinFull
+	publishNotification_END
+MESSAGE_HANDLER_END
+
+// If we got a status update from water supply...
+// (Results are passed to the continuation of the supply request)
+MESSAGE_HANDLER_BEGIN(waterStatusReceived, WaterSupply, Status)
+	coffeeMaker.isWaterAvailable = content.availability;
+
+	// Send notification to client
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, IngredientAvailabilityChangedNotification)
+		.ingredientIndex = WATER_INDEX,
+		.availability = coffeeMaker.isWaterAvailable
+	publishNotification_END
+MESSAGE_HANDLER_END
+
+// If we got a status update from milk supply...
+// (Results are passed to the continuation of the supply request)
+MESSAGE_HANDLER_BEGIN(milkStatusReceived, MilkSupply, Status)
+	coffeeMaker.isMilkAvailable = content.availability;
+
+	// Send notification to client
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, IngredientAvailabilityChangedNotification)
+		.ingredientIndex = MILK_INDEX,
+		.availability = coffeeMaker.isMilkAvailable
+	publishNotification_END
+MESSAGE_HANDLER_END
+
+// If we got an init command...
+MESSAGE_HANDLER_BEGIN(initCommandReceived, MainController, InitCommand)
+	logInfo("[mainController] Going to switch on...");
+
+	processStateMachineEvent(&stateMachine, event_switchedOn);
+MESSAGE_HANDLER_END
+
+// If we got an off command...
+MESSAGE_HANDLER_BEGIN(offCommandReceived, MainController, OffCommand)
+	logInfo("[mainController] Going to switch off...");
+
+	processStateMachineEvent(&stateMachine, event_switchedOff);
+MESSAGE_HANDLER_END
+
+// If we got an produce product command...
+MESSAGE_HANDLER_BEGIN(produceProductCommandReceived, MainController, ProduceProductCommand)
+	logInfo("[mainController] Going to produce product %u %s milk...", content.productIndex, (content.withMilk ? "with" : "without"));
+
+	// (The process instance keeps the product choice, it is only started if the precondition is met)
+	deleteRequestedMakeCoffeeProcessInstance(&coffeeMaker);
+	coffeeMaker.requestedCoffeeMaking = newMakeCoffeeProcessInstance(content.productIndex, content.withMilk);
+
+	processStateMachineEvent(&stateMachine, event_productSelected);
+
+	// (Not started: The product has been selected while producing)
+	deleteRequestedMakeCoffeeProcessInstance(&coffeeMaker);
+MESSAGE_HANDLER_END
+
+// If we got an abort command...
+MESSAGE_HANDLER_BEGIN(abortCommandReceived, MainController, AbortCommand)
+	logInfo("[mainController] Going to abort current operation...");
+	processStateMachineEvent(&stateMachine, event_productionProcessAborted);
+MESSAGE_HANDLER_END
+
 static void setUpMainController(void *activity) {
 	//logInfo("[mainController] Setting up...");
 
 	this = (Activity *)activity;
+
+	subscribe(this, WATER_SUPPLY_TOPIC);
+
+	// Register message handlers
+	// (Messages from a supply which are not handled here are unexpected)
+	MESSAGE_HANDLER(this, CoffeeSupply, CoffeeSupply, BeanStatus, coffeeBeanStatusReceived)
+	MESSAGE_HANDLER(this, CoffeeSupply, CoffeeSupply, WasteBinStatus, coffeeWasteBinStatusReceived)
+	MESSAGE_HANDLER(this, WaterSupply, WaterSupply, Status, waterStatusReceived)
+	MESSAGE_HANDLER(this, MilkSupply, MilkSupply, Status, milkStatusReceived)
+	// (Commands are accepted from any client)
+	ANY_SENDER_MESSAGE_HANDLER(this, MainController, InitCommand, initCommandReceived)
+	ANY_SENDER_MESSAGE_HANDLER(this, MainController, OffCommand, offCommandReceived)
+	ANY_SENDER_MESSAGE_HANDLER(this, MainController, ProduceProductCommand, produceProductCommandReceived)
+	ANY_SENDER_MESSAGE_HANDLER(this, MainController, AbortCommand, abortCommandReceived)
+
+	// (The coffee making process machine is only set up when a product is made)
+	registerStateMachine(&coffeeMakingProcessDefinition);
 }
 
 static void runMainController(void *activity) {
@@ -817,7 +1094,7 @@ static void runMainController(void *activity) {
 									logWarn("[mainController] Irrelevant message with content id %u from water supply received!", specificMessage->type);
 							MESSAGE_SELECTOR_END
 						MESSAGE_SELECTOR_ANY
-							logWarn("[mainController] Irrelevant message from %s received!", senderDescriptor.name);
+							logWarn("[mainController] Irrelevant message from %s received!", senderDescriptor->name);
 					MESSAGE_SELECTOR_END
 				}
 			receiveGenericMessage_END
@@ -830,18 +1107,14 @@ static void runMainController(void *activity) {
 	sleep(1);
 
 	logInfo("[mainController] Going to switch on coffee supply...");
-	sendMessage(getCoffeeSupplyDescriptor(), (char *)&(CoffeeSupplyMessage) {
-		.activity = getMainControllerDescriptor(),
-		.intValue = INIT_COMMAND
-	}, sizeof(CoffeeSupplyMessage), messagePriority_medium);
+	sendRequest_BEGIN(this, CoffeeSupply, InitCommand)
+	sendRequest_END
 
 	sleep(1);
 
 	logInfo("[mainController] Going to grind beans...");
-	sendMessage(getCoffeeSupplyDescriptor(), (char *)&(CoffeeSupplyMessage) {
-		.activity = getMainControllerDescriptor(),
-		.intValue = SUPPLY_START_COMMAND
-	}, sizeof(CoffeeSupplyMessage), messagePriority_medium);
+	sendRequest_BEGIN(this, CoffeeSupply, GrindCoffeePowderCommand)
+	sendRequest_END
 
 	while (TRUE);
 	*/
@@ -888,164 +1161,144 @@ static void runMainController(void *activity) {
 	//sendRequest_END
 	*/
 
-	while (TRUE) {
+	while (isActivityRunning(this)) {
 		receiveGenericMessage_BEGIN(this)
 			if (result > 0) {
-				MESSAGE_SELECTOR_BEGIN
-					MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, CoffeeSupply)
-						MESSAGE_SELECTOR_BEGIN
-							// If we got a result from coffee supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, CoffeeSupply, Result)
-								// Propagate event to coffee making process state machine
-								if (content.code == OK_RESULT) {
-									if (coffeeMakingProcessMachine.activeState == &grindingCoffeePowderActivity) {
-										processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_coffeePowderGrinded);
-									} else if (coffeeMakingProcessMachine.activeState == &ejectingCoffeeWasteActivity) {
-										processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_coffeeWasteEjected);
-									}
-								} else {
-									char *errorMessage;
-									switch (content.errorCode) {
-										case NO_COFFEE_BEANS_ERROR:
-											errorMessage = "No coffee beans!";
-											producingError = PROCESS_NO_COFFEE_BEANS_ERROR;
-											break;
-										case COFFEE_WASTE_EJECTION_NOT_POSSIBLE_ERROR:
-											errorMessage = "Coffee waste ejection not possible!";
-										default:
-											errorMessage = "<Unknown error>";
-									}
-									logInfo("[mainController] Coffee supply reports an error: %s", errorMessage);
-
-									processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_errorOccured);
-								}
-							// If we got a bean status update from coffee supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, CoffeeSupply, BeanStatus)
-								coffeeMaker.areCoffeeBeansAvailable = content.availability;
-
-								// Send notification to client
-								sendNotification_BEGIN(this, MainController, clientDescriptor, IngredientAvailabilityChangedNotification)
-									.ingredientIndex = COFFEE_INDEX,
-									.availability = coffeeMaker.areCoffeeBeansAvailable
-								sendNotification_END
-							// If we got a waste bin status update from coffee supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, CoffeeSupply, WasteBinStatus)
-								coffeeMaker.isCoffeeWasteBinFull = content.isBinFull;
-
-								// Send notification to client
-								sendNotification_BEGIN(this, MainController, clientDescriptor, CoffeeWasteBinStateChangedNotification)
-									.isBinFull = coffeeMaker.isCoffeeWasteBinFull
-								sendNotification_END
-							MESSAGE_SELECTOR_ANY
-						MESSAGE_SELECTOR_END
-					MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, WaterSupply)
-						MESSAGE_SELECTOR_BEGIN
-							// If we got a result from water supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, WaterSupply, Result)
-								// Propagate event to coffee making process state machine
-								if (content.code == OK_RESULT) {
-									processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_waterSupplied);
-								} else {
-									char *errorMessage;
-									switch (content.errorCode) {
-										case NO_WATER_ERROR:
-											errorMessage = "No water!";
-											producingError = PROCESS_NO_WATER_ERROR;
-											break;
-										case NO_WATER_FLOW_ERROR:
-											errorMessage = "No water flow!";
-											producingError = PROCESS_NO_WATER_FLOW_ERROR;
-											break;
-										case WATER_TEMPERATURE_TOO_LOW_ERROR:
-											errorMessage = "Water temperature too low!";
-											producingError = PROCESS_WATER_TEMPERATURE_TOO_LOW_ERROR;
-											break;
-										case ABORTED_ERROR:
-											errorMessage = "Supplying aborted!";
-											break;
-										default:
-											errorMessage = "<Unknown error>";
-									}
-									logInfo("[mainController] Water supply reports an error: %s", errorMessage);
-
-									processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_errorOccured);
-								}
-							// If we got a status update from water supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, WaterSupply, Status)
-								coffeeMaker.isWaterAvailable = content.availability;
-
-								// Send notification to client
-								sendNotification_BEGIN(this, MainController, clientDescriptor, IngredientAvailabilityChangedNotification)
-									.ingredientIndex = WATER_INDEX,
-									.availability = coffeeMaker.isWaterAvailable
-								sendNotification_END
-							MESSAGE_SELECTOR_ANY
-
-						MESSAGE_SELECTOR_END
-					MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, MilkSupply)
-						MESSAGE_SELECTOR_BEGIN
-							// If we got a result from milk supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MilkSupply, Result)
-								// Propagate event to coffee making process state machine
-								if (content.code == OK_RESULT) {
-									processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_milkSupplied);
-								} else {
-									processStateMachineEvent(&coffeeMakingProcessMachine, coffeeMakingEvent_errorOccured);
-								}
-							// If we got a status update from milk supply...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MilkSupply, Status)
-								coffeeMaker.isMilkAvailable = content.availability;
-
-								// Send notification to client
-								sendNotification_BEGIN(this, MainController, clientDescriptor, IngredientAvailabilityChangedNotification)
-									.ingredientIndex = MILK_INDEX,
-									.availability = coffeeMaker.isMilkAvailable
-								sendNotification_END
-							MESSAGE_SELECTOR_ANY
-
-						MESSAGE_SELECTOR_END
-					MESSAGE_SELECTOR_ANY
-						MainControllerMessage *specificMessage = (MainControllerMessage *)&message;
-						MESSAGE_SELECTOR_BEGIN
-							// If we got an init command...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, InitCommand)
-								logInfo("[mainController] Going to switch on...");
-
-								clientDescriptor = senderDescriptor;
-
-								processStateMachineEvent(&stateMachine, event_switchedOn);
-							// If we got an off command...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, OffCommand)
-								logInfo("[mainController] Going to switch off...");
-
-								processStateMachineEvent(&stateMachine, event_switchedOff);
-							// If we got an produce product command...
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, ProduceProductCommand)
-								logInfo("[mainController] Going to produce product %u %s milk...", content.productIndex, (content.withMilk ? "with" : "without"));
-
-								productToProduceIndex = content.productIndex;
-								produceWithMilk = content.withMilk;
-
-								processStateMachineEvent(&stateMachine, event_productSelected);
-							MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, AbortCommand)
-								logInfo("[mainController] Going to abort current operation...");
-								processStateMachineEvent(&stateMachine, event_productionProcessAborted);
-							MESSAGE_SELECTOR_ANY
-								logWarn("[mainController] Unexpected message %u from %s received!", specificMessage->type, senderDescriptor.name);
-						MESSAGE_SELECTOR_END
-				MESSAGE_SELECTOR_END
+				dispatchMessage(this, &header, message);
 			}
 		receiveGenericMessage_END
 	}
 }
 
+/**
+ * Gets the coffee making process instance a supply result responds to (or NULL if the process has ended meanwhile).
+ */
+static MakeCoffeeProcessInstance *takeMakeCoffeeProcessWaitingFor(MessageHeader *header) {
+	MakeCoffeeProcessInstance *process = findMakeCoffeeProcessByRequest(&coffeeMaker, header->correlationId);
+	if (process) {
+		process->supplyRequest = NULL_REQUEST_TOKEN;
+	}
+
+	return process;
+}
+
+/**
+ * Continuation for the result of a grind coffee powder or eject coffee waste command.
+ */
+static void coffeeSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context) {
+	CoffeeSupplyMessage *message = (CoffeeSupplyMessage *)response;
+	MakeCoffeeProcessInstance *process = takeMakeCoffeeProcessWaitingFor(header);
+	if (!process) {
+		return;
+	}
+
+	MESSAGE_SELECTOR_BEGIN
+		MESSAGE_BY_TYPE_SELECTOR(*message, CoffeeSupply, Result)
+			// Propagate event to coffee making process state machine
+			if (content.code == OK_RESULT) {
+				if (isStateActive(&process->machine, &grindingCoffeePowderActivity)) {
+					processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_coffeePowderGrinded);
+				} else if (isStateActive(&process->machine, &ejectingCoffeeWasteActivity)) {
+					processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_coffeeWasteEjected);
+				}
+			} else {
+				char *errorMessage;
+				switch (content.errorCode) {
+					case NO_COFFEE_BEANS_ERROR:
+						errorMessage = "No coffee beans!";
+						process->error = PROCESS_NO_COFFEE_BEANS_ERROR;
+						break;
+					case COFFEE_WASTE_EJECTION_NOT_POSSIBLE_ERROR:
+						errorMessage = "Coffee waste ejection not possible!";
+					default:
+						errorMessage = "<Unknown error>";
+				}
+				logInfo("[mainController] Coffee supply reports an error: %s", errorMessage);
+
+				processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_errorOccured);
+			}
+		MESSAGE_SELECTOR_ANY
+			logWarn("[mainController] Unexpected response %u from coffee supply received!", message->type);
+	MESSAGE_SELECTOR_END
+}
+
+/**
+ * Continuation for the result of a supply water command.
+ */
+static void waterSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context) {
+	WaterSupplyMessage *message = (WaterSupplyMessage *)response;
+	MakeCoffeeProcessInstance *process = takeMakeCoffeeProcessWaitingFor(header);
+	if (!process) {
+		return;
+	}
+
+	MESSAGE_SELECTOR_BEGIN
+		MESSAGE_BY_TYPE_SELECTOR(*message, WaterSupply, Result)
+			// Propagate event to coffee making process state machine
+			if (content.code == OK_RESULT) {
+				processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_waterSupplied);
+			} else {
+				char *errorMessage;
+				switch (content.errorCode) {
+					case NO_WATER_ERROR:
+						errorMessage = "No water!";
+						process->error = PROCESS_NO_WATER_ERROR;
+						break;
+					case NO_WATER_FLOW_ERROR:
+						errorMessage = "No water flow!";
+						process->error = PROCESS_NO_WATER_FLOW_ERROR;
+						break;
+					case WATER_TEMPERATURE_TOO_LOW_ERROR:
+						errorMessage = "Water temperature too low!";
+						process->error = PROCESS_WATER_TEMPERATURE_TOO_LOW_ERROR;
+						break;
+					case ABORTED_ERROR:
+						errorMessage = "Supplying aborted!";
+						break;
+					default:
+						errorMessage = "<Unknown error>";
+				}
+				logInfo("[mainController] Water supply reports an error: %s", errorMessage);
+
+				processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_errorOccured);
+			}
+		MESSAGE_SELECTOR_ANY
+			logWarn("[mainController] Unexpected response %u from water supply received!", message->type);
+	MESSAGE_SELECTOR_END
+}
+
+/**
+ * Continuation for the result of a supply milk command.
+ */
+static void milkSupplyResultReceived(void *activity, MessageHeader *header, void *response, void *context) {
+	MilkSupplyMessage *message = (MilkSupplyMessage *)response;
+	MakeCoffeeProcessInstance *process = takeMakeCoffeeProcessWaitingFor(header);
+	if (!process) {
+		return;
+	}
+
+	MESSAGE_SELECTOR_BEGIN
+		MESSAGE_BY_TYPE_SELECTOR(*message, MilkSupply, Result)
+			// Propagate event to coffee making process state machine
+			if (content.code == OK_RESULT) {
+				processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_milkSupplied);
+			} else {
+				processMakeCoffeeProcessEvent(&coffeeMaker, process, coffeeMakingEvent_errorOccured);
+			}
+		MESSAGE_SELECTOR_ANY
+			logWarn("[mainController] Unexpected response %u from milk supply received!", message->type);
+	MESSAGE_SELECTOR_END
+}
+
 static void sendError(int code) {
-	sendNotification_BEGIN(this, MainController, clientDescriptor, Result)
+	publishNotification_BEGIN(this, MainController, MAIN_CONTROLLER_TOPIC, Result)
 		.code = NOK_RESULT,
 		.errorCode = code
-	sendNotification_END
+	publishNotification_END
 }
 
 static void tearDownMainController(void *activity) {
 	//logInfo("[mainController] Tearing down...");
+
+	logStateMachineStatistics(&stateMachine);
 }
@@ -12,6 +12,9 @@
 #include <mqueue.h>
 #include "activity.h"
 
+// Topic of the machine state, production and ingredient notifications (and errors)
+#define MAIN_CONTROLLER_TOPIC "mainController"
+
 #define COFFEE_INDEX 1
 #define WATER_INDEX 2
 #define MILK_INDEX 3
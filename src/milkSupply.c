@@ -17,9 +17,12 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include "defines.h"
 #include "log.h"
 #include "device.h"
+#include "coroutine.h"
+#include "startup.h"
 #include "milkSupply.h"
 
 // Message type for milk supply subsystems
@@ -43,73 +46,109 @@ static ActivityDescriptor milkSupply = {
 	.name = "milkSupply",
 	.setUp = setUpMilkSupply,
 	.run = runMilkSupply,
-	.tearDown = tearDownMilkSupply
+	.tearDown = tearDownMilkSupply,
+	.execution = activityExecution_coroutine,
+	.stackSize = SMALL_ACTIVITY_STACK_SIZE
 };
 
 static ActivityDescriptor lacticAcidMonitorDescriptor = {
 	.name = "milkLacticAcidMonitor",
 	.setUp = setUpSubsystem,
 	.run = runSubsystem,
-	.tearDown = tearDownSubsystem
+	.tearDown = tearDownSubsystem,
+	.execution = activityExecution_reactor
 };
 
 static ActivityDescriptor coolingDescriptor = {
 	.name = "milkCooling",
 	.setUp = setUpSubsystem,
 	.run = runSubsystem,
-	.tearDown = tearDownSubsystem
+	.tearDown = tearDownSubsystem,
+	.execution = activityExecution_reactor
 };
 
 static ActivityDescriptor fillStateMonitorDescriptor = {
 	.name = "milkFillStateMonitor",
 	.setUp = setUpSubsystem,
 	.run = runSubsystem,
-	.tearDown = tearDownSubsystem
+	.tearDown = tearDownSubsystem,
+	.execution = activityExecution_reactor
 };
 
 static ActivityDescriptor pipeFlushingDescriptor = {
 	.name = "milkPipeFlushing",
 	.setUp = setUpSubsystem,
 	.run = runSubsystem,
-	.tearDown = tearDownSubsystem
+	.tearDown = tearDownSubsystem,
+	.execution = activityExecution_reactor
 };
 
 static Activity *this;
 
+// The subsystems are only created when milk is supplied the first time
 static Activity *lacticAcidMonitor;
 static Activity *cooling;
 static Activity *fillStateMonitor;
 static Activity *pipeFlushing;
 
+// The ongoing supply (runs as a coroutine, so commands are still handled meanwhile)
+static CoroutineId supplyingCoroutine = NULL_COROUTINE_ID;
+static unsigned int milkAmountToSupply = 0;
+static ActivityDescriptor callerDescriptor;
+static DWord callerRequestId;
+
 MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, InitCommand, 1)
 MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, OffCommand, 2)
 MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, SupplyMilkCommand, 3)
-MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, Result, 4)
-MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, Status, 5)
+MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, AbortCommand, 4)
+MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, Result, 5)
+MESSAGE_CONTENT_TYPE_MAPPING(MilkSupply, Status, 6)
 
 ActivityDescriptor getMilkSupplyDescriptor() {
-	return milkSupply;
+	return internActivityDescriptor(&milkSupply);
 }
 
 static void setUpMilkSupply(void *activity) {
 	//logInfo("[milkSupply] Setting up...");
 
 	this = (Activity *)activity;
+}
 
-	lacticAcidMonitor = createActivity(lacticAcidMonitorDescriptor, messageQueue_blocking);
-	cooling = createActivity(coolingDescriptor, messageQueue_blocking);
-	fillStateMonitor = createActivity(fillStateMonitorDescriptor, messageQueue_blocking);
-	pipeFlushing = createActivity(pipeFlushingDescriptor, messageQueue_blocking);
+static void setUpSubsystems() {
+	createActivityOnFirstUse(&lacticAcidMonitor, lacticAcidMonitorDescriptor, messageQueue_blocking);
+	createActivityOnFirstUse(&cooling, coolingDescriptor, messageQueue_blocking);
+	createActivityOnFirstUse(&fillStateMonitor, fillStateMonitorDescriptor, messageQueue_blocking);
+	createActivityOnFirstUse(&pipeFlushing, pipeFlushingDescriptor, messageQueue_blocking);
+}
+
+static void supplyMilk(void *activity, void *argument) {
+	logInfo("[milkSupply] Supplying %u ml milk...", milkAmountToSupply);
+
+	int supplyError = NO_ERROR;
+	if (sleepFor(this, 2000) == -EINTR) {
+		logWarn("[milkSupply] Supplying milk aborted!");
+
+		supplyError = ABORTED_ERROR;
+	} else {
+		logInfo("[milkSupply] ...done (supplying milk).");
+	}
+
+	sendDeferredResponse_BEGIN(this, MilkSupply, callerDescriptor, callerRequestId, Result)
+		.code = supplyError == NO_ERROR ? OK_RESULT : NOK_RESULT,
+		.errorCode = supplyError
+	sendDeferredResponse_END
+
+	supplyingCoroutine = NULL_COROUTINE_ID;
 }
 
 static void runMilkSupply(void *activity) {
 	//logInfo("[milkSupply] Running...");
 
-	while (TRUE) {
+	while (isActivityRunning(this)) {
 		receiveMessage_BEGIN(this, MilkSupply)
 			if (error) {
 				//TODO Implement appropriate error handling
-				sleep(10);
+				sleepFor(this, 10000);
 
 				// Try again
 				continue;
@@ -117,20 +156,35 @@ static void runMilkSupply(void *activity) {
 			if (result > 0) {
 				//TODO Implement business logic
 				MESSAGE_SELECTOR_BEGIN
-					MESSAGE_BY_TYPE_SELECTOR(message, MilkSupply, InitCommand)
+					MESSAGE_BY_TYPE_SELECTOR(*message, MilkSupply, InitCommand)
 						sendResponse_BEGIN(this, MilkSupply, Status)
 							.availability = available
 						sendResponse_END
 						logInfo("[milkSupply] Switched on.");
-					MESSAGE_BY_TYPE_SELECTOR(message, MilkSupply, OffCommand)
+					MESSAGE_BY_TYPE_SELECTOR(*message, MilkSupply, OffCommand)
+						interruptCoroutine(this, supplyingCoroutine);
 						logInfo("[milkSupply] Switched off.");
-					MESSAGE_BY_TYPE_SELECTOR(message, MilkSupply, SupplyMilkCommand)
-						logInfo("[milkSupply] Supplying %u ml milk...", content.milkAmount);
-						sleep(2);
-						logInfo("[milkSupply] ...done (supplying milk).");
-						sendResponse_BEGIN(this, MilkSupply, Result)
-							.code = OK_RESULT
-						sendResponse_END
+					MESSAGE_BY_TYPE_SELECTOR(*message, MilkSupply, SupplyMilkCommand)
+						setUpSubsystems();
+
+						CoroutineId coroutine = -EBUSY;
+						if (supplyingCoroutine == NULL_COROUTINE_ID) {
+							callerDescriptor = *senderDescriptor;
+							callerRequestId = header.sequenceNumber;
+
+							milkAmountToSupply = content.milkAmount;
+
+							coroutine = startCoroutine(this, supplyMilk, NULL);
+						}
+						if (coroutine > NULL_COROUTINE_ID) {
+							supplyingCoroutine = coroutine;
+						} else {
+							sendResponse_BEGIN(this, MilkSupply, Result)
+								.code = NOK_RESULT
+							sendResponse_END
+						}
+					MESSAGE_BY_TYPE_SELECTOR(*message, MilkSupply, AbortCommand)
+						interruptCoroutine(this, supplyingCoroutine);
 				MESSAGE_SELECTOR_END
 			}
 		receiveMessage_END
@@ -140,10 +194,14 @@ static void runMilkSupply(void *activity) {
 static void tearDownMilkSupply(void *activity) {
 	//logInfo("[milkSupply] Tearing down...");
 
-	destroyActivity(pipeFlushing);
-	destroyActivity(fillStateMonitor);
-	destroyActivity(cooling);
-	destroyActivity(lacticAcidMonitor);
+	Activity **subsystems[] = { &pipeFlushing, &fillStateMonitor, &cooling, &lacticAcidMonitor };
+	unsigned int i;
+	for (i = 0; i < sizeof(subsystems) / sizeof(Activity **); i++) {
+		if (*subsystems[i]) {
+			destroyActivity(*subsystems[i]);
+			*subsystems[i] = NULL;
+		}
+	}
 }
 
 //TODO Implement
@@ -153,8 +211,12 @@ static void setUpSubsystem(void *activity) {
 
 //TODO Implement
 static void runSubsystem(void *activity) {
+	// Called by the executor whenever there are incoming messages
 	while (TRUE) {
 		receiveMessage_BEGIN(activity, Subsystem)
+			if (result <= 0) {
+				break;
+			}
 		receiveMessage_END
 	}
 }
@@ -20,6 +20,8 @@ MESSAGE_CONTENT_DEFINITION_BEGIN
 	unsigned int milkAmount; // [ml]
 MESSAGE_CONTENT_DEFINITION_END(MilkSupply, SupplyMilkCommand)
 
+COMMON_MESSAGE_CONTENT_REDEFINITION(MilkSupply, AbortCommand)
+
 COMMON_MESSAGE_CONTENT_REDEFINITION(MilkSupply, Result)
 
 MESSAGE_CONTENT_DEFINITION_BEGIN
@@ -31,6 +33,7 @@ MESSAGE_DEFINITION_BEGIN
 	MESSAGE_CONTENT(MilkSupply, InitCommand)
 	MESSAGE_CONTENT(MilkSupply, OffCommand)
 	MESSAGE_CONTENT(MilkSupply, SupplyMilkCommand)
+	MESSAGE_CONTENT(MilkSupply, AbortCommand)
 	MESSAGE_CONTENT(MilkSupply, Result)
 	MESSAGE_CONTENT(MilkSupply, Status)
 MESSAGE_DEFINITION_END(MilkSupply)
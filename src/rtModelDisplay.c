@@ -16,5 +16,5 @@ static ActivityDescriptor rtModelDisplay = {
 };
 
 ActivityDescriptor getRtModelDisplayDescriptor() {
-	return rtModelDisplay;
+	return internActivityDescriptor(&rtModelDisplay);
 }
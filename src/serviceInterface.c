@@ -21,13 +21,14 @@ static ActivityDescriptor serviceInterface = {
 	.name = "serviceInterface",
 	.setUp = setUpServiceInterface,
 	.run = runServiceInterface,
-	.tearDown = tearDownServiceInterface
+	.tearDown = tearDownServiceInterface,
+	.execution = activityExecution_reactor
 };
 
 static Activity *this;
 
 ActivityDescriptor getServiceInterfaceDescriptor() {
-	return serviceInterface;
+	return internActivityDescriptor(&serviceInterface);
 }
 
 static void setUpServiceInterface(void *activity) {
@@ -46,8 +47,12 @@ static void runServiceInterface(void *activity) {
 //		logInfo("[serviceInterface] Message received - length: %ld, value: %d, message: %s",
 //				messageLength, message.intValue, message.strValue);
 //	}
+	// Called by the executor whenever there are incoming messages
 	while (TRUE) {
 		receiveMessage_BEGIN(this, ServiceInterface)
+			if (result <= 0) {
+				break;
+			}
 		receiveMessage_END
 	}
 }
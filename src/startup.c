@@ -0,0 +1,321 @@
+/**
+ * Startup orchestrator
+ *
+ * The orchestrator starts every activity whose dependencies are ready, then waits until one more activity
+ * becomes ready and repeats until all activities are ready. The timeline uses the same clock as the activities'
+ * ready times (the monotonic clock [us]).
+ *
+ * @file    startup.c
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "defines.h"
+#include "log.h"
+#include "startup.h"
+
+/**
+ * Represents an entry of the startup timeline (a started activity or a reached milestone).
+ */
+typedef struct {
+	char name[MAX_ACTIVITY_NAME_LENGTH]; /**< The activity's or milestone's name. */
+	Activity *activity; /**< The activity (NULL for a milestone). */
+	DWord time; /**< When the activity has been started (or the milestone has been reached). */
+	int isOnFirstUse; /**< Has the activity been created on its first use? */
+} TimelineEntry;
+
+static DWord startupTime = 0;
+static TimelineEntry timeline[MAX_NUMBER_OF_TIMELINE_ENTRIES];
+static unsigned int numberOfTimelineEntries = 0;
+static pthread_mutex_t timelineLock = PTHREAD_MUTEX_INITIALIZER;
+
+static DWord getStartupClockTime(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (DWord)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Formats a duration [us] in milliseconds (with one decimal).
+ */
+static char *formatDuration(DWord duration, char *buffer) {
+	sprintf(buffer, "%u.%u ms", (unsigned int)(duration / 1000), (unsigned int)(duration % 1000 / 100));
+
+	return buffer;
+}
+
+static unsigned int toMilliseconds(DWord time) {
+	return (unsigned int)((time - startupTime) / 1000);
+}
+
+/**
+ * Adds an entry to the timeline (unless it is full).
+ * Returns FALSE if there has already been a milestone with the same name.
+ */
+static int addTimelineEntry(char *name, Activity *activity, DWord time, int isOnFirstUse) {
+	int isAdded = FALSE;
+
+	// Critical section
+	pthread_mutex_lock(&timelineLock);
+	unsigned int i;
+	for (i = 0; i < numberOfTimelineEntries; i++) {
+		if (!activity && !timeline[i].activity && strcmp(timeline[i].name, name) == 0) {
+			break;
+		}
+	}
+	if (i == numberOfTimelineEntries && numberOfTimelineEntries < MAX_NUMBER_OF_TIMELINE_ENTRIES) {
+		TimelineEntry *entry = &timeline[numberOfTimelineEntries++];
+		strncpy(entry->name, name, MAX_ACTIVITY_NAME_LENGTH - 1);
+		entry->name[MAX_ACTIVITY_NAME_LENGTH - 1] = '\0';
+		entry->activity = activity;
+		entry->time = time;
+		entry->isOnFirstUse = isOnFirstUse;
+
+		isAdded = TRUE;
+	}
+	pthread_mutex_unlock(&timelineLock);
+
+	return isAdded;
+}
+
+/**
+ * Gets the index of the startup table entry declaring the given activity (or -1).
+ */
+static int findStartupEntry(StartupEntry *entries, unsigned int numberOfEntries, ActivityDescriptorProvider descriptor) {
+	unsigned int id = descriptor().id;
+
+	unsigned int i;
+	for (i = 0; i < numberOfEntries; i++) {
+		if (entries[i].descriptor().id == id) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Checks whether all dependencies of a startup table entry are ready.
+ */
+static int areDependenciesReady(StartupEntry *entries, int dependencies[]) {
+	unsigned int i;
+	for (i = 0; i < MAX_NUMBER_OF_STARTUP_DEPENDENCIES && dependencies[i] >= 0; i++) {
+		Activity *dependency = entries[dependencies[i]].activity;
+		if (!dependency || !isActivityReady(dependency)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * @copydoc startUpActivities
+ */
+int startUpActivities(StartupEntry *entries, unsigned int numberOfEntries, unsigned int timeout) {
+	if (numberOfEntries > MAX_NUMBER_OF_STARTUP_ACTIVITIES) {
+		logErr("[startup] Too many activities (%u)!", numberOfEntries);
+
+		return -EINVAL;
+	}
+
+	// Resolve the dependencies to startup table indices
+	int dependencies[MAX_NUMBER_OF_STARTUP_ACTIVITIES][MAX_NUMBER_OF_STARTUP_DEPENDENCIES];
+	unsigned int i, j;
+	for (i = 0; i < numberOfEntries; i++) {
+		entries[i].activity = NULL;
+
+		for (j = 0; j < MAX_NUMBER_OF_STARTUP_DEPENDENCIES; j++) {
+			dependencies[i][j] = -1;
+			if (!entries[i].dependencies[j]) {
+				break;
+			}
+
+			dependencies[i][j] = findStartupEntry(entries, numberOfEntries, entries[i].dependencies[j]);
+			if (dependencies[i][j] < 0) {
+				logErr("[startup] %s depends on %s, which is not declared!", entries[i].descriptor().name, entries[i].dependencies[j]().name);
+
+				return -EINVAL;
+			}
+		}
+	}
+
+	// Critical section
+	pthread_mutex_lock(&timelineLock);
+	startupTime = getStartupClockTime();
+	numberOfTimelineEntries = 0;
+	pthread_mutex_unlock(&timelineLock);
+
+	logInfo("[startup] Starting %u activities...", numberOfEntries);
+
+	while (TRUE) {
+		// (Read before checking the activities, so no activity becoming ready meanwhile is missed)
+		unsigned int readinessCount = getActivityReadinessCount();
+
+		// Start every activity whose dependencies are ready
+		int isAnyStarted = FALSE;
+		for (i = 0; i < numberOfEntries; i++) {
+			if (!entries[i].activity && areDependenciesReady(entries, dependencies[i])) {
+				ActivityDescriptor descriptor = entries[i].descriptor();
+				DWord startTime = getStartupClockTime();
+				entries[i].activity = createActivity(descriptor, entries[i].messageQueueMode);
+				addTimelineEntry(descriptor.name, entries[i].activity, startTime, FALSE);
+
+				isAnyStarted = TRUE;
+			}
+		}
+
+		unsigned int numberOfStarted = 0;
+		unsigned int numberOfReady = 0;
+		for (i = 0; i < numberOfEntries; i++) {
+			if (entries[i].activity) {
+				numberOfStarted++;
+				if (isActivityReady(entries[i].activity)) {
+					numberOfReady++;
+				}
+			}
+		}
+		if (numberOfReady == numberOfEntries) {
+			break;
+		}
+		if (!isAnyStarted && numberOfStarted == numberOfReady) {
+			// Nothing to wait for, but activities left: Their dependencies are circular
+			for (i = 0; i < numberOfEntries; i++) {
+				if (!entries[i].activity) {
+					logErr("[startup] %s cannot be started (circular dependency)!", entries[i].descriptor().name);
+				}
+			}
+
+			return -EINVAL;
+		}
+
+		int elapsedTime = toMilliseconds(getStartupClockTime());
+		if (elapsedTime >= (int)timeout || waitForActivityReadiness(readinessCount, timeout - elapsedTime) < 0) {
+			for (i = 0; i < numberOfEntries; i++) {
+				if (!entries[i].activity || !isActivityReady(entries[i].activity)) {
+					logErr("[startup] %s has not become ready within %u ms!", entries[i].descriptor().name, timeout);
+				}
+			}
+
+			return -ETIMEDOUT;
+		}
+	}
+
+	char duration[16];
+	logInfo("[startup] All activities ready after %s.", formatDuration(getStartupClockTime() - startupTime, duration));
+
+	return 0;
+}
+
+/**
+ * @copydoc tearDownActivities
+ */
+void tearDownActivities(StartupEntry *entries, unsigned int numberOfEntries) {
+	// Destroy an activity only when no other running activity depends on it anymore
+	int isAnyDestroyed = TRUE;
+	while (isAnyDestroyed) {
+		isAnyDestroyed = FALSE;
+
+		unsigned int i, j, k;
+		for (i = 0; i < numberOfEntries; i++) {
+			if (!entries[i].activity) {
+				continue;
+			}
+
+			int isDependedOn = FALSE;
+			unsigned int id = entries[i].descriptor().id;
+			for (j = 0; j < numberOfEntries && !isDependedOn; j++) {
+				if (!entries[j].activity || j == i) {
+					continue;
+				}
+				for (k = 0; k < MAX_NUMBER_OF_STARTUP_DEPENDENCIES && entries[j].dependencies[k]; k++) {
+					if (entries[j].dependencies[k]().id == id) {
+						isDependedOn = TRUE;
+
+						break;
+					}
+				}
+			}
+
+			if (!isDependedOn) {
+				destroyActivity(entries[i].activity);
+				entries[i].activity = NULL;
+
+				isAnyDestroyed = TRUE;
+			}
+		}
+	}
+
+	// (Only left if the dependencies were circular)
+	unsigned int i;
+	for (i = 0; i < numberOfEntries; i++) {
+		if (entries[i].activity) {
+			destroyActivity(entries[i].activity);
+			entries[i].activity = NULL;
+		}
+	}
+}
+
+/**
+ * @copydoc createActivityOnFirstUse
+ */
+Activity *createActivityOnFirstUse(Activity **activity, ActivityDescriptor descriptor, MessageQueueMode messageQueueMode) {
+	if (!*activity) {
+		logInfo("[startup] Creating %s on its first use...", descriptor.name);
+
+		DWord startTime = getStartupClockTime();
+		*activity = createActivity(descriptor, messageQueueMode);
+		addTimelineEntry(descriptor.name, *activity, startTime, TRUE);
+	}
+
+	return *activity;
+}
+
+/**
+ * @copydoc reportStartupMilestone
+ */
+void reportStartupMilestone(char *name) {
+	DWord time = getStartupClockTime();
+	if (addTimelineEntry(name, NULL, time, FALSE)) {
+		char duration[16];
+		logInfo("[startup] %s after %s.", name, formatDuration(time - startupTime, duration));
+	}
+}
+
+/**
+ * @copydoc logStartupTimeline
+ */
+void logStartupTimeline(void) {
+	logInfo("[startup] Timeline:");
+
+	char time[16], timeToReady[16];
+	// Critical section
+	pthread_mutex_lock(&timelineLock);
+	unsigned int i;
+	for (i = 0; i < numberOfTimelineEntries; i++) {
+		TimelineEntry *entry = &timeline[i];
+		formatDuration(entry->time - startupTime, time);
+		if (!entry->activity) {
+			logInfo("[startup] %10s: %s", time, entry->name);
+		} else if (isActivityReady(entry->activity)) {
+			logInfo("[startup] %10s: %s started%s, time to ready: %s",
+					time,
+					entry->name,
+					entry->isOnFirstUse ? " (on first use)" : "",
+					formatDuration(entry->activity->readyTime - entry->time, timeToReady));
+		} else {
+			logInfo("[startup] %10s: %s started%s, not ready yet",
+					time,
+					entry->name,
+					entry->isOnFirstUse ? " (on first use)" : "");
+		}
+	}
+	pthread_mutex_unlock(&timelineLock);
+}
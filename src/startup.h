@@ -0,0 +1,103 @@
+/**
+ * Startup orchestrator
+ *
+ * Starts the subsystems declared in a startup table: An activity is created as soon as all
+ * the activities it depends on are ready (= have run their 'set up' handlers), so independent
+ * activities start in parallel and no message is sent to a subsystem which is not running yet.
+ * Activities which are only needed later can be created on their first use instead.
+ * The orchestrator records a startup timeline (when each activity has been started and has become ready
+ * and when the milestones reported by the subsystems have been reached, e.g. the machine becoming idle).
+ *
+ * @file    startup.h
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#include "activity.h"
+
+/**
+ * The maximum number of activities a startup table may declare.
+ */
+#define MAX_NUMBER_OF_STARTUP_ACTIVITIES 16
+
+/**
+ * The maximum number of dependencies of an activity in a startup table.
+ */
+#define MAX_NUMBER_OF_STARTUP_DEPENDENCIES 4
+
+/**
+ * The maximum number of entries (activities and milestones) of the startup timeline.
+ */
+#define MAX_NUMBER_OF_TIMELINE_ENTRIES 32
+
+/**
+ * The default time all activities of a startup table may take to become ready [ms].
+ */
+#define DEFAULT_STARTUP_TIMEOUT 5000
+
+/**
+ * Defines the signature of the function providing an activity's descriptor (e.g. getCoffeeSupplyDescriptor()).
+ */
+typedef ActivityDescriptor (*ActivityDescriptorProvider)(void);
+
+/**
+ * Declares an activity of a startup table.
+ */
+typedef struct {
+	ActivityDescriptorProvider descriptor; /**< Provides the activity's descriptor. */
+	ActivityDescriptorProvider dependencies[MAX_NUMBER_OF_STARTUP_DEPENDENCIES]; /**< The activities which have to be ready before the activity is started (the first NULL ends the list). */
+	MessageQueueMode messageQueueMode; /**< The mode of the activity's queue. */
+	Activity *activity; /**< The started activity (set by the orchestrator). */
+} StartupEntry;
+
+/**
+ * Starts the activities of a startup table in dependency order (independent activities in parallel)
+ * and waits until all of them are ready.
+ * The timeline is reset first, the startup time is the reference of all its entries.
+ *
+ * @param entries The startup table
+ * @param numberOfEntries The number of activities in the startup table
+ * @param timeout The time all activities may take to become ready [ms]
+ * @return Returns 0 on success, -EINVAL if a dependency is unknown or circular,
+ * -ETIMEDOUT if not all activities have become ready within the timeout (the started ones keep running)
+ */
+extern int startUpActivities(StartupEntry *entries, unsigned int numberOfEntries, unsigned int timeout);
+
+/**
+ * Destroys the activities of a startup table in reverse startup order (dependent activities first).
+ *
+ * @param entries The startup table
+ * @param numberOfEntries The number of activities in the startup table
+ */
+extern void tearDownActivities(StartupEntry *entries, unsigned int numberOfEntries);
+
+/**
+ * Creates an activity on its first use (does nothing if it has already been created).
+ * The activity is added to the startup timeline.
+ * Must only be called by the activity owning the reference.
+ *
+ * @param activity The reference to the activity (NULL until the activity has been created)
+ * @param descriptor The activity's descriptor
+ * @param messageQueueMode The mode of the activity's queue
+ * @return Returns the activity
+ */
+extern Activity *createActivityOnFirstUse(Activity **activity, ActivityDescriptor descriptor, MessageQueueMode messageQueueMode);
+
+/**
+ * Records a milestone in the startup timeline (only its first occurrence) and logs the time since the startup.
+ * Can be called by any activity.
+ *
+ * @param name The milestone's name (a string literal, it is not copied)
+ */
+extern void reportStartupMilestone(char *name);
+
+/**
+ * Logs the startup timeline (must be called before the activities in it are destroyed).
+ */
+extern void logStartupTimeline(void);
+
+#endif /* STARTUP_H_ */
@@ -0,0 +1,113 @@
+/**
+ * Declarative state machine description
+ *
+ * A state machine is described by three X-macro lists, each entry passes the list's first argument on:
+ *
+ *	#define EXAMPLE_STATES(STATE, _) \
+ *		STATE(_, exampleState_off, offState) \
+ *		STATE(_, exampleState_on, onState)
+ *
+ *	#define EXAMPLE_EVENTS(EVENT, _) \
+ *		EVENT(_, exampleEvent_switchOn) \
+ *		EVENT(_, exampleEvent_switchOff)
+ *
+ *	#define EXAMPLE_TRANSITIONS(TRANSITION, _) \
+ *		TRANSITION(_, exampleState_off, exampleEvent_switchOn, onState) \
+ *		TRANSITION(_, exampleState_on, exampleEvent_switchOff, offState)
+ *
+ * The lists generate the state and event enums (DECLARE_STATE_MACHINE_ENUM()), the forward declarations of the
+ * state objects (DECLARE_STATE_MACHINE_STATES()) and the machine's 'static const' tables (DEFINE_STATE_MACHINE_TABLES()),
+ * which a state machine definition refers to with STATE_MACHINE_TABLES(). The number of states and events is derived
+ * from the lists, so it cannot get out of sync with the enums.
+ * The transitions have to be listed grouped by source state (in the order of the states) and sorted by event.
+ * The engine validates the tables when the machine is registered (see validateStateMachine()).
+ * The regions of a composite state are described the same way, but with the event list of their state machine.
+ *
+ * @file    stateMachineDescription.h
+ * @version 1.0
+ * @authors	Toni Baumann (bauma12@bfh.ch), Ronny Stauffer (staur3@bfh.ch), Elmar Vonlanthen (vonle1@bfh.ch)
+ * @date    Oct 17, 2026
+ */
+
+#ifndef STATEMACHINEDESCRIPTION_H_
+#define STATEMACHINEDESCRIPTION_H_
+
+#include "stateMachineEngine.h"
+
+// List item generators
+#define STATE_MACHINE_ITEM_COUNT(_, ...) + 1
+#define STATE_MACHINE_ENUM_ITEM(_, name, ...) name,
+#define STATE_MACHINE_NAME_ITEM(_, name, ...) #name,
+#define STATE_MACHINE_STATE_DECLARATION(_, name, state) static State state;
+#define STATE_MACHINE_STATE_REFERENCE(_, name, state) &state,
+#define STATE_MACHINE_TRANSITION_ITEM(_, source, event, nextState) { event, &nextState },
+#define STATE_MACHINE_TRANSITION_SOURCE(_, source, event, nextState) source,
+#define STATE_MACHINE_TRANSITIONS_BEFORE(state, source, event, nextState) + ((source) < (state))
+#define STATE_MACHINE_ROW_OFFSET(TRANSITIONS, name, state) (0 TRANSITIONS(STATE_MACHINE_TRANSITIONS_BEFORE, name)),
+
+/**
+ * Gets the number of entries of a state, event or transition list (a constant expression).
+ */
+#define STATE_MACHINE_COUNT(LIST) (0 LIST(STATE_MACHINE_ITEM_COUNT, ~))
+
+/**
+ * Generates an enum of a state or event list.
+ */
+#define DECLARE_STATE_MACHINE_ENUM(Type, LIST) \
+	typedef enum { \
+		LIST(STATE_MACHINE_ENUM_ITEM, ~) \
+	} Type;
+
+/**
+ * Forward declares the state objects of a state list.
+ */
+#define DECLARE_STATE_MACHINE_STATES(STATES) \
+	STATES(STATE_MACHINE_STATE_DECLARATION, ~)
+
+/**
+ * Generates the 'static const' tables of a state machine (prefixed with the given name):
+ * The compiled transition table and the description used by the validation.
+ * (Must be placed after the definitions of the state objects.)
+ */
+#define DEFINE_STATE_MACHINE_TABLES(name, STATES, EVENTS, TRANSITIONS) \
+	typedef char name##TransitionCountCheck[STATE_MACHINE_COUNT(TRANSITIONS) <= 255 ? 1 : -1]; \
+	static const Transition name##Transitions[] = { \
+		TRANSITIONS(STATE_MACHINE_TRANSITION_ITEM, ~) \
+	}; \
+	static const unsigned char name##RowOffsets[] = { \
+		STATES(STATE_MACHINE_ROW_OFFSET, TRANSITIONS) \
+		STATE_MACHINE_COUNT(TRANSITIONS) \
+	}; \
+	static const CompiledTransitions name##CompiledTransitions = { \
+		.rowOffsets = name##RowOffsets, \
+		.transitions = name##Transitions \
+	}; \
+	static State *const name##States[] = { \
+		STATES(STATE_MACHINE_STATE_REFERENCE, ~) \
+	}; \
+	static const char *const name##StateNames[] = { \
+		STATES(STATE_MACHINE_NAME_ITEM, ~) \
+	}; \
+	static const char *const name##EventNames[] = { \
+		EVENTS(STATE_MACHINE_NAME_ITEM, ~) \
+	}; \
+	static const unsigned char name##TransitionSources[] = { \
+		TRANSITIONS(STATE_MACHINE_TRANSITION_SOURCE, ~) \
+	}; \
+	static const StateMachineDescription name##Description = { \
+		.states = name##States, \
+		.stateNames = name##StateNames, \
+		.eventNames = name##EventNames, \
+		.transitionSources = name##TransitionSources \
+	};
+
+/**
+ * Initializes the table related members of a state machine definition with the tables generated by DEFINE_STATE_MACHINE_TABLES().
+ */
+#define STATE_MACHINE_TABLES(name, STATES, EVENTS) \
+	.numberOfStates = STATE_MACHINE_COUNT(STATES), \
+	.numberOfEvents = STATE_MACHINE_COUNT(EVENTS), \
+	.compiledTransitions = &name##CompiledTransitions, \
+	.description = &name##Description
+
+#endif /* STATEMACHINEDESCRIPTION_H_ */
@@ -7,143 +7,969 @@
  * Contains the state machine engine.
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include "defines.h"
 #include "log.h"
 #include "stateMachineEngine.h"
 
-static Event activateState(StateMachine *stateMachine, State *nextState);
-static Event runState(State *state);
+static Event activateState(StateMachineInstance *stateMachine, State *nextState);
+static Event runState(StateMachineInstance *stateMachine);
+static State *lookUpTransition(const StateMachineDefinition *definition, unsigned int stateIndex, Event event);
+static Event takeTransition(StateMachineInstance *stateMachine, Event event);
+static void runToCompletion(StateMachineInstance *stateMachine, Event event);
+static void clearEventQueue(StateMachineInstance *stateMachine);
+static void queueEvent(StateMachineInstance *stateMachine, Event event);
+static Event dequeueEvent(StateMachineInstance *stateMachine);
+static void exitRegions(StateMachineInstance *stateMachine);
+static unsigned long long getDispatchClockTime(void);
+
+/**
+ * Represents a registered state machine definition.
+ */
+typedef struct {
+	const StateMachineDefinition *definition; /**< The state machine definition. */
+	int isRejected; /**< Has the validation found errors in the definition's tables? */
+} RegisteredStateMachine;
+
+static RegisteredStateMachine registeredStateMachines[MAX_NUMBER_OF_REGISTERED_STATE_MACHINES];
+static unsigned int numberOfRegisteredStateMachines = 0;
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * @copydoc setUpStateMachine
  */
-void setUpStateMachine(StateMachine *stateMachine) {
+void setUpStateMachine(StateMachineInstance *stateMachine) {
 	if (stateMachine->isInitialized) {
 		return;
 	}
 
-	if (stateMachine->setUpAction) {
-		stateMachine->setUpAction();
+	if (registerStateMachine(stateMachine->definition) < 0) {
+		logErr("[%s state machine] Cannot set up a state machine with invalid tables!", stateMachine->definition->name);
+
+		return;
 	}
 
-	Event event = activateState(stateMachine, stateMachine->initialState);
+	clearEventQueue(stateMachine);
+	// (An instance can be set up again after it has been aborted: Its last state must not be exited twice)
+	stateMachine->activeState = NULL;
+
+	if (stateMachine->definition->setUpAction) {
+		stateMachine->definition->setUpAction(stateMachine->context);
+	}
+
+	Event event = activateState(stateMachine, stateMachine->definition->initialState);
 
 	stateMachine->isInitialized = TRUE;
 
+	// (Entering the regions of a composite state may have queued events)
+	if (event == NO_EVENT) {
+		event = dequeueEvent(stateMachine);
+	}
 	if (event != NO_EVENT) {
 		processStateMachineEvent(stateMachine, event);
 	}
 }
 
 /**
- * @copydoc setUpStateMachine
+ * Checks whether one of the active state's wake-up sources has fired (and schedules its next wake-up).
  */
-void runStateMachine(StateMachine *stateMachine) {
-	if (!stateMachine->isInitialized) {
-		return;
+static int isWakeUpDue(StateMachineInstance *stateMachine) {
+	// (No clock reading for a state which is not woken up at all)
+	if (!stateMachine->deadline && !stateMachine->nextPeriod && !stateMachine->nextSensorReading) {
+		return FALSE;
+	}
+
+	const WakeUp *wakeUp = &stateMachine->activeState->wakeUp;
+	unsigned long long now = getDispatchClockTime();
+	int isDue = FALSE;
+
+	if (stateMachine->deadline && now >= stateMachine->deadline) {
+		stateMachine->deadline = 0;
+
+		isDue = TRUE;
 	}
+	if (stateMachine->nextPeriod && now >= stateMachine->nextPeriod) {
+		// (Periods which have been missed are skipped)
+		unsigned long long period = (unsigned long long)wakeUp->period * 1000;
+		stateMachine->nextPeriod += ((now - stateMachine->nextPeriod) / period + 1) * period;
+
+		isDue = TRUE;
+	}
+	if (stateMachine->nextSensorReading && now >= stateMachine->nextSensorReading) {
+		stateMachine->nextSensorReading = now + (unsigned long long)wakeUp->sensorPeriod * 1000;
+
+		int isAboveThreshold = wakeUp->sensor() >= wakeUp->threshold;
+		if (isAboveThreshold != stateMachine->isSensorAboveThreshold) {
+			stateMachine->isSensorAboveThreshold = isAboveThreshold;
+
+			isDue = TRUE;
+		}
+	}
+
+	return isDue;
+}
+
+/**
+ * Runs the active state's 'do' action and processes its follow-up event.
+ */
+static void wakeUpState(StateMachineInstance *stateMachine) {
+	stateMachine->statistics.numberOfWakeUps++;
 
 	// Run active state and process events
-	Event event = runState(stateMachine->activeState);
+	Event event = runState(stateMachine);
+	if (event == NO_EVENT) {
+		event = dequeueEvent(stateMachine);
+	}
 	if (event != NO_EVENT) {
 		processStateMachineEvent(stateMachine, event);
 	}
 }
 
+/**
+ * @copydoc runStateMachine
+ */
+void runStateMachine(StateMachineInstance *stateMachine) {
+	if (!stateMachine->isInitialized || !isWakeUpDue(stateMachine)) {
+		return;
+	}
+
+	wakeUpState(stateMachine);
+}
+
+/**
+ * @copydoc wakeStateMachine
+ */
+void wakeStateMachine(StateMachineInstance *stateMachine) {
+	if (!stateMachine->isInitialized) {
+		return;
+	}
+
+	wakeUpState(stateMachine);
+}
+
+/**
+ * @copydoc getStateMachineTimeout
+ */
+unsigned int getStateMachineTimeout(StateMachineInstance *stateMachine) {
+	if (!stateMachine->isInitialized) {
+		return NO_WAKE_UP;
+	}
+
+	unsigned long long wakeUpTimes[] = { stateMachine->deadline, stateMachine->nextPeriod, stateMachine->nextSensorReading };
+	unsigned long long nextWakeUp = 0;
+	unsigned int i;
+	for (i = 0; i < sizeof(wakeUpTimes) / sizeof(wakeUpTimes[0]); i++) {
+		if (wakeUpTimes[i] && (!nextWakeUp || wakeUpTimes[i] < nextWakeUp)) {
+			nextWakeUp = wakeUpTimes[i];
+		}
+	}
+	if (!nextWakeUp) {
+		return NO_WAKE_UP;
+	}
+
+	unsigned long long now = getDispatchClockTime();
+	if (nextWakeUp <= now) {
+		return 0;
+	}
+
+	return (unsigned int)((nextWakeUp - now + 999) / 1000);
+}
+
+/**
+ * @copydoc setStateMachineDeadline
+ */
+void setStateMachineDeadline(StateMachineInstance *stateMachine, unsigned int timeout) {
+	stateMachine->deadline = timeout ? getDispatchClockTime() + (unsigned long long)timeout * 1000 : 0;
+}
+
 /**
  * @copydoc abortStateMachine
  */
-void abortStateMachine(StateMachine *stateMachine) {
+void abortStateMachine(StateMachineInstance *stateMachine) {
 	if (!stateMachine->isInitialized) {
 		return;
 	}
 
+	exitRegions(stateMachine);
 	if (stateMachine->activeState->exitAction) {
-		stateMachine->activeState->exitAction();
+		stateMachine->activeState->exitAction(stateMachine->context);
 	}
 
-	if (stateMachine->abortAction) {
-		stateMachine->abortAction();
+	if (stateMachine->definition->abortAction) {
+		stateMachine->definition->abortAction(stateMachine->context);
 	}
 
 	stateMachine->isInitialized = FALSE;
+
+	// (Events queued for the aborted instance must not be processed by the next one)
+	clearEventQueue(stateMachine);
 }
 
 /**
  * @copydoc processStateMachineEvent
  */
-void processStateMachineEvent(StateMachine *stateMachine, Event event) {
+void processStateMachineEvent(StateMachineInstance *stateMachine, Event event) {
 	if (!stateMachine->isInitialized) {
 		return;
 	}
 
+	if (stateMachine->definition->mode == stateMachineMode_runToCompletion) {
+		runToCompletion(stateMachine, event);
+
+		return;
+	}
+
+	Event followUpEvent = takeTransition(stateMachine, event);
+	if (followUpEvent != NO_EVENT) {
+		processStateMachineEvent(stateMachine, followUpEvent);
+	}
+}
+
+/**
+ * @copydoc isStateActive
+ */
+int isStateActive(StateMachineInstance *stateMachine, State *state) {
+	if (!stateMachine->isInitialized) {
+		return FALSE;
+	}
+	if (stateMachine->activeState == state) {
+		return TRUE;
+	}
+
+	const struct StateMachineDefinition *const *regions = stateMachine->activeState->regions;
+	unsigned int i;
+	for (i = 0; regions && regions[i]; i++) {
+		if (stateMachine->activeRegionStates[i] == state) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * @copydoc logStateMachineStatistics
+ */
+void logStateMachineStatistics(StateMachineInstance *stateMachine) {
+	StateMachineStatistics *statistics = &stateMachine->statistics;
+	if (stateMachine->definition->mode != stateMachineMode_runToCompletion
+		|| !statistics->numberOfDispatches) {
+		return;
+	}
+
+	logInfo("[%s state machine] %u dispatches, %u events, max. chain depth: %u, avg. dispatch time: %u us, max. dispatch time: %u us, dropped events: %u, wake-ups: %u",
+			stateMachine->definition->name,
+			statistics->numberOfDispatches,
+			statistics->numberOfProcessedEvents,
+			statistics->maxChainDepth,
+			(unsigned int)(statistics->totalDispatchTime / statistics->numberOfDispatches),
+			statistics->maxDispatchTime,
+			statistics->numberOfDroppedEvents,
+			statistics->numberOfWakeUps);
+}
+
+/**
+ * @copydoc registerStateMachine
+ */
+int registerStateMachine(const StateMachineDefinition *definition) {
+	// Critical section
+	// (Validated while holding the lock, so a definition shared by several activities is validated only once)
+	pthread_mutex_lock(&registryLock);
+	unsigned int i;
+	for (i = 0; i < numberOfRegisteredStateMachines; i++) {
+		if (registeredStateMachines[i].definition == definition) {
+			break;
+		}
+	}
+	int isRejected;
+	if (i < numberOfRegisteredStateMachines) {
+		isRejected = registeredStateMachines[i].isRejected;
+	} else {
+		isRejected = validateStateMachine(definition) < 0;
+
+		if (numberOfRegisteredStateMachines < MAX_NUMBER_OF_REGISTERED_STATE_MACHINES) {
+			registeredStateMachines[numberOfRegisteredStateMachines].definition = definition;
+			registeredStateMachines[numberOfRegisteredStateMachines].isRejected = isRejected;
+			numberOfRegisteredStateMachines++;
+		}
+	}
+	pthread_mutex_unlock(&registryLock);
+
+	return isRejected ? -EINVAL : 0;
+}
+
+/**
+ * @copydoc initStateMachineInstance
+ */
+void initStateMachineInstance(StateMachineInstance *stateMachine, const StateMachineDefinition *definition, void *context) {
+	memset(stateMachine, 0, sizeof(StateMachineInstance));
+	stateMachine->definition = definition;
+	stateMachine->context = context;
+}
+
+/**
+ * Gets a state's name for log messages (or its index if the state machine has no description).
+ */
+static const char *getStateName(const StateMachineDefinition *definition, unsigned int stateIndex, char *buffer) {
+	if (definition->description && stateIndex < definition->numberOfStates) {
+		return definition->description->stateNames[stateIndex];
+	}
+
+	sprintf(buffer, "state %u", stateIndex);
+
+	return buffer;
+}
+
+/**
+ * Gets an event's name for log messages (or its number if the state machine has no description).
+ */
+static const char *getEventName(const StateMachineDefinition *definition, Event event, char *buffer) {
+	if (definition->description && event >= 0 && (unsigned int)event < definition->numberOfEvents) {
+		return definition->description->eventNames[event];
+	}
+
+	sprintf(buffer, "event %d", event);
+
+	return buffer;
+}
+
+/**
+ * Validates a transition (of the given source state), marks its event as triggering a transition and records its next state.
+ * Returns FALSE if the transition refers to an undefined state or event.
+ */
+static int validateTransition(const StateMachineDefinition *definition, unsigned int source, Event event, State *nextState, int isTriggering[], State *states[]) {
+	char sourceName[16];
+	char eventName[16];
+	if (event < 0 || (unsigned int)event >= definition->numberOfEvents) {
+		logErr("[%s state machine] The transition from %s refers to the undefined %s!",
+				definition->name, getStateName(definition, source, sourceName), getEventName(definition, event, eventName));
+
+		return FALSE;
+	}
+	if (!nextState || nextState->stateIndex >= definition->numberOfStates) {
+		logErr("[%s state machine] The transition from %s on %s leads to an undefined state!",
+				definition->name, getStateName(definition, source, sourceName), getEventName(definition, event, eventName));
+
+		return FALSE;
+	}
+
+	isTriggering[event] = TRUE;
+	states[nextState->stateIndex] = nextState;
+
+	return TRUE;
+}
+
+static int validateDefinition(const StateMachineDefinition *definition, int isRegion, int isTriggering[]);
+
+/**
+ * Validates the regions of a composite state.
+ * Returns FALSE if the composite state is not supported or one of its regions has errors.
+ */
+static int validateRegions(const StateMachineDefinition *definition, int isRegion, State *state, int isTriggering[]) {
+	char name[16];
+	const char *stateName = getStateName(definition, state->stateIndex, name);
+
+	if (isRegion) {
+		logErr("[%s state machine] %s is a composite state, but the states of a region have to be simple states!", definition->name, stateName);
+
+		return FALSE;
+	}
+	if (definition->mode != stateMachineMode_runToCompletion) {
+		logErr("[%s state machine] %s is a composite state, but the state machine does not run to completion!", definition->name, stateName);
+
+		return FALSE;
+	}
+
+	int isValid = TRUE;
+
+	unsigned int i;
+	for (i = 0; state->regions[i]; i++) {
+		const StateMachineDefinition *region = state->regions[i];
+		if (i == MAX_NUMBER_OF_REGIONS) {
+			logErr("[%s state machine] %s has more than %u regions!", definition->name, stateName, MAX_NUMBER_OF_REGIONS);
+
+			return FALSE;
+		}
+		if (region->numberOfEvents != definition->numberOfEvents) {
+			logErr("[%s state machine] The %s region of %s does not share the state machine's events!", definition->name, region->name, stateName);
+
+			isValid = FALSE;
+
+			continue;
+		}
+		if (!region->finalState || region->finalState->stateIndex >= region->numberOfStates) {
+			logErr("[%s state machine] The %s region of %s has no final state!", definition->name, region->name, stateName);
+
+			isValid = FALSE;
+		}
+		if (validateDefinition(region, TRUE, isTriggering) < 0) {
+			isValid = FALSE;
+		}
+	}
+
+	return isValid;
+}
+
+/**
+ * Validates the tables of a state machine or region (see validateStateMachine()) and marks the events which trigger a transition.
+ */
+static int validateDefinition(const StateMachineDefinition *definition, int isRegion, int isTriggering[]) {
+	unsigned int numberOfStates = definition->numberOfStates;
+	unsigned int numberOfEvents = definition->numberOfEvents;
+	const StateMachineDescription *description = definition->description;
+	const CompiledTransitions *compiledTransitions = definition->compiledTransitions;
+	char name[16];
+	char otherName[16];
+	char sourceName[16];
+
+	if (!numberOfStates || !numberOfEvents) {
+		logErr("[%s state machine] The number of states and events is not defined!", definition->name);
+
+		return -EINVAL;
+	}
+	if (!definition->initialState || definition->initialState->stateIndex >= numberOfStates) {
+		logErr("[%s state machine] The initial state is undefined!", definition->name);
+
+		return -EINVAL;
+	}
+
+	int isValid = TRUE;
+
+	// The state indices have to match the states' positions
+	unsigned int i, j;
+	if (description) {
+		for (i = 0; i < numberOfStates; i++) {
+			if (description->states[i]->stateIndex != i) {
+				logErr("[%s state machine] The index of %s is %u instead of %u!",
+						definition->name, description->stateNames[i], description->states[i]->stateIndex, i);
+
+				isValid = FALSE;
+			}
+		}
+	}
+
+	State *states[numberOfStates];
+	memset(states, 0, sizeof(states));
+	states[definition->initialState->stateIndex] = definition->initialState;
+
+	for (i = 0; i < numberOfStates; i++) {
+		if (compiledTransitions) {
+			unsigned int first = compiledTransitions->rowOffsets[i];
+			unsigned int last = compiledTransitions->rowOffsets[i + 1];
+			if (last < first) {
+				logErr("[%s state machine] The row offsets of %s are decreasing!", definition->name, getStateName(definition, i, name));
+
+				isValid = FALSE;
+
+				continue;
+			}
+
+			for (j = first; j < last; j++) {
+				const Transition *transition = &compiledTransitions->transitions[j];
+				if (description && description->transitionSources[j] != i) {
+					logErr("[%s state machine] The transition from %s on %s is listed among the transitions from %s!",
+							definition->name,
+							getStateName(definition, description->transitionSources[j], sourceName),
+							getEventName(definition, transition->event, otherName),
+							getStateName(definition, i, name));
+
+					isValid = FALSE;
+				}
+				if (j > first && transition->event <= compiledTransitions->transitions[j - 1].event) {
+					logErr("[%s state machine] The transitions from %s are not sorted by event (or %s is listed twice)!",
+							definition->name, getStateName(definition, i, name), getEventName(definition, transition->event, otherName));
+
+					isValid = FALSE;
+				}
+				if (!validateTransition(definition, i, transition->event, transition->nextState, isTriggering, states)) {
+					isValid = FALSE;
+				}
+			}
+		} else {
+			for (j = 0; j < numberOfEvents; j++) {
+				State *nextState = definition->transitions[i * numberOfEvents + j];
+				if (nextState && !validateTransition(definition, i, j, nextState, isTriggering, states)) {
+					isValid = FALSE;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < numberOfStates; i++) {
+		if (states[i] && states[i]->regions && !validateRegions(definition, isRegion, states[i], isTriggering)) {
+			isValid = FALSE;
+		}
+		if (states[i] && states[i]->wakeUp.sensor && !states[i]->wakeUp.sensorPeriod) {
+			logErr("[%s state machine] %s is woken up by a sensor, but does not define how often it is read!", definition->name, getStateName(definition, i, name));
+
+			isValid = FALSE;
+		}
+	}
+
+	if (!isValid) {
+		return -EINVAL;
+	}
+
+	// A state is reachable if it is the initial state or a transition from a reachable state leads to it
+	int isReached[numberOfStates];
+	memset(isReached, 0, sizeof(isReached));
+	isReached[definition->initialState->stateIndex] = TRUE;
+	int isAnyReached = TRUE;
+	while (isAnyReached) {
+		isAnyReached = FALSE;
+
+		for (i = 0; i < numberOfStates; i++) {
+			for (j = 0; j < numberOfEvents && isReached[i]; j++) {
+				State *nextState = lookUpTransition(definition, i, j);
+				if (nextState && !isReached[nextState->stateIndex]) {
+					isReached[nextState->stateIndex] = TRUE;
+
+					isAnyReached = TRUE;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < numberOfStates; i++) {
+		if (!isReached[i]) {
+			logWarn("[%s state machine] %s is unreachable!", definition->name, getStateName(definition, i, name));
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @copydoc validateStateMachine
+ */
+int validateStateMachine(const StateMachineDefinition *definition) {
+	if (!definition->numberOfEvents) {
+		logErr("[%s state machine] The number of states and events is not defined!", definition->name);
+
+		return -EINVAL;
+	}
+
+	int isTriggering[definition->numberOfEvents];
+	memset(isTriggering, 0, sizeof(isTriggering));
+
+	if (validateDefinition(definition, FALSE, isTriggering) < 0) {
+		return -EINVAL;
+	}
+
+	char name[16];
+	unsigned int i;
+	for (i = 0; i < definition->numberOfEvents; i++) {
+		if (!isTriggering[i]) {
+			logWarn("[%s state machine] %s does not trigger any transition!", definition->name, getEventName(definition, i, name));
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @copydoc logStateMachineTables
+ */
+void logStateMachineTables(void) {
+	logInfo("[stateMachineEngine] Transition tables:");
+
+	// Critical section
+	pthread_mutex_lock(&registryLock);
+	unsigned int i, j;
+	for (i = 0; i < numberOfRegisteredStateMachines; i++) {
+		const StateMachineDefinition *definition = registeredStateMachines[i].definition;
+		unsigned int numberOfEntries = definition->numberOfStates * definition->numberOfEvents;
+
+		unsigned int numberOfTransitions = 0;
+		if (definition->compiledTransitions) {
+			numberOfTransitions = definition->compiledTransitions->rowOffsets[definition->numberOfStates];
+		} else {
+			for (j = 0; j < numberOfEntries; j++) {
+				if (definition->transitions[j]) {
+					numberOfTransitions++;
+				}
+			}
+		}
+
+		unsigned int denseSize = numberOfEntries * sizeof(State *);
+		unsigned int compiledSize = sizeof(CompiledTransitions)
+				+ (definition->numberOfStates + 1) * sizeof(unsigned char)
+				+ numberOfTransitions * sizeof(Transition);
+		logInfo("[stateMachineEngine] %s: %u states x %u events, %u transitions (%u%% dense), dense table: %u bytes, compiled table: %u bytes (uses the %s table)",
+				definition->name,
+				definition->numberOfStates,
+				definition->numberOfEvents,
+				numberOfTransitions,
+				numberOfEntries ? numberOfTransitions * 100 / numberOfEntries : 0,
+				denseSize,
+				compiledSize,
+				definition->compiledTransitions ? "compiled" : "dense");
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+/**
+ * Looks up the next state of a state in the transition table (NULL if the event triggers no transition).
+ */
+static State *lookUpTransition(const StateMachineDefinition *definition, unsigned int stateIndex, Event event) {
+	const CompiledTransitions *compiledTransitions = definition->compiledTransitions;
+	if (compiledTransitions) {
+		// (The rows are short and sorted: A linear search ending at the first larger event is the fastest)
+		unsigned int i;
+		for (i = compiledTransitions->rowOffsets[stateIndex]; i < compiledTransitions->rowOffsets[stateIndex + 1]; i++) {
+			const Transition *transition = &compiledTransitions->transitions[i];
+			if (transition->event >= event) {
+				return transition->event == event ? transition->nextState : NULL;
+			}
+		}
+
+		return NULL;
+	}
+
+	return definition->transitions[stateIndex * definition->numberOfEvents + event];
+}
+
+/**
+ * Activates the given state of a region (the follow-up event of its 'do' action is queued).
+ * Returns FALSE if the state's precondition is not met.
+ */
+static int activateRegionState(StateMachineInstance *stateMachine, unsigned int regionIndex, State *nextState) {
+	State *activeState = stateMachine->activeRegionStates[regionIndex];
+
+	if (nextState->precondition
+		&& !nextState->precondition(stateMachine->context)) {
+		if (nextState->postAction) {
+			nextState->postAction(stateMachine->context);
+		}
+
+		return FALSE;
+	}
+
+	if (activeState) {
+		if (activeState->exitAction) {
+			activeState->exitAction(stateMachine->context);
+		}
+		if (activeState->postAction) {
+			activeState->postAction(stateMachine->context);
+		}
+	}
+
+	stateMachine->activeRegionStates[regionIndex] = nextState;
+	if (nextState->entryAction) {
+		nextState->entryAction(stateMachine->context);
+	}
+	if (nextState->doAction) {
+		queueEvent(stateMachine, nextState->doAction(stateMachine->context));
+	}
+
+	return TRUE;
+}
+
+/**
+ * Signals the active composite state's completion event once all its regions have reached their final state (join).
+ */
+static void checkRegionsCompletion(StateMachineInstance *stateMachine) {
+	State *compositeState = stateMachine->activeState;
+	unsigned int i;
+	for (i = 0; compositeState->regions[i]; i++) {
+		if (stateMachine->activeRegionStates[i] != compositeState->regions[i]->finalState) {
+			return;
+		}
+	}
+
+	queueEvent(stateMachine, compositeState->completionEvent);
+}
+
+/**
+ * Enters the initial state of every region of the active composite state.
+ */
+static void enterRegions(StateMachineInstance *stateMachine) {
+	State *compositeState = stateMachine->activeState;
+	unsigned int i;
+	for (i = 0; compositeState->regions[i]; i++) {
+		stateMachine->activeRegionStates[i] = NULL;
+		activateRegionState(stateMachine, i, compositeState->regions[i]->initialState);
+	}
+
+	checkRegionsCompletion(stateMachine);
+}
+
+/**
+ * Exits the current state of every region of the active composite state (before the composite state itself is exited).
+ */
+static void exitRegions(StateMachineInstance *stateMachine) {
+	const struct StateMachineDefinition *const *regions = stateMachine->activeState->regions;
+	unsigned int i;
+	for (i = 0; regions && regions[i]; i++) {
+		State *activeState = stateMachine->activeRegionStates[i];
+		if (!activeState) {
+			continue;
+		}
+		stateMachine->activeRegionStates[i] = NULL;
+
+		if (activeState->exitAction) {
+			activeState->exitAction(stateMachine->context);
+		}
+		if (activeState->postAction) {
+			activeState->postAction(stateMachine->context);
+		}
+	}
+}
+
+/**
+ * Offers an event to every region of the active composite state
+ * (the state machine is processing the event, so the active state does not change meanwhile).
+ * Returns TRUE if a region has taken a transition on the event (the event is consumed).
+ */
+static int processRegionEvent(StateMachineInstance *stateMachine, Event event) {
+	State *compositeState = stateMachine->activeState;
+	int isConsumed = FALSE;
+
+	unsigned int i;
+	// (Stop if an action has aborted the state machine)
+	for (i = 0; compositeState->regions[i] && stateMachine->isInitialized; i++) {
+		State *activeState = stateMachine->activeRegionStates[i];
+		// (A region whose initial state's precondition has not been met has no active state)
+		State *nextState = activeState ? lookUpTransition(compositeState->regions[i], activeState->stateIndex, event) : NULL;
+		if (nextState) {
+			activateRegionState(stateMachine, i, nextState);
+
+			isConsumed = TRUE;
+		}
+	}
+
+	if (isConsumed && stateMachine->isInitialized) {
+		checkRegionsCompletion(stateMachine);
+	}
+
+	return isConsumed;
+}
+
+/**
+ * Processes an event: Looks up the state machine's next state in the transition table and activates it.
+ * Returns the follow-up event of the next state's 'do' action (or NO_EVENT).
+ */
+static Event takeTransition(StateMachineInstance *stateMachine, Event event) {
+	Event followUpEvent = NO_EVENT;
+
+	// The regions of a composite state take precedence over the composite state itself
+	if (stateMachine->activeState->regions && processRegionEvent(stateMachine, event)) {
+		return NO_EVENT;
+	}
+
 	// Processing an event means looking up the state machine's next state in the transition table
-	State *nextState = stateMachine->transitions[stateMachine->activeState->stateIndex * stateMachine->numberOfEvents + event];
+	State *nextState = lookUpTransition(stateMachine->definition, stateMachine->activeState->stateIndex, event);
 	if (nextState) {
 		// If next state either has no precondition
 		// or the precondition is true...
 		if (!nextState->precondition
-			|| nextState->precondition()) {
+			|| nextState->precondition(stateMachine->context)) {
 			// Activate next state
-			Event event = activateState(stateMachine, nextState);
-			if (event != NO_EVENT) {
-				processStateMachineEvent(stateMachine, event);
-			}
+			followUpEvent = activateState(stateMachine, nextState);
 		} else {
-			//logWarn("[%s state machine] Precondition for state %d is not met!", stateMachine->name, nextState->stateIndex);
+			//logWarn("[%s state machine] Precondition for state %d is not met!", stateMachine->definition->name, nextState->stateIndex);
 
 			// If the state has an 'post' action,
 			// run the state's 'post' action
 			if (nextState->postAction) {
-				nextState->postAction();
+				nextState->postAction(stateMachine->context);
 			}
 		}
 	} else {
-		//logWarn("[%s state machine] Ignoring event %d!", stateMachine->name, event);
+		//logWarn("[%s state machine] Ignoring event %d!", stateMachine->definition->name, event);
+	}
+
+	return followUpEvent;
+}
+
+/**
+ * Gets the monotonic clock time [us].
+ */
+static unsigned long long getDispatchClockTime(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Removes all queued events.
+ */
+static void clearEventQueue(StateMachineInstance *stateMachine) {
+	stateMachine->firstQueuedEvent = 0;
+	stateMachine->numberOfQueuedEvents = 0;
+}
+
+/**
+ * Queues an event (does nothing for NO_EVENT). The event is dropped if the queue is full.
+ */
+static void queueEvent(StateMachineInstance *stateMachine, Event event) {
+	if (event == NO_EVENT) {
+		return;
+	}
+
+	if (stateMachine->numberOfQueuedEvents == STATE_MACHINE_EVENT_QUEUE_CAPACITY) {
+		logErr("[%s state machine] Event queue full, dropping event %d!", stateMachine->definition->name, event);
+		stateMachine->statistics.numberOfDroppedEvents++;
+
+		return;
 	}
+
+	stateMachine->queuedEvents[(stateMachine->firstQueuedEvent + stateMachine->numberOfQueuedEvents) % STATE_MACHINE_EVENT_QUEUE_CAPACITY] = event;
+	stateMachine->numberOfQueuedEvents++;
 }
 
 /**
- * Heartbeat function for the state's 'do' action.
+ * Removes the oldest queued event from the queue (NO_EVENT if the queue is empty).
  */
-static Event runState(State *state) {
+static Event dequeueEvent(StateMachineInstance *stateMachine) {
+	if (!stateMachine->numberOfQueuedEvents) {
+		return NO_EVENT;
+	}
+
+	Event event = stateMachine->queuedEvents[stateMachine->firstQueuedEvent];
+	stateMachine->firstQueuedEvent = (stateMachine->firstQueuedEvent + 1) % STATE_MACHINE_EVENT_QUEUE_CAPACITY;
+	stateMachine->numberOfQueuedEvents--;
+
+	return event;
+}
+
+/**
+ * Processes an event in run-to-completion mode.
+ * If the state machine is already processing an event (i.e. an action signaled the event), the event is queued.
+ * Otherwise the event, its follow-up events and the queued events are processed one after another
+ * (without recursion, so the stack depth does not depend on the length of the chain).
+ */
+static void runToCompletion(StateMachineInstance *stateMachine, Event event) {
+	StateMachineStatistics *statistics = &stateMachine->statistics;
+
+	if (stateMachine->isProcessing) {
+		queueEvent(stateMachine, event);
+
+		return;
+	}
+
+	stateMachine->isProcessing = TRUE;
+	unsigned long long startTime = getDispatchClockTime();
+	unsigned int chainDepth = 0;
+
+	// (Stop if an action has aborted the state machine)
+	while (event != NO_EVENT && stateMachine->isInitialized) {
+		chainDepth++;
+
+		// A follow-up event is processed before the queued events
+		event = takeTransition(stateMachine, event);
+		if (event == NO_EVENT) {
+			event = dequeueEvent(stateMachine);
+		}
+	}
+
+	stateMachine->isProcessing = FALSE;
+
+	unsigned int dispatchTime = (unsigned int)(getDispatchClockTime() - startTime);
+	statistics->numberOfDispatches++;
+	statistics->numberOfProcessedEvents += chainDepth;
+	if (chainDepth > statistics->maxChainDepth) {
+		statistics->maxChainDepth = chainDepth;
+	}
+	statistics->totalDispatchTime += dispatchTime;
+	if (dispatchTime > statistics->maxDispatchTime) {
+		statistics->maxDispatchTime = dispatchTime;
+	}
+}
+
+/**
+ * Runs the state's 'do' action (on activation and whenever one of its wake-ups is due).
+ */
+static Event runState(StateMachineInstance *stateMachine) {
+	State *state = stateMachine->activeState;
 	Event event = NO_EVENT;
 
+	// Run the 'do' actions of the composite state's regions first (their follow-up events are queued)
+	unsigned int i;
+	for (i = 0; state->regions && state->regions[i] && stateMachine->activeState == state; i++) {
+		State *regionState = stateMachine->activeRegionStates[i];
+		if (regionState && regionState->doAction) {
+			queueEvent(stateMachine, regionState->doAction(stateMachine->context));
+		}
+	}
+	if (stateMachine->activeState != state) {
+		return NO_EVENT;
+	}
+
 	// If the state has a 'do' action, then run it
 	if (state->doAction) {
-		event = state->doAction();
+		event = state->doAction(stateMachine->context);
 	}
 
 	return event;
 }
 
+/**
+ * Schedules the wake-ups declared by the active state.
+ */
+static void armWakeUp(StateMachineInstance *stateMachine) {
+	const WakeUp *wakeUp = &stateMachine->activeState->wakeUp;
+
+	stateMachine->deadline = 0;
+	stateMachine->nextPeriod = 0;
+	stateMachine->nextSensorReading = 0;
+	if (!wakeUp->deadline && !wakeUp->period && !wakeUp->sensor) {
+		return;
+	}
+
+	unsigned long long now = getDispatchClockTime();
+	if (wakeUp->deadline) {
+		stateMachine->deadline = now + (unsigned long long)wakeUp->deadline * 1000;
+	}
+	if (wakeUp->period) {
+		stateMachine->nextPeriod = now + (unsigned long long)wakeUp->period * 1000;
+	}
+	if (wakeUp->sensor) {
+		stateMachine->nextSensorReading = now + (unsigned long long)wakeUp->sensorPeriod * 1000;
+		stateMachine->isSensorAboveThreshold = wakeUp->sensor() >= wakeUp->threshold;
+	}
+}
+
 /**
  * Activates the given state.
  */
-static Event activateState(StateMachine *stateMachine, State *nextState) {
+static Event activateState(StateMachineInstance *stateMachine, State *nextState) {
 	// If a state is currently active and the state has an 'exit' and/or 'post' action,
 	// then run the state's 'exit' and/or 'post' action
 	if (stateMachine->activeState) {
+		exitRegions(stateMachine);
+
 		if (stateMachine->activeState->exitAction) {
-			stateMachine->activeState->exitAction();
+			stateMachine->activeState->exitAction(stateMachine->context);
 		}
 
 		if (stateMachine->activeState->postAction) {
-			stateMachine->activeState->postAction();
+			stateMachine->activeState->postAction(stateMachine->context);
 		}
 	}
 	// Make the next state the currently active state
 	stateMachine->activeState = nextState;
+	// (Before the 'entry' action, which may set another deadline)
+	armWakeUp(stateMachine);
 	// If the (now currently active) state has an 'entry' action,
 	// run the state's 'entry' action
 	if (stateMachine->activeState->entryAction) {
-		stateMachine->activeState->entryAction();
+		stateMachine->activeState->entryAction(stateMachine->context);
+	}
+	// If the state is a composite state, enter its regions
+	if (stateMachine->activeState->regions) {
+		enterRegions(stateMachine);
 	}
 
 	// If the state has a 'do' action, then run it once immediatly after activation
 	Event event = NO_EVENT;
 	if (stateMachine->activeState->doAction) {
-		event = stateMachine->activeState->doAction();
+		event = stateMachine->activeState->doAction(stateMachine->context);
 	}
 
 	return event;
@@ -12,11 +12,33 @@
 #ifndef STATEMACHINEENGINE_H_
 #define STATEMACHINEENGINE_H_
 
+#include <limits.h>
+
 /**
  * Special case value for 'no event'.
  */
 #define NO_EVENT 999
 
+/**
+ * The maximum number of events queued by a run-to-completion state machine.
+ */
+#define STATE_MACHINE_EVENT_QUEUE_CAPACITY 8
+
+/**
+ * The timeout returned by getStateMachineTimeout() if no wake-up is pending (the activities' 'wait forever').
+ */
+#define NO_WAKE_UP UINT_MAX
+
+/**
+ * The maximum number of orthogonal regions of a composite state.
+ */
+#define MAX_NUMBER_OF_REGIONS 4
+
+/**
+ * The maximum number of state machines in the registry (reported by logStateMachineTables()).
+ */
+#define MAX_NUMBER_OF_REGISTERED_STATE_MACHINES 16
+
 /**
  * Represents an event.
  */
@@ -24,81 +46,272 @@ typedef int Event;
 
 /**
  * Defines the signature of an 'set up' action.
+ * Every action gets the context of the state machine instance it is called for.
  */
-typedef void (*SetUpAction)();
+typedef void (*SetUpAction)(void *context);
 
 /**
  * Defines the signature of an 'abort' action.
  */
-typedef void (*AbortAction)();
+typedef void (*AbortAction)(void *context);
 
 /**
  * Defines the signature of a state precondition predicate.
  */
-typedef int (*StatePrecondition)();
+typedef int (*StatePrecondition)(void *context);
 /**
  * Defines the signature of a state action.
  */
-typedef void (*StateAction)();
+typedef void (*StateAction)(void *context);
 /**
  * Defines the signature of a 'do' state action.
  */
-typedef Event (*DoStateAction)();
+typedef Event (*DoStateAction)(void *context);
+
+/**
+ * Defines the signature of a sensor reader (e.g. reading a device).
+ */
+typedef int (*SensorReader)(void);
+
+/**
+ * Declares what wakes a state's 'do' action.
+ * The 'do' action is run when the state is activated and then only when one of the state's wake-up sources fires
+ * (a state declaring none is not run again). The client waits for the time returned by getStateMachineTimeout()
+ * (and its messages) before it calls runStateMachine(), so an idle state machine does not cost any CPU time.
+ * A device whose file descriptor becomes readable is watched by the activity (see watchFd()),
+ * its handler runs the 'do' action with wakeStateMachine().
+ */
+typedef struct {
+	unsigned int deadline; /**< Wakes the 'do' action once the state has been active for this time [ms] (0 = none, see also setStateMachineDeadline()). */
+	unsigned int period; /**< Wakes the 'do' action periodically [ms] (0 = none), e.g. to supervise an ongoing process. */
+	SensorReader sensor; /**< Wakes the 'do' action when the sensor's value crosses the threshold (NULL = none). */
+	int threshold; /**< The sensor's threshold (crossed when the value changes from below the threshold to at or above it or back). */
+	unsigned int sensorPeriod; /**< How often the sensor is read [ms]. */
+} WakeUp;
+
+struct StateMachineDefinition;
 
 /**
  * Represents a state.
+ * A composite state contains orthogonal regions (a hierarchical state is a composite state with one region):
+ * Each region is a state machine definition of its own, whose initial state is entered when the composite state is entered.
+ * An event is offered to the regions first, only if no region takes a transition on it, the composite state's transitions apply
+ * (e.g. an error leaves the composite state and all its regions). Once all regions have reached their final state,
+ * the composite state's completion event is signaled (join).
+ * Composite states are only supported by run-to-completion state machines, the states of a region have to be simple states.
  */
 typedef struct {
 	int stateIndex; /**< The state's index. */
 	StatePrecondition precondition; /**< The state's precondition predicate determines if a state can be activated or not. If all preconditions to activate the state are met the predicate should return TRUE, otherwise FALSE. */
 	StateAction entryAction; /**< The state's 'entry' action is called once after the state was activated. */
-	DoStateAction doAction; /**< The state's 'do' action is constantly called while the state is active. */
+	DoStateAction doAction; /**< The state's 'do' action is called once after the 'entry' action and whenever the state is woken up. */
 	StateAction exitAction; /**< The state's 'exit' action is called once before the state will be deactivated. */
 	StateAction postAction; /**< The state's 'post' action is called once in each case after state activiation, either if the state has been successfully or unsuccessfully (e.g. the precondition was not met) activated. */
+	const struct StateMachineDefinition *const *regions; /**< The orthogonal regions of a composite state (NULL terminated, NULL for a simple state). */
+	Event completionEvent; /**< The event signaled once all regions of a composite state have reached their final state. */
+	WakeUp wakeUp; /**< Declares what wakes the state's 'do' action (the wake-ups of a composite state also run the 'do' actions of its regions). */
 } State;
 
 /**
- * Represents a state machine definition.
+ * Represents a transition of a compiled transition table.
+ */
+typedef struct {
+	Event event; /**< The event triggering the transition. */
+	State *nextState; /**< The state activated by the transition. */
+} Transition;
+
+/**
+ * Represents a compiled (sparse) transition table in compressed sparse row format:
+ * The transitions of state i are transitions[rowOffsets[i]] to transitions[rowOffsets[i + 1] - 1], sorted by event.
+ * Only the existing transitions are stored, and a table declared 'static const' is placed in read-only memory
+ * (so it can be shared by several machines, too).
+ */
+typedef struct {
+	const unsigned char *rowOffsets; /**< The index of each state's first transition (numberOfStates + 1 entries, the last one is the number of transitions). */
+	const Transition *transitions; /**< The transitions sorted by state and event. */
+} CompiledTransitions;
+
+/**
+ * Represents the description of a state machine's states and events (used to validate its transition table and in log messages).
+ * The description is generated along with the transition table (see stateMachineDescription.h).
+ */
+typedef struct {
+	State *const *states; /**< The states by state index. */
+	const char *const *stateNames; /**< The states' names by state index. */
+	const char *const *eventNames; /**< The events' names. */
+	const unsigned char *transitionSources; /**< The source state index of each compiled transition. */
+} StateMachineDescription;
+
+/**
+ * Defines how a state machine processes the events signaled while it is processing an event.
+ */
+typedef enum {
+	stateMachineMode_recursive = 0, /**< Every event (including the follow-up events returned by 'do' actions) is processed immediately (nested in the action which signaled it). */
+	stateMachineMode_runToCompletion = 1 /**< An event is processed completely before the next one: Events signaled meanwhile are queued and processed one after another (follow-up events first). */
+} StateMachineMode;
+
+/**
+ * Represents the statistics of a run-to-completion state machine.
  */
 typedef struct {
+	unsigned int numberOfDispatches; /**< The number of run-to-completion steps (= signaled events processed with their follow-up and queued events). */
+	unsigned int numberOfProcessedEvents; /**< The number of processed events. */
+	unsigned int maxChainDepth; /**< The largest number of events processed in one step. */
+	unsigned long long totalDispatchTime; /**< The total time spent processing events [us]. */
+	unsigned int maxDispatchTime; /**< The longest step [us]. */
+	unsigned int numberOfDroppedEvents; /**< The number of events dropped because the queue was full. */
+	unsigned int numberOfWakeUps; /**< The number of times a 'do' action has been woken up (besides the state activations). */
+} StateMachineStatistics;
+
+/**
+ * Represents a state machine definition (the states, transitions and actions, which do not change).
+ * A definition can be shared by any number of instances and be declared 'static const'.
+ */
+typedef struct StateMachineDefinition {
 	char *name; /**< The state machine's name. */
-	int isInitialized; /**< Is the state machine already initialized? */
+	unsigned int numberOfStates; /**< The number of defined states (= rows of the transition table). */
 	unsigned int numberOfEvents; /**<  The number of defined events. */
 	SetUpAction setUpAction; /**< The machine's 'set up' action is called once the machine is set up. */
 	AbortAction abortAction; /**< The machine's 'abort' action is called once the machine is aborted. */
 	State *initialState; /**< Defines the state machine's initial state. */
+	State *finalState; /**< Defines the final state of a region (a region has to share the events of its state machine). */
+	StateMachineMode mode; /**< How events signaled while processing an event are processed. */
+	const CompiledTransitions *compiledTransitions; /**< Defines the state machine's state transitions as a compiled table (replaces the dense 'transitions' table if set). */
+	const StateMachineDescription *description; /**< Describes the state machine's states and events (optional). */
+	State *transitions[]; /**< Defines the state machine's state transitions (dense table, numberOfStates x numberOfEvents). */
+} StateMachineDefinition;
+
+/**
+ * Represents a state machine instance (the runtime state of a state machine definition).
+ */
+typedef struct {
+	const StateMachineDefinition *definition; /**< The state machine's definition. */
+	void *context; /**< The context passed to the definition's actions (e.g. the object the instance controls). */
+	int isInitialized; /**< Is the state machine already initialized? */
 	State *activeState; /**< The current state. */
-	State *transitions[]; /**< Defines the state machine's state transitions. */
-} StateMachine;
+	State *activeRegionStates[MAX_NUMBER_OF_REGIONS]; /**< The current state of each region (if the current state is a composite state). */
+	int isProcessing; /**< Is the state machine processing an event (run-to-completion mode only)? */
+	Event queuedEvents[STATE_MACHINE_EVENT_QUEUE_CAPACITY]; /**< The events waiting to be processed (run-to-completion mode only). */
+	unsigned int firstQueuedEvent; /**< The index of the oldest queued event. */
+	unsigned int numberOfQueuedEvents; /**< The number of queued events. */
+	StateMachineStatistics statistics; /**< The statistics (run-to-completion mode only). */
+	unsigned long long deadline; /**< When the active state's 'do' action is woken up [us] (0 = no deadline). */
+	unsigned long long nextPeriod; /**< When the active state's 'do' action is woken up periodically next [us] (0 = not periodically). */
+	unsigned long long nextSensorReading; /**< When the active state's sensor is read next [us] (0 = no sensor). */
+	int isSensorAboveThreshold; /**< Has the sensor's value been at or above the threshold the last time it has been read? */
+} StateMachineInstance;
+
+/**
+ * Initializes a state machine instance (e.g. one allocated dynamically).
+ * A static instance can be initialized with { .definition = ..., .context = ... } instead.
+ *
+ * @param stateMachine A state machine instance.
+ * @param definition The state machine's definition.
+ * @param context The context passed to the definition's actions.
+ */
+extern void initStateMachineInstance(StateMachineInstance *stateMachine, const StateMachineDefinition *definition, void *context);
+
+/**
+ * Sets up and starts a state machine instance.
+ * An instance whose definition has errors in its tables is not set up.
+ *
+ * @param stateMachine A state machine instance.
+ */
+extern void setUpStateMachine(StateMachineInstance *stateMachine);
+
+/**
+ * Runs the active state's 'do' action if one of its wake-up sources has fired (see WakeUp).
+ * Should be called by the client whenever it has waited for its messages or the time returned by getStateMachineTimeout().
+ *
+ * @param stateMachine A state machine instance.
+ */
+extern void runStateMachine(StateMachineInstance *stateMachine);
+
+/**
+ * Runs the active state's 'do' action right away (e.g. by the handler of a watched device).
+ *
+ * @param stateMachine A state machine instance.
+ */
+extern void wakeStateMachine(StateMachineInstance *stateMachine);
 
 /**
- * Sets up and starts a new state machine.
+ * Gets the time until the active state's next wake-up.
  *
- * @param stateMachine A state machine definition.
+ * @param stateMachine A state machine instance.
+ * @return Returns the time [ms] (0 if a wake-up is already due), NO_WAKE_UP if no wake-up is pending
  */
-extern void setUpStateMachine(StateMachine *stateMachine);
+extern unsigned int getStateMachineTimeout(StateMachineInstance *stateMachine);
 
 /**
- * Heartbeat function for ongoing tasks.
- * Should be constantly called by the client.
+ * Wakes the active state's 'do' action once the given time has elapsed (replaces the state's pending deadline).
+ * Can be called by the state's actions (the deadline is reset when another state is activated).
  *
- * @param stateMachine A state machine definition.
+ * @param stateMachine A state machine instance.
+ * @param timeout The time [ms] (0 = no deadline)
  */
-extern void runStateMachine(StateMachine *stateMachine);
+extern void setStateMachineDeadline(StateMachineInstance *stateMachine, unsigned int timeout);
 
 /**
  * Aborts a running state machine.
  *
- * @param stateMachine A state machine definition.
+ * @param stateMachine A state machine instance.
  */
-extern void abortStateMachine(StateMachine *stateMachine);
+extern void abortStateMachine(StateMachineInstance *stateMachine);
 
 /**
  * Signals an event to a state machine.
+ * A run-to-completion state machine which is already processing an event (e.g. if called by one of its actions)
+ * queues the event, it is processed as soon as the current event has been processed completely.
  *
- * @param stateMachine A state machine definition.
+ * @param stateMachine A state machine instance.
  * @param event An event.
  */
-extern void processStateMachineEvent(StateMachine *stateMachine, Event event);
+extern void processStateMachineEvent(StateMachineInstance *stateMachine, Event event);
+
+/**
+ * Checks whether a state is active, either as the current state or as the current state of one of its regions.
+ *
+ * @param stateMachine A state machine instance.
+ * @param state A state.
+ * @return Returns TRUE if the state is active, otherwise FALSE
+ */
+extern int isStateActive(StateMachineInstance *stateMachine, State *state);
+
+/**
+ * Logs the statistics of a run-to-completion state machine
+ * (the maximum number of events processed in one step and the time spent per step).
+ *
+ * @param stateMachine A state machine instance.
+ */
+extern void logStateMachineStatistics(StateMachineInstance *stateMachine);
+
+/**
+ * Validates a state machine's tables.
+ * Errors: A state's index does not match its position in the description, a transition (or the initial state) refers to
+ * an undefined state or event, the transitions of the compiled table are not grouped by source state and sorted by event.
+ * Warnings: A state cannot be reached from the initial state, an event does not trigger any transition (dangling event).
+ * The regions of the composite states are validated along with the state machine (they must not contain composite states
+ * and need a final state).
+ *
+ * @param definition A state machine definition.
+ * @return Returns 0 if the tables are valid (there may be warnings), -EINVAL if there are errors.
+ */
+extern int validateStateMachine(const StateMachineDefinition *definition);
+
+/**
+ * Adds a state machine definition to the registry and validates it (does nothing if it has already been added).
+ * A definition is added when its first instance is set up, definitions which are instantiated later on can be added in advance.
+ * A definition with errors in its tables is rejected (its instances cannot be set up).
+ *
+ * @param definition A state machine definition.
+ * @return Returns 0 if the definition is valid, -EINVAL if it has been rejected
+ */
+extern int registerStateMachine(const StateMachineDefinition *definition);
+
+/**
+ * Logs the transition table of every registered state machine definition:
+ * The number of transitions, the density and the memory used by the dense and the compiled representation.
+ */
+extern void logStateMachineTables(void);
 
 #endif /* STATEMACHINEENGINE_H_ */
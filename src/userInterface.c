@@ -47,7 +47,10 @@ static ActivityDescriptor userInterfaceDescriptor = {
 	.name = "userInterface",
 	.setUp = setUpUserInterface,
 	.run = runUserInterface,
-	.tearDown = tearDownUserInterface
+	.tearDown = tearDownUserInterface,
+	// (Notifications come in bursts, e.g. while producing a product)
+	.queueCapacity = 32,
+	.stackSize = SMALL_ACTIVITY_STACK_SIZE
 };
 
 MESSAGE_CONTENT_TYPE_MAPPING(UserInterface, Command, 1)
@@ -70,7 +73,7 @@ static int switchesStates = 0;
 static int switchesPreviousStates = 0;
 
 ActivityDescriptor getUserInterfaceDescriptor() {
-	return userInterfaceDescriptor;
+	return internActivityDescriptor(&userInterfaceDescriptor);
 }
 
 static void updateDisplay() {
@@ -93,7 +96,8 @@ static void showActivity(char *message) {
 		.type = RtModelDisplayShowMessageCommandType
 	};
 	memcpy(activityMessage.content.RtModelDisplayShowMessageCommand.message, message, strlen(message) + 1);
-	sendMessage2(this, getRtModelDisplayDescriptor(), sizeof(activityMessage), &activityMessage, messagePriority_medium);
+	// (Don't wait for the RT-model display if it does not keep up, skip the message instead)
+	trySendMessage(this, getRtModelDisplayDescriptor(), messagePriority_medium, NO_DEADLINE, MESSAGE_LENGTH(RtModelDisplay, ShowMessageCommand), &activityMessage);
 }
 
 static void showError(char *message) {
@@ -101,7 +105,7 @@ static void showError(char *message) {
 		.type = DisplayShowErrorCommandType
 	};
 	memcpy(errorMessage.content.DisplayShowErrorCommand.message, message, strlen(message) + 1);
-	sendMessage2(this, getDisplayDescriptor(), sizeof(errorMessage), &errorMessage, messagePriority_medium);
+	sendMessage2(this, getDisplayDescriptor(), MESSAGE_LENGTH(Display, ShowErrorCommand), &errorMessage, messagePriority_medium);
 }
 
 static void setUpUserInterface(void *activity) {
@@ -109,6 +113,8 @@ static void setUpUserInterface(void *activity) {
 
 	this = (Activity *)activity;
 
+	subscribe(this, MAIN_CONTROLLER_TOPIC);
+
 	display = createActivity(getDisplayDescriptor(), messageQueue_blocking);
 }
 
@@ -130,8 +136,8 @@ static void processSwitchesChanges(int switchesStates) {
 				powerState = TRUE;
 			} else {
 				// send off command to mainController:
-				sendRequest_BEGIN(this, MainController, OffCommand)
-				sendRequest_END
+				sendPrioritizedRequest_BEGIN(this, MainController, OffCommand, messagePriority_high)
+				sendPrioritizedRequest_END
 				powerState = FALSE;
 			}
 
@@ -151,11 +157,57 @@ static void processSwitchesChanges(int switchesStates) {
 	}
 }
 
-static void runUserInterface(void *activity) {
-	int polling, fd, i, value, result;
-	struct epoll_event firedEvents[100];
-	int numberOfFiredEvents;
+static void processButtonsEvent(void *activity, int buttonsFileDescriptor) {
 	char buffer[BUFFER_SIZE];
+	int value, result;
+
+	//logInfo("[%s] Buttons event", this->descriptor->name);
+	memset(buffer, 0, BUFFER_SIZE);
+	result = read(buttonsFileDescriptor, buffer, BUFFER_SIZE);
+	if (result < 0) {
+		logErr("[%s] Could not read buttons: %s", this->descriptor->name, strerror(errno));
+	}
+	if (result > 0) {
+		//logInfo("Buttons: %s", buffer);
+		if (wasteBinFull) {
+			logWarn("[%s] Unable to produce coffee, because waste bin is full", this->descriptor->name);
+		} else if (machineState == machineState_idle) {
+			value = atoi(buffer);
+			unsigned int productIndex = value + 1;
+			// check if product index is in range:
+			if (productIndex > 0 && productIndex <= NUMBER_OF_PRODUCTS) {
+				sendRequest_BEGIN(this, MainController, ProduceProductCommand)
+					.productIndex = productIndex,
+					.withMilk = withMilk
+				sendRequest_END
+			} else {
+				logWarn("[%s] Undefined product %d!", this->descriptor->name, value + 1);
+			}
+		} else {
+			logWarn("[%s] Product selected, but machine is not ready!", this->descriptor->name, machineState);
+		}
+	}
+}
+
+static void processSwitchesEvent(void *activity, int switchesFileDescriptor) {
+	char buffer[BUFFER_SIZE];
+	int result;
+
+	//logInfo("[%s] Switches event", this->descriptor->name);
+	// Get bitfield of current switches status:
+	memset(buffer, 0, BUFFER_SIZE);
+	result = read(switchesFileDescriptor, buffer, BUFFER_SIZE);
+	if (result < 0) {
+		logErr("[%s] Could not read switches: %s", this->descriptor->name, strerror(errno));
+	}
+	if (result > 0) {
+		//logInfo("Switches: %s", buffer);
+		switchesStates = atoi(buffer);
+		processSwitchesChanges(switchesStates);
+	}
+}
+
+static void runUserInterface(void *activity) {
 	char buttonsEventDevice[] = "/dev/buttonsEvent";
 	int buttonsFileDescriptor;
 	char switchesDevice[] = "/dev/switches";
@@ -187,211 +239,148 @@ static void runUserInterface(void *activity) {
 	switchesFileDescriptor = open(switchesEventDevice, O_RDONLY);
 	if (switchesFileDescriptor < 0) {
 		logErr("[%s] Unable to open device %s: %s", this->descriptor->name, switchesEventDevice, strerror(errno));
+		close(buttonsFileDescriptor);
 		return;
 	}
 
-	// create poll device and add message queue, switches and buttons event devices:
-	//logInfo("[userInterface] Creating polling device...");
-	if ((polling = epoll_create(3)) < 0) {
-		logErr("[%s] Error setting up event waiting: %s", this->descriptor->name, strerror(errno));
-	}
-	struct epoll_event eventDescriptors[] = {
-		{ .events = EPOLLIN, .data.fd = this->messageQueue },
-		{ .events = EPOLLIN, .data.fd = buttonsFileDescriptor },
-		{ .events = EPOLLIN, .data.fd = switchesFileDescriptor }
-	};
-	for (i = 0; i < 3; i++) {
-		if (epoll_ctl(polling, EPOLL_CTL_ADD, eventDescriptors[i].data.fd, &eventDescriptors[i]) < 0) {
-			logErr("[%s] Error registering event source %d (file descriptor: %d): %s", this->descriptor->name, i, eventDescriptors[i].data.fd, strerror(errno));
-			close(polling);
-			close(buttonsFileDescriptor);
-			close(switchesFileDescriptor);
-			return;
-		}
+	// watch the switches and buttons event devices along with the incoming messages:
+	if (watchFd(this, buttonsFileDescriptor, EPOLLIN, processButtonsEvent) < 0
+		|| watchFd(this, switchesFileDescriptor, EPOLLIN, processSwitchesEvent) < 0) {
+		close(buttonsFileDescriptor);
+		close(switchesFileDescriptor);
+		return;
 	}
 
-	while (TRUE) {
-		// wait for events:
-		numberOfFiredEvents = epoll_wait(polling, firedEvents, 100, -1);
-		if (numberOfFiredEvents < 0) {
-			logErr("[%s] Error waiting for event: %s", this->descriptor->name, strerror(errno));
-		} else {
-			//logInfo("[%s] Number of Events: %d", this->descriptor->name, numberOfFiredEvents);
-			for (i = 0; i < numberOfFiredEvents; i++) {
-				if (!(firedEvents[i].events & EPOLLIN)) {
-					logErr("[%s] Event was not EPOLLIN", this->descriptor->name);
-					continue;
-				}
-
-				fd = firedEvents[i].data.fd;
-				if (fd == this->messageQueue) {
-					//logInfo("[%s] Message queue event", this->descriptor->name);
-					receiveGenericMessage_BEGIN(this)
-						if (error) {
-							//TODO Implement appropriate error handling
-							sleep(10);
-
-							// Try again
-							continue;
-						}
-						MESSAGE_SELECTOR_BEGIN
-							MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, Display)
-								MESSAGE_SELECTOR_BEGIN
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, Display, Result)
-										//logInfo("[%s] Display result received!", this->descriptor->name);
-								MESSAGE_SELECTOR_END
-							MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, MainController)
-								MESSAGE_SELECTOR_BEGIN
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, MachineStateChangedNotification)
-										// Process received machine state and update display
-										MachineState lastMachineState = machineState;
-										machineState = content.state;
-										// if machine is not producing reset product index to 0:
-										if (content.state != machineState_producing) {
-											productIndex = 0;
-										}
-										if (machineState != lastMachineState) {
-											updateDisplay();
-										}
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, ProducingProductNotification)
-										productIndex = content.productIndex;
-										updateDisplay();
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, ExecutingActivityNotification)
-										char *activityMessage;
-										switch (content.activityIndex) {
-										case PROCESS_NO_ACTIVITY:
-											activityMessage = "";
-											break;
-										case PROCESS_WARMING_UP_ACTIVITY:
-											activityMessage = "Warming up...";
-											break;
-										case PROCESS_CHECKING_CUP_FILL_STATE_ACTIVITY:
-											activityMessage = "Checking cup fill state...";
-											break;
-										case PROCESS_GRINDING_COFFEE_POWDER_ACTIVITY:
-											activityMessage = "Grinding coffee powder...";
-											break;
-										case PROCESS_SUPPLYING_WATER_ACTIVITY:
-											activityMessage = "Supplying water...";
-											break;
-										case PROCESS_SUPPLYING_MILK_ACTIVITY:
-											activityMessage = "Supplying milk...";
-											break;
-										case PROCESS_EJECTING_COFFEE_WASTE_ACTIVITY:
-											activityMessage = "Ejecting coffee waste...";
-											break;
-										default:
-											activityMessage = "Unknown activity!";
-										}
-										if (strlen(activityMessage) > 0) {
-											showActivity(activityMessage);
-										}
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, IngredientAvailabilityChangedNotification)
-										// Process received ingredient availability and update display
-										Availability lastCoffeeAvailability = coffeeAvailability;
-										Availability lastWaterAvailability = waterAvailability;
-										Availability lastMilkAvailability = milkAvailability;
-										switch (content.ingredientIndex) {
-										case COFFEE_INDEX:
-											coffeeAvailability = content.availability;
-											break;
-										case WATER_INDEX:
-											waterAvailability = content.availability;
-											break;
-										case MILK_INDEX:
-											milkAvailability = content.availability;
-										}
-										if (coffeeAvailability != lastCoffeeAvailability
-												|| waterAvailability != lastWaterAvailability
-												|| milkAvailability != lastMilkAvailability) {
-											updateDisplay();
-										}
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, CoffeeWasteBinStateChangedNotification)
-										int lastWasteBinFull = wasteBinFull;
-										wasteBinFull = content.isBinFull;
-										if (wasteBinFull != lastWasteBinFull) {
-											updateDisplay();
-										}
-									MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, Result)
-										if (content.code == NOK_RESULT) {
-											char *errorMessage;
-											switch (content.errorCode) {
-											case PROCESS_CUP_IS_NOT_EMPTY_ERROR:
-												errorMessage = "Cup is not empty!";
-												break;
-											case PROCESS_NO_COFFEE_BEANS_ERROR:
-												errorMessage = "No coffee beans!";
-												break;
-											case PROCESS_COFFEE_WASTE_BIN_IS_FULL_ERROR:
-												errorMessage = "Coffee waste bin is full!";
-												break;
-											case PROCESS_NO_WATER_ERROR:
-												errorMessage = "No water!";
-												break;
-											case PROCESS_NO_WATER_FLOW_ERROR:
-												errorMessage = "No water flow!";
-												break;
-											case PROCESS_WATER_TEMPERATURE_TOO_LOW_ERROR:
-												errorMessage = "Water temperature too low!";
-												break;
-											case PROCESS_NO_MILK_ERROR:
-												errorMessage = "No milk!";
-												break;
-											case PROCESS_UNDEFINED_PRODUCT_ERROR:
-												errorMessage = "Undefined product!";
-												break;
-											default:
-												errorMessage = "Unknown error!";
-											}
-											showError(errorMessage);
-										}
-								MESSAGE_SELECTOR_END
-						MESSAGE_SELECTOR_END
-					receiveGenericMessage_END
-				} else if(fd == buttonsFileDescriptor) {
-					//logInfo("[%s] Buttons event", this->descriptor->name);
-					memset(buffer, 0, BUFFER_SIZE);
-					result = read(buttonsFileDescriptor, buffer, BUFFER_SIZE);
-					if (result < 0) {
-						logErr("[%s] Could not read buttons: %s", this->descriptor->name, strerror(errno));
-					}
-					if (result > 0) {
-						//logInfo("Buttons: %s", buffer);
-						if (wasteBinFull) {
-							logWarn("[%s] Unable to produce coffee, because waste bin is full", this->descriptor->name);
-						} else if (machineState == machineState_idle) {
-							value = atoi(buffer);
-							unsigned int productIndex = value + 1;
-							// check if product index is in range:
-							if (productIndex > 0 && productIndex <= NUMBER_OF_PRODUCTS) {
-								sendRequest_BEGIN(this, MainController, ProduceProductCommand)
-									.productIndex = productIndex,
-									.withMilk = withMilk
-								sendRequest_END
-							} else {
-								logWarn("[%s] Undefined product %d!", this->descriptor->name, value + 1);
+	while (isActivityRunning(this)) {
+		// wait for the next message (button and switch events are processed meanwhile):
+		receiveGenericMessage_BEGIN(this)
+			if (error) {
+				//TODO Implement appropriate error handling
+				sleep(10);
+
+				// Try again
+				continue;
+			}
+			MESSAGE_SELECTOR_BEGIN
+				MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, Display)
+					MESSAGE_SELECTOR_BEGIN
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, Display, Result)
+							//logInfo("[%s] Display result received!", this->descriptor->name);
+					MESSAGE_SELECTOR_END
+				MESSAGE_BY_SENDER_SELECTOR(senderDescriptor, message, MainController)
+					MESSAGE_SELECTOR_BEGIN
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, MachineStateChangedNotification)
+							// Process received machine state and update display
+							MachineState lastMachineState = machineState;
+							machineState = content.state;
+							// if machine is not producing reset product index to 0:
+							if (content.state != machineState_producing) {
+								productIndex = 0;
 							}
-						} else {
-							logWarn("[%s] Product selected, but machine is not ready!", this->descriptor->name, machineState);
-						}
-					}
-				} else if(fd == switchesFileDescriptor) {
-					//logInfo("[%s] Switches event", this->descriptor->name);
-					// Get bitfield of current switches status:
-					memset(buffer, 0, BUFFER_SIZE);
-					result = read(switchesFileDescriptor, buffer, BUFFER_SIZE);
-					if (result < 0) {
-						logErr("[%s] Could not read switches: %s", this->descriptor->name, strerror(errno));
-					}
-					if (result > 0) {
-						//logInfo("Switches: %s", buffer);
-						switchesStates = atoi(buffer);
-						processSwitchesChanges(switchesStates);
-					}
-				}
-			} // foreach event end
-		} // if number of fired events end
+							if (machineState != lastMachineState) {
+								updateDisplay();
+							}
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, ProducingProductNotification)
+							productIndex = content.productIndex;
+							updateDisplay();
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, ExecutingActivityNotification)
+							char *activityMessage;
+							switch (content.activityIndex) {
+							case PROCESS_NO_ACTIVITY:
+								activityMessage = "";
+								break;
+							case PROCESS_WARMING_UP_ACTIVITY:
+								activityMessage = "Warming up...";
+								break;
+							case PROCESS_CHECKING_CUP_FILL_STATE_ACTIVITY:
+								activityMessage = "Checking cup fill state...";
+								break;
+							case PROCESS_GRINDING_COFFEE_POWDER_ACTIVITY:
+								activityMessage = "Grinding coffee powder...";
+								break;
+							case PROCESS_SUPPLYING_WATER_ACTIVITY:
+								activityMessage = "Supplying water...";
+								break;
+							case PROCESS_SUPPLYING_MILK_ACTIVITY:
+								activityMessage = "Supplying milk...";
+								break;
+							case PROCESS_EJECTING_COFFEE_WASTE_ACTIVITY:
+								activityMessage = "Ejecting coffee waste...";
+								break;
+							default:
+								activityMessage = "Unknown activity!";
+							}
+							if (strlen(activityMessage) > 0) {
+								showActivity(activityMessage);
+							}
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, IngredientAvailabilityChangedNotification)
+							// Process received ingredient availability and update display
+							Availability lastCoffeeAvailability = coffeeAvailability;
+							Availability lastWaterAvailability = waterAvailability;
+							Availability lastMilkAvailability = milkAvailability;
+							switch (content.ingredientIndex) {
+							case COFFEE_INDEX:
+								coffeeAvailability = content.availability;
+								break;
+							case WATER_INDEX:
+								waterAvailability = content.availability;
+								break;
+							case MILK_INDEX:
+								milkAvailability = content.availability;
+							}
+							if (coffeeAvailability != lastCoffeeAvailability
+									|| waterAvailability != lastWaterAvailability
+									|| milkAvailability != lastMilkAvailability) {
+								updateDisplay();
+							}
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, CoffeeWasteBinStateChangedNotification)
+							int lastWasteBinFull = wasteBinFull;
+							wasteBinFull = content.isBinFull;
+							if (wasteBinFull != lastWasteBinFull) {
+								updateDisplay();
+							}
+						MESSAGE_BY_TYPE_SELECTOR(*specificMessage, MainController, Result)
+							if (content.code == NOK_RESULT) {
+								char *errorMessage;
+								switch (content.errorCode) {
+								case PROCESS_CUP_IS_NOT_EMPTY_ERROR:
+									errorMessage = "Cup is not empty!";
+									break;
+								case PROCESS_NO_COFFEE_BEANS_ERROR:
+									errorMessage = "No coffee beans!";
+									break;
+								case PROCESS_COFFEE_WASTE_BIN_IS_FULL_ERROR:
+									errorMessage = "Coffee waste bin is full!";
+									break;
+								case PROCESS_NO_WATER_ERROR:
+									errorMessage = "No water!";
+									break;
+								case PROCESS_NO_WATER_FLOW_ERROR:
+									errorMessage = "No water flow!";
+									break;
+								case PROCESS_WATER_TEMPERATURE_TOO_LOW_ERROR:
+									errorMessage = "Water temperature too low!";
+									break;
+								case PROCESS_NO_MILK_ERROR:
+									errorMessage = "No milk!";
+									break;
+								case PROCESS_UNDEFINED_PRODUCT_ERROR:
+									errorMessage = "Undefined product!";
+									break;
+								default:
+									errorMessage = "Unknown error!";
+								}
+								showError(errorMessage);
+							}
+					MESSAGE_SELECTOR_END
+			MESSAGE_SELECTOR_END
+		receiveGenericMessage_END
 	}
+
+	unwatchFd(this, buttonsFileDescriptor);
+	unwatchFd(this, switchesFileDescriptor);
+	close(buttonsFileDescriptor);
+	close(switchesFileDescriptor);
 }
 
 static void tearDownUserInterface(void *activity) {
@@ -17,7 +17,7 @@
 #include "timer.h"
 #include "device.h"
 #include "data.h"
-#include "stateMachineEngine.h"
+#include "stateMachineDescription.h"
 #include "waterSupply.h"
 
 typedef enum {
@@ -35,7 +35,13 @@ static ActivityDescriptor waterSupply = {
 	.name = "waterSupply",
 	.setUp = setUpWaterSupply,
 	.run = runWaterSupply,
-	.tearDown = tearDownWaterSupply
+	.tearDown = tearDownWaterSupply,
+	// (Controls the heater: must not be delayed by the user interface activities)
+	.schedulingPolicy = activitySchedulingPolicy_fifo,
+	.schedulingPriority = 50,
+	// (Prefaulted, so page faults cannot delay it)
+	.stackSize = SMALL_ACTIVITY_STACK_SIZE,
+	.isStackPrefaulted = TRUE
 };
 
 MESSAGE_CONTENT_TYPE_MAPPING(WaterSupply, InitCommand, 1)
@@ -47,15 +53,29 @@ MESSAGE_CONTENT_TYPE_MAPPING(WaterSupply, Status, 6)
 
 static Activity *this;
 
-static StateMachine stateMachine;
+/**
+ * Represents a water supply job (the context of the state machine's actions).
+ */
+typedef struct {
+	ActivityDescriptor callerDescriptor; /**< The activity which has requested the water. */
+	DWord callerRequestId; /**< The request to respond to. */
+	unsigned int waterAmount; /**< The amount of water to supply [ml]. */
+	SupplyResult result; /**< The job's result. */
+	int error; /**< The error which has made the job fail (or NO_ERROR). */
+	int isInitialized; /**< Have pump and heater been running long enough to check flow and temperature? */
+	TIMER initializingTimer;
+	TIMER supplyingTimer;
+	StateMachineInstance *machine; /**< The state machine instance which runs the job (its context is the job). */
+} SupplyJob;
+
+static StateMachineInstance stateMachine;
+static SupplyJob supplyJob = {
+	.machine = &stateMachine
+};
 static int waterBrewTemperature = 0;
-static unsigned int waterAmountToSupply = 0;
-
-static ActivityDescriptor clientDescriptor;
-static ActivityDescriptor callerDescriptor;
 
 ActivityDescriptor getWaterSupplyDescriptor() {
-	return waterSupply;
+	return internActivityDescriptor(&waterSupply);
 }
 
 static int hasWater() {
@@ -86,9 +106,9 @@ static int checkWater() {
 	if (hasWaterState != lastHasWaterState) {
 		lastHasWaterState = hasWaterState;
 
-		sendNotification_BEGIN(this, WaterSupply, /* getMainControllerDescriptor() */ clientDescriptor, Status)
+		publishNotification_BEGIN(this, WaterSupply, WATER_SUPPLY_TOPIC, Status)
 			.availability = hasWaterState ? available : notAvailable
-		sendNotification_END
+		publishNotification_END
 	}
 
 	return hasWaterState;
@@ -134,15 +154,19 @@ static void controlHeater(DeviceState state) {
  ***************************************************************************
  */
 
+/**
+ * The water supply states (and their state objects)
+ */
+#define WATER_SUPPLY_STATES(STATE, _) \
+	STATE(_, waterSupplyState_switchedOff, switchedOffState) \
+	STATE(_, waterSupplyState_initializing, initializingState) \
+	STATE(_, waterSupplyState_idle, idleState) \
+	STATE(_, waterSupplyState_supplying, supplyingState)
+
 /**
  * Represents a water supply state
  */
-typedef enum {
-	waterSupplyState_switchedOff,
-	waterSupplyState_initializing,
-	waterSupplyState_idle,
-	waterSupplyState_supplying
-} WaterSupplyState;
+DECLARE_STATE_MACHINE_ENUM(WaterSupplyState, WATER_SUPPLY_STATES)
 
 /*
  ***************************************************************************
@@ -150,17 +174,21 @@ typedef enum {
  ***************************************************************************
  */
 
+/**
+ * The water supply events
+ */
+#define WATER_SUPPLY_EVENTS(EVENT, _) \
+	EVENT(_, waterSupplyEvent_switchOn) \
+	EVENT(_, waterSupplyEvent_switchOff) \
+	EVENT(_, waterSupplyEvent_initialized) \
+	EVENT(_, waterSupplyEvent_startSupplying) \
+	EVENT(_, waterSupplyEvent_supplyingFinished) \
+	EVENT(_, waterSupplyEvent_reconfigure)
+
 /**
  * Represents a water supply event
  */
-typedef enum {
-	waterSupplyEvent_switchOn,
-	waterSupplyEvent_switchOff,
-	waterSupplyEvent_initialized,
-	waterSupplyEvent_startSupplying,
-	waterSupplyEvent_supplyingFinished,
-	waterSupplyEvent_reconfigure,
-} WaterSupplyEvent;
+DECLARE_STATE_MACHINE_ENUM(WaterSupplyEvent, WATER_SUPPLY_EVENTS)
 
 /*
  ***************************************************************************
@@ -178,11 +206,11 @@ static State switchedOffState = {
  ***************************************************************************
  */
 
-static void initializingStateEntryAction() {
+static void initializingStateEntryAction(void *context) {
 	waterBrewTemperature = getMainParameter("waterBrewTemperature");
 }
 
-static Event initializingStateDoAction() {
+static Event initializingStateDoAction(void *context) {
 	return waterSupplyEvent_initialized;
 }
 
@@ -198,7 +226,12 @@ static State initializingState = {
  ***************************************************************************
  */
 
-static Event idleStateDoAction() {
+/**
+ * How often the water sensor is read while the water supply is idle [ms].
+ */
+#define WATER_SENSOR_PERIOD 500
+
+static Event idleStateDoAction(void *context) {
 	checkWater();
 
 	return NO_EVENT;
@@ -206,7 +239,13 @@ static Event idleStateDoAction() {
 
 static State idleState = {
 	.stateIndex = waterSupplyState_idle,
-	.doAction = idleStateDoAction
+	.doAction = idleStateDoAction,
+	// (Only woken up when the water runs out or is refilled)
+	.wakeUp = {
+		.sensor = hasWater,
+		.threshold = TRUE,
+		.sensorPeriod = WATER_SENSOR_PERIOD
+	}
 };
 
 /*
@@ -215,15 +254,19 @@ static State idleState = {
  ***************************************************************************
  */
 
-static SupplyResult supplyResult;
-static int supplyError;
+/**
+ * How often water, flow and temperature are checked while supplying [ms].
+ */
+#define SUPPLY_SUPERVISION_PERIOD 100
+
+static int supplyingStatePrecondition(void *context) {
+	SupplyJob *job = context;
 
-static int supplyingStatePrecondition() {
-	supplyResult = supplyResult_nok;
-	supplyError = NO_ERROR;
+	job->result = supplyResult_nok;
+	job->error = NO_ERROR;
 
 	if (!hasWaterState) {
-		supplyError = NO_WATER_ERROR;
+		job->error = NO_WATER_ERROR;
 
 		return FALSE;
 	}
@@ -231,55 +274,57 @@ static int supplyingStatePrecondition() {
 	return TRUE;
 }
 
-static int isSupplyInitialized;
-static TIMER supplyInitializingTimer;
-static TIMER supplyingTimer;
+static void supplyingStateEntryAction(void *context) {
+	SupplyJob *job = context;
 
-static void supplyingStateEntryAction() {
-	logInfo("[waterSupply] Going to supply %u ml water with a temperature of %d °C...", waterAmountToSupply, waterBrewTemperature);
+	logInfo("[waterSupply] Going to supply %u ml water with a temperature of %d °C...", job->waterAmount, waterBrewTemperature);
 
-	isSupplyInitialized = FALSE;
+	job->isInitialized = FALSE;
 
 	// Start pump and heater
 	controlPump(deviceState_on);
 	controlHeater(deviceState_on);
 
-	supplyingTimer = setUpTimer(1000 + (100 * waterAmountToSupply));
-	supplyInitializingTimer = setUpTimer(1000);
+	job->supplyingTimer = setUpTimer(1000 + (100 * job->waterAmount));
+	job->initializingTimer = setUpTimer(1000);
+	// (The supply ends on time, not only with the next supervision)
+	setStateMachineDeadline(job->machine, 1000 + (100 * job->waterAmount));
 }
 
-static Event supplyingStateDoAction() {
-	if (isTimerElapsed(supplyInitializingTimer)) {
-		supplyInitializingTimer = NULL;
+static Event supplyingStateDoAction(void *context) {
+	SupplyJob *job = context;
 
-		isSupplyInitialized = TRUE;
+	if (isTimerElapsed(job->initializingTimer)) {
+		job->initializingTimer = NULL;
+
+		job->isInitialized = TRUE;
 	}
 
 	// Check water
 	if (!checkWater()) {
-		supplyError = NO_WATER_ERROR;
+		job->error = NO_WATER_ERROR;
 
 		return waterSupplyEvent_supplyingFinished;
 	}
 
-	if (isSupplyInitialized) {
+	if (job->isInitialized) {
 		// Check flow and temperature
 		if (!hasFlow()) {
-			supplyError = NO_WATER_FLOW_ERROR;
+			job->error = NO_WATER_FLOW_ERROR;
 
 			return waterSupplyEvent_supplyingFinished;
 		}
 		if (getTemperature() < waterBrewTemperature) {
-			supplyError = WATER_TEMPERATURE_TOO_LOW_ERROR;
+			job->error = WATER_TEMPERATURE_TOO_LOW_ERROR;
 
 			return waterSupplyEvent_supplyingFinished;
 		}
 	}
 
-	if (isTimerElapsed(supplyingTimer)) {
-		supplyingTimer = NULL;
+	if (isTimerElapsed(job->supplyingTimer)) {
+		job->supplyingTimer = NULL;
 
-		supplyResult = supplyResult_ok;
+		job->result = supplyResult_ok;
 
 		return waterSupplyEvent_supplyingFinished;
 	}
@@ -287,12 +332,14 @@ static Event supplyingStateDoAction() {
 	return NO_EVENT;
 }
 
-static void supplyingStateExitAction() {
-	if (supplyInitializingTimer) {
-		abortTimer(supplyInitializingTimer);
+static void supplyingStateExitAction(void *context) {
+	SupplyJob *job = context;
+
+	if (job->initializingTimer) {
+		abortTimer(job->initializingTimer);
 	}
-	if (supplyingTimer) {
-		abortTimer(supplyingTimer);
+	if (job->supplyingTimer) {
+		abortTimer(job->supplyingTimer);
 	}
 
 	// Stop pump and heater
@@ -301,17 +348,19 @@ static void supplyingStateExitAction() {
 
 	logInfo("[waterSupply] ...done (supplying water).");
 
-//	sendNotification_BEGIN(this, WaterSupply, callerDescriptor, Result)
-//		.code = supplyResult == supplyResult_ok ? OK_RESULT : NOK_RESULT,
-//		.errorCode = supplyError
+//	sendNotification_BEGIN(this, WaterSupply, job->callerDescriptor, Result)
+//		.code = job->result == supplyResult_ok ? OK_RESULT : NOK_RESULT,
+//		.errorCode = job->error
 //	sendNotification_END
 }
 
-static void supplyingStatePostAction() {
-	sendNotification_BEGIN(this, WaterSupply, callerDescriptor, Result)
-		.code = supplyResult == supplyResult_ok ? OK_RESULT : NOK_RESULT,
-		.errorCode = supplyError
-	sendNotification_END
+static void supplyingStatePostAction(void *context) {
+	SupplyJob *job = context;
+
+	sendDeferredResponse_BEGIN(this, WaterSupply, job->callerDescriptor, job->callerRequestId, Result)
+		.code = job->result == supplyResult_ok ? OK_RESULT : NOK_RESULT,
+		.errorCode = job->error
+	sendDeferredResponse_END
 }
 
 static State supplyingState = {
@@ -320,7 +369,11 @@ static State supplyingState = {
 	.entryAction = supplyingStateEntryAction,
 	.doAction = supplyingStateDoAction,
 	.exitAction = supplyingStateExitAction,
-	.postAction = supplyingStatePostAction
+	.postAction = supplyingStatePostAction,
+	// (Water, flow and temperature are supervised while supplying)
+	.wakeUp = {
+		.period = SUPPLY_SUPERVISION_PERIOD
+	}
 };
 
 /*
@@ -329,40 +382,31 @@ static State supplyingState = {
  ***************************************************************************
  */
 
-static StateMachine stateMachine = {
+/**
+ * The water supply transitions (grouped by source state, sorted by event)
+ */
+#define WATER_SUPPLY_TRANSITIONS(TRANSITION, _) \
+	TRANSITION(_, waterSupplyState_switchedOff, waterSupplyEvent_switchOn, initializingState) \
+	TRANSITION(_, waterSupplyState_initializing, waterSupplyEvent_switchOff, switchedOffState) \
+	TRANSITION(_, waterSupplyState_initializing, waterSupplyEvent_initialized, idleState) \
+	TRANSITION(_, waterSupplyState_idle, waterSupplyEvent_switchOff, switchedOffState) \
+	TRANSITION(_, waterSupplyState_idle, waterSupplyEvent_startSupplying, supplyingState) \
+	TRANSITION(_, waterSupplyState_idle, waterSupplyEvent_reconfigure, initializingState) \
+	TRANSITION(_, waterSupplyState_supplying, waterSupplyEvent_switchOff, switchedOffState) \
+	TRANSITION(_, waterSupplyState_supplying, waterSupplyEvent_supplyingFinished, idleState)
+
+DEFINE_STATE_MACHINE_TABLES(waterSupply, WATER_SUPPLY_STATES, WATER_SUPPLY_EVENTS, WATER_SUPPLY_TRANSITIONS)
+
+static const StateMachineDefinition stateMachineDefinition = {
 	.name = "waterSupply",
-	.numberOfEvents = 6,
 	.initialState = &switchedOffState,
-	.transitions = {
-		/* waterSupplyState_switchedOff: */
-			/* waterSupplyEvent_switchOn: */ &initializingState,
-			/* waterSupplyEvent_switchOff: */ NULL,
-			/* waterSupplyEvent_initialized: */ NULL,
-			/* waterSupplyEvent_startSupplying: */ NULL,
-			/* waterSupplyEvent_supplyingFinished: */ NULL,
-			/* waterSupplyEvent_reconfigure: */ NULL,
-		/* waterSupplyState_initializing: */
-			/* waterSupplyEvent_switchOn: */ NULL,
-			/* waterSupplyEvent_switchOff: */ &switchedOffState,
-			/* waterSupplyEvent_initialized: */ &idleState,
-			/* waterSupplyEvent_startSupplying: */ NULL,
-			/* waterSupplyEvent_supplyingFinished: */ NULL,
-			/* waterSupplyEvent_reconfigure: */ NULL,
-		/* waterSupplyState_idle: */
-			/* waterSupplyEvent_switchOn: */ NULL,
-			/* waterSupplyEvent_switchOff: */ &switchedOffState,
-			/* waterSupplyEvent_initialized: */ NULL,
-			/* waterSupplyEvent_startSupplying: */ &supplyingState,
-			/* waterSupplyEvent_supplyingFinished: */ NULL,
-			/* waterSupplyEvent_reconfigure: */ &initializingState,
-		/* waterSupplyState_supplying: */
-			/* waterSupplyEvent_switchOn: */ NULL,
-			/* waterSupplyEvent_switchOff: */ &switchedOffState,
-			/* waterSupplyEvent_initialized: */ NULL,
-			/* waterSupplyEvent_startSupplying: */ NULL,
-			/* waterSupplyEvent_supplyingFinished: */ &idleState,
-			/* waterSupplyEvent_reconfigure: */ NULL
-		}
+	.mode = stateMachineMode_runToCompletion,
+	STATE_MACHINE_TABLES(waterSupply, WATER_SUPPLY_STATES, WATER_SUPPLY_EVENTS)
+};
+
+static StateMachineInstance stateMachine = {
+	.definition = &stateMachineDefinition,
+	.context = &supplyJob
 };
 
 static void setUpWaterSupply(void *activity) {
@@ -376,8 +420,10 @@ static void setUpWaterSupply(void *activity) {
 static void runWaterSupply(void *activity) {
 	//logInfo("[waterSupply] Running...");
 
-	while (TRUE) {
-		waitForEvent_BEGIN(this, WaterSupply, 100)
+	while (isActivityRunning(this)) {
+		// Process all pending messages before running the state machine (once per batch)
+		// (Wait only until the active state's next wake-up)
+		waitForEvents_BEGIN(this, getStateMachineTimeout(&stateMachine))
 			if (error) {
 				//TODO Implement appropriate error handling
 				sleep(10);
@@ -385,23 +431,22 @@ static void runWaterSupply(void *activity) {
 				// Try again
 				continue;
 			}
-			if (result > 0) {
+			forEachReceivedMessage_BEGIN(WaterSupply)
 				MESSAGE_SELECTOR_BEGIN
-					MESSAGE_BY_TYPE_SELECTOR(message, WaterSupply, InitCommand)
-						clientDescriptor = senderDescriptor;
-
+					MESSAGE_BY_TYPE_SELECTOR(*message, WaterSupply, InitCommand)
 						if (stateMachine.activeState == &switchedOffState) {
 							processStateMachineEvent(&stateMachine, waterSupplyEvent_switchOn);
 						} else {
 							processStateMachineEvent(&stateMachine, waterSupplyEvent_reconfigure);
 						}
-					MESSAGE_BY_TYPE_SELECTOR(message, WaterSupply, OffCommand)
+					MESSAGE_BY_TYPE_SELECTOR(*message, WaterSupply, OffCommand)
 						processStateMachineEvent(&stateMachine, waterSupplyEvent_switchOff);
-					MESSAGE_BY_TYPE_SELECTOR(message, WaterSupply, SupplyWaterCommand)
+					MESSAGE_BY_TYPE_SELECTOR(*message, WaterSupply, SupplyWaterCommand)
 						if (stateMachine.activeState == &idleState) {
-							callerDescriptor = senderDescriptor;
+							supplyJob.callerDescriptor = *senderDescriptor;
+							supplyJob.callerRequestId = header.sequenceNumber;
 
-							waterAmountToSupply = content.waterAmount;
+							supplyJob.waterAmount = content.waterAmount;
 
 							processStateMachineEvent(&stateMachine, waterSupplyEvent_startSupplying);
 						} else {
@@ -409,13 +454,13 @@ static void runWaterSupply(void *activity) {
 								.code = NOK_RESULT
 							sendResponse_END
 						}
-					MESSAGE_BY_TYPE_SELECTOR(message, WaterSupply, AbortCommand)
-						supplyError = ABORTED_ERROR;
+					MESSAGE_BY_TYPE_SELECTOR(*message, WaterSupply, AbortCommand)
+						supplyJob.error = ABORTED_ERROR;
 
 						processStateMachineEvent(&stateMachine, waterSupplyEvent_supplyingFinished);
 				MESSAGE_SELECTOR_END
-			}
-		waitForEvent_END
+			forEachReceivedMessage_END
+		waitForEvents_END
 
 		// Run state machine
 		runStateMachine(&stateMachine);
@@ -426,4 +471,5 @@ static void tearDownWaterSupply(void *activity) {
 	//logInfo("[waterSupply] Tearing down...");
 
 	abortStateMachine(&stateMachine);
+	logStateMachineStatistics(&stateMachine);
 }
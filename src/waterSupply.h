@@ -13,6 +13,9 @@
 #include "defines.h"
 #include "activity.h"
 
+// Topic of the water availability notifications
+#define WATER_SUPPLY_TOPIC "waterSupply"
+
 #define NO_WATER_ERROR 1
 #define NO_WATER_FLOW_ERROR 2
 #define WATER_TEMPERATURE_TOO_LOW_ERROR 3